@@ -11,6 +11,9 @@
 #include "assets/lang_config.h"
 #include "mcp_server.h"
 #include "audio_debugger.h"
+#include "settings.h"
+#include "boot_profiler.h"
+#include "asset_partition.h"
 
 #if CONFIG_USE_AUDIO_PROCESSOR
 #include "afe_audio_processor.h"
@@ -147,6 +150,10 @@ void Application::CheckNewVersion() {
 
             auto& board = Board::GetInstance();
             board.SetPowerSaveMode(false);
+            // The audio models may still be loading on the other core
+            if (boot_graph_ != nullptr) {
+                boot_graph_->WaitFor("wake_word");
+            }
             wake_word_->StopDetection();
             // 预先关闭音频输出，避免升级过程有音频操作
             auto codec = board.GetAudioCodec();
@@ -402,14 +409,8 @@ void Application::StopListening() {
     });
 }
 
-void Application::Start() {
+void Application::InitializeAudioCodec() {
     auto& board = Board::GetInstance();
-    SetDeviceState(kDeviceStateStarting);
-
-    /* Setup the display */
-    auto display = board.GetDisplay();
-
-    /* Setup the audio codec */
     auto codec = board.GetAudioCodec();
     opus_decoder_ = std::make_unique<OpusDecoderWrapper>(codec->output_sample_rate(), 1, OPUS_FRAME_DURATION_MS);
     opus_encoder_ = std::make_unique<OpusEncoderWrapper>(16000, 1, OPUS_FRAME_DURATION_MS);
@@ -443,18 +444,12 @@ void Application::Start() {
         vTaskDelete(NULL);
     }, "audio_loop", 4096 * 2, this, 8, &audio_loop_task_handle_);
 #endif
+}
 
-    /* Start the clock timer to update the status bar */
-    esp_timer_start_periodic(clock_timer_handle_, 1000000);
-
-    /* Wait for the network to be ready */
-    board.StartNetwork();
-
-    // Update the status bar immediately to show the network state
-    display->UpdateStatusBar(true);
-
-    // Check for new firmware version or get the MQTT broker address
-    CheckNewVersion();
+bool Application::InitializeProtocol() {
+    auto& board = Board::GetInstance();
+    auto display = board.GetDisplay();
+    auto codec = board.GetAudioCodec();
 
     // Initialize the protocol
     display->SetStatus(Lang::Strings::LOADING_PROTOCOL);
@@ -492,7 +487,11 @@ void Application::Start() {
 
 #if CONFIG_IOT_PROTOCOL_XIAOZHI
         auto& thing_manager = iot::ThingManager::GetInstance();
-        protocol_->SendIotDescriptors(thing_manager.GetDescriptorsJson());
+        if (protocol_->iot_descriptors_cached()) {
+            ESP_LOGI(TAG, "IoT descriptors are cached by the server, skip sending");
+        } else {
+            protocol_->SendIotDescriptors(thing_manager.GetDescriptorsJson());
+        }
         std::string states;
         if (thing_manager.GetStatesJson(states, false)) {
             protocol_->SendIotStates(states);
@@ -507,19 +506,19 @@ void Application::Start() {
             SetDeviceState(kDeviceStateIdle);
         });
     });
-    protocol_->OnIncomingJson([this, display](const cJSON* root) {
-        // Parse JSON data
-        auto type = cJSON_GetObjectItem(root, "type");
-        if (strcmp(type->valuestring, "tts") == 0) {
-            auto state = cJSON_GetObjectItem(root, "state");
-            if (strcmp(state->valuestring, "start") == 0) {
+    // High rate messages are extracted by the protocol without building a cJSON tree
+    auto on_incoming_message = [this, display](const IncomingMessage& message) {
+        switch (message.type) {
+        case kMessageTypeTts:
+            if (message.state == "start") {
+                answer_started_ = true;
                 Schedule([this]() {
                     aborted_ = false;
                     if (device_state_ == kDeviceStateIdle || device_state_ == kDeviceStateListening) {
                         SetDeviceState(kDeviceStateSpeaking);
                     }
                 });
-            } else if (strcmp(state->valuestring, "stop") == 0) {
+            } else if (message.state == "stop") {
                 Schedule([this]() {
                     background_task_->WaitForCompletion();
                     if (device_state_ == kDeviceStateSpeaking) {
@@ -530,39 +529,65 @@ void Application::Start() {
                         }
                     }
                 });
-            } else if (strcmp(state->valuestring, "sentence_start") == 0) {
-                auto text = cJSON_GetObjectItem(root, "text");
-                if (cJSON_IsString(text)) {
-                    ESP_LOGI(TAG, "<< %s", text->valuestring);
-                    Schedule([this, display, message = std::string(text->valuestring)]() {
-                        display->SetChatMessage("assistant", message.c_str());
+            } else if (message.state == "sentence_start") {
+                if (message.text.valid) {
+                    auto text = message.text.ToString();
+                    ESP_LOGI(TAG, "<< %s", text.c_str());
+                    // The sentences of one answer share a message, a new answer gets its own
+                    bool append = !answer_started_;
+                    answer_started_ = false;
+                    Schedule([this, display, append, message = std::move(text)]() {
+                        if (append) {
+                            display->AppendChatMessage("assistant", message.c_str());
+                        } else {
+                            display->SetChatMessage("assistant", message.c_str());
+                        }
                     });
                 }
             }
-        } else if (strcmp(type->valuestring, "stt") == 0) {
-            auto text = cJSON_GetObjectItem(root, "text");
-            if (cJSON_IsString(text)) {
-                ESP_LOGI(TAG, ">> %s", text->valuestring);
-                Schedule([this, display, message = std::string(text->valuestring)]() {
+            break;
+        case kMessageTypeStt:
+            if (message.text.valid) {
+                auto text = message.text.ToString();
+                ESP_LOGI(TAG, ">> %s", text.c_str());
+                Schedule([this, display, message = std::move(text)]() {
                     display->SetChatMessage("user", message.c_str());
                 });
             }
-        } else if (strcmp(type->valuestring, "llm") == 0) {
-            auto emotion = cJSON_GetObjectItem(root, "emotion");
-            if (cJSON_IsString(emotion)) {
-                Schedule([this, display, emotion_str = std::string(emotion->valuestring)]() {
+            break;
+        case kMessageTypeLlm:
+            if (message.emotion.valid) {
+                Schedule([this, display, emotion_str = message.emotion.ToString()]() {
                     display->SetEmotion(emotion_str.c_str());
                 });
             }
+            break;
+        default:
+            break;
+        }
+    };
+    protocol_->OnIncomingMessage(on_incoming_message);
+    protocol_->OnIncomingJson([this, display, on_incoming_message](const cJSON* root) {
+        // Parse JSON data
+        auto type = cJSON_GetObjectItem(root, "type");
+        switch (GetMessageType(type->valuestring)) {
+        case kMessageTypeTts:
+        case kMessageTypeStt:
+        case kMessageTypeLlm:
+            // Handed back by the fast path, e.g. because the type is escaped
+            on_incoming_message(GetIncomingMessage(root));
+            break;
 #if CONFIG_IOT_PROTOCOL_MCP
-        } else if (strcmp(type->valuestring, "mcp") == 0) {
+        case kMessageTypeMcp: {
             auto payload = cJSON_GetObjectItem(root, "payload");
-            if (cJSON_IsObject(payload)) {
+            if (cJSON_IsObject(payload) || cJSON_IsArray(payload)) {
                 McpServer::GetInstance().ParseMessage(payload);
             }
+            break;
+        }
 #endif
 #if CONFIG_IOT_PROTOCOL_XIAOZHI
-        } else if (strcmp(type->valuestring, "iot") == 0) {
+        case kMessageTypeIot: {
             auto commands = cJSON_GetObjectItem(root, "commands");
             if (cJSON_IsArray(commands)) {
                 auto& thing_manager = iot::ThingManager::GetInstance();
@@ -571,8 +596,10 @@ void Application::Start() {
                     thing_manager.Invoke(command);
                 }
             }
+            break;
+        }
 #endif
-        } else if (strcmp(type->valuestring, "system") == 0) {
+        case kMessageTypeSystem: {
             auto command = cJSON_GetObjectItem(root, "command");
             if (cJSON_IsString(command)) {
                 ESP_LOGI(TAG, "System command: %s", command->valuestring);
@@ -585,7 +612,9 @@ void Application::Start() {
                     ESP_LOGW(TAG, "Unknown system command: %s", command->valuestring);
                 }
             }
-        } else if (strcmp(type->valuestring, "alert") == 0) {
+            break;
+        }
+        case kMessageTypeAlert: {
             auto status = cJSON_GetObjectItem(root, "status");
             auto message = cJSON_GetObjectItem(root, "message");
             auto emotion = cJSON_GetObjectItem(root, "emotion");
@@ -594,12 +623,24 @@ void Application::Start() {
             } else {
                 ESP_LOGW(TAG, "Alert command requires status, message and emotion");
             }
-        } else {
+            break;
+        }
+        default:
             ESP_LOGW(TAG, "Unknown message type: %s", type->valuestring);
+            break;
         }
     });
-    bool protocol_started = protocol_->Start();
 
+    // Advertise the descriptor hashes in the hello, they do not change after this point
+#if CONFIG_IOT_PROTOCOL_XIAOZHI
+    protocol_->SetDescriptorsHash(iot::ThingManager::GetInstance().GetDescriptorsHash(), "");
+#elif CONFIG_IOT_PROTOCOL_MCP
+    protocol_->SetDescriptorsHash("", McpServer::GetInstance().GetToolsVersion());
+#endif
+    return protocol_->Start();
+}
+
+void Application::InitializeAudioProcessor(AudioCodec* codec) {
     audio_debugger_ = std::make_unique<AudioDebugger>();
     audio_processor_->Initialize(codec);
     audio_processor_->OnOutput([this](std::vector<int16_t>&& data) {
@@ -653,7 +694,9 @@ void Application::Start() {
             });
         }
     });
+}
 
+void Application::InitializeWakeWord(AudioCodec* codec) {
     wake_word_->Initialize(codec);
     wake_word_->OnWakeWordDetected([this](const std::string& wake_word) {
         Schedule([this, &wake_word]() {
@@ -696,6 +739,57 @@ void Application::Start() {
             }
         });
     });
+}
+
+void Application::Start() {
+    int board_phase = BootProfiler::GetInstance().BeginPhase("board");
+    auto& board = Board::GetInstance();
+    BootProfiler::GetInstance().EndPhase(board_phase);
+    SetDeviceState(kDeviceStateStarting);
+
+    /* Setup the display */
+    auto display = board.GetDisplay();
+    auto codec = board.GetAudioCodec();
+
+    /*
+     * The network branch (network, version check, protocol) runs on this task,
+     * the audio front end and wake word models are loaded on core 1 meanwhile.
+     */
+    BootGraph graph;
+    bool protocol_started = false;
+    graph.AddStep("audio_codec", {}, [this]() {
+        InitializeAudioCodec();
+    });
+    graph.AddStep("audio_processor", {"audio_codec"}, [this, codec]() {
+        InitializeAudioProcessor(codec);
+    }, 1);
+    graph.AddStep("wake_word", {"audio_processor"}, [this, codec]() {
+        InitializeWakeWord(codec);
+    }, 1);
+    graph.AddStep("assets", {}, []() {
+        AssetPartition::GetInstance().Initialize();
+    });
+    graph.AddStep("network", {"audio_codec", "assets"}, [&board, display]() {
+        /* Wait for the network to be ready */
+        board.StartNetwork();
+
+        // Update the status bar immediately to show the network state
+        display->UpdateStatusBar(true);
+    });
+    graph.AddStep("version_check", {"network"}, [this]() {
+        // Check for new firmware version or get the MQTT broker address
+        CheckNewVersion();
+    });
+    graph.AddStep("protocol", {"version_check"}, [this, &protocol_started]() {
+        protocol_started = InitializeProtocol();
+    });
+
+    /* Start the clock timer to update the status bar */
+    esp_timer_start_periodic(clock_timer_handle_, 1000000);
+
+    boot_graph_ = &graph;
+    graph.Run();
+    boot_graph_ = nullptr;
     wake_word_->StartDetection();
 
     // Wait for the new version check to finish
@@ -710,6 +804,8 @@ void Application::Start() {
         ResetDecoder();
         PlaySound(Lang::Sounds::P3_SUCCESS);
     }
+    BootProfiler::GetInstance().MarkReady();
+    BootProfiler::GetInstance().LogTimeline();
 
     // Print heap stats
     SystemInfo::PrintHeapStats();
@@ -1069,6 +1165,7 @@ void Application::UpdateIotStates() {
 
 void Application::Reboot() {
     ESP_LOGI(TAG, "Rebooting...");
+    Settings::Flush();
     esp_restart();
 }
 
@@ -23,6 +23,7 @@
 #include "audio_processor.h"
 #include "wake_word.h"
 #include "audio_debugger.h"
+#include "boot_graph.h"
 
 #define SCHEDULE_EVENT (1 << 0)
 #define SEND_AUDIO_EVENT (1 << 1)
@@ -103,8 +104,11 @@ private:
     bool aborted_ = false;
     bool voice_detected_ = false;
     bool busy_decoding_audio_ = false;
+    // The next sentence starts a new chat message, only used by the protocol callback
+    bool answer_started_ = false;
     int clock_ticks_ = 0;
     TaskHandle_t check_new_version_task_handle_ = nullptr;
+    BootGraph* boot_graph_ = nullptr;   // Only set while the boot steps are running
 
     // Audio encode / decode
     TaskHandle_t audio_loop_task_handle_ = nullptr;
@@ -133,6 +137,10 @@ private:
     void ResetDecoder();
     void SetDecodeSampleRate(int sample_rate, int frame_duration);
     void CheckNewVersion();
+    void InitializeAudioCodec();
+    bool InitializeProtocol();
+    void InitializeAudioProcessor(AudioCodec* codec);
+    void InitializeWakeWord(AudioCodec* codec);
     void ShowActivationCode();
     void OnClockTimer();
     void SetListeningMode(ListeningMode mode);
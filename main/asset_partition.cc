@@ -0,0 +1,118 @@
+#include "asset_partition.h"
+#include "assets/lang_config.h"
+
+#include <esp_log.h>
+#include <esp_rom_crc.h>
+
+#define TAG "AssetPartition"
+
+AssetPartition::~AssetPartition() {
+    if (header_ != nullptr) {
+        esp_partition_munmap(mmap_handle_);
+    }
+}
+
+bool AssetPartition::Initialize(const char* label) {
+    if (header_ != nullptr) {
+        return true;
+    }
+    auto partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+    if (partition == nullptr) {
+#ifdef CONFIG_SOUNDS_IN_ASSET_PARTITION
+        ESP_LOGE(TAG, "No %s partition, the sounds are not linked into the firmware", label);
+#else
+        ESP_LOGI(TAG, "No %s partition, using the linked assets", label);
+#endif
+        return false;
+    }
+
+    AssetImageHeader header;
+    esp_err_t err = esp_partition_read(partition, 0, &header, sizeof(header));
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to read the header: %s", esp_err_to_name(err));
+        return false;
+    }
+    if (header.magic != ASSET_PARTITION_MAGIC || header.version != ASSET_PARTITION_VERSION) {
+        ESP_LOGI(TAG, "The %s partition holds no asset image", label);
+        return false;
+    }
+    size_t table_end = sizeof(header) + header.slot_count * sizeof(AssetSlot);
+    if (header.slot_count == 0 || (header.slot_count & (header.slot_count - 1)) != 0 ||
+        header.image_size < table_end || header.image_size > partition->size) {
+        ESP_LOGE(TAG, "Invalid image header");
+        return false;
+    }
+
+    const void* ptr = nullptr;
+    err = esp_partition_mmap(partition, 0, header.image_size, ESP_PARTITION_MMAP_DATA, &ptr, &mmap_handle_);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to map %lu bytes: %s", header.image_size, esp_err_to_name(err));
+        return false;
+    }
+    auto slots = reinterpret_cast<const AssetSlot*>(static_cast<const uint8_t*>(ptr) + sizeof(header));
+    if (esp_rom_crc32_le(0, reinterpret_cast<const uint8_t*>(slots), header.slot_count * sizeof(AssetSlot)) != header.table_crc32) {
+        ESP_LOGE(TAG, "Asset table CRC mismatch");
+        esp_partition_munmap(mmap_handle_);
+        return false;
+    }
+    header_ = static_cast<const AssetImageHeader*>(ptr);
+    slots_ = slots;
+    ESP_LOGI(TAG, "Mapped %lu assets, %lu bytes", header_->asset_count, header_->image_size);
+
+    // Runs before the first sound is played, see the boot graph in Application::Start()
+    int replaced = 0;
+    for (size_t i = 0; i < Lang::Sounds::ASSET_COUNT; i++) {
+        auto& asset = Lang::Sounds::ASSETS[i];
+        if (Replace(*asset.sound, asset.name)) {
+            replaced++;
+        } else if (asset.sound->empty()) {
+            ESP_LOGW(TAG, "Sound %s is missing", asset.name);
+        }
+    }
+    if (replaced > 0) {
+        ESP_LOGI(TAG, "%d sounds loaded from the partition", replaced);
+    }
+    return true;
+}
+
+std::string_view AssetPartition::Find(uint32_t id) const {
+    if (header_ == nullptr || id == 0) {
+        return {};
+    }
+    // The table is at most half full, so the probe ends at an empty slot quickly
+    uint32_t mask = header_->slot_count - 1;
+    for (uint32_t i = 0, index = id & mask; i <= mask; i++, index = (index + 1) & mask) {
+        auto& slot = slots_[index];
+        if (slot.id == 0) {
+            break;
+        }
+        if (slot.id == id) {
+            if (slot.offset > header_->image_size || slot.size > header_->image_size - slot.offset) {
+                ESP_LOGE(TAG, "Asset 0x%08lx is out of the image", id);
+                return {};
+            }
+            return std::string_view(reinterpret_cast<const char*>(header_) + slot.offset, slot.size);
+        }
+    }
+    return {};
+}
+
+bool AssetPartition::Replace(std::string_view& sound, const char* name) {
+    uint32_t id = GetAssetId(name);
+    auto asset = Find(id);
+    if (asset.empty()) {
+        return false;
+    }
+    uint32_t mask = header_->slot_count - 1;
+    uint32_t index = id & mask;
+    while (slots_[index].id != id) {
+        index = (index + 1) & mask;
+    }
+    // Only checked for the assets in use, a broken one falls back to the linked data
+    if (esp_rom_crc32_le(0, reinterpret_cast<const uint8_t*>(asset.data()), asset.size()) != slots_[index].crc32) {
+        ESP_LOGW(TAG, "Asset %s CRC mismatch", name);
+        return false;
+    }
+    sound = asset;
+    return true;
+}
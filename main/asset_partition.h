@@ -0,0 +1,73 @@
+#ifndef ASSET_PARTITION_H
+#define ASSET_PARTITION_H
+
+#include <esp_partition.h>
+
+#include <string_view>
+#include <cstdint>
+
+#define ASSET_PARTITION_MAGIC 0x53415a58  // "XZAS"
+#define ASSET_PARTITION_VERSION 1
+
+struct AssetImageHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t slot_count;    // Power of two
+    uint32_t asset_count;
+    uint32_t image_size;
+    uint32_t table_crc32;
+    uint8_t reserved[12];
+};
+
+struct AssetSlot {
+    uint32_t id;            // 0 for an empty slot
+    uint32_t offset;        // From the start of the image
+    uint32_t size;
+    uint32_t crc32;
+};
+
+// Assets packed by scripts/pack_assets.py into the `assets` partition. The image is
+// memory mapped, so the returned views point straight into flash and stay valid for
+// the lifetime of the program. Assets are looked up by the hash of their name, an
+// image flashed later can replace them without rebuilding the firmware.
+class AssetPartition {
+public:
+    static AssetPartition& GetInstance() {
+        static AssetPartition instance;
+        return instance;
+    }
+    AssetPartition(const AssetPartition&) = delete;
+    AssetPartition& operator=(const AssetPartition&) = delete;
+
+    // Maps the partition and points the Lang::Sounds found in it to the partition,
+    // returns false if there is no partition or it holds no valid image
+    bool Initialize(const char* label = "assets");
+    bool IsMapped() const { return header_ != nullptr; }
+
+    // Returns an empty view if the asset does not exist
+    std::string_view Find(std::string_view name) const { return Find(GetAssetId(name)); }
+    std::string_view Find(uint32_t id) const;
+
+    // FNV-1a, must match asset_id() in scripts/pack_assets.py
+    static constexpr uint32_t GetAssetId(std::string_view name) {
+        uint32_t hash = 0x811c9dc5;
+        for (char c : name) {
+            hash ^= static_cast<uint8_t>(c);
+            hash *= 0x01000193;
+        }
+        return hash;
+    }
+
+private:
+    AssetPartition() = default;
+    ~AssetPartition();
+
+    // Points `sound` to the asset named `name` if it is present and intact
+    bool Replace(std::string_view& sound, const char* name);
+
+    esp_partition_mmap_handle_t mmap_handle_ = 0;
+    const AssetImageHeader* header_ = nullptr;
+    const AssetSlot* slots_ = nullptr;
+};
+
+#endif // ASSET_PARTITION_H
@@ -57,7 +57,8 @@ public:
     void SetBrightness(uint8_t brightness) {
         // Map 0~100 to 0~255
         brightness = brightness * 255 / 100;
-        WriteReg(0x0E, brightness);
+        // 背光渐变在 esp_timer 回调中调用，不等待 I2C 传输
+        WriteRegAsync(0x0E, brightness);
     }
 };
 
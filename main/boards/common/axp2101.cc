@@ -7,6 +7,12 @@
 #define TAG "Axp2101"
 
 Axp2101::Axp2101(i2c_master_bus_handle_t i2c_bus, uint8_t addr) : I2cDevice(i2c_bus, addr) {
+    // 状态寄存器在一次电量查询内共用一次读取，ADC、充电灯和DCDC/LDO配置只由驱动修改
+    SetCacheable(0x00, 0x01, 100);
+    SetCacheable(0x30, 0x30);
+    SetCacheable(0x69, 0x69);
+    SetCacheable(0x80, 0x86);
+    SetCacheable(0x90, 0x9A);
 }
 
 int Axp2101::GetBatteryCurrentDirection() {
@@ -35,7 +41,5 @@ float Axp2101::GetTemperature() {
 }
 
 void Axp2101::PowerOff() {
-    uint8_t value = ReadReg(0x10);
-    value = value | 0x01;
-    WriteReg(0x10, value);
+    UpdateReg(0x10, 0x01, 0x01);
 }
@@ -3,6 +3,7 @@
 #include "settings.h"
 #include "display/display.h"
 #include "assets/lang_config.h"
+#include "json_writer.h"
 
 #include <esp_log.h>
 #include <esp_ota_ops.h>
@@ -106,62 +107,124 @@ std::string Board::GetJson() {
             }
         }
     */
-    std::string json = "{";
-    json += "\"version\":2,";
-    json += "\"language\":\"" + std::string(Lang::CODE) + "\",";
-    json += "\"flash_size\":" + std::to_string(SystemInfo::GetFlashSize()) + ",";
-    json += "\"minimum_free_heap_size\":" + std::to_string(SystemInfo::GetMinimumFreeHeapSize()) + ",";
-    json += "\"mac_address\":\"" + SystemInfo::GetMacAddress() + "\",";
-    json += "\"uuid\":\"" + uuid_ + "\",";
-    json += "\"chip_model_name\":\"" + SystemInfo::GetChipModelName() + "\",";
-    json += "\"chip_info\":{";
+    std::string json;
+    json.reserve(1024);
+    JsonWriter writer(json);
+    writer.BeginObject();
+    WriteDescriptor(writer);
+    writer.Member("minimum_free_heap_size", SystemInfo::GetMinimumFreeHeapSize());
+    writer.RawMember("board", GetBoardJson());
+
+    // Close the JSON object
+    writer.EndObject();
+    return json;
+}
+
+void Board::WriteDescriptor(JsonWriter& writer) {
+    writer.Member("version", 2)
+        .Member("language", Lang::CODE)
+        .Member("flash_size", SystemInfo::GetFlashSize())
+        .Member("mac_address", SystemInfo::GetMacAddress())
+        .Member("uuid", uuid_)
+        .Member("chip_model_name", SystemInfo::GetChipModelName());
 
     esp_chip_info_t chip_info;
     esp_chip_info(&chip_info);
-    json += "\"model\":" + std::to_string(chip_info.model) + ",";
-    json += "\"cores\":" + std::to_string(chip_info.cores) + ",";
-    json += "\"revision\":" + std::to_string(chip_info.revision) + ",";
-    json += "\"features\":" + std::to_string(chip_info.features);
-    json += "},";
+    writer.Key("chip_info").BeginObject()
+        .Member("model", (int)chip_info.model)
+        .Member("cores", chip_info.cores)
+        .Member("revision", chip_info.revision)
+        .Member("features", chip_info.features)
+        .EndObject();
 
-    json += "\"application\":{";
     auto app_desc = esp_app_get_description();
-    json += "\"name\":\"" + std::string(app_desc->project_name) + "\",";
-    json += "\"version\":\"" + std::string(app_desc->version) + "\",";
-    json += "\"compile_time\":\"" + std::string(app_desc->date) + "T" + std::string(app_desc->time) + "Z\",";
-    json += "\"idf_version\":\"" + std::string(app_desc->idf_ver) + "\",";
-
+    char compile_time[40];
+    snprintf(compile_time, sizeof(compile_time), "%sT%sZ", app_desc->date, app_desc->time);
     char sha256_str[65];
     for (int i = 0; i < 32; i++) {
         snprintf(sha256_str + i * 2, sizeof(sha256_str) - i * 2, "%02x", app_desc->app_elf_sha256[i]);
     }
-    json += "\"elf_sha256\":\"" + std::string(sha256_str) + "\"";
-    json += "},";
-
-    json += "\"partition_table\": [";
+    writer.Key("application").BeginObject()
+        .Member("name", app_desc->project_name)
+        .Member("version", app_desc->version)
+        .Member("compile_time", compile_time)
+        .Member("idf_version", app_desc->idf_ver)
+        .Member("elf_sha256", sha256_str)
+        .EndObject();
+
+    writer.Key("partition_table").BeginArray();
     esp_partition_iterator_t it = esp_partition_find(ESP_PARTITION_TYPE_ANY, ESP_PARTITION_SUBTYPE_ANY, NULL);
     while (it) {
         const esp_partition_t *partition = esp_partition_get(it);
-        json += "{";
-        json += "\"label\":\"" + std::string(partition->label) + "\",";
-        json += "\"type\":" + std::to_string(partition->type) + ",";
-        json += "\"subtype\":" + std::to_string(partition->subtype) + ",";
-        json += "\"address\":" + std::to_string(partition->address) + ",";
-        json += "\"size\":" + std::to_string(partition->size);
-        json += "},";
+        writer.BeginObject()
+            .Member("label", partition->label)
+            .Member("type", (int)partition->type)
+            .Member("subtype", (int)partition->subtype)
+            .Member("address", partition->address)
+            .Member("size", partition->size)
+            .EndObject();
         it = esp_partition_next(it);
     }
-    json.pop_back(); // Remove the last comma
-    json += "],";
+    writer.EndArray();
 
-    json += "\"ota\":{";
     auto ota_partition = esp_ota_get_running_partition();
-    json += "\"label\":\"" + std::string(ota_partition->label) + "\"";
-    json += "},";
+    writer.Key("ota").BeginObject()
+        .Member("label", ota_partition->label)
+        .EndObject();
+}
 
-    json += "\"board\":" + GetBoardJson();
+const std::string& Board::GetDescriptorHash() {
+    if (!descriptor_hash_.empty()) {
+        return descriptor_hash_;
+    }
+    std::string json;
+    json.reserve(1024);
+    JsonWriter writer(json);
+    writer.BeginObject();
+    WriteDescriptor(writer);
+    writer.EndObject();
+
+    uint32_t hash = 2166136261u;
+    for (char c : json) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+    }
+    char hash_str[9];
+    snprintf(hash_str, sizeof(hash_str), "%08lx", (unsigned long)hash);
+    descriptor_hash_ = hash_str;
+    return descriptor_hash_;
+}
 
-    // Close the JSON object
-    json += "}";
+std::string Board::GetCompactJson() {
+    /*
+        {
+            "version": 2,
+            "language": "zh-CN",
+            "mac_address": "00:00:00:00:00:00",
+            "uuid": "00000000-0000-0000-0000-000000000000",
+            "descriptor_hash": "1a2b3c4d",
+            "minimum_free_heap_size": 123456,
+            "application": {
+                "version": "1.0.0"
+            },
+            "board": {
+                ...
+            }
+        }
+    */
+    std::string json;
+    json.reserve(512);
+    JsonWriter writer(json);
+    writer.BeginObject()
+        .Member("version", 2)
+        .Member("language", Lang::CODE)
+        .Member("mac_address", SystemInfo::GetMacAddress())
+        .Member("uuid", uuid_)
+        .Member("descriptor_hash", GetDescriptorHash())
+        .Member("minimum_free_heap_size", SystemInfo::GetMinimumFreeHeapSize());
+    writer.Key("application").BeginObject()
+        .Member("version", esp_app_get_description()->version)
+        .EndObject();
+    writer.RawMember("board", GetBoardJson());
+    writer.EndObject();
     return json;
 }
\ No newline at end of file
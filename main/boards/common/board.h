@@ -14,6 +14,7 @@
 void* create_board();
 class AudioCodec;
 class Display;
+class JsonWriter;
 class Board {
 private:
     Board(const Board&) = delete; // 禁用拷贝构造函数
@@ -25,6 +26,9 @@ protected:
 
     // 软件生成的设备唯一标识
     std::string uuid_;
+    std::string descriptor_hash_;
+
+    void WriteDescriptor(JsonWriter& writer);
 
 public:
     static Board& GetInstance() {
@@ -49,6 +53,11 @@ public:
     virtual const char* GetNetworkStateIcon() = 0;
     virtual bool GetBatteryLevel(int &level, bool& charging, bool& discharging);
     virtual std::string GetJson();
+    // Only the members that change at runtime, plus the hash of the full descriptor.
+    // Sent instead of GetJson() to servers that answered with X-Compact-Descriptor: 1
+    virtual std::string GetCompactJson();
+    // FNV-1a hash of the members of GetJson() that are fixed until the next upgrade
+    const std::string& GetDescriptorHash();
     virtual void SetPowerSaveMode(bool enabled) = 0;
     virtual std::string GetBoardJson() = 0;
     virtual std::string GetDeviceStatusJson() = 0;
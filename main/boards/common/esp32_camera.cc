@@ -24,47 +24,34 @@ Esp32Camera::Esp32Camera(const camera_config_t& config) {
         s->set_hmirror(s, 0);  // 这里控制摄像头镜像 写1镜像 写0不镜像
     }
 
-    // 初始化预览图片的内存
-    memset(&preview_image_, 0, sizeof(preview_image_));
-    preview_image_.header.magic = LV_IMAGE_HEADER_MAGIC;
-    preview_image_.header.cf = LV_COLOR_FORMAT_RGB565;
-    preview_image_.header.flags = LV_IMAGE_FLAGS_ALLOCATED | LV_IMAGE_FLAGS_MODIFIABLE;
-
     switch (config.frame_size) {
         case FRAMESIZE_SVGA:
-            preview_image_.header.w = 800;
-            preview_image_.header.h = 600;
+            preview_width_ = 800;
+            preview_height_ = 600;
             break;
         case FRAMESIZE_VGA:
-            preview_image_.header.w = 640;
-            preview_image_.header.h = 480;
+            preview_width_ = 640;
+            preview_height_ = 480;
             break;
         case FRAMESIZE_QVGA:
-            preview_image_.header.w = 320;
-            preview_image_.header.h = 240;
+            preview_width_ = 320;
+            preview_height_ = 240;
             break;
         case FRAMESIZE_128X128:
-            preview_image_.header.w = 128;
-            preview_image_.header.h = 128;
+            preview_width_ = 128;
+            preview_height_ = 128;
             break;
         case FRAMESIZE_240X240:
-            preview_image_.header.w = 240;
-            preview_image_.header.h = 240;
+            preview_width_ = 240;
+            preview_height_ = 240;
             break;
         default:
             ESP_LOGE(TAG, "Unsupported frame size: %d, image preview will not be shown", config.frame_size);
-            preview_image_.data_size = 0;
-            preview_image_.data = nullptr;
             return;
     }
 
-    preview_image_.header.stride = preview_image_.header.w * 2;
-    preview_image_.data_size = preview_image_.header.w * preview_image_.header.h * 2;
-    preview_image_.data = (uint8_t*)heap_caps_malloc(preview_image_.data_size, MALLOC_CAP_SPIRAM);
-    if (preview_image_.data == nullptr) {
-        ESP_LOGE(TAG, "Failed to allocate memory for preview image");
-        return;
-    }
+    // 初始化预览图片的内存
+    preview_image_ = PreviewImage::Create(preview_width_, preview_height_);
 }
 
 Esp32Camera::~Esp32Camera() {
@@ -72,10 +59,6 @@ Esp32Camera::~Esp32Camera() {
         esp_camera_fb_return(fb_);
         fb_ = nullptr;
     }
-    if (preview_image_.data) {
-        heap_caps_free((void*)preview_image_.data);
-        preview_image_.data = nullptr;
-    }
     esp_camera_deinit();
 }
 
@@ -104,25 +87,22 @@ bool Esp32Camera::Capture() {
 
     // 如果预览图片 buffer 为空，则跳过预览
     // 但仍返回 true，因为此时图像可以上传至服务器
-    if (preview_image_.data_size == 0) {
+    if (preview_width_ == 0) {
         ESP_LOGW(TAG, "Skip preview because of unsupported frame size");
         return true;
     }
-    if (preview_image_.data == nullptr) {
-        ESP_LOGE(TAG, "Preview image data is not initialized");
-        return true;
-    }
     // 显示预览图片
     auto display = Board::GetInstance().GetDisplay();
     if (display != nullptr) {
-        auto src = (uint16_t*)fb_->buf;
-        auto dst = (uint16_t*)preview_image_.data;
-        size_t pixel_count = fb_->len / 2;
-        for (size_t i = 0; i < pixel_count; i++) {
-            // 交换每个16位字内的字节
-            dst[i] = __builtin_bswap16(src[i]);
+        // The display may still show the previous image, fill a new one then
+        if (!preview_image_ || preview_image_.use_count() > 1) {
+            preview_image_ = PreviewImage::Create(preview_width_, preview_height_);
+            if (!preview_image_) {
+                return true;
+            }
         }
-        display->SetPreviewImage(&preview_image_);
+        preview_image_->CopyByteSwapped(fb_->buf, fb_->len);
+        display->SetPreviewImage(preview_image_);
     }
     return true;
 }
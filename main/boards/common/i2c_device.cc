@@ -1,11 +1,45 @@
 #include "i2c_device.h"
+#include "json_writer.h"
 
 #include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
 
 #define TAG "I2cDevice"
 
+#define I2C_TIMEOUT_MS 100
+#define I2C_BURST_STACK_BUFFER 32
+#define I2C_ASYNC_QUEUE_SIZE 16
+#define I2C_ASYNC_TASK_STACK_SIZE 3072
+#define I2C_ASYNC_TASK_PRIORITY 3
+
+namespace {
+
+struct AsyncWrite {
+    I2cDevice* device;
+    uint8_t reg;
+    uint8_t value;
+};
+
+// Shared by all devices, the worker task is created by the first asynchronous write
+std::mutex async_mutex;
+std::condition_variable async_condition;
+std::condition_variable async_done_condition;
+std::vector<AsyncWrite> async_writes;
+I2cDevice* async_writing_device = nullptr;  // Taken from the queue and not yet written
+bool async_task_started = false;
+
+std::mutex devices_mutex;
+std::vector<I2cDevice*> devices;
+
+}
 
-I2cDevice::I2cDevice(i2c_master_bus_handle_t i2c_bus, uint8_t addr) {
+I2cDevice::I2cDevice(i2c_master_bus_handle_t i2c_bus, uint8_t addr) : address_(addr) {
     i2c_device_config_t i2c_device_cfg = {
         .dev_addr_length = I2C_ADDR_BIT_LEN_7,
         .device_address = addr,
@@ -17,19 +51,333 @@ I2cDevice::I2cDevice(i2c_master_bus_handle_t i2c_bus, uint8_t addr) {
     };
     ESP_ERROR_CHECK(i2c_master_bus_add_device(i2c_bus, &i2c_device_cfg, &i2c_device_));
     assert(i2c_device_ != NULL);
+
+    std::lock_guard<std::mutex> lock(devices_mutex);
+    devices.push_back(this);
+}
+
+I2cDevice::~I2cDevice() {
+    {
+        std::unique_lock<std::mutex> lock(async_mutex);
+        async_writes.erase(std::remove_if(async_writes.begin(), async_writes.end(),
+            [this](const AsyncWrite& write) { return write.device == this; }), async_writes.end());
+        // Wait for a write the worker task already took from the queue
+        async_done_condition.wait(lock, [this]() { return async_writing_device != this; });
+    }
+    {
+        std::lock_guard<std::mutex> lock(devices_mutex);
+        devices.erase(std::remove(devices.begin(), devices.end(), this), devices.end());
+    }
+    i2c_master_bus_rm_device(i2c_device_);
+}
+
+esp_err_t I2cDevice::Transfer(const uint8_t* write_buffer, size_t write_size, uint8_t* read_buffer, size_t read_size) {
+    int64_t start_time = esp_timer_get_time();
+    esp_err_t ret;
+    if (read_size > 0) {
+        ret = i2c_master_transmit_receive(i2c_device_, write_buffer, write_size, read_buffer, read_size, I2C_TIMEOUT_MS);
+    } else {
+        ret = i2c_master_transmit(i2c_device_, write_buffer, write_size, I2C_TIMEOUT_MS);
+    }
+    uint32_t elapsed_us = esp_timer_get_time() - start_time;
+
+    stats_.transactions++;
+    stats_.bytes += write_size + read_size;
+    stats_.busy_us += elapsed_us;
+    stats_.max_transaction_us = std::max(stats_.max_transaction_us, elapsed_us);
+    if (ret != ESP_OK) {
+        stats_.errors++;
+        if (stats_.consecutive_errors++ == 0) {
+            ESP_LOGW(TAG, "Device 0x%02x: %s", address_, esp_err_to_name(ret));
+        }
+    } else if (stats_.consecutive_errors > 0) {
+        ESP_LOGI(TAG, "Device 0x%02x recovered after %lu errors", address_, stats_.consecutive_errors);
+        stats_.consecutive_errors = 0;
+    }
+    return ret;
 }
 
-void I2cDevice::WriteReg(uint8_t reg, uint8_t value) {
-    uint8_t buffer[2] = {reg, value};
-    ESP_ERROR_CHECK(i2c_master_transmit(i2c_device_, buffer, 2, 100));
+esp_err_t I2cDevice::WriteReg(uint8_t reg, uint8_t value) {
+    return WriteRegs(reg, &value, 1);
 }
 
 uint8_t I2cDevice::ReadReg(uint8_t reg) {
-    uint8_t buffer[1];
-    ESP_ERROR_CHECK(i2c_master_transmit_receive(i2c_device_, &reg, 1, buffer, 1, 100));
-    return buffer[0];
+    FlushAsyncWrites();
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint8_t value = 0;
+    ReadRegLocked(reg, value);
+    return value;
+}
+
+esp_err_t I2cDevice::ReadRegs(uint8_t reg, uint8_t* buffer, size_t length) {
+    FlushAsyncWrites();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (cache_) {
+        size_t cached = 0;
+        while (cached < length && reg + cached <= 0xff && ReadCached(reg + cached, buffer[cached])) {
+            cached++;
+        }
+        if (cached == length) {
+            return ESP_OK;
+        }
+    }
+
+    esp_err_t ret = Transfer(&reg, 1, buffer, length);
+    if (ret != ESP_OK) {
+        memset(buffer, 0, length);
+        return ret;
+    }
+    StoreCached(reg, buffer, length);
+    return ESP_OK;
+}
+
+esp_err_t I2cDevice::WriteRegs(uint8_t reg, const uint8_t* data, size_t length) {
+    FlushAsyncWrites();
+    std::lock_guard<std::mutex> lock(mutex_);
+    return WriteRegsLocked(reg, data, length);
+}
+
+esp_err_t I2cDevice::UpdateReg(uint8_t reg, uint8_t mask, uint8_t value) {
+    FlushAsyncWrites();
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint8_t current;
+    esp_err_t ret = ReadRegLocked(reg, current);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    uint8_t updated = (current & ~mask) | (value & mask);
+    if (updated == current) {
+        return ESP_OK;
+    }
+    return WriteRegsLocked(reg, &updated, 1);
+}
+
+esp_err_t I2cDevice::WriteRegsLocked(uint8_t reg, const uint8_t* data, size_t length) {
+    uint8_t stack_buffer[I2C_BURST_STACK_BUFFER + 1];
+    std::unique_ptr<uint8_t[]> heap_buffer;
+    uint8_t* buffer = stack_buffer;
+    if (length > I2C_BURST_STACK_BUFFER) {
+        heap_buffer = std::make_unique<uint8_t[]>(length + 1);
+        buffer = heap_buffer.get();
+    }
+    buffer[0] = reg;
+    memcpy(buffer + 1, data, length);
+
+    esp_err_t ret = Transfer(buffer, length + 1, nullptr, 0);
+    if (ret != ESP_OK) {
+        // The device may have taken part of the write
+        InvalidateCached(reg, length);
+        return ret;
+    }
+    StoreCached(reg, data, length);
+    return ESP_OK;
+}
+
+esp_err_t I2cDevice::ReadRegLocked(uint8_t reg, uint8_t& value) {
+    if (ReadCached(reg, value)) {
+        return ESP_OK;
+    }
+    esp_err_t ret = Transfer(&reg, 1, &value, 1);
+    if (ret != ESP_OK) {
+        value = 0;
+        return ret;
+    }
+    StoreCached(reg, &value, 1);
+    return ESP_OK;
+}
+
+void I2cDevice::WriteRegAsync(uint8_t reg, uint8_t value) {
+    std::lock_guard<std::mutex> lock(async_mutex);
+    if (!async_task_started) {
+        async_writes.reserve(I2C_ASYNC_QUEUE_SIZE);
+        xTaskCreate([](void* arg) {
+            AsyncWriteLoop();
+        }, "i2c_async", I2C_ASYNC_TASK_STACK_SIZE, nullptr, I2C_ASYNC_TASK_PRIORITY, nullptr);
+        async_task_started = true;
+    }
+
+    auto it = std::find_if(async_writes.begin(), async_writes.end(), [this, reg](const AsyncWrite& write) {
+        return write.device == this && write.reg == reg;
+    });
+    if (it != async_writes.end()) {
+        it->value = value;
+        async_coalesced_++;
+        return;
+    }
+    if (async_writes.size() >= I2C_ASYNC_QUEUE_SIZE) {
+        async_dropped_++;
+        return;
+    }
+    async_writes.push_back({this, reg, value});
+    async_writes_++;
+    async_condition.notify_one();
+}
+
+void I2cDevice::AsyncWriteLoop() {
+    while (true) {
+        std::unique_lock<std::mutex> lock(async_mutex);
+        async_condition.wait(lock, []() { return !async_writes.empty(); });
+        auto write = async_writes.front();
+        async_writes.erase(async_writes.begin());
+        async_writing_device = write.device;
+        // The queue is never held during a transaction, so WriteRegAsync does not block
+        lock.unlock();
+        {
+            std::lock_guard<std::mutex> device_lock(write.device->mutex_);
+            write.device->WriteRegsLocked(write.reg, &write.value, 1);
+        }
+        lock.lock();
+        async_writing_device = nullptr;
+        async_done_condition.notify_all();
+    }
+}
+
+void I2cDevice::FlushAsyncWrites() {
+    AsyncWrite pending[I2C_ASYNC_QUEUE_SIZE];
+    size_t count = 0;
+    {
+        std::unique_lock<std::mutex> lock(async_mutex);
+        if (async_writes.empty() && async_writing_device != this) {
+            return;
+        }
+        // A write the worker task took from the queue is older than the ones still queued
+        async_done_condition.wait(lock, [this]() { return async_writing_device != this; });
+        for (auto it = async_writes.begin(); it != async_writes.end();) {
+            if (it->device == this) {
+                pending[count++] = *it;
+                it = async_writes.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    if (count == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = 0; i < count; i++) {
+        WriteRegsLocked(pending[i].reg, &pending[i].value, 1);
+    }
+}
+
+void I2cDevice::SetCacheable(uint8_t first, uint8_t last, uint16_t max_age_ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!cache_) {
+        cache_ = std::make_unique<RegisterCache>();
+    }
+    RegisterCache::Range range = {first, last, max_age_ms};
+    if (max_age_ms > 0) {
+        range.read_time_us.resize(last - first + 1);
+    }
+    cache_->ranges.push_back(std::move(range));
+}
+
+void I2cDevice::InvalidateCache() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (cache_) {
+        cache_->valid.reset();
+    }
+}
+
+I2cDevice::RegisterCache::Range* I2cDevice::FindCacheRange(uint8_t reg) {
+    for (auto& range : cache_->ranges) {
+        if (reg >= range.first && reg <= range.last) {
+            return &range;
+        }
+    }
+    return nullptr;
+}
+
+bool I2cDevice::ReadCached(uint8_t reg, uint8_t& value) {
+    if (!cache_ || !cache_->valid[reg]) {
+        return false;
+    }
+    auto range = FindCacheRange(reg);
+    if (range->max_age_ms > 0 &&
+        esp_timer_get_time() - range->read_time_us[reg - range->first] > range->max_age_ms * 1000LL) {
+        return false;
+    }
+    value = cache_->values[reg];
+    stats_.cache_hits++;
+    return true;
+}
+
+void I2cDevice::StoreCached(uint8_t reg, const uint8_t* values, size_t length) {
+    if (!cache_) {
+        return;
+    }
+    int64_t now_us = esp_timer_get_time();
+    for (size_t i = 0; i < length && reg + i <= 0xff; i++) {
+        uint8_t current = reg + i;
+        auto range = FindCacheRange(current);
+        if (range != nullptr) {
+            cache_->values[current] = values[i];
+            cache_->valid[current] = true;
+            if (range->max_age_ms > 0) {
+                range->read_time_us[current - range->first] = now_us;
+            }
+        }
+    }
+}
+
+void I2cDevice::InvalidateCached(uint8_t reg, size_t length) {
+    if (!cache_) {
+        return;
+    }
+    for (size_t i = 0; i < length && reg + i <= 0xff; i++) {
+        cache_->valid[reg + i] = false;
+    }
 }
 
-void I2cDevice::ReadRegs(uint8_t reg, uint8_t* buffer, size_t length) {
-    ESP_ERROR_CHECK(i2c_master_transmit_receive(i2c_device_, &reg, 1, buffer, length, 100));
-}
\ No newline at end of file
+size_t I2cDevice::GetDeviceCount() {
+    std::lock_guard<std::mutex> lock(devices_mutex);
+    return devices.size();
+}
+
+/*
+ * {"uptime_us": 60000000, "devices": [{"address": "0x34", "transactions": 240, "bytes": 560,
+ *   "errors": 0, "cache_hits": 180, "busy_us": 36000, "bus_permille": 0, "max_transaction_us": 420,
+ *   "async_writes": 50, "async_coalesced": 30, "async_dropped": 0}]}
+ */
+std::string I2cDevice::GetStatsJson() {
+    int64_t uptime_us = esp_timer_get_time();
+    std::string json;
+    JsonWriter writer(json);
+    writer.BeginObject();
+    writer.Member("uptime_us", uptime_us);
+    writer.Key("devices").BeginArray();
+    std::lock_guard<std::mutex> lock(devices_mutex);
+    for (auto device : devices) {
+        I2cDeviceStats stats;
+        {
+            std::lock_guard<std::mutex> device_lock(device->mutex_);
+            stats = device->stats_;
+        }
+        uint32_t async_writes, async_coalesced, async_dropped;
+        {
+            std::lock_guard<std::mutex> async_lock(async_mutex);
+            async_writes = device->async_writes_;
+            async_coalesced = device->async_coalesced_;
+            async_dropped = device->async_dropped_;
+        }
+        char address[8];
+        snprintf(address, sizeof(address), "0x%02x", device->address_);
+        writer.BeginObject();
+        writer.Member("address", address);
+        writer.Member("transactions", stats.transactions);
+        writer.Member("bytes", stats.bytes);
+        writer.Member("errors", stats.errors);
+        writer.Member("cache_hits", stats.cache_hits);
+        writer.Member("busy_us", stats.busy_us);
+        writer.Member("bus_permille", uptime_us > 0 ? static_cast<int64_t>(stats.busy_us * 1000 / uptime_us) : 0);
+        writer.Member("max_transaction_us", stats.max_transaction_us);
+        writer.Member("async_writes", async_writes);
+        writer.Member("async_coalesced", async_coalesced);
+        writer.Member("async_dropped", async_dropped);
+        writer.EndObject();
+    }
+    writer.EndArray();
+    writer.EndObject();
+    return json;
+}
@@ -3,16 +3,89 @@
 
 #include <driver/i2c_master.h>
 
+#include <string>
+#include <memory>
+#include <vector>
+#include <bitset>
+#include <mutex>
+
+struct I2cDeviceStats {
+    uint32_t transactions = 0;
+    uint32_t bytes = 0;
+    uint32_t errors = 0;
+    uint32_t consecutive_errors = 0;
+    uint32_t cache_hits = 0;
+    uint64_t busy_us = 0;           // Time spent in transactions, including waiting for the bus
+    uint32_t max_transaction_us = 0;
+};
+
+/*
+ * Register access to an I2C device. Errors are counted and logged once per streak
+ * instead of aborting: reads return 0 and writes return the error.
+ *
+ * Drivers can mark registers as cacheable: configuration registers that only change
+ * when the driver writes them are read from the bus once, status registers can be
+ * cached for `max_age_ms` so that the getters called by one battery poll share a read.
+ */
 class I2cDevice {
 public:
     I2cDevice(i2c_master_bus_handle_t i2c_bus, uint8_t addr);
+    ~I2cDevice();
+
+    // Transactions, errors, cache hits and bus time of every device
+    static std::string GetStatsJson();
+    static size_t GetDeviceCount();
 
 protected:
     i2c_master_dev_handle_t i2c_device_;
 
-    void WriteReg(uint8_t reg, uint8_t value);
+    esp_err_t WriteReg(uint8_t reg, uint8_t value);
     uint8_t ReadReg(uint8_t reg);
-    void ReadRegs(uint8_t reg, uint8_t* buffer, size_t length);
+    // Burst access, the device must increment the register address by itself
+    esp_err_t ReadRegs(uint8_t reg, uint8_t* buffer, size_t length);
+    esp_err_t WriteRegs(uint8_t reg, const uint8_t* data, size_t length);
+    // Read-modify-write of the bits in `mask`, the write is skipped if they already match
+    esp_err_t UpdateReg(uint8_t reg, uint8_t mask, uint8_t value);
+    // Queued for the I2C worker task, for callers that must not block such as esp_timer
+    // callbacks. A pending write to the same register is replaced by the newer value and
+    // pending writes go out before any other access to the device.
+    void WriteRegAsync(uint8_t reg, uint8_t value);
+
+    // max_age_ms 0: the registers keep their value until written through this class
+    void SetCacheable(uint8_t first, uint8_t last, uint16_t max_age_ms = 0);
+    void InvalidateCache();
+
+private:
+    struct RegisterCache {
+        struct Range {
+            uint8_t first;
+            uint8_t last;
+            uint16_t max_age_ms;
+            std::vector<int64_t> read_time_us;  // Per register, only for ranges with a max age
+        };
+        std::vector<Range> ranges;
+        std::bitset<256> valid;
+        uint8_t values[256];
+    };
+
+    uint8_t address_;
+    std::mutex mutex_;              // Serializes the transactions, cache and stats of the device
+    std::unique_ptr<RegisterCache> cache_;
+    I2cDeviceStats stats_;
+    // Guarded by the queue mutex of the worker task
+    uint32_t async_writes_ = 0;
+    uint32_t async_coalesced_ = 0;  // Replaced by a newer value before they were written
+    uint32_t async_dropped_ = 0;    // The queue was full
+
+    esp_err_t Transfer(const uint8_t* write_buffer, size_t write_size, uint8_t* read_buffer, size_t read_size);
+    esp_err_t WriteRegsLocked(uint8_t reg, const uint8_t* data, size_t length);
+    esp_err_t ReadRegLocked(uint8_t reg, uint8_t& value);
+    bool ReadCached(uint8_t reg, uint8_t& value);
+    void StoreCached(uint8_t reg, const uint8_t* values, size_t length);
+    void InvalidateCached(uint8_t reg, size_t length);
+    RegisterCache::Range* FindCacheRange(uint8_t reg);
+    void FlushAsyncWrites();
+    static void AsyncWriteLoop();
 };
 
 #endif // I2C_DEVICE_H
@@ -4,6 +4,7 @@
 #include "display.h"
 #include "font_awesome_symbols.h"
 #include "assets/lang_config.h"
+#include "json_writer.h"
 
 #include <esp_log.h>
 #include <esp_timer.h>
@@ -106,14 +107,18 @@ const char* Ml307Board::GetNetworkStateIcon() {
 
 std::string Ml307Board::GetBoardJson() {
     // Set the board type for OTA
-    std::string board_json = std::string("{\"type\":\"" BOARD_TYPE "\",");
-    board_json += "\"name\":\"" BOARD_NAME "\",";
-    board_json += "\"revision\":\"" + modem_.GetModuleName() + "\",";
-    board_json += "\"carrier\":\"" + modem_.GetCarrierName() + "\",";
-    board_json += "\"csq\":\"" + std::to_string(modem_.GetCsq()) + "\",";
-    board_json += "\"imei\":\"" + modem_.GetImei() + "\",";
-    board_json += "\"iccid\":\"" + modem_.GetIccid() + "\",";
-    board_json += "\"cereg\":" + modem_.GetRegistrationState().ToString() + "}";
+    std::string board_json;
+    JsonWriter json(board_json);
+    json.BeginObject()
+        .Member("type", BOARD_TYPE)
+        .Member("name", BOARD_NAME)
+        .Member("revision", modem_.GetModuleName())
+        .Member("carrier", modem_.GetCarrierName())
+        .Member("csq", std::to_string(modem_.GetCsq()))
+        .Member("imei", modem_.GetImei())
+        .Member("iccid", modem_.GetIccid())
+        .RawMember("cereg", modem_.GetRegistrationState().ToString())
+        .EndObject();
     return board_json;
 }
 
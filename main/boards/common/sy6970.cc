@@ -7,6 +7,10 @@
 #define TAG "Sy6970"
 
 Sy6970::Sy6970(i2c_master_bus_handle_t i2c_bus, uint8_t addr) : I2cDevice(i2c_bus, addr) {
+    // 状态和电池电压在一次电量查询内共用一次读取，充电电压配置在看门狗复位后会恢复默认值，定期重新读取
+    SetCacheable(0x06, 0x06, 10000);
+    SetCacheable(0x0B, 0x0B, 100);
+    SetCacheable(0x0E, 0x0E, 100);
 }
 
 int Sy6970::GetChangingStatus() {
@@ -6,6 +6,7 @@
 #include "font_awesome_symbols.h"
 #include "settings.h"
 #include "assets/lang_config.h"
+#include "json_writer.h"
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
@@ -153,15 +154,19 @@ const char* WifiBoard::GetNetworkStateIcon() {
 std::string WifiBoard::GetBoardJson() {
     // Set the board type for OTA
     auto& wifi_station = WifiStation::GetInstance();
-    std::string board_json = std::string("{\"type\":\"" BOARD_TYPE "\",");
-    board_json += "\"name\":\"" BOARD_NAME "\",";
+    std::string board_json;
+    JsonWriter json(board_json);
+    json.BeginObject()
+        .Member("type", BOARD_TYPE)
+        .Member("name", BOARD_NAME);
     if (!wifi_config_mode_) {
-        board_json += "\"ssid\":\"" + wifi_station.GetSsid() + "\",";
-        board_json += "\"rssi\":" + std::to_string(wifi_station.GetRssi()) + ",";
-        board_json += "\"channel\":" + std::to_string(wifi_station.GetChannel()) + ",";
-        board_json += "\"ip\":\"" + wifi_station.GetIpAddress() + "\",";
+        json.Member("ssid", wifi_station.GetSsid())
+            .Member("rssi", wifi_station.GetRssi())
+            .Member("channel", wifi_station.GetChannel())
+            .Member("ip", wifi_station.GetIpAddress());
     }
-    board_json += "\"mac\":\"" + SystemInfo::GetMacAddress() + "\"}";
+    json.Member("mac", SystemInfo::GetMacAddress())
+        .EndObject();
     return board_json;
 }
 
@@ -13,39 +13,39 @@
 // 表情映射表 - 将多种表情映射到现有6个GIF
 const ElectronEmojiDisplay::EmotionMap ElectronEmojiDisplay::emotion_maps_[] = {
     // 中性/平静类表情 -> staticstate
-    {"neutral", &staticstate},
-    {"relaxed", &staticstate},
-    {"sleepy", &staticstate},
+    {"neutral", &staticstate, "emoji/staticstate.sprite"},
+    {"relaxed", &staticstate, "emoji/staticstate.sprite"},
+    {"sleepy", &staticstate, "emoji/staticstate.sprite"},
 
     // 积极/开心类表情 -> happy
-    {"happy", &happy},
-    {"laughing", &happy},
-    {"funny", &happy},
-    {"loving", &happy},
-    {"confident", &happy},
-    {"winking", &happy},
-    {"cool", &happy},
-    {"delicious", &happy},
-    {"kissy", &happy},
-    {"silly", &happy},
+    {"happy", &happy, "emoji/happy.sprite"},
+    {"laughing", &happy, "emoji/happy.sprite"},
+    {"funny", &happy, "emoji/happy.sprite"},
+    {"loving", &happy, "emoji/happy.sprite"},
+    {"confident", &happy, "emoji/happy.sprite"},
+    {"winking", &happy, "emoji/happy.sprite"},
+    {"cool", &happy, "emoji/happy.sprite"},
+    {"delicious", &happy, "emoji/happy.sprite"},
+    {"kissy", &happy, "emoji/happy.sprite"},
+    {"silly", &happy, "emoji/happy.sprite"},
 
     // 悲伤类表情 -> sad
-    {"sad", &sad},
-    {"crying", &sad},
+    {"sad", &sad, "emoji/sad.sprite"},
+    {"crying", &sad, "emoji/sad.sprite"},
 
     // 愤怒类表情 -> anger
-    {"angry", &anger},
+    {"angry", &anger, "emoji/anger.sprite"},
 
     // 惊讶类表情 -> scare
-    {"surprised", &scare},
-    {"shocked", &scare},
+    {"surprised", &scare, "emoji/scare.sprite"},
+    {"shocked", &scare, "emoji/scare.sprite"},
 
     // 思考/困惑类表情 -> buxue
-    {"thinking", &buxue},
-    {"confused", &buxue},
-    {"embarrassed", &buxue},
+    {"thinking", &buxue, "emoji/buxue.sprite"},
+    {"confused", &buxue, "emoji/buxue.sprite"},
+    {"embarrassed", &buxue, "emoji/buxue.sprite"},
 
-    {nullptr, nullptr}  // 结束标记
+    {nullptr, nullptr, nullptr}  // 结束标记
 };
 
 ElectronEmojiDisplay::ElectronEmojiDisplay(esp_lcd_panel_io_handle_t panel_io,
@@ -85,13 +85,16 @@ void ElectronEmojiDisplay::SetupGifContainer() {
     lv_obj_set_style_border_width(emotion_label_, 0, 0);
     lv_obj_add_flag(emotion_label_, LV_OBJ_FLAG_HIDDEN);
 
-    emotion_gif_ = lv_gif_create(content_);
-    int gif_size = LV_HOR_RES;
-    lv_obj_set_size(emotion_gif_, gif_size, gif_size);
-    lv_obj_set_style_border_width(emotion_gif_, 0, 0);
-    lv_obj_set_style_bg_opa(emotion_gif_, LV_OPA_TRANSP, 0);
-    lv_obj_center(emotion_gif_);
-    lv_gif_set_src(emotion_gif_, &staticstate);
+    // 资源分区中有精灵图时使用预解码的帧，否则使用内置的GIF
+    if (!SetupEmotionSprites(content_, "emoji/staticstate.sprite")) {
+        emotion_gif_ = lv_gif_create(content_);
+        int gif_size = LV_HOR_RES;
+        lv_obj_set_size(emotion_gif_, gif_size, gif_size);
+        lv_obj_set_style_border_width(emotion_gif_, 0, 0);
+        lv_obj_set_style_bg_opa(emotion_gif_, LV_OPA_TRANSP, 0);
+        lv_obj_center(emotion_gif_);
+        lv_gif_set_src(emotion_gif_, &staticstate);
+    }
 
     chat_message_label_ = lv_label_create(content_);
     lv_label_set_text(chat_message_label_, "");
@@ -110,8 +113,8 @@ void ElectronEmojiDisplay::SetupGifContainer() {
     LcdDisplay::SetTheme("dark");
 }
 
-void ElectronEmojiDisplay::SetEmotion(const char* emotion) {
-    if (!emotion || !emotion_gif_) {
+void ElectronEmojiDisplay::ApplyEmotion(const char* emotion) {
+    if (!emotion || (!emotion_gif_ && !sprite_player_)) {
         return;
     }
 
@@ -119,17 +122,25 @@ void ElectronEmojiDisplay::SetEmotion(const char* emotion) {
 
     for (const auto& map : emotion_maps_) {
         if (map.name && strcmp(map.name, emotion) == 0) {
-            lv_gif_set_src(emotion_gif_, map.gif);
+            if (sprite_player_) {
+                PlayEmotionSprite(map.sprite);
+            } else {
+                lv_gif_set_src(emotion_gif_, map.gif);
+            }
             ESP_LOGI(TAG, "设置表情: %s", emotion);
             return;
         }
     }
 
-    lv_gif_set_src(emotion_gif_, &staticstate);
+    if (sprite_player_) {
+        PlayEmotionSprite("emoji/staticstate.sprite");
+    } else {
+        lv_gif_set_src(emotion_gif_, &staticstate);
+    }
     ESP_LOGI(TAG, "未知表情'%s'，使用默认", emotion);
 }
 
-void ElectronEmojiDisplay::SetChatMessage(const char* role, const char* content) {
+void ElectronEmojiDisplay::ApplyChatMessage(const char* role, const char* content) {
     DisplayLockGuard lock(this);
     if (chat_message_label_ == nullptr) {
         return;
@@ -146,7 +157,7 @@ void ElectronEmojiDisplay::SetChatMessage(const char* role, const char* content)
     ESP_LOGI(TAG, "设置聊天消息 [%s]: %s", role, content);
 }
 
-void ElectronEmojiDisplay::SetIcon(const char* icon) {
+void ElectronEmojiDisplay::ApplyIcon(const char* icon) {
     if (!icon) {
         return;
     }
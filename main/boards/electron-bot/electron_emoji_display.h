@@ -27,14 +27,15 @@ public:
 
     virtual ~ElectronEmojiDisplay() = default;
 
+protected:
     // 重写表情设置方法
-    virtual void SetEmotion(const char* emotion) override;
+    virtual void ApplyEmotion(const char* emotion) override;
 
     // 重写聊天消息设置方法
-    virtual void SetChatMessage(const char* role, const char* content) override;
+    virtual void ApplyChatMessage(const char* role, const char* content) override;
 
     // 重写图标设置方法
-    virtual void SetIcon(const char* icon) override;
+    virtual void ApplyIcon(const char* icon) override;
 
 private:
     void SetupGifContainer();
@@ -45,6 +46,7 @@ private:
     struct EmotionMap {
         const char* name;
         const lv_image_dsc_t* gif;
+        const char* sprite;  ///< 资源分区中的精灵图名称
     };
 
     static const EmotionMap emotion_maps_[];
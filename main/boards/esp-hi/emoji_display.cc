@@ -107,7 +107,7 @@ EmojiWidget::~EmojiWidget()
 
 }
 
-void EmojiWidget::SetEmotion(const char* emotion)
+void EmojiWidget::ApplyEmotion(const char* emotion)
 {
     if (!player_) {
         return;
@@ -143,7 +143,7 @@ void EmojiWidget::SetEmotion(const char* emotion)
     }
 }
 
-void EmojiWidget::SetStatus(const char* status)
+void EmojiWidget::ApplyStatus(const char* status)
 {
     if (player_) {
         if (strcmp(status, "聆听中...") == 0) {
@@ -36,13 +36,15 @@ public:
     EmojiWidget(esp_lcd_panel_handle_t panel, esp_lcd_panel_io_handle_t panel_io);
     virtual ~EmojiWidget();
 
-    virtual void SetEmotion(const char* emotion) override;
-    virtual void SetStatus(const char* status) override;
     anim::EmojiPlayer* GetPlayer()
     {
         return player_.get();
     }
 
+protected:
+    virtual void ApplyEmotion(const char* emotion) override;
+    virtual void ApplyStatus(const char* status) override;
+
 private:
     void InitializePlayer(esp_lcd_panel_handle_t panel, esp_lcd_panel_io_handle_t panel_io);
     virtual bool Lock(int timeout_ms = 0) override;
@@ -41,7 +41,8 @@ public:
 
     void SetBrightness(uint8_t brightness) {
         brightness = ((brightness + 641) >> 5);
-        WriteReg(0x99, brightness);
+        // 背光渐变在 esp_timer 回调中调用，不等待 I2C 传输
+        WriteRegAsync(0x99, brightness);
     }
 };
 
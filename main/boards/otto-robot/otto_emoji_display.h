@@ -20,14 +20,15 @@ public:
 
     virtual ~OttoEmojiDisplay() = default;
 
+protected:
     // 重写表情设置方法
-    virtual void SetEmotion(const char* emotion) override;
+    virtual void ApplyEmotion(const char* emotion) override;
 
     // 重写聊天消息设置方法
-    virtual void SetChatMessage(const char* role, const char* content) override;
+    virtual void ApplyChatMessage(const char* role, const char* content) override;
 
-    // 添加SetIcon方法声明
-    virtual void SetIcon(const char* icon) override;
+    // 重写图标设置方法
+    virtual void ApplyIcon(const char* icon) override;
 
 private:
     void SetupGifContainer();
@@ -38,6 +39,7 @@ private:
     struct EmotionMap {
         const char* name;
         const lv_img_dsc_t* gif;
+        const char* sprite;  ///< 资源分区中的精灵图名称
     };
 
     static const EmotionMap emotion_maps_[];
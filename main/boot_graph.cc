@@ -0,0 +1,93 @@
+#include "boot_graph.h"
+#include "boot_profiler.h"
+
+#include <esp_log.h>
+#include <cstring>
+#include <cassert>
+#include <utility>
+
+#define TAG "BootGraph"
+
+// FreeRTOS event groups hold 24 bits
+#define BOOT_GRAPH_MAX_STEPS 24
+
+BootGraph::BootGraph() {
+    event_group_ = xEventGroupCreate();
+}
+
+BootGraph::~BootGraph() {
+    vEventGroupDelete(event_group_);
+}
+
+EventBits_t BootGraph::GetBit(const char* name) {
+    for (size_t i = 0; i < steps_.size(); i++) {
+        if (strcmp(steps_[i].name, name) == 0) {
+            return 1 << i;
+        }
+    }
+    ESP_LOGE(TAG, "Unknown step: %s", name);
+    return 0;
+}
+
+void BootGraph::AddStep(const char* name, std::vector<const char*> dependencies, std::function<void()> callback,
+    int core, uint32_t stack_size) {
+    assert(steps_.size() < BOOT_GRAPH_MAX_STEPS);
+    // Dependencies must be added first, which also rules out cycles
+    EventBits_t bits = 0;
+    for (auto dependency : dependencies) {
+        bits |= GetBit(dependency);
+    }
+    steps_.push_back({name, bits, callback, core, stack_size});
+}
+
+void BootGraph::RunStep(Step& step, EventBits_t bit) {
+    if (step.dependencies != 0) {
+        xEventGroupWaitBits(event_group_, step.dependencies, pdFALSE, pdTRUE, portMAX_DELAY);
+    }
+    {
+        BootPhase phase(step.name);
+        step.callback();
+    }
+    xEventGroupSetBits(event_group_, bit);
+}
+
+void BootGraph::Run() {
+    EventBits_t all_bits = 0;
+    for (size_t i = 0; i < steps_.size(); i++) {
+        all_bits |= 1 << i;
+        auto& step = steps_[i];
+        if (step.core == BOOT_STEP_INLINE) {
+            continue;
+        }
+        // Single core chips run everything on core 0
+        int core = step.core < portNUM_PROCESSORS ? step.core : tskNO_AFFINITY;
+        auto args = new std::pair<BootGraph*, size_t>(this, i);
+        auto ret = xTaskCreatePinnedToCore([](void* arg) {
+            auto args = static_cast<std::pair<BootGraph*, size_t>*>(arg);
+            auto graph = args->first;
+            graph->RunStep(graph->steps_[args->second], 1 << args->second);
+            delete args;
+            vTaskDelete(NULL);
+        }, step.name, step.stack_size, args, 2, nullptr, core);
+        if (ret != pdPASS) {
+            // Fall back to running it on the calling task
+            ESP_LOGW(TAG, "Failed to create task for step %s, run it inline", step.name);
+            delete args;
+            step.core = BOOT_STEP_INLINE;
+        }
+    }
+
+    for (size_t i = 0; i < steps_.size(); i++) {
+        if (steps_[i].core == BOOT_STEP_INLINE) {
+            RunStep(steps_[i], 1 << i);
+        }
+    }
+    xEventGroupWaitBits(event_group_, all_bits, pdFALSE, pdTRUE, portMAX_DELAY);
+}
+
+void BootGraph::WaitFor(const char* name) {
+    auto bit = GetBit(name);
+    if (bit != 0) {
+        xEventGroupWaitBits(event_group_, bit, pdFALSE, pdTRUE, portMAX_DELAY);
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef BOOT_GRAPH_H
+#define BOOT_GRAPH_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <freertos/task.h>
+
+#include <string>
+#include <vector>
+#include <functional>
+
+// Run on the task that calls Run(), in the order the steps were added
+#define BOOT_STEP_INLINE -2
+
+// The steps used to run on the main task, give their tasks the same stack by default
+#ifdef CONFIG_ESP_MAIN_TASK_STACK_SIZE
+#define BOOT_STEP_STACK_SIZE CONFIG_ESP_MAIN_TASK_STACK_SIZE
+#else
+#define BOOT_STEP_STACK_SIZE 8192
+#endif
+
+// Startup steps and their dependencies. Each step starts as soon as the steps it
+// depends on are done, so independent steps run concurrently on both cores.
+// Every step is recorded as a phase of the boot timeline.
+class BootGraph {
+public:
+    BootGraph();
+    ~BootGraph();
+
+    // `core` is the core of the task running the step, tskNO_AFFINITY or BOOT_STEP_INLINE
+    void AddStep(const char* name, std::vector<const char*> dependencies, std::function<void()> callback,
+        int core = BOOT_STEP_INLINE, uint32_t stack_size = BOOT_STEP_STACK_SIZE);
+
+    // Run all steps and return when they are done
+    void Run();
+    // Block until the step is done, for work that must not overlap with it
+    void WaitFor(const char* name);
+
+private:
+    struct Step {
+        const char* name;
+        EventBits_t dependencies;
+        std::function<void()> callback;
+        int core;
+        uint32_t stack_size;
+    };
+
+    EventGroupHandle_t event_group_ = nullptr;
+    std::vector<Step> steps_;
+
+    EventBits_t GetBit(const char* name);
+    void RunStep(Step& step, EventBits_t bit);
+};
+
+#endif // BOOT_GRAPH_H
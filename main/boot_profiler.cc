@@ -0,0 +1,113 @@
+#include "boot_profiler.h"
+#include "json_writer.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_system.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <cstring>
+
+#define TAG "BootProfiler"
+
+#define BOOT_TIMELINE_MAGIC 0x424f4f54
+
+RTC_NOINIT_ATTR static BootTimeline rtc_timeline;
+
+static void WriteTimelineMembers(JsonWriter& writer, const BootTimeline& timeline) {
+    writer.Member("ready_ms", timeline.ready_us / 1000);
+    writer.Key("phases").BeginArray();
+    for (uint32_t i = 0; i < timeline.count; i++) {
+        auto& phase = timeline.phases[i];
+        writer.BeginObject()
+            .Member("name", phase.name)
+            .Member("core", phase.core)
+            .Member("start_ms", phase.start_us / 1000)
+            .Member("end_ms", phase.end_us / 1000)
+            .EndObject();
+    }
+    writer.EndArray();
+}
+
+static bool IsTimelineValid(const BootTimeline& timeline) {
+    return timeline.magic == BOOT_TIMELINE_MAGIC && timeline.count <= BOOT_PROFILER_MAX_PHASES;
+}
+
+BootProfiler::BootProfiler() {
+    // RTC memory keeps its content over software resets only
+    auto reason = esp_reset_reason();
+    if (reason != ESP_RST_POWERON && reason != ESP_RST_BROWNOUT && IsTimelineValid(rtc_timeline)) {
+        previous_ = rtc_timeline;
+        has_previous_ = true;
+    }
+    memset(&rtc_timeline, 0, sizeof(rtc_timeline));
+    rtc_timeline.magic = BOOT_TIMELINE_MAGIC;
+}
+
+int BootProfiler::BeginPhase(const char* name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (rtc_timeline.count >= BOOT_PROFILER_MAX_PHASES) {
+        ESP_LOGW(TAG, "Timeline is full, phase %s is not recorded", name);
+        return -1;
+    }
+    int index = rtc_timeline.count;
+    auto& phase = rtc_timeline.phases[index];
+    strncpy(phase.name, name, sizeof(phase.name) - 1);
+    phase.core = xPortGetCoreID();
+    phase.start_us = esp_timer_get_time();
+    phase.end_us = 0;
+    rtc_timeline.count++;
+    return index;
+}
+
+void BootProfiler::EndPhase(int index) {
+    if (index < 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& phase = rtc_timeline.phases[index];
+    phase.end_us = esp_timer_get_time();
+    ESP_LOGI(TAG, "Phase %s took %lld ms on core %d", phase.name, (phase.end_us - phase.start_us) / 1000, phase.core);
+}
+
+void BootProfiler::MarkReady() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    rtc_timeline.ready_us = esp_timer_get_time();
+}
+
+void BootProfiler::LogTimeline() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ESP_LOGI(TAG, "Ready after %lld ms", rtc_timeline.ready_us / 1000);
+    for (uint32_t i = 0; i < rtc_timeline.count; i++) {
+        auto& phase = rtc_timeline.phases[i];
+        ESP_LOGI(TAG, "  %-15s core %d  %6lld - %6lld ms", phase.name, phase.core,
+            phase.start_us / 1000, phase.end_us / 1000);
+    }
+    if (has_previous_ && previous_.ready_us == 0) {
+        ESP_LOGW(TAG, "The previous boot did not get ready, last phase: %s",
+            previous_.count > 0 ? previous_.phases[previous_.count - 1].name : "none");
+    }
+}
+
+/*
+ * {
+ *   "ready_ms": 3120,
+ *   "phases": [ { "name": "network", "core": 0, "start_ms": 410, "end_ms": 2600 }, ... ],
+ *   "previous": { ... }
+ * }
+ */
+std::string BootProfiler::GetTimelineJson() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::string json;
+    JsonWriter writer(json);
+    writer.BeginObject();
+    WriteTimelineMembers(writer, rtc_timeline);
+    if (has_previous_) {
+        writer.Key("previous").BeginObject();
+        WriteTimelineMembers(writer, previous_);
+        writer.EndObject();
+    }
+    writer.EndObject();
+    return json;
+}
@@ -0,0 +1,64 @@
+#ifndef BOOT_PROFILER_H
+#define BOOT_PROFILER_H
+
+#include <esp_attr.h>
+
+#include <string>
+#include <mutex>
+#include <cstdint>
+
+#define BOOT_PROFILER_MAX_PHASES 16
+
+struct BootPhaseRecord {
+    char name[16];
+    int8_t core;
+    int64_t start_us;
+    int64_t end_us;     // 0 while the phase is running
+};
+
+struct BootTimeline {
+    uint32_t magic;
+    uint32_t count;
+    int64_t ready_us;   // 0 until the device is ready
+    BootPhaseRecord phases[BOOT_PROFILER_MAX_PHASES];
+};
+
+// Records when each boot phase starts and ends. The timeline is kept in RTC memory,
+// so after a restart the timeline of the previous boot is still available, including
+// the phase it was stuck in if it never got ready.
+class BootProfiler {
+public:
+    static BootProfiler& GetInstance() {
+        static BootProfiler instance;
+        return instance;
+    }
+    BootProfiler(const BootProfiler&) = delete;
+    BootProfiler& operator=(const BootProfiler&) = delete;
+
+    // Returns the phase index for EndPhase(), -1 if the timeline is full
+    int BeginPhase(const char* name);
+    void EndPhase(int index);
+    void MarkReady();
+
+    void LogTimeline();
+    std::string GetTimelineJson();
+
+private:
+    BootProfiler();
+
+    std::mutex mutex_;
+    BootTimeline previous_ = {};
+    bool has_previous_ = false;
+};
+
+// Measures a phase for the lifetime of the object
+class BootPhase {
+public:
+    BootPhase(const char* name) : index_(BootProfiler::GetInstance().BeginPhase(name)) {}
+    ~BootPhase() { BootProfiler::GetInstance().EndPhase(index_); }
+
+private:
+    int index_;
+};
+
+#endif // BOOT_PROFILER_H
@@ -3,6 +3,7 @@
 #include <string>
 #include <cstdlib>
 #include <cstring>
+#include <cctype>
 
 #include "display.h"
 #include "board.h"
@@ -11,9 +12,13 @@
 #include "audio_codec.h"
 #include "settings.h"
 #include "assets/lang_config.h"
+#include "json_writer.h"
 
 #define TAG "Display"
 
+// Chat messages waiting for the LVGL task, the oldest ones are dropped beyond this
+#define DISPLAY_MAX_PENDING_MESSAGES 16
+
 Display::Display() {
     // Notification timer
     esp_timer_create_args_t notification_timer_args = {
@@ -44,6 +49,9 @@ Display::~Display() {
         esp_timer_stop(notification_timer_);
         esp_timer_delete(notification_timer_);
     }
+    if (command_timer_ != nullptr) {
+        lv_timer_delete(command_timer_);
+    }
 
     if (network_label_ != nullptr) {
         lv_obj_del(network_label_);
@@ -61,14 +69,149 @@ Display::~Display() {
     }
 }
 
-void Display::SetStatus(const char* status) {
-    DisplayLockGuard lock(this);
-    if (status_label_ == nullptr) {
+void Display::StartCommandTimer() {
+    command_timer_ = lv_timer_create([](lv_timer_t* timer) {
+        auto display = static_cast<Display*>(lv_timer_get_user_data(timer));
+        display->ProcessCommands();
+    }, LV_DEF_REFR_PERIOD, this);
+}
+
+/*
+ * Updates are kept in one slot per command, so a newer status, emotion or status bar
+ * replaces the one still waiting and only the latest is drawn in a frame. Chat messages
+ * are all shown in order, only a system message replaces a waiting system message.
+ */
+void Display::PostCommand(DisplayCommand command, std::function<void()> update) {
+    {
+        std::lock_guard<std::mutex> lock(command_mutex_);
+        update();
+        command_stats_[command].posted++;
+        if (!(pending_commands_ & (1 << command))) {
+            posted_time_[command] = esp_timer_get_time();
+            pending_commands_ |= (1 << command);
+        }
+    }
+    if (command_timer_ == nullptr) {
+        ProcessCommands();
+    }
+}
+
+void Display::RecordApplied(DisplayCommand command, int64_t posted_time) {
+    uint32_t latency = esp_timer_get_time() - posted_time;
+    std::lock_guard<std::mutex> lock(command_mutex_);
+    auto& stats = command_stats_[command];
+    stats.applied++;
+    stats.total_latency_us += latency;
+    if (latency > stats.max_latency_us) {
+        stats.max_latency_us = latency;
+    }
+}
+
+void Display::ProcessCommands() {
+    if (pending_commands_ == 0) {
         return;
     }
-    lv_label_set_text(status_label_, status);
-    lv_obj_clear_flag(status_label_, LV_OBJ_FLAG_HIDDEN);
-    lv_obj_add_flag(notification_label_, LV_OBJ_FLAG_HIDDEN);
+
+    uint32_t commands;
+    int64_t posted_time[kDisplayCommandCount];
+    std::string status, notification, emotion;
+    int notification_duration;
+    bool notification_after_status;
+    std::deque<ChatMessage> chat_messages;
+    const char *mute_icon, *battery_icon, *network_icon;
+    bool low_battery;
+    {
+        std::lock_guard<std::mutex> lock(command_mutex_);
+        commands = pending_commands_.exchange(0);
+        memcpy(posted_time, posted_time_, sizeof(posted_time));
+        status.swap(pending_status_);
+        notification.swap(pending_notification_);
+        notification_duration = pending_notification_duration_;
+        notification_after_status = notification_after_status_;
+        emotion.swap(pending_emotion_);
+        chat_messages.swap(pending_chat_messages_);
+        mute_icon = pending_mute_icon_;
+        battery_icon = pending_battery_icon_;
+        network_icon = pending_network_icon_;
+        low_battery = pending_low_battery_;
+        pending_mute_icon_ = pending_battery_icon_ = pending_network_icon_ = nullptr;
+    }
+
+    auto has = [commands](DisplayCommand command) { return (commands & (1 << command)) != 0; };
+    if (has(kDisplayCommandStatusBar)) {
+        ApplyStatusBar(mute_icon, battery_icon, network_icon, low_battery);
+        RecordApplied(kDisplayCommandStatusBar, posted_time[kDisplayCommandStatusBar]);
+    }
+    // The status and the notification share the place, keep the order they were posted in
+    if (has(kDisplayCommandStatus) && notification_after_status) {
+        ApplyStatus(status.c_str());
+        RecordApplied(kDisplayCommandStatus, posted_time[kDisplayCommandStatus]);
+    }
+    if (has(kDisplayCommandNotification)) {
+        ApplyNotification(notification.c_str(), notification_duration);
+        RecordApplied(kDisplayCommandNotification, posted_time[kDisplayCommandNotification]);
+    }
+    if (has(kDisplayCommandStatus) && !notification_after_status) {
+        ApplyStatus(status.c_str());
+        RecordApplied(kDisplayCommandStatus, posted_time[kDisplayCommandStatus]);
+    }
+    if (has(kDisplayCommandEmotion)) {
+        ApplyEmotion(emotion.c_str());
+        RecordApplied(kDisplayCommandEmotion, posted_time[kDisplayCommandEmotion]);
+    } else if (has(kDisplayCommandIcon)) {
+        ApplyIcon(emotion.c_str());
+        RecordApplied(kDisplayCommandIcon, posted_time[kDisplayCommandIcon]);
+    }
+    for (auto& message : chat_messages) {
+        if (message.append) {
+            ApplyAppendChatMessage(message.role.c_str(), message.content.c_str());
+        } else {
+            ApplyChatMessage(message.role.c_str(), message.content.c_str());
+        }
+        RecordApplied(kDisplayCommandChatMessage, message.posted_time);
+    }
+    if (commands & ~(1 << kDisplayCommandStatusBar)) {
+        OnContentChanged();
+    }
+}
+
+/*
+ * {
+ *   "status": { "posted": 12, "applied": 9, "max_latency_us": 35210, "avg_latency_us": 14020 },
+ *   "notification": { ... }, "emotion": { ... }, "icon": { ... }, "chat_message": { ... }, "status_bar": { ... }
+ * }
+ */
+std::string Display::GetCommandStatsJson() {
+    static const char* const names[kDisplayCommandCount] = {
+        "status", "notification", "emotion", "icon", "chat_message", "status_bar"
+    };
+
+    std::string json;
+    JsonWriter writer(json);
+    writer.BeginObject();
+    {
+        std::lock_guard<std::mutex> lock(command_mutex_);
+        for (int i = 0; i < kDisplayCommandCount; i++) {
+            auto& stats = command_stats_[i];
+            writer.Key(names[i]).BeginObject();
+            writer.Member("posted", stats.posted);
+            writer.Member("applied", stats.applied);
+            writer.Member("max_latency_us", stats.max_latency_us);
+            writer.Member("avg_latency_us", stats.applied > 0 ? stats.total_latency_us / stats.applied : 0);
+            writer.EndObject();
+        }
+    }
+    // Not under the command mutex, the LVGL task takes it while holding the display lock
+    WriteStatsJson(writer);
+    writer.EndObject();
+    return json;
+}
+
+void Display::SetStatus(const char* status) {
+    PostCommand(kDisplayCommandStatus, [&]() {
+        pending_status_ = status;
+        notification_after_status_ = false;
+    });
 }
 
 void Display::ShowNotification(const std::string &notification, int duration_ms) {
@@ -76,44 +219,91 @@ void Display::ShowNotification(const std::string &notification, int duration_ms)
 }
 
 void Display::ShowNotification(const char* notification, int duration_ms) {
-    DisplayLockGuard lock(this);
-    if (notification_label_ == nullptr) {
-        return;
-    }
-    lv_label_set_text(notification_label_, notification);
-    lv_obj_clear_flag(notification_label_, LV_OBJ_FLAG_HIDDEN);
-    lv_obj_add_flag(status_label_, LV_OBJ_FLAG_HIDDEN);
+    PostCommand(kDisplayCommandNotification, [&]() {
+        pending_notification_ = notification;
+        pending_notification_duration_ = duration_ms;
+        notification_after_status_ = true;
+    });
+}
 
-    esp_timer_stop(notification_timer_);
-    ESP_ERROR_CHECK(esp_timer_start_once(notification_timer_, duration_ms * 1000));
+void Display::SetEmotion(const char* emotion) {
+    PostCommand(kDisplayCommandEmotion, [&]() {
+        pending_emotion_ = emotion;
+        pending_commands_ &= ~(1 << kDisplayCommandIcon);
+    });
+}
+
+void Display::SetIcon(const char* icon) {
+    PostCommand(kDisplayCommandIcon, [&]() {
+        pending_emotion_ = icon;
+        pending_commands_ &= ~(1 << kDisplayCommandEmotion);
+    });
+}
+
+void Display::SetChatMessage(const char* role, const char* content) {
+    PostChatMessage(role, content, false);
+}
+
+void Display::AppendChatMessage(const char* role, const char* content) {
+    PostChatMessage(role, content, true);
+}
+
+void Display::PostChatMessage(const char* role, const char* content, bool append) {
+    PostCommand(kDisplayCommandChatMessage, [&]() {
+        if (!pending_chat_messages_.empty()) {
+            auto& last = pending_chat_messages_.back();
+            if (!append && strcmp(role, "system") == 0 && last.role == "system") {
+                last.content = content;
+                return;
+            }
+            // Sentences that arrive within a frame are joined before they are drawn
+            if (append && last.role == role) {
+                if (NeedsSeparator(last.content.data(), last.content.size(), content)) {
+                    last.content += ' ';
+                }
+                last.content += content;
+                return;
+            }
+        }
+        if (pending_chat_messages_.size() >= DISPLAY_MAX_PENDING_MESSAGES) {
+            pending_chat_messages_.pop_front();
+        }
+        pending_chat_messages_.push_back({role, content, append, esp_timer_get_time()});
+    });
+}
+
+bool Display::NeedsSeparator(const char* text, size_t length, const char* sentence) {
+    if (length == 0 || sentence[0] == '\0') {
+        return false;
+    }
+    // CJK text is joined without spaces, only ASCII words are separated
+    unsigned char last = text[length - 1];
+    unsigned char first = sentence[0];
+    return last < 0x80 && !isspace(last) && first < 0x80 && !isspace(first);
 }
 
 void Display::UpdateStatusBar(bool update_all) {
     auto& board = Board::GetInstance();
     auto codec = board.GetAudioCodec();
 
-    {
-        DisplayLockGuard lock(this);
-        if (mute_label_ == nullptr) {
-            return;
-        }
-
-        // 如果静音状态改变，则更新图标
-        if (codec->output_volume() == 0 && !muted_) {
-            muted_ = true;
-            lv_label_set_text(mute_label_, FONT_AWESOME_VOLUME_MUTE);
-        } else if (codec->output_volume() > 0 && muted_) {
-            muted_ = false;
-            lv_label_set_text(mute_label_, "");
-        }
+    // 如果静音状态改变，则更新图标
+    const char* mute_icon = nullptr;
+    if (codec->output_volume() == 0 && !muted_) {
+        muted_ = true;
+        mute_icon = FONT_AWESOME_VOLUME_MUTE;
+    } else if (codec->output_volume() > 0 && muted_) {
+        muted_ = false;
+        mute_icon = "";
     }
 
     esp_pm_lock_acquire(pm_lock_);
     // 更新电池图标
     int battery_level;
     bool charging, discharging;
-    const char* icon = nullptr;
+    const char* battery_icon = nullptr;
+    bool low_battery = low_battery_;
     if (board.GetBatteryLevel(battery_level, charging, discharging)) {
+        const char* icon;
         if (charging) {
             icon = FONT_AWESOME_BATTERY_CHARGING;
         } else {
@@ -127,29 +317,21 @@ void Display::UpdateStatusBar(bool update_all) {
             };
             icon = levels[battery_level / 20];
         }
-        DisplayLockGuard lock(this);
-        if (battery_label_ != nullptr && battery_icon_ != icon) {
+        if (battery_icon_ != icon) {
             battery_icon_ = icon;
-            lv_label_set_text(battery_label_, battery_icon_);
+            battery_icon = icon;
         }
 
-        if (low_battery_popup_ != nullptr) {
-            if (strcmp(icon, FONT_AWESOME_BATTERY_EMPTY) == 0 && discharging) {
-                if (lv_obj_has_flag(low_battery_popup_, LV_OBJ_FLAG_HIDDEN)) { // 如果低电量提示框隐藏，则显示
-                    lv_obj_clear_flag(low_battery_popup_, LV_OBJ_FLAG_HIDDEN);
-                    auto& app = Application::GetInstance();
-                    app.PlaySound(Lang::Sounds::P3_LOW_BATTERY);
-                }
-            } else {
-                // Hide the low battery popup when the battery is not empty
-                if (!lv_obj_has_flag(low_battery_popup_, LV_OBJ_FLAG_HIDDEN)) { // 如果低电量提示框显示，则隐藏
-                    lv_obj_add_flag(low_battery_popup_, LV_OBJ_FLAG_HIDDEN);
-                }
-            }
+        // 低电量时显示提示框并播放提示音
+        low_battery = strcmp(icon, FONT_AWESOME_BATTERY_EMPTY) == 0 && discharging;
+        if (low_battery && !low_battery_ && low_battery_popup_ != nullptr) {
+            auto& app = Application::GetInstance();
+            app.PlaySound(Lang::Sounds::P3_LOW_BATTERY);
         }
     }
 
     // 每 10 秒更新一次网络图标
+    const char* network_icon = nullptr;
     static int seconds_counter = 0;
     if (update_all || seconds_counter++ % 10 == 0) {
         // 升级固件时，不读取 4G 网络状态，避免占用 UART 资源
@@ -162,20 +344,78 @@ void Display::UpdateStatusBar(bool update_all) {
             kDeviceStateActivating,
         };
         if (std::find(allowed_states.begin(), allowed_states.end(), device_state) != allowed_states.end()) {
-            icon = board.GetNetworkStateIcon();
-            if (network_label_ != nullptr && icon != nullptr && network_icon_ != icon) {
-                DisplayLockGuard lock(this);
+            auto icon = board.GetNetworkStateIcon();
+            if (icon != nullptr && network_icon_ != icon) {
                 network_icon_ = icon;
-                lv_label_set_text(network_label_, network_icon_);
+                network_icon = icon;
             }
         }
     }
 
     esp_pm_lock_release(pm_lock_);
+
+    if (mute_icon == nullptr && battery_icon == nullptr && network_icon == nullptr && low_battery == low_battery_) {
+        return;
+    }
+    low_battery_ = low_battery;
+    PostCommand(kDisplayCommandStatusBar, [&]() {
+        if (mute_icon != nullptr) {
+            pending_mute_icon_ = mute_icon;
+        }
+        if (battery_icon != nullptr) {
+            pending_battery_icon_ = battery_icon;
+        }
+        if (network_icon != nullptr) {
+            pending_network_icon_ = network_icon;
+        }
+        pending_low_battery_ = low_battery;
+    });
 }
 
+void Display::ApplyStatus(const char* status) {
+    DisplayLockGuard lock(this);
+    if (status_label_ == nullptr) {
+        return;
+    }
+    lv_label_set_text(status_label_, status);
+    lv_obj_clear_flag(status_label_, LV_OBJ_FLAG_HIDDEN);
+    lv_obj_add_flag(notification_label_, LV_OBJ_FLAG_HIDDEN);
+}
 
-void Display::SetEmotion(const char* emotion) {
+void Display::ApplyNotification(const char* notification, int duration_ms) {
+    DisplayLockGuard lock(this);
+    if (notification_label_ == nullptr) {
+        return;
+    }
+    lv_label_set_text(notification_label_, notification);
+    lv_obj_clear_flag(notification_label_, LV_OBJ_FLAG_HIDDEN);
+    lv_obj_add_flag(status_label_, LV_OBJ_FLAG_HIDDEN);
+
+    esp_timer_stop(notification_timer_);
+    ESP_ERROR_CHECK(esp_timer_start_once(notification_timer_, duration_ms * 1000));
+}
+
+void Display::ApplyStatusBar(const char* mute_icon, const char* battery_icon, const char* network_icon, bool low_battery) {
+    DisplayLockGuard lock(this);
+    if (mute_icon != nullptr && mute_label_ != nullptr) {
+        lv_label_set_text(mute_label_, mute_icon);
+    }
+    if (battery_icon != nullptr && battery_label_ != nullptr) {
+        lv_label_set_text(battery_label_, battery_icon);
+    }
+    if (network_icon != nullptr && network_label_ != nullptr) {
+        lv_label_set_text(network_label_, network_icon);
+    }
+    if (low_battery_popup_ != nullptr) {
+        if (low_battery) {
+            lv_obj_clear_flag(low_battery_popup_, LV_OBJ_FLAG_HIDDEN);
+        } else {
+            lv_obj_add_flag(low_battery_popup_, LV_OBJ_FLAG_HIDDEN);
+        }
+    }
+}
+
+void Display::ApplyEmotion(const char* emotion) {
     struct Emotion {
         const char* icon;
         const char* text;
@@ -223,7 +463,7 @@ void Display::SetEmotion(const char* emotion) {
     }
 }
 
-void Display::SetIcon(const char* icon) {
+void Display::ApplyIcon(const char* icon) {
     DisplayLockGuard lock(this);
     if (emotion_label_ == nullptr) {
         return;
@@ -231,11 +471,15 @@ void Display::SetIcon(const char* icon) {
     lv_label_set_text(emotion_label_, icon);
 }
 
-void Display::SetPreviewImage(const lv_img_dsc_t* image) {
+void Display::SetPreviewImage(std::shared_ptr<PreviewImage> image) {
     // Do nothing
 }
 
-void Display::SetChatMessage(const char* role, const char* content) {
+void Display::ApplyAppendChatMessage(const char* role, const char* content) {
+    ApplyChatMessage(role, content);
+}
+
+void Display::ApplyChatMessage(const char* role, const char* content) {
     DisplayLockGuard lock(this);
     if (chat_message_label_ == nullptr) {
         return;
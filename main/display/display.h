@@ -7,6 +7,15 @@
 #include <esp_pm.h>
 
 #include <string>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+#include "preview_image.h"
+
+class JsonWriter;
 
 struct DisplayFonts {
     const lv_font_t* text_font = nullptr;
@@ -14,21 +23,46 @@ struct DisplayFonts {
     const lv_font_t* emoji_font = nullptr;
 };
 
+// Updates posted to the display, applied later by the LVGL task
+enum DisplayCommand {
+    kDisplayCommandStatus,
+    kDisplayCommandNotification,
+    kDisplayCommandEmotion,
+    kDisplayCommandIcon,
+    kDisplayCommandChatMessage,
+    kDisplayCommandStatusBar,
+    kDisplayCommandCount
+};
+
+struct DisplayCommandStats {
+    uint32_t posted = 0;
+    uint32_t applied = 0;       // The others were superseded before they were applied
+    uint32_t max_latency_us = 0;
+    uint64_t total_latency_us = 0;
+};
+
 class Display {
 public:
     Display();
     virtual ~Display();
 
-    virtual void SetStatus(const char* status);
-    virtual void ShowNotification(const char* notification, int duration_ms = 3000);
-    virtual void ShowNotification(const std::string &notification, int duration_ms = 3000);
-    virtual void SetEmotion(const char* emotion);
-    virtual void SetChatMessage(const char* role, const char* content);
-    virtual void SetIcon(const char* icon);
-    virtual void SetPreviewImage(const lv_img_dsc_t* image);
+    // These only post the update and return, see ProcessCommands()
+    void SetStatus(const char* status);
+    void ShowNotification(const char* notification, int duration_ms = 3000);
+    void ShowNotification(const std::string &notification, int duration_ms = 3000);
+    void SetEmotion(const char* emotion);
+    void SetChatMessage(const char* role, const char* content);
+    // Continue the last message if it has the same role, e.g. the sentences of one answer
+    void AppendChatMessage(const char* role, const char* content);
+    void SetIcon(const char* icon);
+    void UpdateStatusBar(bool update_all = false);
+
+    // The display keeps a reference to the image while it is shown, nullptr hides the preview
+    virtual void SetPreviewImage(std::shared_ptr<PreviewImage> image);
     virtual void SetTheme(const std::string& theme_name);
     virtual std::string GetTheme() { return current_theme_name_; }
-    virtual void UpdateStatusBar(bool update_all = false);
+
+    std::string GetCommandStatsJson();
 
     inline int width() const { return width_; }
     inline int height() const { return height_; }
@@ -50,9 +84,11 @@ protected:
     lv_obj_t* low_battery_popup_ = nullptr;
     lv_obj_t* low_battery_label_ = nullptr;
     
+    // Status bar state as last posted by UpdateStatusBar
     const char* battery_icon_ = nullptr;
     const char* network_icon_ = nullptr;
     bool muted_ = false;
+    bool low_battery_ = false;
     std::string current_theme_name_;
 
     esp_timer_handle_t notification_timer_ = nullptr;
@@ -60,6 +96,57 @@ protected:
     friend class DisplayLockGuard;
     virtual bool Lock(int timeout_ms = 0) = 0;
     virtual void Unlock() = 0;
+
+    // Called with the posted updates, override these to change how they are shown
+    virtual void ApplyStatus(const char* status);
+    virtual void ApplyNotification(const char* notification, int duration_ms);
+    virtual void ApplyEmotion(const char* emotion);
+    virtual void ApplyIcon(const char* icon);
+    virtual void ApplyChatMessage(const char* role, const char* content);
+    // Shows the text as a new message unless overridden
+    virtual void ApplyAppendChatMessage(const char* role, const char* content);
+    virtual void ApplyStatusBar(const char* mute_icon, const char* battery_icon, const char* network_icon, bool low_battery);
+    // Called after updates other than the status bar were applied
+    virtual void OnContentChanged() {}
+
+    // Add members to the GetCommandStatsJson() result
+    virtual void WriteStatsJson(JsonWriter& writer) {}
+
+    // Call after the UI is set up to apply the posted updates from the LVGL task once per frame,
+    // until then they are applied by the caller
+    void StartCommandTimer();
+    void ProcessCommands();
+
+    // True if a space is needed to join the sentence to the text, e.g. between two English sentences
+    static bool NeedsSeparator(const char* text, size_t length, const char* sentence);
+
+private:
+    struct ChatMessage {
+        std::string role;
+        std::string content;
+        bool append;
+        int64_t posted_time;
+    };
+
+    std::mutex command_mutex_;
+    lv_timer_t* command_timer_ = nullptr;
+    std::atomic<uint32_t> pending_commands_ = 0;    // One bit per DisplayCommand
+    int64_t posted_time_[kDisplayCommandCount] = {};
+    std::string pending_status_;
+    std::string pending_notification_;
+    int pending_notification_duration_ = 0;
+    bool notification_after_status_ = false;
+    std::string pending_emotion_;       // Emotion or icon, whichever was posted last
+    std::deque<ChatMessage> pending_chat_messages_;
+    const char* pending_mute_icon_ = nullptr;   // nullptr if unchanged, same for the other icons
+    const char* pending_battery_icon_ = nullptr;
+    const char* pending_network_icon_ = nullptr;
+    bool pending_low_battery_ = false;
+    DisplayCommandStats command_stats_[kDisplayCommandCount];
+
+    void PostCommand(DisplayCommand command, std::function<void()> update);
+    void PostChatMessage(const char* role, const char* content, bool append);
+    void RecordApplied(DisplayCommand command, int64_t posted_time);
 };
 
 
@@ -0,0 +1,122 @@
+#include "glyph_cache.h"
+#include "json_writer.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+
+#include <cstring>
+
+#define TAG "GlyphCache"
+
+static void* AllocateBuffer(size_t size) {
+    auto buffer = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (buffer == nullptr) {
+        buffer = heap_caps_malloc(size, MALLOC_CAP_8BIT);
+    }
+    return buffer;
+}
+
+GlyphCache::GlyphCache(const lv_font_t* font, size_t capacity)
+    : base_(font), font_(*font), capacity_(capacity) {
+    font_.get_glyph_bitmap = GetGlyphBitmap;
+    font_.user_data = this;
+    ESP_LOGI(TAG, "Caching up to %u KB of glyphs", capacity_ / 1024);
+}
+
+GlyphCache::~GlyphCache() {
+    for (auto& glyph : glyphs_) {
+        heap_caps_free(glyph.buffer.data);
+    }
+}
+
+const void* GlyphCache::GetGlyphBitmap(lv_font_glyph_dsc_t* dsc, lv_draw_buf_t* draw_buf) {
+    auto cache = static_cast<GlyphCache*>(dsc->resolved_font->user_data);
+    return cache->Lookup(dsc, draw_buf);
+}
+
+// Called from the LVGL task only, like the rest of the rendering
+const void* GlyphCache::Lookup(lv_font_glyph_dsc_t* dsc, lv_draw_buf_t* draw_buf) {
+    auto it = index_.find(dsc->gid.index);
+    if (it != index_.end()) {
+        hits_++;
+        glyphs_.splice(glyphs_.begin(), glyphs_, it->second);
+        return &it->second->buffer;
+    }
+
+    misses_++;
+    auto bitmap = base_->get_glyph_bitmap(dsc, draw_buf);
+    // Only glyphs unpacked into the draw buffer are kept, raw bitmaps are already in flash
+    if (bitmap != draw_buf || draw_buf == nullptr) {
+        return bitmap;
+    }
+    size_t size = draw_buf->header.stride * draw_buf->header.h;
+    if (size == 0 || size > capacity_ / 16) {
+        return bitmap;
+    }
+
+    Evict(size);
+    auto data = static_cast<uint8_t*>(AllocateBuffer(size));
+    if (data == nullptr) {
+        return bitmap;
+    }
+    memcpy(data, draw_buf->data, size);
+
+    Glyph glyph = { dsc->gid.index, *draw_buf };
+    glyph.buffer.data = data;
+    glyph.buffer.unaligned_data = data;
+    glyph.buffer.data_size = size;
+    glyphs_.push_front(glyph);
+    index_[glyph.index] = glyphs_.begin();
+    size_ += size;
+    return &glyphs_.front().buffer;
+}
+
+void GlyphCache::Evict(size_t size) {
+    while (!glyphs_.empty() && size_ + size > capacity_) {
+        auto& glyph = glyphs_.back();
+        size_ -= glyph.buffer.data_size;
+        heap_caps_free(glyph.buffer.data);
+        index_.erase(glyph.index);
+        glyphs_.pop_back();
+    }
+}
+
+lv_coord_t GlyphCache::GetTextWidth(const char* text) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    uint32_t length = 0;
+    for (auto p = text; *p; p++, length++) {
+        hash = (hash ^ (uint8_t)*p) * 16777619u;
+    }
+
+    for (auto& entry : text_widths_) {
+        if (entry.hash == hash && entry.length == length) {
+            width_hits_++;
+            return entry.width;
+        }
+    }
+
+    width_misses_++;
+    auto& entry = text_widths_[next_text_width_];
+    next_text_width_ = (next_text_width_ + 1) % kTextWidthCount;
+    entry.hash = hash;
+    entry.length = length;
+    entry.width = lv_txt_get_width(text, length, &font_, 0);
+    return entry.width;
+}
+
+/*
+ * "glyph_cache": { "glyphs": 214, "size": 30208, "capacity": 98304, "hits": 5120, "misses": 230,
+ *                  "width_hits": 48, "width_misses": 61 }
+ */
+void GlyphCache::WriteStatsJson(JsonWriter& writer) {
+    writer.Key("glyph_cache").BeginObject();
+    writer.Member("glyphs", glyphs_.size());
+    writer.Member("size", size_);
+    writer.Member("capacity", capacity_);
+    writer.Member("hits", hits_);
+    writer.Member("misses", misses_);
+    writer.Member("width_hits", width_hits_);
+    writer.Member("width_misses", width_misses_);
+    writer.EndObject();
+}
@@ -0,0 +1,66 @@
+#ifndef GLYPH_CACHE_H
+#define GLYPH_CACHE_H
+
+#include <lvgl.h>
+
+#include <list>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+
+class JsonWriter;
+
+/*
+ * Wraps a bitmap font and keeps the glyph bitmaps LVGL unpacks from it, in PSRAM when
+ * available. A glyph drawn again, e.g. the CJK characters of the status texts, is then
+ * copied from the cache instead of being unpacked from the font in flash. Glyphs are
+ * dropped in least recently used order once `capacity` bytes are used.
+ *
+ * Give font() to LVGL instead of the original font. Glyphs of its fallback fonts are
+ * not cached.
+ */
+class GlyphCache {
+public:
+    GlyphCache(const lv_font_t* font, size_t capacity);
+    ~GlyphCache();
+
+    const lv_font_t* font() const { return &font_; }
+
+    // Width of a single line of text, recurring texts are only measured once
+    lv_coord_t GetTextWidth(const char* text);
+
+    void WriteStatsJson(JsonWriter& writer);
+
+private:
+    struct Glyph {
+        uint32_t index;
+        lv_draw_buf_t buffer;
+    };
+
+    struct TextWidth {
+        uint32_t hash = 0;
+        uint32_t length = 0;
+        lv_coord_t width = 0;
+    };
+
+    const lv_font_t* base_;
+    lv_font_t font_;
+    size_t capacity_;
+    size_t size_ = 0;
+    std::list<Glyph> glyphs_;   // Most recently used first
+    std::unordered_map<uint32_t, std::list<Glyph>::iterator> index_;
+    uint32_t hits_ = 0;
+    uint32_t misses_ = 0;
+
+    static constexpr int kTextWidthCount = 32;
+    TextWidth text_widths_[kTextWidthCount];
+    int next_text_width_ = 0;
+    uint32_t width_hits_ = 0;
+    uint32_t width_misses_ = 0;
+
+    static const void* GetGlyphBitmap(lv_font_glyph_dsc_t* dsc, lv_draw_buf_t* draw_buf);
+    const void* Lookup(lv_font_glyph_dsc_t* dsc, lv_draw_buf_t* draw_buf);
+    void Evict(size_t size);
+};
+
+#endif // GLYPH_CACHE_H
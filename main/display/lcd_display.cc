@@ -12,9 +12,14 @@
 #include "settings.h"
 
 #include "board.h"
+#include "asset_partition.h"
 
 #define TAG "LcdDisplay"
 
+#ifndef CONFIG_EMOJI_FRAME_CACHE_KB
+#define CONFIG_EMOJI_FRAME_CACHE_KB 0
+#endif
+
 // Color definitions for dark theme
 #define DARK_BACKGROUND_COLOR       lv_color_hex(0x121212)     // Dark background
 #define DARK_TEXT_COLOR             lv_color_white()           // White text
@@ -65,6 +70,28 @@ const ThemeColors LIGHT_THEME = {
 };
 
 
+#ifndef CONFIG_GLYPH_CACHE_SIZE_KB
+#define CONFIG_GLYPH_CACHE_SIZE_KB 0
+#endif
+
+#ifndef CONFIG_LCD_DRAW_BUFFER_LINES
+#define CONFIG_LCD_DRAW_BUFFER_LINES 20
+#endif
+
+#ifndef CONFIG_LCD_IDLE_FPS
+#define CONFIG_LCD_IDLE_FPS 0
+#endif
+
+#ifndef CONFIG_LCD_IDLE_TIMEOUT_MS
+#define CONFIG_LCD_IDLE_TIMEOUT_MS 5000
+#endif
+
+#if CONFIG_LCD_DOUBLE_BUFFER
+#define LCD_DOUBLE_BUFFER true
+#else
+#define LCD_DOUBLE_BUFFER false
+#endif
+
 LV_FONT_DECLARE(font_awesome_30_4);
 
 LcdDisplay::LcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_handle_t panel, DisplayFonts fonts, int width, int height)
@@ -72,6 +99,11 @@ LcdDisplay::LcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_handle_
     width_ = width;
     height_ = height;
 
+    if (CONFIG_GLYPH_CACHE_SIZE_KB > 0 && fonts_.text_font != nullptr) {
+        glyph_cache_ = std::make_unique<GlyphCache>(fonts_.text_font, CONFIG_GLYPH_CACHE_SIZE_KB * 1024);
+        fonts_.text_font = glyph_cache_->font();
+    }
+
     // Load theme from settings
     Settings settings("display", false);
     current_theme_name_ = settings.GetString("theme", "light");
@@ -113,8 +145,8 @@ SpiLcdDisplay::SpiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_h
         .io_handle = panel_io_,
         .panel_handle = panel_,
         .control_handle = nullptr,
-        .buffer_size = static_cast<uint32_t>(width_ * 20),
-        .double_buffer = false,
+        .buffer_size = static_cast<uint32_t>(width_ * CONFIG_LCD_DRAW_BUFFER_LINES),
+        .double_buffer = LCD_DOUBLE_BUFFER,
         .trans_size = 0,
         .hres = static_cast<uint32_t>(width_),
         .vres = static_cast<uint32_t>(height_),
@@ -145,6 +177,7 @@ SpiLcdDisplay::SpiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_h
         lv_display_set_offset(display_, offset_x, offset_y);
     }
 
+    SetupRefreshPolicy();
     SetupUI();
 }
 
@@ -174,7 +207,7 @@ RgbLcdDisplay::RgbLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_h
     const lvgl_port_display_cfg_t display_cfg = {
         .io_handle = panel_io_,
         .panel_handle = panel_,
-        .buffer_size = static_cast<uint32_t>(width_ * 20),
+        .buffer_size = static_cast<uint32_t>(width_ * CONFIG_LCD_DRAW_BUFFER_LINES),
         .double_buffer = true,
         .hres = static_cast<uint32_t>(width_),
         .vres = static_cast<uint32_t>(height_),
@@ -205,7 +238,7 @@ RgbLcdDisplay::RgbLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_h
     // ESP_LOGI(TAG, "buffer_size: %d", width_ * height_ * sizeof(lv_color16_t) / 16);
 
     lvgl_port_display_cfg_t jc8048w550_cfg = display_cfg;
-    jc8048w550_cfg.buffer_size = static_cast<uint32_t>(width_ * 20);
+    jc8048w550_cfg.buffer_size = static_cast<uint32_t>(width_ * CONFIG_LCD_DRAW_BUFFER_LINES);
     jc8048w550_cfg.color_format = LV_COLOR_FORMAT_RGB565;
     jc8048w550_cfg.flags.buff_spiram = 1;
     jc8048w550_cfg.flags.buff_dma = 0;
@@ -232,6 +265,7 @@ RgbLcdDisplay::RgbLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_h
         lv_display_set_offset(display_, offset_x, offset_y);
     }
 
+    SetupRefreshPolicy();
     SetupUI();
 }
 
@@ -257,7 +291,7 @@ MipiLcdDisplay::MipiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel
             .io_handle = panel_io,
             .panel_handle = panel,
             .control_handle = nullptr,
-            .buffer_size = static_cast<uint32_t>(width_ * 50),
+            .buffer_size = static_cast<uint32_t>(width_ * CONFIG_LCD_DRAW_BUFFER_LINES),
             .double_buffer = false,
             .hres = static_cast<uint32_t>(width_),
             .vres = static_cast<uint32_t>(height_),
@@ -290,10 +324,14 @@ MipiLcdDisplay::MipiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel
         lv_display_set_offset(display_, offset_x, offset_y);
     }
 
+    SetupRefreshPolicy();
     SetupUI();
 }
 
 LcdDisplay::~LcdDisplay() {
+    refresh_policy_.reset();
+    // The sprite player deletes its own image, before the parent is deleted
+    sprite_player_.reset();
     // 然后再清理 LVGL 对象
     if (content_ != nullptr) {
         lv_obj_del(content_);
@@ -307,6 +345,15 @@ LcdDisplay::~LcdDisplay() {
     if (container_ != nullptr) {
         lv_obj_del(container_);
     }
+#if CONFIG_USE_WECHAT_MESSAGE_STYLE
+    if (!chat_bubbles_.empty()) {
+        lv_style_reset(&bubble_style_);
+        lv_style_reset(&bubble_row_style_);
+        lv_style_reset(&user_bubble_style_);
+        lv_style_reset(&assistant_bubble_style_);
+        lv_style_reset(&system_bubble_style_);
+    }
+#endif
     if (display_ != nullptr) {
         lv_display_delete(display_);
     }
@@ -319,6 +366,52 @@ LcdDisplay::~LcdDisplay() {
     }
 }
 
+void LcdDisplay::SetupRefreshPolicy() {
+    DisplayLockGuard lock(this);
+    uint32_t idle_period_ms = CONFIG_LCD_IDLE_FPS > 0 ? 1000 / CONFIG_LCD_IDLE_FPS : 0;
+    refresh_policy_ = std::make_unique<RefreshPolicy>(display_, idle_period_ms, CONFIG_LCD_IDLE_TIMEOUT_MS);
+}
+
+void LcdDisplay::OnContentChanged() {
+    if (refresh_policy_) {
+        DisplayLockGuard lock(this);
+        refresh_policy_->MarkActive();
+    }
+}
+
+void LcdDisplay::WriteStatsJson(JsonWriter& writer) {
+    DisplayLockGuard lock(this);
+    if (glyph_cache_) {
+        glyph_cache_->WriteStatsJson(writer);
+    }
+    if (refresh_policy_) {
+        refresh_policy_->WriteStatsJson(writer);
+    }
+    if (sprite_player_) {
+        sprite_player_->WriteStatsJson(writer);
+    }
+}
+
+bool LcdDisplay::SetupEmotionSprites(lv_obj_t* parent, const char* neutral_sprite) {
+    auto& assets = AssetPartition::GetInstance();
+    auto neutral = assets.Initialize() ? assets.Find(neutral_sprite) : std::string_view();
+    if (neutral.empty()) {
+        return false;
+    }
+    sprite_player_ = std::make_unique<SpritePlayer>(parent, CONFIG_EMOJI_FRAME_CACHE_KB * 1024);
+    neutral_sprite_ = neutral_sprite;
+    return sprite_player_->Play(neutral);
+}
+
+void LcdDisplay::PlayEmotionSprite(const char* sprite) {
+    auto& assets = AssetPartition::GetInstance();
+    auto data = assets.Find(sprite);
+    if (data.empty()) {
+        data = assets.Find(neutral_sprite_);
+    }
+    sprite_player_->Play(data);
+}
+
 bool LcdDisplay::Lock(int timeout_ms) {
     return lvgl_port_lock(timeout_ms);
 }
@@ -371,8 +464,10 @@ void LcdDisplay::SetupUI() {
     lv_obj_set_flex_align(content_, LV_FLEX_ALIGN_START, LV_FLEX_ALIGN_START, LV_FLEX_ALIGN_START);
     lv_obj_set_style_pad_row(content_, 10, 0); // Space between messages
 
-    // We'll create chat messages dynamically in SetChatMessage
+    // Chat messages reuse a fixed set of bubbles with shared styles
     chat_message_label_ = nullptr;
+    SetupBubbleStyles();
+    CreateChatBubbles();
 
     /* Status bar */
     lv_obj_set_flex_flow(status_bar_, LV_FLEX_FLOW_ROW);
@@ -436,212 +531,222 @@ void LcdDisplay::SetupUI() {
     lv_obj_set_style_text_color(low_battery_label_, lv_color_white(), 0);
     lv_obj_center(low_battery_label_);
     lv_obj_add_flag(low_battery_popup_, LV_OBJ_FLAG_HIDDEN);
+
+    StartCommandTimer();
+}
+
+void LcdDisplay::SetupBubbleStyles() {
+    lv_style_init(&bubble_style_);
+    lv_style_set_radius(&bubble_style_, 8);
+    lv_style_set_border_width(&bubble_style_, 1);
+    lv_style_set_pad_all(&bubble_style_, 8);
+
+    lv_style_init(&bubble_row_style_);
+    lv_style_set_bg_opa(&bubble_row_style_, LV_OPA_TRANSP);
+    lv_style_set_border_width(&bubble_row_style_, 0);
+    lv_style_set_pad_all(&bubble_row_style_, 0);
+
+    lv_style_init(&user_bubble_style_);
+    lv_style_init(&assistant_bubble_style_);
+    lv_style_init(&system_bubble_style_);
+    UpdateBubbleStyles();
+}
+
+// Theme colors live in the shared styles, the bubbles follow them without being touched
+void LcdDisplay::UpdateBubbleStyles() {
+    lv_style_set_border_color(&bubble_style_, current_theme_.border);
+    lv_style_set_bg_color(&user_bubble_style_, current_theme_.user_bubble);
+    lv_style_set_text_color(&user_bubble_style_, current_theme_.text);
+    lv_style_set_bg_color(&assistant_bubble_style_, current_theme_.assistant_bubble);
+    lv_style_set_text_color(&assistant_bubble_style_, current_theme_.text);
+    lv_style_set_bg_color(&system_bubble_style_, current_theme_.system_bubble);
+    lv_style_set_text_color(&system_bubble_style_, current_theme_.system_text);
+
+    lv_obj_report_style_change(&bubble_style_);
+    lv_obj_report_style_change(&user_bubble_style_);
+    lv_obj_report_style_change(&assistant_bubble_style_);
+    lv_obj_report_style_change(&system_bubble_style_);
+}
+
+lv_style_t* LcdDisplay::GetBubbleStyle(const char* role) {
+    if (strcmp(role, "user") == 0) {
+        return &user_bubble_style_;
+    } else if (strcmp(role, "system") == 0) {
+        return &system_bubble_style_;
+    }
+    return &assistant_bubble_style_;
 }
+
 #if CONFIG_IDF_TARGET_ESP32P4
 #define  MAX_MESSAGES 40
 #else
 #define  MAX_MESSAGES 20
 #endif
-void LcdDisplay::SetChatMessage(const char* role, const char* content) {
+// Appended text goes to a new bubble beyond this length, an append lays out and redraws the whole bubble
+#define MAX_BUBBLE_TEXT_LENGTH 512
+// 气泡宽度不超过屏幕宽度的85%
+#define MAX_BUBBLE_WIDTH (LV_HOR_RES * 85 / 100 - 16)
+
+/*
+ * The rows of the last MAX_MESSAGES messages are created once and recycled in ring
+ * order: a new message reuses the oldest row and moves it to the end. Rows scrolled
+ * out of view are not drawn, so the history only costs the memory of its widgets.
+ */
+void LcdDisplay::CreateChatBubbles() {
+    chat_bubbles_.resize(MAX_MESSAGES);
+    for (auto& entry : chat_bubbles_) {
+        entry.row = lv_obj_create(content_);
+        lv_obj_add_style(entry.row, &bubble_row_style_, 0);
+        lv_obj_set_width(entry.row, LV_HOR_RES);
+        lv_obj_set_height(entry.row, LV_SIZE_CONTENT);
+        lv_obj_remove_flag(entry.row, LV_OBJ_FLAG_SCROLLABLE);
+        lv_obj_add_flag(entry.row, LV_OBJ_FLAG_HIDDEN);
+
+        entry.bubble = lv_obj_create(entry.row);
+        lv_obj_add_style(entry.bubble, &bubble_style_, 0);
+        lv_obj_add_style(entry.bubble, &assistant_bubble_style_, 0);
+        lv_obj_set_size(entry.bubble, LV_SIZE_CONTENT, LV_SIZE_CONTENT);
+        lv_obj_set_scrollbar_mode(entry.bubble, LV_SCROLLBAR_MODE_OFF);
+        lv_obj_remove_flag(entry.bubble, LV_OBJ_FLAG_SCROLLABLE);
+        lv_obj_align(entry.bubble, LV_ALIGN_LEFT_MID, 0, 0);
+
+        entry.label = lv_label_create(entry.bubble);
+        lv_label_set_long_mode(entry.label, LV_LABEL_LONG_WRAP);
+        entry.role = "assistant";
+    }
+    ESP_LOGI(TAG, "Created %u chat bubbles", chat_bubbles_.size());
+}
+
+lv_coord_t LcdDisplay::GetBubbleWidth(const char* text) {
+    // 计算文本实际宽度
+    lv_coord_t text_width = glyph_cache_ ? glyph_cache_->GetTextWidth(text)
+        : lv_txt_get_width(text, strlen(text), fonts_.text_font, 0);
+
+    // 计算气泡宽度：不小于最小宽度，不超过屏幕宽度的85%
+    lv_coord_t max_width = MAX_BUBBLE_WIDTH;
+    lv_coord_t min_width = 20;
+    return std::clamp(text_width, min_width, max_width);
+}
+
+/*
+ * Adds the text to the end of the last bubble. LVGL lays out the whole label again and redraws
+ * the whole bubble on every append, which MAX_BUBBLE_TEXT_LENGTH keeps bounded: longer text goes
+ * to a new bubble. The joined text is measured until the bubble reaches its maximum width and
+ * the bubble only gets wider, so the lines already shown do not wrap differently. The view jumps
+ * without an animation, which would redraw the whole chat every frame.
+ */
+void LcdDisplay::ApplyAppendChatMessage(const char* role, const char* content) {
     DisplayLockGuard lock(this);
-    if (content_ == nullptr) {
+    if (content_ == nullptr || chat_bubbles_.empty() || strlen(content) == 0) {
+        return;
+    }
+
+    size_t pool_size = chat_bubbles_.size();
+    auto& last = chat_bubbles_[(chat_bubble_next_ + pool_size - 1) % pool_size];
+    size_t length = strlen(content);
+    if (chat_bubble_count_ == 0 || strcmp(last.role, role) != 0 ||
+        lv_obj_get_index(last.row) != (int32_t)lv_obj_get_child_cnt(content_) - 1 ||
+        last.length + length > MAX_BUBBLE_TEXT_LENGTH) {
+        ApplyChatMessage(role, content);
+        return;
+    }
+
+    if (NeedsSeparator(lv_label_get_text(last.label), last.length, content)) {
+        lv_label_ins_text(last.label, LV_LABEL_POS_LAST, " ");
+        last.length++;
+    }
+    lv_label_ins_text(last.label, LV_LABEL_POS_LAST, content);
+    last.length += length;
+
+    if (last.width < MAX_BUBBLE_WIDTH) {
+        lv_coord_t width = GetBubbleWidth(lv_label_get_text(last.label));
+        if (width > last.width) {
+            last.width = width;
+            lv_obj_set_width(last.label, width);
+        }
+    }
+
+    lv_obj_scroll_to_view_recursive(last.row, LV_ANIM_OFF);
+    chat_message_label_ = last.label;
+}
+
+void LcdDisplay::ApplyChatMessage(const char* role, const char* content) {
+    DisplayLockGuard lock(this);
+    if (content_ == nullptr || chat_bubbles_.empty()) {
         return;
     }
     
     //避免出现空的消息框
     if(strlen(content) == 0) return;
-    
-    // 检查消息数量是否超过限制
-    uint32_t child_count = lv_obj_get_child_cnt(content_);
-    if (child_count >= MAX_MESSAGES) {
-        // 删除最早的消息（第一个子对象）
-        lv_obj_t* first_child = lv_obj_get_child(content_, 0);
-        lv_obj_t* last_child = lv_obj_get_child(content_, child_count - 1);
-        if (first_child != nullptr) {
-            lv_obj_del(first_child);
-        }
-        // Scroll to the last message immediately
-        if (last_child != nullptr) {
-            lv_obj_scroll_to_view_recursive(last_child, LV_ANIM_OFF);
+
+    ChatBubble* entry = nullptr;
+    size_t pool_size = chat_bubbles_.size();
+    // 折叠系统消息（如果是系统消息，且最后一个消息也是系统消息，则直接替换它）
+    if (strcmp(role, "system") == 0 && chat_bubble_count_ > 0) {
+        auto& last = chat_bubbles_[(chat_bubble_next_ + pool_size - 1) % pool_size];
+        if (strcmp(last.role, "system") == 0 && lv_obj_get_index(last.row) == (int32_t)lv_obj_get_child_cnt(content_) - 1) {
+            entry = &last;
         }
     }
-    
-    // 折叠系统消息（如果是系统消息，检查最后一个消息是否也是系统消息）
-    if (strcmp(role, "system") == 0 && child_count > 0) {
-        // 获取最后一个消息容器
-        lv_obj_t* last_container = lv_obj_get_child(content_, child_count - 1);
-        if (last_container != nullptr && lv_obj_get_child_cnt(last_container) > 0) {
-            // 获取容器内的气泡
-            lv_obj_t* last_bubble = lv_obj_get_child(last_container, 0);
-            if (last_bubble != nullptr) {
-                // 检查气泡类型是否为系统消息
-                void* bubble_type_ptr = lv_obj_get_user_data(last_bubble);
-                if (bubble_type_ptr != nullptr && strcmp((const char*)bubble_type_ptr, "system") == 0) {
-                    // 如果最后一个消息也是系统消息，则删除它
-                    lv_obj_del(last_container);
-                }
+
+    bool recycled = false;
+    if (entry == nullptr) {
+        entry = &chat_bubbles_[chat_bubble_next_];
+        chat_bubble_next_ = (chat_bubble_next_ + 1) % pool_size;
+        if (chat_bubble_count_ < pool_size) {
+            chat_bubble_count_++;
+            lv_obj_remove_flag(entry->row, LV_OBJ_FLAG_HIDDEN);
+        } else {
+            // The oldest row is the first one, preview images in front of it go with it
+            while (lv_obj_get_index(entry->row) > 0) {
+                lv_obj_delete(lv_obj_get_child(content_, 0));
             }
+            recycled = true;
         }
-    }
-    
-    // Create a message bubble
-    lv_obj_t* msg_bubble = lv_obj_create(content_);
-    lv_obj_set_style_radius(msg_bubble, 8, 0);
-    lv_obj_set_scrollbar_mode(msg_bubble, LV_SCROLLBAR_MODE_OFF);
-    lv_obj_set_style_border_width(msg_bubble, 1, 0);
-    lv_obj_set_style_border_color(msg_bubble, current_theme_.border, 0);
-    lv_obj_set_style_pad_all(msg_bubble, 8, 0);
-
-    // Create the message text
-    lv_obj_t* msg_text = lv_label_create(msg_bubble);
-    lv_label_set_text(msg_text, content);
-    
-    // 计算文本实际宽度
-    lv_coord_t text_width = lv_txt_get_width(content, strlen(content), fonts_.text_font, 0);
-
-    // 计算气泡宽度
-    lv_coord_t max_width = LV_HOR_RES * 85 / 100 - 16;  // 屏幕宽度的85%
-    lv_coord_t min_width = 20;  
-    lv_coord_t bubble_width;
-    
-    // 确保文本宽度不小于最小宽度
-    if (text_width < min_width) {
-        text_width = min_width;
+        lv_obj_move_to_index(entry->row, -1);
     }
 
-    // 如果文本宽度小于最大宽度，使用文本宽度
-    if (text_width < max_width) {
-        bubble_width = text_width; 
-    } else {
-        bubble_width = max_width;
+    if (strcmp(entry->role, role) != 0) {
+        lv_obj_remove_style(entry->bubble, GetBubbleStyle(entry->role), 0);
+        lv_obj_add_style(entry->bubble, GetBubbleStyle(role), 0);
+        // 设置自定义属性标记气泡类型
+        if (strcmp(role, "user") == 0) {
+            entry->role = "user";
+            lv_obj_align(entry->bubble, LV_ALIGN_RIGHT_MID, -25, 0);
+        } else if (strcmp(role, "system") == 0) {
+            entry->role = "system";
+            lv_obj_align(entry->bubble, LV_ALIGN_CENTER, 0, 0);
+        } else {
+            entry->role = "assistant";
+            lv_obj_align(entry->bubble, LV_ALIGN_LEFT_MID, 0, 0);
+        }
     }
-    
-    // 设置消息文本的宽度
-    lv_obj_set_width(msg_text, bubble_width);  // 减去padding
-    lv_label_set_long_mode(msg_text, LV_LABEL_LONG_WRAP);
-    lv_obj_set_style_text_font(msg_text, fonts_.text_font, 0);
 
-    // 设置气泡宽度
-    lv_obj_set_width(msg_bubble, bubble_width);
-    lv_obj_set_height(msg_bubble, LV_SIZE_CONTENT);
+    entry->width = GetBubbleWidth(content);
+    entry->length = strlen(content);
+    lv_label_set_text(entry->label, content);
+    lv_obj_set_width(entry->label, entry->width);
 
-    // Set alignment and style based on message role
-    if (strcmp(role, "user") == 0) {
-        // User messages are right-aligned with green background
-        lv_obj_set_style_bg_color(msg_bubble, current_theme_.user_bubble, 0);
-        // Set text color for contrast
-        lv_obj_set_style_text_color(msg_text, current_theme_.text, 0);
-        
-        // 设置自定义属性标记气泡类型
-        lv_obj_set_user_data(msg_bubble, (void*)"user");
-        
-        // Set appropriate width for content
-        lv_obj_set_width(msg_bubble, LV_SIZE_CONTENT);
-        lv_obj_set_height(msg_bubble, LV_SIZE_CONTENT);
-        
-        // Don't grow
-        lv_obj_set_style_flex_grow(msg_bubble, 0, 0);
-    } else if (strcmp(role, "assistant") == 0) {
-        // Assistant messages are left-aligned with white background
-        lv_obj_set_style_bg_color(msg_bubble, current_theme_.assistant_bubble, 0);
-        // Set text color for contrast
-        lv_obj_set_style_text_color(msg_text, current_theme_.text, 0);
-        
-        // 设置自定义属性标记气泡类型
-        lv_obj_set_user_data(msg_bubble, (void*)"assistant");
-        
-        // Set appropriate width for content
-        lv_obj_set_width(msg_bubble, LV_SIZE_CONTENT);
-        lv_obj_set_height(msg_bubble, LV_SIZE_CONTENT);
-        
-        // Don't grow
-        lv_obj_set_style_flex_grow(msg_bubble, 0, 0);
-    } else if (strcmp(role, "system") == 0) {
-        // System messages are center-aligned with light gray background
-        lv_obj_set_style_bg_color(msg_bubble, current_theme_.system_bubble, 0);
-        // Set text color for contrast
-        lv_obj_set_style_text_color(msg_text, current_theme_.system_text, 0);
-        
-        // 设置自定义属性标记气泡类型
-        lv_obj_set_user_data(msg_bubble, (void*)"system");
-        
-        // Set appropriate width for content
-        lv_obj_set_width(msg_bubble, LV_SIZE_CONTENT);
-        lv_obj_set_height(msg_bubble, LV_SIZE_CONTENT);
-        
-        // Don't grow
-        lv_obj_set_style_flex_grow(msg_bubble, 0, 0);
-    }
-    
-    // Create a full-width container for user messages to ensure right alignment
-    if (strcmp(role, "user") == 0) {
-        // Create a full-width container
-        lv_obj_t* container = lv_obj_create(content_);
-        lv_obj_set_width(container, LV_HOR_RES);
-        lv_obj_set_height(container, LV_SIZE_CONTENT);
-        
-        // Make container transparent and borderless
-        lv_obj_set_style_bg_opa(container, LV_OPA_TRANSP, 0);
-        lv_obj_set_style_border_width(container, 0, 0);
-        lv_obj_set_style_pad_all(container, 0, 0);
-        
-        // Move the message bubble into this container
-        lv_obj_set_parent(msg_bubble, container);
-        
-        // Right align the bubble in the container
-        lv_obj_align(msg_bubble, LV_ALIGN_RIGHT_MID, -25, 0);
-        
-        // Auto-scroll to this container
-        lv_obj_scroll_to_view_recursive(container, LV_ANIM_ON);
-    } else if (strcmp(role, "system") == 0) {
-        // 为系统消息创建全宽容器以确保居中对齐
-        lv_obj_t* container = lv_obj_create(content_);
-        lv_obj_set_width(container, LV_HOR_RES);
-        lv_obj_set_height(container, LV_SIZE_CONTENT);
-        
-        // 使容器透明且无边框
-        lv_obj_set_style_bg_opa(container, LV_OPA_TRANSP, 0);
-        lv_obj_set_style_border_width(container, 0, 0);
-        lv_obj_set_style_pad_all(container, 0, 0);
-        
-        // 将消息气泡移入此容器
-        lv_obj_set_parent(msg_bubble, container);
-        
-        // 将气泡居中对齐在容器中
-        lv_obj_align(msg_bubble, LV_ALIGN_CENTER, 0, 0);
-        
-        // 自动滚动底部
-        lv_obj_scroll_to_view_recursive(container, LV_ANIM_ON);
-    } else {
-        // For assistant messages
-        // Left align assistant messages
-        lv_obj_align(msg_bubble, LV_ALIGN_LEFT_MID, 0, 0);
+    // Jump to a recycled row immediately, it was scrolled out of view
+    lv_obj_scroll_to_view_recursive(entry->row, recycled ? LV_ANIM_OFF : LV_ANIM_ON);
 
-        // Auto-scroll to the message bubble
-        lv_obj_scroll_to_view_recursive(msg_bubble, LV_ANIM_ON);
-    }
-    
     // Store reference to the latest message label
-    chat_message_label_ = msg_text;
+    chat_message_label_ = entry->label;
 }
 
-void LcdDisplay::SetPreviewImage(const lv_img_dsc_t* img_dsc) {
+void LcdDisplay::SetPreviewImage(std::shared_ptr<PreviewImage> image) {
     DisplayLockGuard lock(this);
+    OnContentChanged();
     if (content_ == nullptr) {
         return;
     }
     
-    if (img_dsc != nullptr) {
+    if (image != nullptr) {
         // Create a message bubble for image preview
         lv_obj_t* img_bubble = lv_obj_create(content_);
-        lv_obj_set_style_radius(img_bubble, 8, 0);
+        lv_obj_add_style(img_bubble, &bubble_style_, 0);
+        lv_obj_add_style(img_bubble, &assistant_bubble_style_, 0);
         lv_obj_set_scrollbar_mode(img_bubble, LV_SCROLLBAR_MODE_OFF);
-        lv_obj_set_style_border_width(img_bubble, 1, 0);
-        lv_obj_set_style_border_color(img_bubble, current_theme_.border, 0);
-        lv_obj_set_style_pad_all(img_bubble, 8, 0);
-        
-        // Set image bubble background color (similar to system message)
-        lv_obj_set_style_bg_color(img_bubble, current_theme_.assistant_bubble, 0);
         
         // 设置自定义属性标记气泡类型
         lv_obj_set_user_data(img_bubble, (void*)"image");
@@ -649,41 +754,13 @@ void LcdDisplay::SetPreviewImage(const lv_img_dsc_t* img_dsc) {
         // Create the image object inside the bubble
         lv_obj_t* preview_image = lv_image_create(img_bubble);
         
-        // Copy the image descriptor and data to avoid source data changes
-        lv_img_dsc_t* copied_img_dsc = (lv_img_dsc_t*)heap_caps_malloc(sizeof(lv_img_dsc_t), MALLOC_CAP_8BIT);
-        if (copied_img_dsc == nullptr) {
-            ESP_LOGE(TAG, "Failed to allocate memory for image descriptor");
-            lv_obj_del(img_bubble);
-            return;
-        }
-        
-        // Copy the header
-        copied_img_dsc->header = img_dsc->header;
-        copied_img_dsc->data_size = img_dsc->data_size;
-        
-        // Copy the image data
-        uint8_t* copied_data = (uint8_t*)heap_caps_malloc(img_dsc->data_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-        if (copied_data == nullptr) {
-            // Fallback to internal RAM if SPIRAM allocation fails
-            copied_data = (uint8_t*)heap_caps_malloc(img_dsc->data_size, MALLOC_CAP_8BIT);
-        }
-        if (copied_data == nullptr) {
-            ESP_LOGE(TAG, "Failed to allocate memory for image data (size: %lu bytes)", img_dsc->data_size);
-            heap_caps_free(copied_img_dsc);
-            lv_obj_del(img_bubble);
-            return;
-        }
-        
-        memcpy(copied_data, img_dsc->data, img_dsc->data_size);
-        copied_img_dsc->data = copied_data;
-        
         // Calculate appropriate size for the image
         lv_coord_t max_width = LV_HOR_RES * 70 / 100;  // 70% of screen width
         lv_coord_t max_height = LV_VER_RES * 50 / 100; // 50% of screen height
         
         // Calculate zoom factor to fit within maximum dimensions
-        lv_coord_t img_width = copied_img_dsc->header.w;
-        lv_coord_t img_height = copied_img_dsc->header.h;
+        lv_coord_t img_width = image->width();
+        lv_coord_t img_height = image->height();
         
         lv_coord_t zoom_w = (max_width * 256) / img_width;
         lv_coord_t zoom_h = (max_height * 256) / img_height;
@@ -693,17 +770,17 @@ void LcdDisplay::SetPreviewImage(const lv_img_dsc_t* img_dsc) {
         if (zoom > 256) zoom = 256;
         
         // Set image properties
-        lv_image_set_src(preview_image, copied_img_dsc);
+        lv_image_set_src(preview_image, image->dsc());
         lv_image_set_scale(preview_image, zoom);
         
-        // Add event handler to clean up copied data when image is deleted
+        // The bubble holds a reference until it is deleted with the oldest chat row,
+        // the camera takes a new image for the next capture meanwhile
         lv_obj_add_event_cb(preview_image, [](lv_event_t* e) {
-            lv_img_dsc_t* copied_img_dsc = (lv_img_dsc_t*)lv_event_get_user_data(e);
-            if (copied_img_dsc != nullptr) {
-                heap_caps_free((void*)copied_img_dsc->data);
-                heap_caps_free(copied_img_dsc);
-            }
-        }, LV_EVENT_DELETE, (void*)copied_img_dsc);
+            auto image = static_cast<std::shared_ptr<PreviewImage>*>(lv_event_get_user_data(e));
+            // A new image may get the same address
+            lv_image_cache_drop((*image)->dsc());
+            delete image;
+        }, LV_EVENT_DELETE, new std::shared_ptr<PreviewImage>(image));
         
         // Calculate actual scaled image dimensions
         lv_coord_t scaled_width = (img_width * zoom) / 256;
@@ -829,19 +906,22 @@ void LcdDisplay::SetupUI() {
     lv_obj_set_style_text_color(low_battery_label_, lv_color_white(), 0);
     lv_obj_center(low_battery_label_);
     lv_obj_add_flag(low_battery_popup_, LV_OBJ_FLAG_HIDDEN);
+
+    StartCommandTimer();
 }
 
-void LcdDisplay::SetPreviewImage(const lv_img_dsc_t* img_dsc) {
+void LcdDisplay::SetPreviewImage(std::shared_ptr<PreviewImage> image) {
     DisplayLockGuard lock(this);
+    OnContentChanged();
     if (preview_image_ == nullptr) {
         return;
     }
     
-    if (img_dsc != nullptr) {
+    if (image != nullptr) {
         // zoom factor 0.5
-        lv_image_set_scale(preview_image_, 128 * width_ / img_dsc->header.w);
+        lv_image_set_scale(preview_image_, 128 * width_ / image->width());
         // 设置图片源并显示预览图片
-        lv_image_set_src(preview_image_, img_dsc);
+        lv_image_set_src(preview_image_, image->dsc());
         lv_obj_clear_flag(preview_image_, LV_OBJ_FLAG_HIDDEN);
         // 隐藏emotion_label_
         if (emotion_label_ != nullptr) {
@@ -854,10 +934,15 @@ void LcdDisplay::SetPreviewImage(const lv_img_dsc_t* img_dsc) {
             lv_obj_clear_flag(emotion_label_, LV_OBJ_FLAG_HIDDEN);
         }
     }
+    // Keep the shown image alive, release the previous one
+    if (preview_image_buffer_ != nullptr && preview_image_buffer_ != image) {
+        lv_image_cache_drop(preview_image_buffer_->dsc());
+    }
+    preview_image_buffer_ = std::move(image);
 }
 #endif
 
-void LcdDisplay::SetEmotion(const char* emotion) {
+void LcdDisplay::ApplyEmotion(const char* emotion) {
     struct Emotion {
         const char* icon;
         const char* text;
@@ -914,7 +999,7 @@ void LcdDisplay::SetEmotion(const char* emotion) {
 #endif
 }
 
-void LcdDisplay::SetIcon(const char* icon) {
+void LcdDisplay::ApplyIcon(const char* icon) {
     DisplayLockGuard lock(this);
     if (emotion_label_ == nullptr) {
         return;
@@ -990,120 +1075,8 @@ void LcdDisplay::SetTheme(const std::string& theme_name) {
         
         // If we have the chat message style, update all message bubbles
 #if CONFIG_USE_WECHAT_MESSAGE_STYLE
-        // Iterate through all children of content (message containers or bubbles)
-        uint32_t child_count = lv_obj_get_child_cnt(content_);
-        for (uint32_t i = 0; i < child_count; i++) {
-            lv_obj_t* obj = lv_obj_get_child(content_, i);
-            if (obj == nullptr) continue;
-            
-            lv_obj_t* bubble = nullptr;
-            
-            // 检查这个对象是容器还是气泡
-            // 如果是容器（用户或系统消息），则获取其子对象作为气泡
-            // 如果是气泡（助手消息），则直接使用
-            if (lv_obj_get_child_cnt(obj) > 0) {
-                // 可能是容器，检查它是否为用户或系统消息容器
-                // 用户和系统消息容器是透明的
-                lv_opa_t bg_opa = lv_obj_get_style_bg_opa(obj, 0);
-                if (bg_opa == LV_OPA_TRANSP) {
-                    // 这是用户或系统消息的容器
-                    bubble = lv_obj_get_child(obj, 0);
-                } else {
-                    // 这可能是助手消息的气泡自身
-                    bubble = obj;
-                }
-            } else {
-                // 没有子元素，可能是其他UI元素，跳过
-                continue;
-            }
-            
-            if (bubble == nullptr) continue;
-            
-            // 使用保存的用户数据来识别气泡类型
-            void* bubble_type_ptr = lv_obj_get_user_data(bubble);
-            if (bubble_type_ptr != nullptr) {
-                const char* bubble_type = static_cast<const char*>(bubble_type_ptr);
-                
-                // 根据气泡类型应用正确的颜色
-                if (strcmp(bubble_type, "user") == 0) {
-                    lv_obj_set_style_bg_color(bubble, current_theme_.user_bubble, 0);
-                } else if (strcmp(bubble_type, "assistant") == 0) {
-                    lv_obj_set_style_bg_color(bubble, current_theme_.assistant_bubble, 0); 
-                } else if (strcmp(bubble_type, "system") == 0) {
-                    lv_obj_set_style_bg_color(bubble, current_theme_.system_bubble, 0);
-                } else if (strcmp(bubble_type, "image") == 0) {
-                    lv_obj_set_style_bg_color(bubble, current_theme_.system_bubble, 0);
-                }
-                
-                // Update border color
-                lv_obj_set_style_border_color(bubble, current_theme_.border, 0);
-                
-                // Update text color for the message
-                if (lv_obj_get_child_cnt(bubble) > 0) {
-                    lv_obj_t* text = lv_obj_get_child(bubble, 0);
-                    if (text != nullptr) {
-                        // 根据气泡类型设置文本颜色
-                        if (strcmp(bubble_type, "system") == 0) {
-                            lv_obj_set_style_text_color(text, current_theme_.system_text, 0);
-                        } else {
-                            lv_obj_set_style_text_color(text, current_theme_.text, 0);
-                        }
-                    }
-                }
-            } else {
-                // 如果没有标记，回退到之前的逻辑（颜色比较）
-                // ...保留原有的回退逻辑...
-                lv_color_t bg_color = lv_obj_get_style_bg_color(bubble, 0);
-            
-                // 改进bubble类型检测逻辑，不仅使用颜色比较
-                bool is_user_bubble = false;
-                bool is_assistant_bubble = false;
-                bool is_system_bubble = false;
-            
-                // 检查用户bubble
-                if (lv_color_eq(bg_color, DARK_USER_BUBBLE_COLOR) || 
-                    lv_color_eq(bg_color, LIGHT_USER_BUBBLE_COLOR) ||
-                    lv_color_eq(bg_color, current_theme_.user_bubble)) {
-                    is_user_bubble = true;
-                }
-                // 检查系统bubble
-                else if (lv_color_eq(bg_color, DARK_SYSTEM_BUBBLE_COLOR) || 
-                         lv_color_eq(bg_color, LIGHT_SYSTEM_BUBBLE_COLOR) ||
-                         lv_color_eq(bg_color, current_theme_.system_bubble)) {
-                    is_system_bubble = true;
-                }
-                // 剩余的都当作助手bubble处理
-                else {
-                    is_assistant_bubble = true;
-                }
-            
-                // 根据bubble类型应用正确的颜色
-                if (is_user_bubble) {
-                    lv_obj_set_style_bg_color(bubble, current_theme_.user_bubble, 0);
-                } else if (is_assistant_bubble) {
-                    lv_obj_set_style_bg_color(bubble, current_theme_.assistant_bubble, 0);
-                } else if (is_system_bubble) {
-                    lv_obj_set_style_bg_color(bubble, current_theme_.system_bubble, 0);
-                }
-                
-                // Update border color
-                lv_obj_set_style_border_color(bubble, current_theme_.border, 0);
-                
-                // Update text color for the message
-                if (lv_obj_get_child_cnt(bubble) > 0) {
-                    lv_obj_t* text = lv_obj_get_child(bubble, 0);
-                    if (text != nullptr) {
-                        // 回退到颜色检测逻辑
-                        if (lv_color_eq(bg_color, current_theme_.system_bubble) ||
-                            lv_color_eq(bg_color, DARK_SYSTEM_BUBBLE_COLOR) || 
-                            lv_color_eq(bg_color, LIGHT_SYSTEM_BUBBLE_COLOR)) {
-                            lv_obj_set_style_text_color(text, current_theme_.system_text, 0);
-                        } else {
-                            lv_obj_set_style_text_color(text, current_theme_.text, 0);
-                        }
-                    }
-                }
-            }
+        if (!chat_bubbles_.empty()) {
+            UpdateBubbleStyles();
         }
 #else
         // Simple UI mode - just update the main chat message
@@ -8,6 +8,12 @@
 #include <font_emoji.h>
 
 #include <atomic>
+#include <vector>
+#include <memory>
+
+#include "glyph_cache.h"
+#include "refresh_policy.h"
+#include "sprite_player.h"
 
 // Theme color structure
 struct ThemeColors {
@@ -34,13 +40,60 @@ protected:
     lv_obj_t* container_ = nullptr;
     lv_obj_t* side_bar_ = nullptr;
     lv_obj_t* preview_image_ = nullptr;
+    std::shared_ptr<PreviewImage> preview_image_buffer_;  // Shown by preview_image_
 
     DisplayFonts fonts_;
     ThemeColors current_theme_;
+    std::unique_ptr<GlyphCache> glyph_cache_;
+    std::unique_ptr<RefreshPolicy> refresh_policy_;
+    std::unique_ptr<SpritePlayer> sprite_player_;   // Emotion sprites from the asset partition
+    const char* neutral_sprite_ = nullptr;
+
+#if CONFIG_USE_WECHAT_MESSAGE_STYLE
+    // A message row created once and reused for newer messages
+    struct ChatBubble {
+        lv_obj_t* row = nullptr;
+        lv_obj_t* bubble = nullptr;
+        lv_obj_t* label = nullptr;
+        const char* role = nullptr;
+        lv_coord_t width = 0;   // Width of the label
+        size_t length = 0;      // Length of the label text
+    };
+    std::vector<ChatBubble> chat_bubbles_;
+    size_t chat_bubble_next_ = 0;   // Oldest row once all rows are in use
+    size_t chat_bubble_count_ = 0;
+
+    lv_style_t bubble_style_;
+    lv_style_t bubble_row_style_;
+    lv_style_t user_bubble_style_;
+    lv_style_t assistant_bubble_style_;
+    lv_style_t system_bubble_style_;
+
+    void SetupBubbleStyles();
+    void UpdateBubbleStyles();
+    lv_style_t* GetBubbleStyle(const char* role);
+    lv_coord_t GetBubbleWidth(const char* text);
+    void CreateChatBubbles();
+#endif
 
     void SetupUI();
+    // Call once the LVGL display is added
+    void SetupRefreshPolicy();
+    // Shows the emotions as sprites from the asset partition in `parent` and plays the neutral one,
+    // returns false if the partition has no sprite named `neutral_sprite`
+    bool SetupEmotionSprites(lv_obj_t* parent, const char* neutral_sprite);
+    // Plays the neutral sprite if the partition has no sprite with this name
+    void PlayEmotionSprite(const char* sprite);
     virtual bool Lock(int timeout_ms = 0) override;
     virtual void Unlock() override;
+    virtual void WriteStatsJson(JsonWriter& writer) override;
+    virtual void OnContentChanged() override;
+    virtual void ApplyEmotion(const char* emotion) override;
+    virtual void ApplyIcon(const char* icon) override;
+#if CONFIG_USE_WECHAT_MESSAGE_STYLE
+    virtual void ApplyChatMessage(const char* role, const char* content) override;
+    virtual void ApplyAppendChatMessage(const char* role, const char* content) override;
+#endif
 
 protected:
     // 添加protected构造函数
@@ -48,12 +101,7 @@ protected:
     
 public:
     ~LcdDisplay();
-    virtual void SetEmotion(const char* emotion) override;
-    virtual void SetIcon(const char* icon) override;
-    virtual void SetPreviewImage(const lv_img_dsc_t* img_dsc) override;
-#if CONFIG_USE_WECHAT_MESSAGE_STYLE
-    virtual void SetChatMessage(const char* role, const char* content) override; 
-#endif  
+    virtual void SetPreviewImage(std::shared_ptr<PreviewImage> image) override;
 
     // Add theme switching function
     virtual void SetTheme(const std::string& theme_name) override;
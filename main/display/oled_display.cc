@@ -25,10 +25,13 @@ OledDisplay::OledDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_handl
     port_cfg.timer_period_ms = 50;
     lvgl_port_init(&port_cfg);
 
+    // Only the changed bytes of the flushed areas go over the bus
+    shadow_panel_ = std::make_unique<OledShadowPanel>(panel_, width_, height_);
+
     ESP_LOGI(TAG, "Adding OLED display");
     const lvgl_port_display_cfg_t display_cfg = {
         .io_handle = panel_io_,
-        .panel_handle = panel_,
+        .panel_handle = shadow_panel_->handle(),
         .control_handle = nullptr,
         .buffer_size = static_cast<uint32_t>(width_ * height_),
         .double_buffer = false,
@@ -55,6 +58,7 @@ OledDisplay::OledDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_handl
         ESP_LOGE(TAG, "Failed to add display");
         return;
     }
+    shadow_panel_->SetDisplay(display_);
 
     if (height_ == 64) {
         SetupUI_128x64();
@@ -94,7 +98,12 @@ void OledDisplay::Unlock() {
     lvgl_port_unlock();
 }
 
-void OledDisplay::SetChatMessage(const char* role, const char* content) {
+void OledDisplay::WriteStatsJson(JsonWriter& writer) {
+    DisplayLockGuard lock(this);
+    shadow_panel_->WriteStatsJson(writer);
+}
+
+void OledDisplay::ApplyChatMessage(const char* role, const char* content) {
     DisplayLockGuard lock(this);
     if (chat_message_label_ == nullptr) {
         return;
@@ -223,6 +232,8 @@ void OledDisplay::SetupUI_128x64() {
     lv_obj_set_style_text_color(low_battery_label_, lv_color_white(), 0);
     lv_obj_center(low_battery_label_);
     lv_obj_add_flag(low_battery_popup_, LV_OBJ_FLAG_HIDDEN);
+
+    StartCommandTimer();
 }
 
 void OledDisplay::SetupUI_128x32() {
@@ -305,5 +316,7 @@ void OledDisplay::SetupUI_128x32() {
     lv_anim_set_repeat_count(&a, LV_ANIM_REPEAT_INFINITE);
     lv_obj_set_style_anim(chat_message_label_, &a, LV_PART_MAIN);
     lv_obj_set_style_anim_duration(chat_message_label_, lv_anim_speed_clamped(60, 300, 60000), LV_PART_MAIN);
+
+    StartCommandTimer();
 }
 
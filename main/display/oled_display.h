@@ -6,6 +6,10 @@
 #include <esp_lcd_panel_io.h>
 #include <esp_lcd_panel_ops.h>
 
+#include <memory>
+
+#include "oled_shadow_panel.h"
+
 class OledDisplay : public Display {
 private:
     esp_lcd_panel_io_handle_t panel_io_ = nullptr;
@@ -19,19 +23,21 @@ private:
     lv_obj_t* side_bar_ = nullptr;
 
     DisplayFonts fonts_;
+    std::unique_ptr<OledShadowPanel> shadow_panel_;
 
     virtual bool Lock(int timeout_ms = 0) override;
     virtual void Unlock() override;
+    virtual void WriteStatsJson(JsonWriter& writer) override;
 
     void SetupUI_128x64();
     void SetupUI_128x32();
 
+    virtual void ApplyChatMessage(const char* role, const char* content) override;
+
 public:
     OledDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_handle_t panel, int width, int height, bool mirror_x, bool mirror_y,
                 DisplayFonts fonts);
     ~OledDisplay();
-
-    virtual void SetChatMessage(const char* role, const char* content) override;
 };
 
 #endif // OLED_DISPLAY_H
@@ -0,0 +1,135 @@
+#include "oled_shadow_panel.h"
+#include "json_writer.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#include <cstring>
+
+#define TAG "OledShadowPanel"
+
+OledShadowPanel::OledShadowPanel(esp_lcd_panel_handle_t panel, int width, int height)
+    : panel_(panel), width_(width), pages_(height / 8),
+      shadow_(width * (height / 8), 0), page_valid_(height / 8, false) {
+    memset(&base_, 0, sizeof(base_));
+    base_.user_data = this;
+    base_.reset = [](esp_lcd_panel_t* panel) {
+        auto self = FromHandle(panel);
+        self->page_valid_.assign(self->pages_, false);
+        return esp_lcd_panel_reset(self->panel_);
+    };
+    base_.init = [](esp_lcd_panel_t* panel) {
+        auto self = FromHandle(panel);
+        self->page_valid_.assign(self->pages_, false);
+        return esp_lcd_panel_init(self->panel_);
+    };
+    base_.del = [](esp_lcd_panel_t* panel) {
+        return ESP_OK;
+    };
+    base_.draw_bitmap = [](esp_lcd_panel_t* panel, int x_start, int y_start, int x_end, int y_end, const void* color_data) {
+        return FromHandle(panel)->DrawBitmap(x_start, y_start, x_end, y_end, static_cast<const uint8_t*>(color_data));
+    };
+    base_.mirror = [](esp_lcd_panel_t* panel, bool mirror_x, bool mirror_y) {
+        return esp_lcd_panel_mirror(FromHandle(panel)->panel_, mirror_x, mirror_y);
+    };
+    base_.swap_xy = [](esp_lcd_panel_t* panel, bool swap_axes) {
+        return esp_lcd_panel_swap_xy(FromHandle(panel)->panel_, swap_axes);
+    };
+    base_.set_gap = [](esp_lcd_panel_t* panel, int x_gap, int y_gap) {
+        return esp_lcd_panel_set_gap(FromHandle(panel)->panel_, x_gap, y_gap);
+    };
+    base_.invert_color = [](esp_lcd_panel_t* panel, bool invert_color_data) {
+        return esp_lcd_panel_invert_color(FromHandle(panel)->panel_, invert_color_data);
+    };
+    base_.disp_on_off = [](esp_lcd_panel_t* panel, bool on_off) {
+        return esp_lcd_panel_disp_on_off(FromHandle(panel)->panel_, on_off);
+    };
+    base_.disp_sleep = [](esp_lcd_panel_t* panel, bool sleep) {
+        return esp_lcd_panel_disp_sleep(FromHandle(panel)->panel_, sleep);
+    };
+}
+
+esp_err_t OledShadowPanel::SendPage(int x_start, int x_end, int page, const uint8_t* data) {
+    int64_t start_time = esp_timer_get_time();
+    esp_err_t err = esp_lcd_panel_draw_bitmap(panel_, x_start, page * 8, x_end, page * 8 + 8, data);
+    stats_.bus_time_us += esp_timer_get_time() - start_time;
+    stats_.transfers++;
+    stats_.bytes_sent += x_end - x_start;
+    return err;
+}
+
+esp_err_t OledShadowPanel::DrawBitmap(int x_start, int y_start, int x_end, int y_end, const uint8_t* data) {
+    int width = x_end - x_start;
+    int bytes = width * ((y_end - y_start + 7) / 8);
+    stats_.flushes++;
+    stats_.bytes_flushed += bytes;
+
+    // The LVGL port rounds the areas of monochrome displays to whole pages
+    if (y_start % 8 != 0 || y_end % 8 != 0 || x_start < 0 || x_end > width_ || y_end / 8 > pages_) {
+        ESP_LOGW(TAG, "Area is not page aligned, sent without diffing");
+        for (int page = y_start / 8; page < pages_ && page < (y_end + 7) / 8; page++) {
+            page_valid_[page] = false;
+        }
+        int64_t start_time = esp_timer_get_time();
+        esp_err_t err = esp_lcd_panel_draw_bitmap(panel_, x_start, y_start, x_end, y_end, data);
+        stats_.bus_time_us += esp_timer_get_time() - start_time;
+        stats_.transfers++;
+        stats_.bytes_sent += bytes;
+        return err;
+    }
+
+    bool sent = false;
+    esp_err_t ret = ESP_OK;
+    for (int page = y_start / 8; page < y_end / 8; page++, data += width) {
+        uint8_t* shadow = &shadow_[page * width_ + x_start];
+        int first = 0;
+        int last = width - 1;
+        if (page_valid_[page]) {
+            while (first < width && shadow[first] == data[first]) {
+                first++;
+            }
+            if (first == width) {
+                continue;
+            }
+            while (shadow[last] == data[last]) {
+                last--;
+            }
+        } else if (width == width_) {
+            page_valid_[page] = true;
+        }
+        memcpy(shadow + first, data + first, last - first + 1);
+        esp_err_t err = SendPage(x_start + first, x_start + last + 1, page, data + first);
+        if (err != ESP_OK) {
+            page_valid_[page] = false;
+            ret = err;
+        }
+        sent = true;
+    }
+
+    // Every transfer reports the flush done through the panel IO callback of the LVGL port,
+    // without any transfer it has to be done here
+    if (!sent && display_ != nullptr) {
+        lv_display_flush_ready(display_);
+    }
+    return ret;
+}
+
+/*
+ * "framebuffer": { "flushes": 320, "transfers": 410, "bytes_flushed": 81920, "bytes_sent": 5210,
+ *                  "bus_time_us": 52000, "saved_us": 765000 }
+ */
+void OledShadowPanel::WriteStatsJson(JsonWriter& writer) {
+    // The bus time of the skipped bytes is estimated from the bytes that were sent
+    uint64_t saved_us = 0;
+    if (stats_.bytes_sent > 0) {
+        saved_us = stats_.bus_time_us * (stats_.bytes_flushed - stats_.bytes_sent) / stats_.bytes_sent;
+    }
+    writer.Key("framebuffer").BeginObject()
+        .Member("flushes", stats_.flushes)
+        .Member("transfers", stats_.transfers)
+        .Member("bytes_flushed", stats_.bytes_flushed)
+        .Member("bytes_sent", stats_.bytes_sent)
+        .Member("bus_time_us", stats_.bus_time_us)
+        .Member("saved_us", saved_us)
+        .EndObject();
+}
@@ -0,0 +1,59 @@
+#ifndef OLED_SHADOW_PANEL_H
+#define OLED_SHADOW_PANEL_H
+
+#include <esp_lcd_panel_ops.h>
+#include <esp_lcd_panel_interface.h>
+#include <lvgl.h>
+
+#include <vector>
+#include <cstdint>
+
+class JsonWriter;
+
+/*
+ * Panel handle given to the LVGL port in place of an SSD1306 class panel. It keeps a
+ * copy of the panel RAM and compares every flushed page (8 rows, one byte per column)
+ * with it, only the columns from the first to the last changed byte of a page are sent,
+ * in one transfer per page. Pages without changes are not sent at all, so a clock tick
+ * in the status bar costs a few bytes on the I2C bus instead of the whole area.
+ *
+ * The data given to draw_bitmap must be in the page format the LVGL port produces for
+ * monochrome displays. The underlying panel is not deleted with this handle.
+ */
+class OledShadowPanel {
+public:
+    OledShadowPanel(esp_lcd_panel_handle_t panel, int width, int height);
+
+    esp_lcd_panel_handle_t handle() { return &base_; }
+    // Flushes that send nothing are reported done to this display
+    void SetDisplay(lv_display_t* display) { display_ = display; }
+
+    void WriteStatsJson(JsonWriter& writer);
+
+private:
+    struct Stats {
+        uint32_t flushes = 0;
+        uint32_t transfers = 0;
+        uint64_t bytes_flushed = 0;   // Bytes LVGL asked to send
+        uint64_t bytes_sent = 0;
+        uint64_t bus_time_us = 0;     // Spent in the transfers that were sent
+    };
+
+    esp_lcd_panel_t base_;
+    esp_lcd_panel_handle_t panel_;
+    lv_display_t* display_ = nullptr;
+    int width_;
+    int pages_;
+    std::vector<uint8_t> shadow_;
+    std::vector<bool> page_valid_;  // The page was written in full once, so the shadow matches the panel
+    Stats stats_;
+
+    esp_err_t DrawBitmap(int x_start, int y_start, int x_end, int y_end, const uint8_t* data);
+    esp_err_t SendPage(int x_start, int x_end, int page, const uint8_t* data);
+
+    static OledShadowPanel* FromHandle(esp_lcd_panel_t* panel) {
+        return static_cast<OledShadowPanel*>(panel->user_data);
+    }
+};
+
+#endif // OLED_SHADOW_PANEL_H
@@ -0,0 +1,55 @@
+#include "preview_image.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+
+#include <algorithm>
+#include <cstring>
+
+#define TAG "PreviewImage"
+
+std::shared_ptr<PreviewImage> PreviewImage::Create(uint16_t width, uint16_t height) {
+    size_t size = width * height * 2;
+    auto data = (uint8_t*)heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (data == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate %ux%u image", width, height);
+        return nullptr;
+    }
+    return std::shared_ptr<PreviewImage>(new PreviewImage(data, width, height));
+}
+
+PreviewImage::PreviewImage(uint8_t* data, uint16_t width, uint16_t height) : data_(data) {
+    memset(&dsc_, 0, sizeof(dsc_));
+    dsc_.header.magic = LV_IMAGE_HEADER_MAGIC;
+    dsc_.header.cf = LV_COLOR_FORMAT_RGB565;
+    dsc_.header.w = width;
+    dsc_.header.h = height;
+    dsc_.header.stride = width * 2;
+    dsc_.data_size = width * height * 2;
+    dsc_.data = data_;
+}
+
+PreviewImage::~PreviewImage() {
+    heap_caps_free(data_);
+}
+
+void PreviewImage::CopyByteSwapped(const uint8_t* src, size_t size) {
+    size = std::min(size, static_cast<size_t>(dsc_.data_size)) & ~static_cast<size_t>(1);
+    size_t done = 0;
+    // Swap two pixels per 32-bit word, the frame buffers of the camera driver are word aligned
+    if ((reinterpret_cast<uintptr_t>(src) & 3) == 0) {
+        auto s = reinterpret_cast<const uint32_t*>(src);
+        auto d = reinterpret_cast<uint32_t*>(data_);
+        size_t words = size / 4;
+        for (size_t i = 0; i < words; i++) {
+            uint32_t v = s[i];
+            d[i] = ((v & 0x00ff00ff) << 8) | ((v >> 8) & 0x00ff00ff);
+        }
+        done = words * 4;
+    }
+    auto s = reinterpret_cast<const uint16_t*>(src + done);
+    auto d = reinterpret_cast<uint16_t*>(data_ + done);
+    for (size_t i = 0; i < (size - done) / 2; i++) {
+        d[i] = __builtin_bswap16(s[i]);
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef PREVIEW_IMAGE_H
+#define PREVIEW_IMAGE_H
+
+#include <lvgl.h>
+
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * RGB565 image in PSRAM, filled once by a camera and shown by the display without a copy.
+ * It is shared through std::shared_ptr: the display keeps a reference as long as the image
+ * is on the screen, so a camera only writes into an image nobody else holds, e.g.
+ *
+ *     if (!image_ || image_.use_count() > 1) {
+ *         image_ = PreviewImage::Create(width, height);
+ *     }
+ */
+class PreviewImage {
+public:
+    // Returns nullptr if the memory can not be allocated
+    static std::shared_ptr<PreviewImage> Create(uint16_t width, uint16_t height);
+    ~PreviewImage();
+    PreviewImage(const PreviewImage&) = delete;
+    PreviewImage& operator=(const PreviewImage&) = delete;
+
+    const lv_img_dsc_t* dsc() const { return &dsc_; }
+    uint16_t width() const { return dsc_.header.w; }
+    uint16_t height() const { return dsc_.header.h; }
+    uint8_t* data() { return data_; }
+    size_t size() const { return dsc_.data_size; }
+
+    // Copies pixels that have the high byte first, as camera sensors send them, in the byte order of LVGL
+    void CopyByteSwapped(const uint8_t* src, size_t size);
+
+private:
+    PreviewImage(uint8_t* data, uint16_t width, uint16_t height);
+
+    uint8_t* data_;
+    lv_img_dsc_t dsc_;
+};
+
+#endif // PREVIEW_IMAGE_H
@@ -0,0 +1,162 @@
+#include "refresh_policy.h"
+#include "json_writer.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <algorithm>
+
+#define TAG "RefreshPolicy"
+
+#define FPS_WINDOW_US 1000000
+
+RefreshPolicy::RefreshPolicy(lv_display_t* display, uint32_t idle_period_ms, uint32_t idle_timeout_ms)
+    : display_(display), idle_period_ms_(idle_period_ms), idle_timeout_ms_(idle_timeout_ms) {
+    refresh_timer_ = lv_display_get_refr_timer(display_);
+    // LVGL creates the refresh timer of every display with this period
+    active_period_ms_ = LV_DEF_REFR_PERIOD;
+    if (idle_period_ms_ <= active_period_ms_) {
+        idle_period_ms_ = 0;
+    }
+    last_active_us_ = fps_window_start_us_ = esp_timer_get_time();
+
+    lv_display_add_event_cb(display_, OnEvent, LV_EVENT_REFR_START, this);
+    lv_display_add_event_cb(display_, OnEvent, LV_EVENT_RENDER_START, this);
+    lv_display_add_event_cb(display_, OnEvent, LV_EVENT_FLUSH_START, this);
+    lv_display_add_event_cb(display_, OnEvent, LV_EVENT_FLUSH_WAIT_START, this);
+    lv_display_add_event_cb(display_, OnEvent, LV_EVENT_FLUSH_WAIT_FINISH, this);
+    lv_display_add_event_cb(display_, OnEvent, LV_EVENT_REFR_READY, this);
+    ESP_LOGI(TAG, "Refresh period %lu ms, %lu ms when idle", active_period_ms_,
+        idle_period_ms_ > 0 ? idle_period_ms_ : active_period_ms_);
+}
+
+RefreshPolicy::~RefreshPolicy() {
+    lv_display_remove_event_cb_with_user_data(display_, OnEvent, this);
+    for (auto indev : input_devices_) {
+        lv_indev_remove_event_cb_with_user_data(indev, OnInputEvent, this);
+    }
+    SetIdle(false);
+}
+
+void RefreshPolicy::WatchInputDevices() {
+    for (auto indev = lv_indev_get_next(nullptr); indev != nullptr; indev = lv_indev_get_next(indev)) {
+        if (lv_indev_get_display(indev) != display_ ||
+            std::find(input_devices_.begin(), input_devices_.end(), indev) != input_devices_.end()) {
+            continue;
+        }
+        lv_indev_add_event_cb(indev, OnInputEvent, LV_EVENT_ALL, this);
+        input_devices_.push_back(indev);
+    }
+}
+
+// Runs in the input device read timer, which keeps its period while the display is idle
+void RefreshPolicy::OnInputEvent(lv_event_t* e) {
+    auto self = static_cast<RefreshPolicy*>(lv_event_get_user_data(e));
+    switch (lv_event_get_code(e)) {
+    case LV_EVENT_PRESSED:
+    case LV_EVENT_PRESSING:
+    case LV_EVENT_GESTURE:
+    case LV_EVENT_KEY:
+        self->MarkActive();
+        break;
+    default:
+        break;
+    }
+}
+
+void RefreshPolicy::OnEvent(lv_event_t* e) {
+    auto self = static_cast<RefreshPolicy*>(lv_event_get_user_data(e));
+    int64_t now = esp_timer_get_time();
+    switch (lv_event_get_code(e)) {
+    case LV_EVENT_REFR_START:
+        // Sent on every refresh timer run, even if nothing is invalidated
+        self->rendering_ = false;
+        self->refresh_start_us_ = now;
+        self->flush_wait_us_ = 0;
+        self->flushed_pixels_ = 0;
+        break;
+    case LV_EVENT_RENDER_START:
+        self->rendering_ = true;
+        break;
+    case LV_EVENT_FLUSH_START: {
+        auto area = static_cast<const lv_area_t*>(lv_event_get_param(e));
+        if (area != nullptr) {
+            self->flushed_pixels_ += lv_area_get_size(area);
+        }
+        break;
+    }
+    case LV_EVENT_FLUSH_WAIT_START:
+        self->flush_wait_start_us_ = now;
+        break;
+    case LV_EVENT_FLUSH_WAIT_FINISH:
+        self->flush_wait_us_ += now - self->flush_wait_start_us_;
+        break;
+    case LV_EVENT_REFR_READY:
+        self->OnRefreshReady();
+        break;
+    default:
+        break;
+    }
+}
+
+void RefreshPolicy::OnRefreshReady() {
+    int64_t now = esp_timer_get_time();
+    if (rendering_) {
+        uint32_t frame_us = now - refresh_start_us_;
+        uint32_t render_us = frame_us > flush_wait_us_ ? frame_us - flush_wait_us_ : 0;
+        stats_.frames++;
+        stats_.total_render_us += render_us;
+        stats_.total_flush_wait_us += flush_wait_us_;
+        stats_.total_pixels += flushed_pixels_;
+        if (render_us > stats_.max_render_us) {
+            stats_.max_render_us = render_us;
+        }
+        if (flush_wait_us_ > stats_.max_flush_wait_us) {
+            stats_.max_flush_wait_us = flush_wait_us_;
+        }
+        fps_window_frames_++;
+        rendering_ = false;
+    }
+
+    if (now - fps_window_start_us_ >= FPS_WINDOW_US) {
+        uint32_t elapsed_us = now - fps_window_start_us_;
+        fps_ = (fps_window_frames_ * 1000000ULL + elapsed_us / 2) / elapsed_us;
+        fps_window_start_us_ = now;
+        fps_window_frames_ = 0;
+    }
+
+    if (!idle_ && now - last_active_us_ >= idle_timeout_ms_ * 1000LL) {
+        SetIdle(true);
+    }
+}
+
+void RefreshPolicy::MarkActive() {
+    last_active_us_ = esp_timer_get_time();
+    SetIdle(false);
+}
+
+void RefreshPolicy::SetIdle(bool idle) {
+    if (idle_ == idle || refresh_timer_ == nullptr || idle_period_ms_ == 0) {
+        return;
+    }
+    idle_ = idle;
+    if (idle) {
+        WatchInputDevices();
+    }
+    // A shorter period takes effect at the next timer handler run
+    lv_timer_set_period(refresh_timer_, idle ? idle_period_ms_ : active_period_ms_);
+}
+
+void RefreshPolicy::WriteStatsJson(JsonWriter& writer) {
+    uint32_t frames = stats_.frames > 0 ? stats_.frames : 1;
+    writer.Key("refresh").BeginObject()
+        .Member("idle", idle_)
+        .Member("period_ms", idle_ ? idle_period_ms_ : active_period_ms_)
+        .Member("fps", fps_)
+        .Member("frames", stats_.frames)
+        .Member("avg_render_us", stats_.total_render_us / frames)
+        .Member("max_render_us", stats_.max_render_us)
+        .Member("avg_flush_wait_us", stats_.total_flush_wait_us / frames)
+        .Member("max_flush_wait_us", stats_.max_flush_wait_us)
+        .Member("avg_pixels", stats_.total_pixels / frames)
+        .EndObject();
+}
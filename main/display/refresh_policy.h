@@ -0,0 +1,73 @@
+#ifndef REFRESH_POLICY_H
+#define REFRESH_POLICY_H
+
+#include <lvgl.h>
+
+#include <cstdint>
+#include <vector>
+
+class JsonWriter;
+
+/*
+ * Measures the frames of an LVGL display and slows its refresh timer down while the
+ * content is idle. A frame is split into the time spent waiting for the panel flush
+ * (DMA still sending the previous buffer) and the rest, which is mostly rendering.
+ *
+ * Call MarkActive() whenever the content changes, the full refresh rate is restored
+ * at once and kept for `idle_timeout_ms`. Touch and key input of the display counts
+ * as activity as well. Animations such as GIF emotions keep playing while idle,
+ * at `idle_period_ms` per frame.
+ *
+ * All methods must be called with the LVGL lock held.
+ */
+class RefreshPolicy {
+public:
+    // idle_period_ms 0 keeps the refresh rate unchanged
+    RefreshPolicy(lv_display_t* display, uint32_t idle_period_ms, uint32_t idle_timeout_ms);
+    ~RefreshPolicy();
+
+    void MarkActive();
+    bool IsIdle() const { return idle_; }
+
+    void WriteStatsJson(JsonWriter& writer);
+
+private:
+    struct FrameStats {
+        uint32_t frames = 0;
+        uint64_t total_render_us = 0;
+        uint64_t total_flush_wait_us = 0;
+        uint64_t total_pixels = 0;
+        uint32_t max_render_us = 0;
+        uint32_t max_flush_wait_us = 0;
+    };
+
+    lv_display_t* display_;
+    lv_timer_t* refresh_timer_;
+    uint32_t active_period_ms_;
+    uint32_t idle_period_ms_;
+    uint32_t idle_timeout_ms_;
+    bool idle_ = false;
+    int64_t last_active_us_ = 0;
+    // Boards add their touch after the display, so input devices are looked up when going idle
+    std::vector<lv_indev_t*> input_devices_;
+
+    // Current frame
+    bool rendering_ = false;
+    int64_t refresh_start_us_ = 0;
+    int64_t flush_wait_start_us_ = 0;
+    uint32_t flush_wait_us_ = 0;
+    uint32_t flushed_pixels_ = 0;
+
+    FrameStats stats_;
+    int64_t fps_window_start_us_ = 0;
+    uint32_t fps_window_frames_ = 0;
+    uint32_t fps_ = 0;     // Over the last window
+
+    static void OnEvent(lv_event_t* e);
+    static void OnInputEvent(lv_event_t* e);
+    void WatchInputDevices();
+    void OnRefreshReady();
+    void SetIdle(bool idle);
+};
+
+#endif // REFRESH_POLICY_H
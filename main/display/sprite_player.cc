@@ -0,0 +1,269 @@
+#include "sprite_player.h"
+#include "json_writer.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+
+#include <algorithm>
+#include <cstring>
+
+#define TAG "SpritePlayer"
+
+#define SPRITE_OP_SKIP 0
+#define SPRITE_OP_FILL 1
+#define SPRITE_OP_COPY 2
+
+// Cache entries are only kept in PSRAM, internal RAM is left to audio and the network
+static uint8_t* AllocateCacheFrames(size_t size) {
+    return (uint8_t*)heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+}
+
+// A single frame, the same memory a GIF decoder would need for it
+static uint8_t* AllocateWorkBuffer(size_t size) {
+    auto data = AllocateCacheFrames(size);
+    if (data == nullptr) {
+        data = (uint8_t*)heap_caps_malloc(size, MALLOC_CAP_8BIT);
+    }
+    return data;
+}
+
+SpritePlayer::SpritePlayer(lv_obj_t* parent, size_t cache_capacity) : cache_capacity_(cache_capacity) {
+    memset(&dsc_, 0, sizeof(dsc_));
+    dsc_.header.magic = LV_IMAGE_HEADER_MAGIC;
+    dsc_.header.cf = LV_COLOR_FORMAT_RGB565;
+
+    image_ = lv_image_create(parent);
+    lv_obj_center(image_);
+    lv_obj_add_flag(image_, LV_OBJ_FLAG_HIDDEN);
+
+    timer_ = lv_timer_create(OnTimer, 100, this);
+    lv_timer_pause(timer_);
+}
+
+SpritePlayer::~SpritePlayer() {
+    lv_timer_delete(timer_);
+    lv_obj_delete(image_);
+    for (auto& entry : cache_) {
+        heap_caps_free(entry.frames);
+    }
+    heap_caps_free(work_buffer_);
+}
+
+bool SpritePlayer::Play(std::string_view sprite) {
+    int64_t start_time = esp_timer_get_time();
+    if (header_ != nullptr && reinterpret_cast<const char*>(header_) == sprite.data()) {
+        return true;
+    }
+
+    auto header = reinterpret_cast<const SpriteHeader*>(sprite.data());
+    if (sprite.size() < sizeof(SpriteHeader) || header->magic != SPRITE_MAGIC || header->version != SPRITE_VERSION ||
+        header->frame_count == 0 || sprite.size() < sizeof(SpriteHeader) + header->frame_count * sizeof(SpriteFrame)) {
+        ESP_LOGE(TAG, "Invalid sprite");
+        return false;
+    }
+
+    Stop();
+    header_ = header;
+    frames_ = reinterpret_cast<const SpriteFrame*>(sprite.data() + sizeof(SpriteHeader));
+    sprite_size_ = sprite.size();
+    frame_bytes_ = header->width * header->height * 2;
+    frame_index_ = 0;
+
+    entry_ = GetCacheEntry(sprite.data(), frame_bytes_ * header->frame_count);
+    if (entry_ == nullptr && work_buffer_size_ < frame_bytes_) {
+        heap_caps_free(work_buffer_);
+        work_buffer_ = AllocateWorkBuffer(frame_bytes_);
+        work_buffer_size_ = work_buffer_ != nullptr ? frame_bytes_ : 0;
+    }
+
+    dsc_.header.w = header->width;
+    dsc_.header.h = header->height;
+    dsc_.header.stride = header->width * 2;
+    dsc_.data_size = frame_bytes_;
+    if (!ShowFrame(0)) {
+        Stop();
+        return false;
+    }
+    lv_obj_remove_flag(image_, LV_OBJ_FLAG_HIDDEN);
+    if (header->frame_count > 1) {
+        lv_timer_set_period(timer_, frames_[0].delay_ms > 0 ? frames_[0].delay_ms : 100);
+        lv_timer_reset(timer_);
+        lv_timer_resume(timer_);
+    }
+
+    stats_.last_switch_us = esp_timer_get_time() - start_time;
+    if (stats_.last_switch_us > stats_.max_switch_us) {
+        stats_.max_switch_us = stats_.last_switch_us;
+    }
+    return true;
+}
+
+void SpritePlayer::Stop() {
+    lv_timer_pause(timer_);
+    lv_obj_add_flag(image_, LV_OBJ_FLAG_HIDDEN);
+    header_ = nullptr;
+    entry_ = nullptr;
+}
+
+void SpritePlayer::OnTimer(lv_timer_t* timer) {
+    auto self = static_cast<SpritePlayer*>(lv_timer_get_user_data(timer));
+    if (self->header_ == nullptr) {
+        return;
+    }
+    uint16_t next = (self->frame_index_ + 1) % self->header_->frame_count;
+    if (!self->ShowFrame(next)) {
+        self->Stop();
+        return;
+    }
+    auto delay_ms = self->frames_[next].delay_ms;
+    lv_timer_set_period(timer, delay_ms > 0 ? delay_ms : 100);
+}
+
+/*
+ * Cached sprites keep every frame, the first time through a frame is decoded into its own
+ * slot from the slot of the previous frame. Without a cache entry the frames are decoded
+ * in place in the work buffer, which works because they are shown in order and the first
+ * frame is always a key frame.
+ */
+bool SpritePlayer::ShowFrame(uint16_t index) {
+    uint8_t* output;
+    if (entry_ != nullptr) {
+        output = entry_->frames + index * frame_bytes_;
+        if (index >= entry_->decoded) {
+            auto previous = index > 0 ? output - frame_bytes_ : nullptr;
+            if (!DecodeFrame(index, reinterpret_cast<uint16_t*>(output), reinterpret_cast<const uint16_t*>(previous))) {
+                return false;
+            }
+            entry_->decoded = index + 1;
+        }
+    } else {
+        if (work_buffer_ == nullptr) {
+            return false;
+        }
+        output = work_buffer_;
+        if (!DecodeFrame(index, reinterpret_cast<uint16_t*>(output), reinterpret_cast<const uint16_t*>(output))) {
+            return false;
+        }
+    }
+
+    frame_index_ = index;
+    dsc_.data = output;
+    // The descriptor stays the same, only its data changes
+    lv_image_cache_drop(&dsc_);
+    lv_image_set_src(image_, &dsc_);
+    stats_.frames_shown++;
+    return true;
+}
+
+bool SpritePlayer::DecodeFrame(uint16_t index, uint16_t* output, const uint16_t* previous) {
+    int64_t start_time = esp_timer_get_time();
+    auto& frame = frames_[index];
+    if (frame.offset > sprite_size_ || frame.size > sprite_size_ - frame.offset || frame.size % 2 != 0 ||
+        (frame.type == kSpriteFrameDelta && (index == 0 || previous == nullptr))) {
+        ESP_LOGE(TAG, "Invalid frame %u", index);
+        return false;
+    }
+
+    auto input = reinterpret_cast<const uint16_t*>(reinterpret_cast<const char*>(header_) + frame.offset);
+    auto input_end = input + frame.size / 2;
+    size_t pixels = frame_bytes_ / 2;
+    size_t position = 0;
+    while (input < input_end) {
+        uint16_t token = *input++;
+        size_t count = token & 0x3fff;
+        if (count > pixels - position) {
+            ESP_LOGE(TAG, "Frame %u overflows", index);
+            return false;
+        }
+        switch (token >> 14) {
+        case SPRITE_OP_SKIP:
+            if (previous != output) {
+                memcpy(output + position, previous + position, count * 2);
+            }
+            break;
+        case SPRITE_OP_FILL: {
+            if (input >= input_end) {
+                return false;
+            }
+            uint16_t color = *input++;
+            std::fill(output + position, output + position + count, color);
+            break;
+        }
+        case SPRITE_OP_COPY:
+            if (count > static_cast<size_t>(input_end - input)) {
+                return false;
+            }
+            memcpy(output + position, input, count * 2);
+            input += count;
+            break;
+        default:
+            return false;
+        }
+        position += count;
+    }
+
+    uint32_t decode_us = esp_timer_get_time() - start_time;
+    stats_.frames_decoded++;
+    stats_.total_decode_us += decode_us;
+    if (decode_us > stats_.max_decode_us) {
+        stats_.max_decode_us = decode_us;
+    }
+    return position == pixels;
+}
+
+SpritePlayer::CacheEntry* SpritePlayer::GetCacheEntry(const char* sprite, size_t size) {
+    for (auto it = cache_.begin(); it != cache_.end(); ++it) {
+        if (it->sprite == sprite) {
+            cache_.splice(cache_.begin(), cache_, it);
+            stats_.cache_hits++;
+            return &cache_.front();
+        }
+    }
+    stats_.cache_misses++;
+    if (size > cache_capacity_) {
+        return nullptr;
+    }
+
+    // Entries are only given up when the memory is needed for the new one
+    auto frames = AllocateCacheFrames(size);
+    while (frames == nullptr && !cache_.empty()) {
+        EvictOldest();
+        frames = AllocateCacheFrames(size);
+    }
+    if (frames == nullptr) {
+        ESP_LOGW(TAG, "Failed to allocate %u bytes of PSRAM for the frames", size);
+        return nullptr;
+    }
+    while (!cache_.empty() && cache_used_ + size > cache_capacity_) {
+        EvictOldest();
+    }
+    cache_.push_front({sprite, frames, size});
+    cache_used_ += size;
+    return &cache_.front();
+}
+
+void SpritePlayer::EvictOldest() {
+    auto& oldest = cache_.back();
+    cache_used_ -= oldest.size;
+    heap_caps_free(oldest.frames);
+    cache_.pop_back();
+}
+
+/*
+ * "sprite": { "frames_shown": 900, "frames_decoded": 42, "avg_decode_us": 1800, "max_decode_us": 4100,
+ *             "cache_hits": 7, "cache_misses": 3, "cache_used": 2764800, "last_switch_us": 2300, "max_switch_us": 4600 }
+ */
+void SpritePlayer::WriteStatsJson(JsonWriter& writer) {
+    writer.Key("sprite").BeginObject()
+        .Member("frames_shown", stats_.frames_shown)
+        .Member("frames_decoded", stats_.frames_decoded)
+        .Member("avg_decode_us", stats_.frames_decoded > 0 ? stats_.total_decode_us / stats_.frames_decoded : 0)
+        .Member("max_decode_us", stats_.max_decode_us)
+        .Member("cache_hits", stats_.cache_hits)
+        .Member("cache_misses", stats_.cache_misses)
+        .Member("cache_used", cache_used_)
+        .Member("last_switch_us", stats_.last_switch_us)
+        .Member("max_switch_us", stats_.max_switch_us)
+        .EndObject();
+}
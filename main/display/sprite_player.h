@@ -0,0 +1,111 @@
+#ifndef SPRITE_PLAYER_H
+#define SPRITE_PLAYER_H
+
+#include <lvgl.h>
+
+#include <string_view>
+#include <list>
+#include <cstdint>
+#include <cstddef>
+
+class JsonWriter;
+
+#define SPRITE_MAGIC 0x50535a58  // "XZSP"
+#define SPRITE_VERSION 1
+
+// Sprite sheet built by scripts/emoji_sprite.py, all fields little endian
+struct SpriteHeader {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t reserved0;
+    uint16_t frame_count;
+    uint16_t width;
+    uint16_t height;
+    uint32_t reserved1;
+};
+
+enum SpriteFrameType : uint8_t {
+    kSpriteFrameKey,    // All pixels
+    kSpriteFrameDelta   // Changes to the previous frame
+};
+
+struct SpriteFrame {
+    uint32_t offset;    // From the start of the sprite
+    uint32_t size;
+    uint16_t delay_ms;
+    SpriteFrameType type;
+    uint8_t reserved;
+};
+
+/*
+ * Plays sprite sheets in an lv_image. A frame is a stream of 16-bit tokens, the top two
+ * bits are the operation and the rest the pixel count:
+ *   SKIP n   keep n pixels of the previous frame (delta frames only)
+ *   FILL n   one RGB565 pixel follows, repeated n times
+ *   COPY n   n RGB565 pixels follow
+ *
+ * The decoded frames of the recently played sprites are kept in PSRAM, up to
+ * `cache_capacity` bytes in least recently used order, so switching back to an emotion
+ * and looping it costs no decoding. A sprite that does not fit the cache, or when PSRAM
+ * is short, is decoded frame by frame into a single buffer.
+ *
+ * All methods must be called with the LVGL lock held.
+ */
+class SpritePlayer {
+public:
+    SpritePlayer(lv_obj_t* parent, size_t cache_capacity);
+    ~SpritePlayer();
+
+    lv_obj_t* image() const { return image_; }
+
+    // The sprite data must stay valid while it is cached, e.g. in the asset partition.
+    // Returns false if the data is not a valid sprite
+    bool Play(std::string_view sprite);
+    void Stop();
+
+    void WriteStatsJson(JsonWriter& writer);
+
+private:
+    struct CacheEntry {
+        const char* sprite;
+        uint8_t* frames;        // frame_count decoded frames
+        size_t size;
+        uint16_t decoded = 0;   // Frames are decoded in order while they are first shown
+    };
+
+    struct Stats {
+        uint32_t frames_shown = 0;
+        uint32_t frames_decoded = 0;
+        uint64_t total_decode_us = 0;
+        uint32_t max_decode_us = 0;
+        uint32_t cache_hits = 0;
+        uint32_t cache_misses = 0;
+        uint32_t last_switch_us = 0;
+        uint32_t max_switch_us = 0;
+    };
+
+    lv_obj_t* image_;
+    lv_timer_t* timer_;
+    lv_img_dsc_t dsc_;
+    size_t cache_capacity_;
+    size_t cache_used_ = 0;
+    std::list<CacheEntry> cache_;   // Most recently used first
+
+    const SpriteHeader* header_ = nullptr;
+    const SpriteFrame* frames_ = nullptr;
+    size_t sprite_size_ = 0;
+    size_t frame_bytes_ = 0;
+    uint16_t frame_index_ = 0;
+    CacheEntry* entry_ = nullptr;   // Cache entry of the sprite, nullptr if it is not cached
+    uint8_t* work_buffer_ = nullptr;
+    size_t work_buffer_size_ = 0;
+    Stats stats_;
+
+    bool ShowFrame(uint16_t index);
+    bool DecodeFrame(uint16_t index, uint16_t* output, const uint16_t* previous);
+    CacheEntry* GetCacheEntry(const char* sprite, size_t size);
+    void EvictOldest();
+    static void OnTimer(lv_timer_t* timer);
+};
+
+#endif // SPRITE_PLAYER_H
@@ -52,6 +52,39 @@ std::string Thing::GetStateJson() {
     return json_str;
 }
 
+bool Thing::WriteStateJson(JsonWriter& json, bool delta) {
+    bool changed = false;
+    for (auto& property : properties_) {
+        property.Refresh();
+        changed = changed || property.dirty();
+    }
+    if (delta && !changed) {
+        return false;
+    }
+
+    json.BeginObject()
+        .Member("name", name_)
+        .Key("state").BeginObject();
+    for (auto& property : properties_) {
+        if (delta && !property.dirty()) {
+            continue;
+        }
+        json.Key(property.name());
+        property.WriteStateJson(json);
+        property.MarkSent();
+    }
+    json.EndObject().EndObject();
+    return true;
+}
+
+void Thing::NotifyPropertyChanged(const std::string& name) {
+    try {
+        properties_[name].Invalidate();
+    } catch (const std::runtime_error& e) {
+        ESP_LOGE(TAG, "Property not found: %s", name.c_str());
+    }
+}
+
 void Thing::Invoke(const cJSON* command) {
     auto method_name = cJSON_GetObjectItem(command, "method");
     auto input_params = cJSON_GetObjectItem(command, "parameters");
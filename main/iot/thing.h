@@ -5,9 +5,12 @@
 #include <map>
 #include <functional>
 #include <vector>
+#include <atomic>
 #include <stdexcept>
 #include <cJSON.h>
 
+#include "json_writer.h"
+
 namespace iot {
 
 enum ValueType {
@@ -25,6 +28,26 @@ private:
     std::function<int()> number_getter_;
     std::function<std::string()> string_getter_;
 
+    // Last value read from the getter and how often it has changed
+    bool boolean_value_ = false;
+    int number_value_ = 0;
+    std::string string_value_;
+    uint32_t version_ = 0;
+    uint32_t sent_version_ = 0;
+    bool polled_ = true;
+
+    // Set by Invalidate() from any task, cleared by Refresh()
+    struct StaleFlag {
+        std::atomic<bool> value{true};
+        StaleFlag() = default;
+        StaleFlag(const StaleFlag& other) : value(other.value.load()) {}
+        StaleFlag& operator=(const StaleFlag& other) {
+            value = other.value.load();
+            return *this;
+        }
+    };
+    StaleFlag stale_;
+
 public:
     Property(const std::string& name, const std::string& description, std::function<bool()> getter) :
         name_(name), description_(description), type_(kValueTypeBoolean), boolean_getter_(getter) {}
@@ -41,6 +64,58 @@ public:
     int number() const { return number_getter_(); }
     std::string string() const { return string_getter_(); }
 
+    // A property that is not polled is only read again after Invalidate(),
+    // use it when every change goes through the thing's own methods.
+    void set_polled(bool polled) { polled_ = polled; }
+    void Invalidate() { stale_.value = true; }
+
+    // Read the getter if needed and bump the version if the value changed
+    bool Refresh() {
+        // Cleared before the getter runs, an Invalidate() meanwhile is read again next time
+        bool stale = stale_.value.exchange(false);
+        if (!polled_ && !stale) {
+            return false;
+        }
+        bool first = stale && version_ == 0;
+        bool changed = first;
+        if (type_ == kValueTypeBoolean) {
+            bool value = boolean_getter_();
+            changed = changed || value != boolean_value_;
+            boolean_value_ = value;
+        } else if (type_ == kValueTypeNumber) {
+            int value = number_getter_();
+            changed = changed || value != number_value_;
+            number_value_ = value;
+        } else if (type_ == kValueTypeString) {
+            std::string value = string_getter_();
+            if (first || value != string_value_) {
+                changed = true;
+                string_value_ = std::move(value);
+            }
+        }
+        if (changed) {
+            version_++;
+        }
+        return changed;
+    }
+
+    uint32_t version() const { return version_; }
+    bool dirty() const { return version_ != sent_version_; }
+    void MarkSent() { sent_version_ = version_; }
+
+    // Write the value read by the last Refresh()
+    void WriteStateJson(JsonWriter& json) const {
+        if (type_ == kValueTypeBoolean) {
+            json.Bool(boolean_value_);
+        } else if (type_ == kValueTypeNumber) {
+            json.Int(number_value_);
+        } else if (type_ == kValueTypeString) {
+            json.String(string_value_);
+        } else {
+            json.Null();
+        }
+    }
+
     std::string GetDescriptorJson() {
         std::string json_str = "{";
         json_str += "\"description\":\"" + description_ + "\",";
@@ -94,6 +169,19 @@ public:
         throw std::runtime_error("Property not found: " + name);
     }
 
+    Property& operator[](const std::string& name) {
+        for (auto& property : properties_) {
+            if (property.name() == name) {
+                return property;
+            }
+        }
+        throw std::runtime_error("Property not found: " + name);
+    }
+
+    // iterator
+    auto begin() { return properties_.begin(); }
+    auto end() { return properties_.end(); }
+
     std::string GetDescriptorJson() {
         std::string json_str = "{";
         for (auto& property : properties_) {
@@ -270,6 +358,13 @@ public:
     virtual std::string GetStateJson();
     virtual void Invoke(const cJSON* command);
 
+    // Refresh all properties and write {"name":...,"state":{...}} with the properties
+    // changed since the last call, or with all of them if `delta` is false.
+    // Returns false and writes nothing if `delta` is true and no property changed.
+    virtual bool WriteStateJson(JsonWriter& json, bool delta);
+    // Mark a property to be read again, for properties that are not polled
+    void NotifyPropertyChanged(const std::string& name);
+
     const std::string& name() const { return name_; }
     const std::string& description() const { return description_; }
 
@@ -1,6 +1,7 @@
 #include "thing_manager.h"
 
 #include <esp_log.h>
+#include <cstdio>
 
 #define TAG "ThingManager"
 
@@ -8,45 +9,52 @@ namespace iot {
 
 void ThingManager::AddThing(Thing* thing) {
     things_.push_back(thing);
+    descriptors_json_.clear();
+    descriptors_hash_.clear();
 }
 
-std::string ThingManager::GetDescriptorsJson() {
-    std::string json_str = "[";
+const std::string& ThingManager::GetDescriptorsJson() {
+    if (!descriptors_json_.empty()) {
+        return descriptors_json_;
+    }
+    descriptors_json_ = "[";
     for (auto& thing : things_) {
-        json_str += thing->GetDescriptorJson() + ",";
+        descriptors_json_ += thing->GetDescriptorJson() + ",";
     }
-    if (json_str.back() == ',') {
-        json_str.pop_back();
+    if (descriptors_json_.back() == ',') {
+        descriptors_json_.pop_back();
     }
-    json_str += "]";
-    return json_str;
+    descriptors_json_ += "]";
+    return descriptors_json_;
 }
 
-bool ThingManager::GetStatesJson(std::string& json, bool delta) {
-    if (!delta) {
-        last_states_.clear();
+const std::string& ThingManager::GetDescriptorsHash() {
+    if (!descriptors_hash_.empty()) {
+        return descriptors_hash_;
     }
+    uint32_t hash = 2166136261u;
+    for (char c : GetDescriptorsJson()) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+    }
+    char hash_str[9];
+    snprintf(hash_str, sizeof(hash_str), "%08lx", (unsigned long)hash);
+    descriptors_hash_ = hash_str;
+    return descriptors_hash_;
+}
+
+// Each property keeps a version that is bumped when its value changes, the delta
+// only contains the properties whose version has not been sent yet.
+bool ThingManager::GetStatesJson(std::string& json, bool delta) {
     bool changed = false;
-    json = "[";
-    // 枚举thing，获取每个thing的state，如果发生变化，则更新，保存到last_states_
-    // 如果delta为true，则只返回变化的部分
+    json.clear();
+    JsonWriter writer(json);
+    writer.BeginArray();
     for (auto& thing : things_) {
-        std::string state = thing->GetStateJson();
-        if (delta) {
-            // 如果delta为true，则只返回变化的部分
-            auto it = last_states_.find(thing->name());
-            if (it != last_states_.end() && it->second == state) {
-                continue;
-            }
+        if (thing->WriteStateJson(writer, delta)) {
             changed = true;
-            last_states_[thing->name()] = state;
         }
-        json += state + ",";
-    }
-    if (json.back() == ',') {
-        json.pop_back();
     }
-    json += "]";
+    writer.EndArray();
     return changed;
 }
 
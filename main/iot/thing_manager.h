@@ -9,7 +9,6 @@
 #include <vector>
 #include <memory>
 #include <functional>
-#include <map>
 
 namespace iot {
 
@@ -24,7 +23,10 @@ public:
 
     void AddThing(Thing* thing);
 
-    std::string GetDescriptorsJson();
+    // Descriptors never change after the things are added, they are built once
+    const std::string& GetDescriptorsJson();
+    // FNV-1a hash of the descriptors as 8 hex digits
+    const std::string& GetDescriptorsHash();
     bool GetStatesJson(std::string& json, bool delta = false);
     void Invoke(const cJSON* command);
 
@@ -33,7 +35,8 @@ private:
     ~ThingManager() = default;
 
     std::vector<Thing*> things_;
-    std::map<std::string, std::string> last_states_;
+    std::string descriptors_json_;
+    std::string descriptors_hash_;
 };
 
 
@@ -6,19 +6,37 @@
 #include "mcp_server.h"
 #include <esp_log.h>
 #include <esp_app_desc.h>
+#include <esp_heap_caps.h>
 #include <algorithm>
 #include <cstring>
-#include <esp_pthread.h>
 
 #include "application.h"
 #include "display.h"
 #include "board.h"
+#include "boot_profiler.h"
+#include "i2c_device.h"
 
 #define TAG "MCP"
 
-#define DEFAULT_TOOLCALL_STACK_SIZE 6144
+// Size limit of one outgoing message, for tools/list pages and batch replies
+#define MAX_PAYLOAD_SIZE 8000
+
+#ifndef CONFIG_MCP_TOOL_CALL_WORKERS
+#define CONFIG_MCP_TOOL_CALL_WORKERS 1
+#define CONFIG_MCP_TOOL_CALL_QUEUE_SIZE 8
+#define CONFIG_MCP_TOOL_CALL_STACK_SIZE 6144
+#define CONFIG_MCP_TOOL_CALL_TIMEOUT_MS 30000
+#endif
 
 McpServer::McpServer() {
+    tool_executor_ = std::make_unique<McpToolExecutor>(CONFIG_MCP_TOOL_CALL_WORKERS,
+        CONFIG_MCP_TOOL_CALL_QUEUE_SIZE, CONFIG_MCP_TOOL_CALL_STACK_SIZE);
+    tool_executor_->OnResult([this](int id, uint32_t batch, const std::string& result) {
+        ReplyResult(id, result, batch);
+    });
+    tool_executor_->OnError([this](int id, uint32_t batch, const std::string& message) {
+        ReplyError(id, message, batch);
+    });
 }
 
 McpServer::~McpServer() {
@@ -26,6 +44,7 @@ McpServer::~McpServer() {
         delete tool;
     }
     tools_.clear();
+    tools_index_.clear();
 }
 
 void McpServer::AddCommonTools() {
@@ -45,26 +64,103 @@ void McpServer::AddCommonTools() {
             return board.GetDeviceStatusJson();
         });
 
-    AddTool("self.audio_speaker.set_volume", 
-        "Set the volume of the audio speaker. If the current volume is unknown, you must call `self.get_device_status` tool first and then call this tool.",
-        PropertyList({
-            Property("volume", kPropertyTypeInteger, 0, 100)
-        }), 
+#ifdef CONFIG_MCP_DIAGNOSTIC_TOOLS
+    AddTool("self.get_boot_timeline",
+        "Provides how long each phase of the last device startup took, and the timeline of the startup before it.",
+        PropertyList(),
+        [](const PropertyList& properties) -> ReturnValue {
+            return BootProfiler::GetInstance().GetTimelineJson();
+        });
+
+    AddTool("self.screen.get_update_latency",
+        "Provides how many updates were posted to the screen, how many were drawn and how long they waited before they were drawn, "
+        "as well as the frame rate and how long the frames took to render and to flush to the panel.",
+        PropertyList(),
         [&board](const PropertyList& properties) -> ReturnValue {
+            return board.GetDisplay()->GetCommandStatsJson();
+        });
+
+    struct ChatBenchmarkArgs {
+        int count;
+    };
+    AddTool<ChatBenchmarkArgs>("self.screen.run_chat_benchmark",
+        "Shows `count` chat messages one after another and provides how long it took, the internal RAM before and after, "
+        "and the screen update latency and frame times afterwards. The chat history on the screen is replaced.",
+        McpArgs(
+            McpArg("count", &ChatBenchmarkArgs::count, 1, 2000)
+        ),
+        [&board](const ChatBenchmarkArgs& args) -> ReturnValue {
+            auto display = board.GetDisplay();
+            auto free_before = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+            auto start_time = esp_timer_get_time();
+            char text[96];
+            for (int i = 0; i < args.count; i++) {
+                snprintf(text, sizeof(text), "Message %d, long enough to wrap to a second line on a small screen", i);
+                display->SetChatMessage(i % 2 ? "user" : "assistant", text);
+                // One message per frame, so every message is drawn
+                vTaskDelay(std::max<TickType_t>(pdMS_TO_TICKS(10), 1));
+            }
+            auto elapsed_ms = (esp_timer_get_time() - start_time) / 1000;
+            auto stats = display->GetCommandStatsJson();
+
+            std::string result;
+            result.reserve(stats.size() + 160);
+            JsonWriter json(result);
+            json.BeginObject()
+                .Member("count", args.count)
+                .Member("elapsedMs", elapsed_ms)
+                .Member("freeInternalBefore", free_before)
+                .Member("freeInternalAfter", heap_caps_get_free_size(MALLOC_CAP_INTERNAL))
+                .Member("minFreeInternal", heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL))
+                .RawMember("display", stats)
+                .EndObject();
+            return result;
+        });
+
+    AddTool("self.get_tool_call_stats",
+        "Provides how many tool calls were run, failed, timed out or were rejected, and how long they waited and ran.",
+        PropertyList(),
+        [this](const PropertyList& properties) -> ReturnValue {
+            return GetToolCallStatsJson();
+        });
+
+    if (I2cDevice::GetDeviceCount() > 0) {
+        AddTool("self.board.get_i2c_usage",
+            "Provides how many transactions each I2C device (power management, IO expander, touch, etc.) has done, "
+            "how many failed or were answered from the register cache, and how much of the time the bus was busy with it.",
+            PropertyList(),
+            [](const PropertyList& properties) -> ReturnValue {
+                return I2cDevice::GetStatsJson();
+            });
+    }
+#endif
+
+    struct VolumeArgs {
+        int volume;
+    };
+    AddTool<VolumeArgs>("self.audio_speaker.set_volume", 
+        "Set the volume of the audio speaker. If the current volume is unknown, you must call `self.get_device_status` tool first and then call this tool.",
+        McpArgs(
+            McpArg("volume", &VolumeArgs::volume, 0, 100)
+        ), 
+        [&board](const VolumeArgs& args) -> ReturnValue {
             auto codec = board.GetAudioCodec();
-            codec->SetOutputVolume(properties["volume"].value<int>());
+            codec->SetOutputVolume(args.volume);
             return true;
         });
     
     auto backlight = board.GetBacklight();
     if (backlight) {
-        AddTool("self.screen.set_brightness",
+        struct BrightnessArgs {
+            int brightness;
+        };
+        AddTool<BrightnessArgs>("self.screen.set_brightness",
             "Set the brightness of the screen.",
-            PropertyList({
-                Property("brightness", kPropertyTypeInteger, 0, 100)
-            }),
-            [backlight](const PropertyList& properties) -> ReturnValue {
-                uint8_t brightness = static_cast<uint8_t>(properties["brightness"].value<int>());
+            McpArgs(
+                McpArg("brightness", &BrightnessArgs::brightness, 0, 100)
+            ),
+            [backlight](const BrightnessArgs& args) -> ReturnValue {
+                uint8_t brightness = static_cast<uint8_t>(args.brightness);
                 backlight->SetBrightness(brightness, true);
                 return true;
             });
@@ -72,56 +168,76 @@ void McpServer::AddCommonTools() {
 
     auto display = board.GetDisplay();
     if (display && !display->GetTheme().empty()) {
-        AddTool("self.screen.set_theme",
+        struct ThemeArgs {
+            std::string theme;
+        };
+        AddTool<ThemeArgs>("self.screen.set_theme",
             "Set the theme of the screen. The theme can be `light` or `dark`.",
-            PropertyList({
-                Property("theme", kPropertyTypeString)
-            }),
-            [display](const PropertyList& properties) -> ReturnValue {
-                display->SetTheme(properties["theme"].value<std::string>().c_str());
+            McpArgs(
+                McpArg("theme", &ThemeArgs::theme)
+            ),
+            [display](const ThemeArgs& args) -> ReturnValue {
+                display->SetTheme(args.theme.c_str());
                 return true;
             });
     }
 
     auto camera = board.GetCamera();
     if (camera) {
-        AddTool("self.camera.take_photo",
+        struct PhotoArgs {
+            std::string question;
+        };
+        AddTool<PhotoArgs>("self.camera.take_photo",
             "Take a photo and explain it. Use this tool after the user asks you to see something.\n"
             "Args:\n"
             "  `question`: The question that you want to ask about the photo.\n"
             "Return:\n"
             "  A JSON object that provides the photo information.",
-            PropertyList({
-                Property("question", kPropertyTypeString)
-            }),
-            [camera](const PropertyList& properties) -> ReturnValue {
+            McpArgs(
+                McpArg("question", &PhotoArgs::question)
+            ),
+            [this, camera](const PhotoArgs& args) -> ReturnValue {
+                ReportProgress(0, 2, "Capturing photo");
                 if (!camera->Capture()) {
                     return "{\"success\": false, \"message\": \"Failed to capture photo\"}";
                 }
-                auto question = properties["question"].value<std::string>();
-                return camera->Explain(question);
+                ReportProgress(1, 2, "Explaining photo");
+                return camera->Explain(args.question);
             });
     }
 
     // Restore the original tools list to the end of the tools list
     tools_.insert(tools_.end(), original_tools.begin(), original_tools.end());
+    tools_pages_dirty_ = true;
 }
 
 void McpServer::AddTool(McpTool* tool) {
     // Prevent adding duplicate tools
-    if (std::find_if(tools_.begin(), tools_.end(), [tool](const McpTool* t) { return t->name() == tool->name(); }) != tools_.end()) {
+    if (tools_index_.find(tool->name()) != tools_index_.end()) {
         ESP_LOGW(TAG, "Tool %s already added", tool->name().c_str());
         return;
     }
 
     ESP_LOGI(TAG, "Add tool: %s", tool->name().c_str());
+    tool->to_json();
     tools_.push_back(tool);
+    tools_index_[tool->name()] = tool;
+    tools_pages_dirty_ = true;
 }
 
 void McpServer::AddTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback) {
     AddTool(new McpTool(name, description, properties, callback));
 }
 
+std::string McpServer::GetToolsVersion() {
+    if (tools_pages_dirty_) {
+        BuildToolsPages();
+    }
+    char version[9];
+    snprintf(version, sizeof(version), "%08lx", (unsigned long)tools_version_);
+    return version;
+}
+
 void McpServer::ParseMessage(const std::string& message) {
     cJSON* json = cJSON_Parse(message.c_str());
     if (json == nullptr) {
@@ -152,10 +268,25 @@ void McpServer::ParseCapabilities(const cJSON* capabilities) {
 }
 
 void McpServer::ParseMessage(const cJSON* json) {
+    if (cJSON_IsArray(json)) {
+        ParseBatch(json);
+        return;
+    }
+    ParseRequest(json, 0);
+}
+
+void McpServer::ParseRequest(const cJSON* json, uint32_t batch) {
+    // Requests with a valid id always get a reply, a batch waits for all of them
+    auto id = cJSON_GetObjectItem(json, "id");
+    bool has_id = cJSON_IsNumber(id);
+
     // Check JSONRPC version
     auto version = cJSON_GetObjectItem(json, "jsonrpc");
     if (version == nullptr || !cJSON_IsString(version) || strcmp(version->valuestring, "2.0") != 0) {
-        ESP_LOGE(TAG, "Invalid JSONRPC version: %s", version ? version->valuestring : "null");
+        ESP_LOGE(TAG, "Invalid JSONRPC version: %s", cJSON_IsString(version) ? version->valuestring : "null");
+        if (has_id) {
+            ReplyError(id->valueint, "Invalid JSONRPC version", batch);
+        }
         return;
     }
     
@@ -163,27 +294,41 @@ void McpServer::ParseMessage(const cJSON* json) {
     auto method = cJSON_GetObjectItem(json, "method");
     if (method == nullptr || !cJSON_IsString(method)) {
         ESP_LOGE(TAG, "Missing method");
+        if (has_id) {
+            ReplyError(id->valueint, "Missing method", batch);
+        }
         return;
     }
     
     auto method_str = std::string(method->valuestring);
     if (method_str.find("notifications") == 0) {
+        if (method_str == "notifications/cancelled") {
+            auto params = cJSON_GetObjectItem(json, "params");
+            auto request_id = cJSON_GetObjectItem(params, "requestId");
+            // Ids are only unique within a batch, so only calls of the batch the
+            // notification came in are cancelled, or calls outside batches if it came alone
+            if (cJSON_IsNumber(request_id) && tool_executor_->Cancel(request_id->valueint, batch)) {
+                ESP_LOGI(TAG, "Tool call %d cancelled", request_id->valueint);
+                // A cancelled call is never answered, do not hold back its batch
+                DropReply(request_id->valueint, batch);
+            }
+        }
         return;
     }
     
+    if (!has_id) {
+        ESP_LOGE(TAG, "Invalid id for method: %s", method_str.c_str());
+        return;
+    }
+    auto id_int = id->valueint;
+
     // Check params
     auto params = cJSON_GetObjectItem(json, "params");
     if (params != nullptr && !cJSON_IsObject(params)) {
         ESP_LOGE(TAG, "Invalid params for method: %s", method_str.c_str());
+        ReplyError(id_int, "Invalid params", batch);
         return;
     }
-
-    auto id = cJSON_GetObjectItem(json, "id");
-    if (id == nullptr || !cJSON_IsNumber(id)) {
-        ESP_LOGE(TAG, "Invalid id for method: %s", method_str.c_str());
-        return;
-    }
-    auto id_int = id->valueint;
     
     if (method_str == "initialize") {
         if (cJSON_IsObject(params)) {
@@ -192,11 +337,28 @@ void McpServer::ParseMessage(const cJSON* json) {
                 ParseCapabilities(capabilities);
             }
         }
+        auto tools_version = GetToolsVersion();
+
         auto app_desc = esp_app_get_description();
-        std::string message = "{\"protocolVersion\":\"2024-11-05\",\"capabilities\":{\"tools\":{}},\"serverInfo\":{\"name\":\"" BOARD_NAME "\",\"version\":\"";
-        message += app_desc->version;
-        message += "\"}}";
-        ReplyResult(id_int, message);
+        // The board name and version have no fixed length
+        std::string result;
+        result.reserve(256);
+        JsonWriter json(result);
+        json.BeginObject()
+            .Member("protocolVersion", "2024-11-05")
+            .Key("capabilities").BeginObject()
+                .Key("tools").BeginObject().EndObject()
+            .EndObject()
+            .Key("serverInfo").BeginObject()
+                .Member("name", BOARD_NAME)
+                .Member("version", app_desc->version)
+            .EndObject()
+            // The client may skip tools/list if it has already cached this version of the tools list
+            .Key("_meta").BeginObject()
+                .Member("toolsVersion", tools_version)
+            .EndObject()
+            .EndObject();
+        ReplyResult(id_int, result, batch);
     } else if (method_str == "tools/list") {
         std::string cursor_str = "";
         if (params != nullptr) {
@@ -205,163 +367,393 @@ void McpServer::ParseMessage(const cJSON* json) {
                 cursor_str = std::string(cursor->valuestring);
             }
         }
-        GetToolsList(id_int, cursor_str);
+        GetToolsList(id_int, cursor_str, batch);
     } else if (method_str == "tools/call") {
         if (!cJSON_IsObject(params)) {
             ESP_LOGE(TAG, "tools/call: Missing params");
-            ReplyError(id_int, "Missing params");
+            ReplyError(id_int, "Missing params", batch);
             return;
         }
         auto tool_name = cJSON_GetObjectItem(params, "name");
         if (!cJSON_IsString(tool_name)) {
             ESP_LOGE(TAG, "tools/call: Missing name");
-            ReplyError(id_int, "Missing name");
+            ReplyError(id_int, "Missing name", batch);
             return;
         }
         auto tool_arguments = cJSON_GetObjectItem(params, "arguments");
         if (tool_arguments != nullptr && !cJSON_IsObject(tool_arguments)) {
             ESP_LOGE(TAG, "tools/call: Invalid arguments");
-            ReplyError(id_int, "Invalid arguments");
+            ReplyError(id_int, "Invalid arguments", batch);
             return;
         }
+        // Calls that ask for more stack than the workers have run on a task of their own
         auto stack_size = cJSON_GetObjectItem(params, "stackSize");
-        if (stack_size != nullptr && !cJSON_IsNumber(stack_size)) {
+        if (stack_size != nullptr && (!cJSON_IsNumber(stack_size) || stack_size->valueint <= 0)) {
             ESP_LOGE(TAG, "tools/call: Invalid stackSize");
-            ReplyError(id_int, "Invalid stackSize");
+            ReplyError(id_int, "Invalid stackSize", batch);
             return;
         }
-        DoToolCall(id_int, std::string(tool_name->valuestring), tool_arguments, stack_size ? stack_size->valueint : DEFAULT_TOOLCALL_STACK_SIZE);
+        auto timeout = cJSON_GetObjectItem(params, "timeout");
+        if (timeout != nullptr && (!cJSON_IsNumber(timeout) || timeout->valueint <= 0)) {
+            ESP_LOGE(TAG, "tools/call: Invalid timeout");
+            ReplyError(id_int, "Invalid timeout", batch);
+            return;
+        }
+        // Long running tools report progress with this token, see ReportProgress()
+        std::string progress_token;
+        auto meta = cJSON_GetObjectItem(params, "_meta");
+        auto token = cJSON_GetObjectItem(meta, "progressToken");
+        if (cJSON_IsString(token) || cJSON_IsNumber(token)) {
+            char* token_json = cJSON_PrintUnformatted(token);
+            progress_token = token_json;
+            cJSON_free(token_json);
+        }
+        DoToolCall(id_int, batch, std::string(tool_name->valuestring), tool_arguments,
+            timeout ? timeout->valueint : CONFIG_MCP_TOOL_CALL_TIMEOUT_MS,
+            stack_size ? stack_size->valueint : 0, progress_token);
     } else {
         ESP_LOGE(TAG, "Method not implemented: %s", method_str.c_str());
-        ReplyError(id_int, "Method not implemented: " + method_str);
+        ReplyError(id_int, "Method not implemented: " + method_str, batch);
     }
 }
 
-void McpServer::ReplyResult(int id, const std::string& result) {
-    std::string payload = "{\"jsonrpc\":\"2.0\",\"id\":";
-    payload += std::to_string(id) + ",\"result\":";
-    payload += result;
-    payload += "}";
-    Application::GetInstance().SendMcpMessage(payload);
+/*
+ * A JSON-RPC batch is answered with an array of responses.
+ * The ids of all requests are registered first, replies are collected until the
+ * last one arrives, including the results of tool calls that finish later on the workers.
+ * Replies are only matched within their own batch, so requests outside the batch
+ * may reuse its ids. Arrays larger than MAX_PAYLOAD_SIZE are split into several messages.
+ */
+void McpServer::ParseBatch(const cJSON* json) {
+    int size = cJSON_GetArraySize(json);
+    if (size == 0) {
+        ESP_LOGE(TAG, "Empty batch");
+        return;
+    }
+
+    McpBatch batch;
+    cJSON* item = nullptr;
+    cJSON_ArrayForEach(item, json) {
+        auto id = cJSON_GetObjectItem(item, "id");
+        auto method = cJSON_GetObjectItem(item, "method");
+        if (!cJSON_IsNumber(id)) {
+            continue;
+        }
+        if (cJSON_IsString(method) && strncmp(method->valuestring, "notifications", 13) == 0) {
+            continue;
+        }
+        batch.pending_ids.push_back(id->valueint);
+    }
+    ESP_LOGI(TAG, "Batch of %d messages, %d requests", size, (int)batch.pending_ids.size());
+
+    // 0 means not in a batch
+    uint32_t sequence = 0;
+    if (!batch.pending_ids.empty()) {
+        std::lock_guard<std::mutex> lock(batches_mutex_);
+        if (++next_batch_sequence_ == 0) {
+            next_batch_sequence_ = 1;
+        }
+        sequence = next_batch_sequence_;
+        batch.sequence = sequence;
+        batches_.push_back(std::move(batch));
+    }
+
+    cJSON_ArrayForEach(item, json) {
+        if (!cJSON_IsObject(item)) {
+            ESP_LOGE(TAG, "Invalid batch item");
+            continue;
+        }
+        ParseRequest(item, sequence);
+    }
 }
 
-void McpServer::ReplyError(int id, const std::string& message) {
-    std::string payload = "{\"jsonrpc\":\"2.0\",\"id\":";
-    payload += std::to_string(id);
-    payload += ",\"error\":{\"message\":\"";
-    payload += message;
-    payload += "\"}}";
-    Application::GetInstance().SendMcpMessage(payload);
+// Returns the batch if `id` was pending in it and the caller holds batches_mutex_
+McpServer::McpBatch* McpServer::TakePendingId(int id, uint32_t batch) {
+    if (batch == 0) {
+        return nullptr;
+    }
+    for (auto& it : batches_) {
+        if (it.sequence != batch) {
+            continue;
+        }
+        auto pending = std::find(it.pending_ids.begin(), it.pending_ids.end(), id);
+        if (pending == it.pending_ids.end()) {
+            return nullptr;
+        }
+        it.pending_ids.erase(pending);
+        return &it;
+    }
+    return nullptr;
 }
 
-void McpServer::GetToolsList(int id, const std::string& cursor) {
-    const int max_payload_size = 8000;
-    std::string json = "{\"tools\":[";
-    
-    bool found_cursor = cursor.empty();
-    auto it = tools_.begin();
-    std::string next_cursor = "";
-    
-    while (it != tools_.end()) {
-        // 如果我们还没有找到起始位置，继续搜索
-        if (!found_cursor) {
-            if ((*it)->name() == cursor) {
-                found_cursor = true;
-            } else {
-                ++it;
-                continue;
+void McpServer::SendReply(int id, uint32_t batch, std::string&& payload) {
+    std::vector<std::string> batch_payloads;
+    {
+        std::lock_guard<std::mutex> lock(batches_mutex_);
+        auto pending_batch = TakePendingId(id, batch);
+        if (pending_batch != nullptr) {
+            pending_batch->replies.push_back(std::move(payload));
+            if (!pending_batch->pending_ids.empty()) {
+                return;
             }
+            batch_payloads = JoinBatchReplies(*pending_batch);
+            RemoveBatch(pending_batch);
         }
-        
-        // 添加tool前检查大小
-        std::string tool_json = (*it)->to_json() + ",";
-        if (json.length() + tool_json.length() + 30 > max_payload_size) {
-            // 如果添加这个tool会超出大小限制，设置next_cursor并退出循环
-            next_cursor = (*it)->name();
-            break;
+    }
+
+    if (batch_payloads.empty()) {
+        Application::GetInstance().SendMcpMessage(payload);
+        return;
+    }
+    for (const auto& batch_payload : batch_payloads) {
+        Application::GetInstance().SendMcpMessage(batch_payload);
+    }
+}
+
+void McpServer::DropReply(int id, uint32_t batch) {
+    std::vector<std::string> batch_payloads;
+    {
+        std::lock_guard<std::mutex> lock(batches_mutex_);
+        auto pending_batch = TakePendingId(id, batch);
+        if (pending_batch == nullptr || !pending_batch->pending_ids.empty()) {
+            return;
         }
-        
-        json += tool_json;
-        ++it;
+        batch_payloads = JoinBatchReplies(*pending_batch);
+        RemoveBatch(pending_batch);
     }
-    
-    if (json.back() == ',') {
-        json.pop_back();
+
+    for (const auto& batch_payload : batch_payloads) {
+        Application::GetInstance().SendMcpMessage(batch_payload);
     }
-    
-    if (json.back() == '[' && !tools_.empty()) {
-        // 如果没有添加任何tool，返回错误
-        ESP_LOGE(TAG, "tools/list: Failed to add tool %s because of payload size limit", next_cursor.c_str());
-        ReplyError(id, "Failed to add tool " + next_cursor + " because of payload size limit");
+}
+
+void McpServer::RemoveBatch(const McpBatch* batch) {
+    batches_.remove_if([batch](const McpBatch& it) { return &it == batch; });
+}
+
+// Pack the replies into as few arrays as the payload size limit allows.
+// A reply that is too large by itself is sent in an array of its own.
+std::vector<std::string> McpServer::JoinBatchReplies(const McpBatch& batch) {
+    std::vector<std::string> payloads;
+    size_t index = 0;
+    while (index < batch.replies.size()) {
+        size_t size = 2;
+        size_t end = index;
+        for (; end < batch.replies.size(); ++end) {
+            size_t reply_size = batch.replies[end].size() + 1;
+            if (end > index && size + reply_size > MAX_PAYLOAD_SIZE) {
+                break;
+            }
+            size += reply_size;
+        }
+
+        std::string payload;
+        payload.reserve(size);
+        JsonWriter json(payload);
+        json.BeginArray();
+        for (; index < end; ++index) {
+            json.Raw(batch.replies[index]);
+        }
+        json.EndArray();
+        payloads.push_back(std::move(payload));
+    }
+    if (payloads.size() > 1) {
+        ESP_LOGI(TAG, "Batch replies split into %u messages", payloads.size());
+    }
+    return payloads;
+}
+
+void McpServer::ReportProgress(int progress, int total, const std::string& message) {
+    // Raw JSON progress token of the tool call running on this task
+    auto& progress_token = McpToolExecutor::GetProgressToken();
+    if (progress_token.empty()) {
         return;
     }
 
-    if (next_cursor.empty()) {
-        json += "]}";
-    } else {
-        json += "],\"nextCursor\":\"" + next_cursor + "\"}";
+    std::string payload;
+    payload.reserve(message.size() + 128);
+    JsonWriter json(payload);
+    json.BeginObject()
+        .Member("jsonrpc", "2.0")
+        .Member("method", "notifications/progress")
+        .Key("params").BeginObject()
+            .RawMember("progressToken", progress_token)
+            .Member("progress", progress);
+    if (total > 0) {
+        json.Member("total", total);
     }
-    
-    ReplyResult(id, json);
+    if (!message.empty()) {
+        json.Member("message", message);
+    }
+    json.EndObject().EndObject();
+    // Progress is sent right away, it is never held back with batch replies
+    Application::GetInstance().SendMcpMessage(payload);
 }
 
-void McpServer::DoToolCall(int id, const std::string& tool_name, const cJSON* tool_arguments, int stack_size) {
-    auto tool_iter = std::find_if(tools_.begin(), tools_.end(), 
-                                 [&tool_name](const McpTool* tool) { 
-                                     return tool->name() == tool_name; 
-                                 });
-    
-    if (tool_iter == tools_.end()) {
-        ESP_LOGE(TAG, "tools/call: Unknown tool: %s", tool_name.c_str());
-        ReplyError(id, "Unknown tool: " + tool_name);
-        return;
+void McpServer::ReplyResult(int id, const std::string& result, uint32_t batch) {
+    std::string payload;
+    payload.reserve(result.size() + 48);
+    JsonWriter json(payload);
+    json.BeginObject()
+        .Member("jsonrpc", "2.0")
+        .Member("id", id)
+        .RawMember("result", result)
+        .EndObject();
+    SendReply(id, batch, std::move(payload));
+}
+
+void McpServer::ReplyError(int id, const std::string& message, uint32_t batch) {
+    std::string payload;
+    payload.reserve(message.size() + 64);
+    JsonWriter json(payload);
+    json.BeginObject()
+        .Member("jsonrpc", "2.0")
+        .Member("id", id)
+        .Key("error").BeginObject()
+            .Member("message", message)
+        .EndObject()
+        .EndObject();
+    SendReply(id, batch, std::move(payload));
+}
+
+/*
+ * Split the tool descriptors into tools/list results of at most 8000 bytes.
+ * A page is requested with the name of its first tool as cursor, so the cursors
+ * stay stable as long as the tools list does not change.
+ * The list version is a FNV-1a hash over all descriptors.
+ */
+void McpServer::BuildToolsPages() {
+    const size_t page_suffix_reserve = 128;
+
+    tools_pages_.clear();
+    tools_page_cursors_.clear();
+    tools_page_errors_.clear();
+
+    uint32_t version = 2166136261u;
+    for (auto tool : tools_) {
+        for (char c : tool->to_json()) {
+            version = (version ^ static_cast<uint8_t>(c)) * 16777619u;
+        }
     }
+    tools_version_ = version;
+    char version_str[9];
+    snprintf(version_str, sizeof(version_str), "%08lx", (unsigned long)tools_version_);
 
-    PropertyList arguments = (*tool_iter)->properties();
-    try {
-        for (auto& argument : arguments) {
-            bool found = false;
-            if (cJSON_IsObject(tool_arguments)) {
-                auto value = cJSON_GetObjectItem(tool_arguments, argument.name().c_str());
-                if (argument.type() == kPropertyTypeBoolean && cJSON_IsBool(value)) {
-                    argument.set_value<bool>(value->valueint == 1);
-                    found = true;
-                } else if (argument.type() == kPropertyTypeInteger && cJSON_IsNumber(value)) {
-                    argument.set_value<int>(value->valueint);
-                    found = true;
-                } else if (argument.type() == kPropertyTypeString && cJSON_IsString(value)) {
-                    argument.set_value<std::string>(value->valuestring);
-                    found = true;
-                }
-            }
+    size_t index = 0;
+    std::string cursor;
+    do {
+        std::string page;
+        page.reserve(MAX_PAYLOAD_SIZE);
+        JsonWriter json(page);
+        json.BeginObject().Key("tools").BeginArray();
 
-            if (!argument.has_default_value() && !found) {
-                ESP_LOGE(TAG, "tools/call: Missing valid argument: %s", argument.name().c_str());
-                ReplyError(id, "Missing valid argument: " + argument.name());
-                return;
+        std::string next_cursor;
+        bool page_empty = true;
+        bool oversized = false;
+        for (; index < tools_.size(); ++index) {
+            auto tool = tools_[index];
+            auto& tool_json = tool->to_json();
+            oversized = tool_json.size() + page_suffix_reserve + 16 > MAX_PAYLOAD_SIZE;
+            if (!page_empty && (oversized || page.size() + tool_json.size() + 1 + page_suffix_reserve > MAX_PAYLOAD_SIZE)) {
+                next_cursor = tool->name();
+                break;
+            }
+            if (oversized) {
+                break;
             }
+            json.Raw(tool_json);
+            page_empty = false;
         }
+
+        // The page that starts with a tool too large for any page is answered with an error,
+        // the tools after it cannot be listed
+        if (page_empty && oversized) {
+            auto& name = tools_[index]->name();
+            ESP_LOGE(TAG, "tools/list: Failed to add tool %s because of payload size limit", name.c_str());
+            tools_page_errors_[cursor] = "Failed to add tool " + name + " because of payload size limit";
+            break;
+        }
+
+        json.EndArray();
+        if (!next_cursor.empty()) {
+            json.Member("nextCursor", next_cursor);
+        }
+        json.Key("_meta").BeginObject().Member("version", version_str).EndObject();
+        json.EndObject();
+
+        tools_page_cursors_[cursor] = tools_pages_.size();
+        tools_pages_.push_back(std::move(page));
+        cursor = std::move(next_cursor);
+    } while (!cursor.empty());
+    tools_pages_dirty_ = false;
+
+    ESP_LOGI(TAG, "tools/list: %u tools in %u pages, version %s", tools_.size(), tools_pages_.size(), version_str);
+}
+
+void McpServer::GetToolsList(int id, const std::string& cursor, uint32_t batch) {
+    if (tools_pages_dirty_) {
+        BuildToolsPages();
+    }
+
+    auto error = tools_page_errors_.find(cursor);
+    if (error != tools_page_errors_.end()) {
+        ReplyError(id, error->second, batch);
+        return;
+    }
+    auto it = tools_page_cursors_.find(cursor);
+    if (it == tools_page_cursors_.end()) {
+        ESP_LOGE(TAG, "tools/list: Invalid cursor %s", cursor.c_str());
+        ReplyError(id, "Invalid cursor: " + cursor, batch);
+        return;
+    }
+    ReplyResult(id, tools_pages_[it->second], batch);
+}
+
+void McpServer::DoToolCall(int id, uint32_t batch, const std::string& tool_name, const cJSON* tool_arguments, int timeout_ms, uint32_t stack_size, const std::string& progress_token) {
+    auto tool_iter = tools_index_.find(tool_name);
+    if (tool_iter == tools_index_.end()) {
+        ESP_LOGE(TAG, "tools/call: Unknown tool: %s", tool_name.c_str());
+        ReplyError(id, "Unknown tool: " + tool_name, batch);
+        return;
+    }
+
+    auto tool = tool_iter->second;
+    // Queue the call on the tool call workers to avoid blocking the main thread
+    bool queued;
+    try {
+        queued = tool_executor_->Submit(id, batch, tool, tool->max_concurrency(), timeout_ms, stack_size, tool_arguments, progress_token);
     } catch (const std::exception& e) {
         ESP_LOGE(TAG, "tools/call: %s", e.what());
-        ReplyError(id, e.what());
+        ReplyError(id, e.what(), batch);
         return;
     }
+    if (!queued) {
+        ESP_LOGE(TAG, "tools/call: Too many pending tool calls, reject %s", tool_name.c_str());
+        ReplyError(id, "Too many pending tool calls", batch);
+    }
+}
 
-    // Start a task to receive data with stack size
-    esp_pthread_cfg_t cfg = esp_pthread_get_default_config();
-    cfg.thread_name = "tool_call";
-    cfg.stack_size = stack_size;
-    cfg.prio = 1;
-    esp_pthread_set_cfg(&cfg);
-
-    // Use a thread to call the tool to avoid blocking the main thread
-    tool_call_thread_ = std::thread([this, id, tool_iter, arguments = std::move(arguments)]() {
-        try {
-            ReplyResult(id, (*tool_iter)->Call(arguments));
-        } catch (const std::exception& e) {
-            ESP_LOGE(TAG, "tools/call: %s", e.what());
-            ReplyError(id, e.what());
-        }
-    });
-    tool_call_thread_.detach();
-}
\ No newline at end of file
+std::string McpServer::GetToolCallStatsJson() {
+    auto stats = tool_executor_->GetStats();
+    std::string result;
+    result.reserve(384);
+    JsonWriter json(result);
+    json.BeginObject()
+        .Member("submitted", stats.submitted)
+        .Member("completed", stats.completed)
+        .Member("failed", stats.failed)
+        .Member("discarded", stats.discarded)
+        .Member("dedicated", stats.dedicated)
+        .Member("rejected", stats.rejected)
+        .Member("timedOut", stats.timed_out)
+        .Member("cancelled", stats.cancelled)
+        .Member("queued", stats.queued)
+        .Member("running", stats.running)
+        .Member("replacedWorkers", stats.replaced_workers)
+        .Member("queueWaitTotalMs", stats.queue_wait_total_us / 1000)
+        .Member("queueWaitMaxMs", stats.queue_wait_max_us / 1000)
+        .Member("runTimeTotalMs", stats.run_time_total_us / 1000)
+        .Member("runTimeMaxMs", stats.run_time_max_us / 1000)
+        .EndObject();
+    return result;
+}
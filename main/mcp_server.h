@@ -4,14 +4,22 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <functional>
 #include <variant>
 #include <optional>
 #include <stdexcept>
-#include <thread>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <list>
+#include <mutex>
 
 #include <cJSON.h>
 
+#include "json_writer.h"
+#include "mcp_tool_executor.h"
+
 // 添加类型别名
 using ReturnValue = std::variant<bool, int, std::string>;
 
@@ -86,37 +94,37 @@ public:
         value_ = value;
     }
 
-    std::string to_json() const {
-        cJSON *json = cJSON_CreateObject();
-        
+    void WriteJson(JsonWriter& json) const {
+        json.BeginObject();
         if (type_ == kPropertyTypeBoolean) {
-            cJSON_AddStringToObject(json, "type", "boolean");
+            json.Member("type", "boolean");
             if (has_default_value_) {
-                cJSON_AddBoolToObject(json, "default", value<bool>());
+                json.Member("default", value<bool>());
             }
         } else if (type_ == kPropertyTypeInteger) {
-            cJSON_AddStringToObject(json, "type", "integer");
+            json.Member("type", "integer");
             if (has_default_value_) {
-                cJSON_AddNumberToObject(json, "default", value<int>());
+                json.Member("default", value<int>());
             }
             if (min_value_.has_value()) {
-                cJSON_AddNumberToObject(json, "minimum", min_value_.value());
+                json.Member("minimum", min_value_.value());
             }
             if (max_value_.has_value()) {
-                cJSON_AddNumberToObject(json, "maximum", max_value_.value());
+                json.Member("maximum", max_value_.value());
             }
         } else if (type_ == kPropertyTypeString) {
-            cJSON_AddStringToObject(json, "type", "string");
+            json.Member("type", "string");
             if (has_default_value_) {
-                cJSON_AddStringToObject(json, "default", value<std::string>().c_str());
+                json.Member("default", value<std::string>());
             }
         }
-        
-        char *json_str = cJSON_PrintUnformatted(json);
-        std::string result(json_str);
-        cJSON_free(json_str);
-        cJSON_Delete(json);
-        
+        json.EndObject();
+    }
+
+    std::string to_json() const {
+        std::string result;
+        JsonWriter json(result);
+        WriteJson(json);
         return result;
     }
 };
@@ -154,29 +162,58 @@ public:
         return required;
     }
 
-    std::string to_json() const {
-        cJSON *json = cJSON_CreateObject();
-        
+    void WriteJson(JsonWriter& json) const {
+        json.BeginObject();
         for (const auto& property : properties_) {
-            cJSON *prop_json = cJSON_Parse(property.to_json().c_str());
-            cJSON_AddItemToObject(json, property.name().c_str(), prop_json);
+            json.Key(property.name());
+            property.WriteJson(json);
         }
-        
-        char *json_str = cJSON_PrintUnformatted(json);
-        std::string result(json_str);
-        cJSON_free(json_str);
-        cJSON_Delete(json);
-        
+        json.EndObject();
+    }
+
+    std::string to_json() const {
+        std::string result;
+        JsonWriter json(result);
+        WriteJson(json);
         return result;
     }
 };
 
-class McpTool {
+class McpTool : public McpToolCallable {
 private:
     std::string name_;
     std::string description_;
     PropertyList properties_;
     std::function<ReturnValue(const PropertyList&)> callback_;
+    mutable std::string json_;
+    int max_concurrency_ = 1;
+
+protected:
+    // For tools that parse their own arguments, `properties` only describes the input schema
+    McpTool(const std::string& name, const std::string& description, const PropertyList& properties)
+        : name_(name), description_(description), properties_(properties) {}
+
+    static std::string FormatResult(const ReturnValue& return_value) {
+        // 返回结果
+        std::string result;
+        JsonWriter json(result);
+        json.BeginObject()
+            .Key("content").BeginArray()
+                .BeginObject()
+                    .Member("type", "text");
+        if (std::holds_alternative<std::string>(return_value)) {
+            json.Member("text", std::get<std::string>(return_value));
+        } else if (std::holds_alternative<bool>(return_value)) {
+            json.Member("text", std::get<bool>(return_value) ? "true" : "false");
+        } else if (std::holds_alternative<int>(return_value)) {
+            json.Member("text", std::to_string(std::get<int>(return_value)));
+        }
+        json.EndObject()
+            .EndArray()
+            .Member("isError", false)
+            .EndObject();
+        return result;
+    }
 
 public:
     McpTool(const std::string& name, 
@@ -187,65 +224,207 @@ public:
         description_(description), 
         properties_(properties), 
         callback_(callback) {}
+    virtual ~McpTool() = default;
 
     inline const std::string& name() const { return name_; }
     inline const std::string& description() const { return description_; }
     inline const PropertyList& properties() const { return properties_; }
+    // How many calls of this tool may run at the same time
+    inline int max_concurrency() const { return max_concurrency_; }
+    inline void set_max_concurrency(int max_concurrency) { max_concurrency_ = max_concurrency; }
 
-    std::string to_json() const {
+    void WriteJson(JsonWriter& json) const {
         std::vector<std::string> required = properties_.GetRequired();
-        
-        cJSON *json = cJSON_CreateObject();
-        cJSON_AddStringToObject(json, "name", name_.c_str());
-        cJSON_AddStringToObject(json, "description", description_.c_str());
-        
-        cJSON *input_schema = cJSON_CreateObject();
-        cJSON_AddStringToObject(input_schema, "type", "object");
-        
-        cJSON *properties = cJSON_Parse(properties_.to_json().c_str());
-        cJSON_AddItemToObject(input_schema, "properties", properties);
-        
+
+        json.BeginObject()
+            .Member("name", name_)
+            .Member("description", description_)
+            .Key("inputSchema").BeginObject()
+                .Member("type", "object")
+                .Key("properties");
+        properties_.WriteJson(json);
         if (!required.empty()) {
-            cJSON *required_array = cJSON_CreateArray();
+            json.Key("required").BeginArray();
             for (const auto& property : required) {
-                cJSON_AddItemToArray(required_array, cJSON_CreateString(property.c_str()));
+                json.String(property);
             }
-            cJSON_AddItemToObject(input_schema, "required", required_array);
+            json.EndArray();
         }
-        
-        cJSON_AddItemToObject(json, "inputSchema", input_schema);
-        
-        char *json_str = cJSON_PrintUnformatted(json);
-        std::string result(json_str);
-        cJSON_free(json_str);
-        cJSON_Delete(json);
-        
-        return result;
+        json.EndObject().EndObject();
     }
 
-    std::string Call(const PropertyList& properties) {
-        ReturnValue return_value = callback_(properties);
-        // 返回结果
-        cJSON* result = cJSON_CreateObject();
-        cJSON* content = cJSON_CreateArray();
-        cJSON* text = cJSON_CreateObject();
-        cJSON_AddStringToObject(text, "type", "text");
-        if (std::holds_alternative<std::string>(return_value)) {
-            cJSON_AddStringToObject(text, "text", std::get<std::string>(return_value).c_str());
-        } else if (std::holds_alternative<bool>(return_value)) {
-            cJSON_AddStringToObject(text, "text", std::get<bool>(return_value) ? "true" : "false");
-        } else if (std::holds_alternative<int>(return_value)) {
-            cJSON_AddStringToObject(text, "text", std::to_string(std::get<int>(return_value)).c_str());
+    // The descriptor never changes after registration, serialize it only once
+    const std::string& to_json() const {
+        if (json_.empty()) {
+            JsonWriter json(json_);
+            WriteJson(json);
+        }
+        return json_;
+    }
+
+    // Copy of the input schema with the values of tools/call
+    void Bind(const cJSON* arguments, McpToolArgs& args) override {
+        auto& properties = args.Emplace<PropertyList>(properties_);
+        for (auto& property : properties) {
+            bool found = false;
+            if (cJSON_IsObject(arguments)) {
+                auto value = cJSON_GetObjectItem(arguments, property.name().c_str());
+                if (property.type() == kPropertyTypeBoolean && cJSON_IsBool(value)) {
+                    property.set_value<bool>(value->valueint == 1);
+                    found = true;
+                } else if (property.type() == kPropertyTypeInteger && cJSON_IsNumber(value)) {
+                    property.set_value<int>(value->valueint);
+                    found = true;
+                } else if (property.type() == kPropertyTypeString && cJSON_IsString(value)) {
+                    property.set_value<std::string>(value->valuestring);
+                    found = true;
+                }
+            }
+
+            if (!property.has_default_value() && !found) {
+                throw std::invalid_argument("Missing valid argument: " + property.name());
+            }
+        }
+    }
+
+    std::string Call(McpToolArgs& args) override {
+        return FormatResult(callback_(args.Get<PropertyList>()));
+    }
+};
+
+// Argument of a typed tool: a member of the argument struct `Args` with its schema.
+// Use McpArg() to create it and McpArgs() to list all arguments of a tool.
+template<typename Args, typename T>
+struct McpField {
+    static_assert(std::is_same_v<T, bool> || std::is_same_v<T, int> || std::is_same_v<T, std::string>,
+        "Tool arguments must be bool, int or std::string");
+    static constexpr PropertyType type = std::is_same_v<T, bool> ? kPropertyTypeBoolean :
+        std::is_same_v<T, int> ? kPropertyTypeInteger : kPropertyTypeString;
+
+    const char* name;
+    T Args::* member;
+    std::optional<T> default_value;
+    std::optional<int> min_value;
+    std::optional<int> max_value;
+
+    Property ToProperty() const {
+        if constexpr (std::is_same_v<T, int>) {
+            if (min_value.has_value() && default_value.has_value()) {
+                return Property(name, type, *default_value, *min_value, *max_value);
+            } else if (min_value.has_value()) {
+                return Property(name, type, *min_value, *max_value);
+            }
+        }
+        if (default_value.has_value()) {
+            return Property(name, type, *default_value);
         }
-        cJSON_AddItemToArray(content, text);
-        cJSON_AddItemToObject(result, "content", content);
-        cJSON_AddBoolToObject(result, "isError", false);
-
-        auto json_str = cJSON_PrintUnformatted(result);
-        std::string result_str(json_str);
-        cJSON_free(json_str);
-        cJSON_Delete(result);
-        return result_str;
+        return Property(name, type);
+    }
+
+    // Same rules and error messages as the PropertyList arguments
+    void Parse(const cJSON* arguments, Args& args) const {
+        auto value = cJSON_IsObject(arguments) ? cJSON_GetObjectItem(arguments, name) : nullptr;
+        if constexpr (std::is_same_v<T, bool>) {
+            if (cJSON_IsBool(value)) {
+                args.*member = value->valueint == 1;
+                return;
+            }
+        } else if constexpr (std::is_same_v<T, int>) {
+            if (cJSON_IsNumber(value)) {
+                if (min_value.has_value() && value->valueint < *min_value) {
+                    throw std::invalid_argument("Value is below minimum allowed: " + std::to_string(*min_value));
+                }
+                if (max_value.has_value() && value->valueint > *max_value) {
+                    throw std::invalid_argument("Value exceeds maximum allowed: " + std::to_string(*max_value));
+                }
+                args.*member = value->valueint;
+                return;
+            }
+        } else {
+            if (cJSON_IsString(value)) {
+                args.*member = value->valuestring;
+                return;
+            }
+        }
+        if (!default_value.has_value()) {
+            throw std::invalid_argument(std::string("Missing valid argument: ") + name);
+        }
+        args.*member = *default_value;
+    }
+};
+
+template<typename T>
+struct McpNonDeduced {
+    using type = T;
+};
+
+// Required argument
+template<typename Args, typename T>
+McpField<Args, T> McpArg(const char* name, T Args::* member) {
+    return McpField<Args, T>{name, member, std::nullopt, std::nullopt, std::nullopt};
+}
+
+// Optional argument with default value
+template<typename Args, typename T>
+McpField<Args, T> McpArg(const char* name, T Args::* member, const typename McpNonDeduced<T>::type& default_value) {
+    return McpField<Args, T>{name, member, default_value, std::nullopt, std::nullopt};
+}
+
+// Required integer argument within [min_value, max_value]
+template<typename Args>
+McpField<Args, int> McpArg(const char* name, int Args::* member, int min_value, int max_value) {
+    return McpField<Args, int>{name, member, std::nullopt, min_value, max_value};
+}
+
+// Optional integer argument within [min_value, max_value]
+template<typename Args>
+McpField<Args, int> McpArg(const char* name, int Args::* member, int default_value, int min_value, int max_value) {
+    if (default_value < min_value || default_value > max_value) {
+        throw std::invalid_argument("Default value must be within the specified range");
+    }
+    return McpField<Args, int>{name, member, default_value, min_value, max_value};
+}
+
+template<typename... Fields>
+std::tuple<Fields...> McpArgs(Fields... fields) {
+    return std::tuple<Fields...>(fields...);
+}
+
+// A tool whose arguments are parsed straight into the struct `Args`.
+// The input schema is generated from the fields once at registration.
+template<typename Args, typename... Fields>
+class TypedMcpTool : public McpTool {
+private:
+    std::tuple<Fields...> fields_;
+    std::function<ReturnValue(const Args&)> callback_;
+
+    static PropertyList MakeProperties(const std::tuple<Fields...>& fields) {
+        PropertyList properties;
+        std::apply([&properties](const auto&... field) {
+            (properties.AddProperty(field.ToProperty()), ...);
+        }, fields);
+        return properties;
+    }
+
+public:
+    TypedMcpTool(const std::string& name,
+            const std::string& description,
+            const std::tuple<Fields...>& fields,
+            std::function<ReturnValue(const Args&)> callback)
+        : McpTool(name, description, MakeProperties(fields)),
+        fields_(fields),
+        callback_(callback) {}
+
+    // The struct is parsed straight into the call slot, see MCP_TOOL_ARGS_SIZE
+    void Bind(const cJSON* arguments, McpToolArgs& slot) override {
+        auto& args = slot.Emplace<Args>();
+        std::apply([arguments, &args](const auto&... field) {
+            (field.Parse(arguments, args), ...);
+        }, fields_);
+    }
+
+    std::string Call(McpToolArgs& slot) override {
+        return FormatResult(callback_(slot.Get<Args>()));
     }
 };
 
@@ -259,8 +438,22 @@ public:
     void AddCommonTools();
     void AddTool(McpTool* tool);
     void AddTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback);
+    // Typed tool, for example:
+    //   struct VolumeArgs { int volume; };
+    //   AddTool<VolumeArgs>("set_volume", "...", McpArgs(McpArg("volume", &VolumeArgs::volume, 0, 100)),
+    //       [](const VolumeArgs& args) -> ReturnValue { ... });
+    template<typename Args, typename... Fields>
+    void AddTool(const std::string& name, const std::string& description, const std::tuple<Fields...>& fields, std::function<ReturnValue(const Args&)> callback) {
+        AddTool(new TypedMcpTool<Args, Fields...>(name, description, fields, callback));
+    }
     void ParseMessage(const cJSON* json);
     void ParseMessage(const std::string& message);
+    // Hash of the tools list, the same as initialize advertises in _meta.toolsVersion
+    std::string GetToolsVersion();
+
+    // Send notifications/progress for the tool call running on the current task.
+    // Does nothing if the caller did not ask for progress. `total` is omitted if not positive.
+    void ReportProgress(int progress, int total = 0, const std::string& message = "");
 
 private:
     McpServer();
@@ -268,14 +461,42 @@ private:
 
     void ParseCapabilities(const cJSON* capabilities);
 
-    void ReplyResult(int id, const std::string& result);
-    void ReplyError(int id, const std::string& message);
-
-    void GetToolsList(int id, const std::string& cursor);
-    void DoToolCall(int id, const std::string& tool_name, const cJSON* tool_arguments, int stack_size);
+    struct McpBatch {
+        uint32_t sequence = 0;
+        std::vector<int> pending_ids;
+        std::vector<std::string> replies;
+    };
+
+    // `batch` is the sequence of the batch the request came in, 0 if it was not in a batch
+    void ParseRequest(const cJSON* json, uint32_t batch);
+    void ParseBatch(const cJSON* json);
+    McpBatch* TakePendingId(int id, uint32_t batch);
+    void RemoveBatch(const McpBatch* batch);
+    void SendReply(int id, uint32_t batch, std::string&& payload);
+    void DropReply(int id, uint32_t batch);
+    std::vector<std::string> JoinBatchReplies(const McpBatch& batch);
+    void ReplyResult(int id, const std::string& result, uint32_t batch);
+    void ReplyError(int id, const std::string& message, uint32_t batch);
+
+    void GetToolsList(int id, const std::string& cursor, uint32_t batch);
+    void BuildToolsPages();
+    void DoToolCall(int id, uint32_t batch, const std::string& tool_name, const cJSON* tool_arguments, int timeout_ms, uint32_t stack_size, const std::string& progress_token);
+    std::string GetToolCallStatsJson();
 
     std::vector<McpTool*> tools_;
-    std::thread tool_call_thread_;
+    std::unordered_map<std::string, McpTool*> tools_index_;
+    // Ready-made tools/list results, keyed by the cursor that requests them ("" for the first page)
+    std::vector<std::string> tools_pages_;
+    std::unordered_map<std::string, size_t> tools_page_cursors_;
+    // Cursors of pages that cannot be built, with the error to reply
+    std::unordered_map<std::string, std::string> tools_page_errors_;
+    bool tools_pages_dirty_ = true;
+    uint32_t tools_version_ = 0;
+    std::unique_ptr<McpToolExecutor> tool_executor_;
+    // Batches waiting for replies, replies of tool calls arrive from the worker tasks
+    std::list<McpBatch> batches_;
+    std::mutex batches_mutex_;
+    uint32_t next_batch_sequence_ = 0;
 };
 
 #endif // MCP_SERVER_H
@@ -0,0 +1,316 @@
+#include "mcp_tool_executor.h"
+
+#include <esp_log.h>
+#include <algorithm>
+#include <stdexcept>
+
+#define TAG "McpToolExecutor"
+
+#define DEADLINE_CHECK_INTERVAL_US (200 * 1000)
+
+thread_local std::string McpToolExecutor::current_progress_token_;
+
+// Slots for all queued and running calls are allocated once, including the calls
+// of the replacement workers
+McpToolExecutor::McpToolExecutor(int worker_count, int queue_size, uint32_t stack_size)
+    : jobs_(queue_size + worker_count * 2), worker_count_(worker_count), queue_size_(queue_size), stack_size_(stack_size) {
+
+    esp_timer_create_args_t deadline_timer_args = {
+        .callback = [](void* arg) {
+            auto executor = static_cast<McpToolExecutor*>(arg);
+            executor->CheckDeadlines();
+        },
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "tool_call_deadline",
+        .skip_unhandled_events = true,
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&deadline_timer_args, &deadline_timer_));
+
+    for (int i = 0; i < worker_count; i++) {
+        StartWorker();
+    }
+    ESP_LOGI(TAG, "Started %d tool call workers, queue size %d, stack size %lu", worker_count, queue_size, stack_size);
+}
+
+McpToolExecutor::~McpToolExecutor() {
+    for (auto handle : workers_) {
+        if (handle != nullptr) {
+            vTaskDelete(handle);
+        }
+    }
+    if (deadline_timer_ != nullptr) {
+        esp_timer_stop(deadline_timer_);
+        esp_timer_delete(deadline_timer_);
+    }
+}
+
+void McpToolExecutor::StartWorker() {
+    TaskHandle_t handle = nullptr;
+    xTaskCreate([](void* arg) {
+        auto executor = static_cast<McpToolExecutor*>(arg);
+        executor->WorkerLoop();
+        vTaskDelete(NULL);
+    }, "tool_call", stack_size_, this, 1, &handle);
+    if (handle != nullptr) {
+        workers_.push_back(handle);
+    }
+}
+
+void McpToolExecutor::OnResult(std::function<void(int id, uint32_t context, const std::string& result)> callback) {
+    on_result_ = callback;
+}
+
+void McpToolExecutor::OnError(std::function<void(int id, uint32_t context, const std::string& message)> callback) {
+    on_error_ = callback;
+}
+
+int McpToolExecutor::CountJobs(JobState state) {
+    return std::count_if(jobs_.begin(), jobs_.end(), [state](const Job& job) { return job.state == state; });
+}
+
+bool McpToolExecutor::Submit(int id, uint32_t context, McpToolCallable* tool, int max_concurrency, int timeout_ms,
+        uint32_t stack_size, const cJSON* arguments, const std::string& progress_token) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto slot = std::find_if(jobs_.begin(), jobs_.end(), [](const Job& job) { return job.state == kJobStateFree; });
+    if (CountJobs(kJobStateQueued) >= queue_size_ || slot == jobs_.end()) {
+        stats_.rejected++;
+        return false;
+    }
+    // The slot stays free if the arguments are rejected
+    tool->Bind(arguments, slot->args);
+
+    auto now = esp_timer_get_time();
+    slot->state = kJobStateQueued;
+    slot->id = id;
+    slot->context = context;
+    slot->tool = tool;
+    slot->max_concurrency = std::max(max_concurrency, 1);
+    slot->replied = false;
+    slot->timed_out = false;
+    slot->dedicated = stack_size > stack_size_;
+    slot->sequence = next_sequence_++;
+    slot->submit_time = now;
+    slot->deadline = now + (int64_t)timeout_ms * 1000;
+    // Reuses the buffer of the slot once it has grown to the token size
+    slot->progress_token.assign(progress_token);
+
+    if (slot->dedicated) {
+        // The stack is only held while the call runs
+        auto start = new DedicatedStart{this, &*slot, slot->sequence};
+        auto ret = xTaskCreate([](void* arg) {
+            auto start = static_cast<DedicatedStart*>(arg);
+            auto executor = start->executor;
+            auto job = start->job;
+            std::unique_lock<std::mutex> lock(executor->mutex_);
+            // The call may have been cancelled or timed out, and its slot reused, before the task ran
+            if (job->state == kJobStateQueued && job->sequence == start->sequence) {
+                executor->RunJob(lock, job);
+            }
+            if (lock.owns_lock()) {
+                lock.unlock();
+            }
+            delete start;
+            vTaskDelete(NULL);
+        }, "tool_call_big", stack_size, start, 1, nullptr);
+        if (ret != pdPASS) {
+            delete start;
+            slot->state = kJobStateFree;
+            slot->args.Reset();
+            stats_.rejected++;
+            throw std::runtime_error("Failed to create a task with stack size " + std::to_string(stack_size));
+        }
+        stats_.dedicated++;
+    }
+    stats_.submitted++;
+
+    if (!deadline_timer_running_) {
+        deadline_timer_running_ = true;
+        esp_timer_start_periodic(deadline_timer_, DEADLINE_CHECK_INTERVAL_US);
+    }
+    condition_variable_.notify_one();
+    return true;
+}
+
+bool McpToolExecutor::Cancel(int id, uint32_t context) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& job : jobs_) {
+        if (job.id != id || job.context != context || job.replied) {
+            continue;
+        }
+        if (job.state == kJobStateQueued) {
+            job.state = kJobStateFree;
+            job.args.Reset();
+            stats_.cancelled++;
+            return true;
+        } else if (job.state == kJobStateRunning) {
+            // The tool keeps running, only its result is discarded
+            job.replied = true;
+            stats_.cancelled++;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Oldest queued call whose tool has not reached its concurrency limit
+McpToolExecutor::Job* McpToolExecutor::PickJob() {
+    Job* picked = nullptr;
+    for (auto& job : jobs_) {
+        if (job.state != kJobStateQueued || job.dedicated) {
+            continue;
+        }
+        if (picked != nullptr && (int32_t)(job.sequence - picked->sequence) > 0) {
+            continue;
+        }
+        int running = std::count_if(jobs_.begin(), jobs_.end(), [&job](const Job& other) {
+            return other.state == kJobStateRunning && other.tool == job.tool;
+        });
+        if (running < job.max_concurrency) {
+            picked = &job;
+        }
+    }
+    return picked;
+}
+
+void McpToolExecutor::WorkerLoop() {
+    while (true) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        Job* job = nullptr;
+        condition_variable_.wait(lock, [this, &job]() {
+            job = PickJob();
+            return job != nullptr;
+        });
+        if (RunJob(lock, job)) {
+            return;
+        }
+    }
+}
+
+// Called with the lock held, returns with it released.
+// Returns true if the calling worker has been replaced and must exit.
+bool McpToolExecutor::RunJob(std::unique_lock<std::mutex>& lock, Job* job) {
+    auto start_time = esp_timer_get_time();
+    auto queue_wait = start_time - job->submit_time;
+    stats_.queue_wait_total_us += queue_wait;
+    stats_.queue_wait_max_us = std::max(stats_.queue_wait_max_us, queue_wait);
+    job->state = kJobStateRunning;
+    int id = job->id;
+    uint32_t context = job->context;
+    // Swapped instead of copied, the buffers go back and forth between the slots and the worker
+    current_progress_token_.swap(job->progress_token);
+    lock.unlock();
+
+    // The slot is not touched by others while the job is running
+    std::string result;
+    std::string error;
+    bool success = true;
+    try {
+        result = job->tool->Call(job->args);
+    } catch (const std::exception& e) {
+        error = e.what();
+        success = false;
+    }
+    current_progress_token_.clear();
+
+    lock.lock();
+    job->args.Reset();
+    auto run_time = esp_timer_get_time() - start_time;
+    stats_.run_time_total_us += run_time;
+    stats_.run_time_max_us = std::max(stats_.run_time_max_us, run_time);
+    bool deliver = !job->replied;
+    if (!deliver) {
+        stats_.discarded++;
+    } else if (success) {
+        stats_.completed++;
+    } else {
+        stats_.failed++;
+    }
+    // A replacement has taken over the place of this worker in the pool
+    bool retire = job->timed_out && !job->dedicated && replacement_workers_ > 0;
+    if (retire) {
+        replacement_workers_--;
+        auto handle = std::find(workers_.begin(), workers_.end(), xTaskGetCurrentTaskHandle());
+        if (handle != workers_.end()) {
+            workers_.erase(handle);
+        }
+    }
+    job->replied = true;
+    job->state = kJobStateFree;
+    // A finished call may unblock a queued call of the same tool
+    condition_variable_.notify_all();
+    lock.unlock();
+
+    if (!deliver) {
+        ESP_LOGW(TAG, "Drop the result of tool call %d after timeout or cancellation", id);
+    } else if (success) {
+        if (on_result_) {
+            on_result_(id, context, result);
+        }
+    } else {
+        ESP_LOGE(TAG, "Tool call %d failed: %s", id, error.c_str());
+        if (on_error_) {
+            on_error_(id, context, error);
+        }
+    }
+    if (retire) {
+        ESP_LOGI(TAG, "Tool call %d returned after timeout, worker exits", id);
+    }
+    return retire;
+}
+
+void McpToolExecutor::CheckDeadlines() {
+    std::vector<std::pair<int, uint32_t>> expired;
+    int stuck_workers = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto now = esp_timer_get_time();
+        bool active = false;
+        for (auto& job : jobs_) {
+            if (job.state == kJobStateFree) {
+                continue;
+            }
+            active = true;
+            if (job.replied || now < job.deadline) {
+                continue;
+            }
+            job.replied = true;
+            stats_.timed_out++;
+            expired.emplace_back(job.id, job.context);
+            if (job.state == kJobStateQueued) {
+                job.state = kJobStateFree;
+                job.args.Reset();
+            } else {
+                job.timed_out = true;
+                if (!job.dedicated) {
+                    stuck_workers++;
+                }
+            }
+        }
+        // Keep the pool serving the queue while the timed out calls still hold their workers
+        for (; stuck_workers > 0 && replacement_workers_ < worker_count_; stuck_workers--) {
+            replacement_workers_++;
+            stats_.replaced_workers++;
+            StartWorker();
+        }
+        if (!active) {
+            esp_timer_stop(deadline_timer_);
+            deadline_timer_running_ = false;
+        }
+    }
+
+    for (auto& [id, context] : expired) {
+        ESP_LOGW(TAG, "Tool call %d timed out", id);
+        if (on_error_) {
+            on_error_(id, context, "Tool call timed out");
+        }
+    }
+}
+
+McpToolCallStats McpToolExecutor::GetStats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto stats = stats_;
+    stats.queued = CountJobs(kJobStateQueued);
+    stats.running = CountJobs(kJobStateRunning);
+    return stats;
+}
@@ -0,0 +1,168 @@
+#ifndef MCP_TOOL_EXECUTOR_H
+#define MCP_TOOL_EXECUTOR_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_timer.h>
+
+#include <cJSON.h>
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <new>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <condition_variable>
+
+// Largest argument type a tool may parse into its call slot
+#define MCP_TOOL_ARGS_SIZE 64
+
+struct McpToolCallStats {
+    uint32_t submitted = 0;
+    uint32_t completed = 0;
+    uint32_t failed = 0;
+    uint32_t discarded = 0;         // Returned after their timeout or cancellation, not in completed or failed
+    uint32_t dedicated = 0;         // Ran on their own task because they asked for a larger stack
+    uint32_t rejected = 0;
+    uint32_t timed_out = 0;
+    uint32_t cancelled = 0;
+    uint32_t queued = 0;
+    uint32_t running = 0;
+    uint32_t replaced_workers = 0;  // Workers started in place of the ones held by timed out calls
+    int64_t queue_wait_total_us = 0;
+    int64_t queue_wait_max_us = 0;
+    int64_t run_time_total_us = 0;
+    int64_t run_time_max_us = 0;
+};
+
+// Parsed arguments of one tool call. They are constructed in place in the job slot
+// of the call, so queuing a call does not allocate a closure for it.
+class McpToolArgs {
+public:
+    McpToolArgs() = default;
+    McpToolArgs(const McpToolArgs&) = delete;
+    McpToolArgs& operator=(const McpToolArgs&) = delete;
+    ~McpToolArgs() { Reset(); }
+
+    template<typename T, typename... Params>
+    T& Emplace(Params&&... params) {
+        static_assert(sizeof(T) <= MCP_TOOL_ARGS_SIZE, "Tool arguments exceed MCP_TOOL_ARGS_SIZE");
+        static_assert(alignof(T) <= alignof(std::max_align_t), "Tool arguments are over-aligned");
+        Reset();
+        auto value = new (storage_) T(std::forward<Params>(params)...);
+        destroy_ = [](void* storage) { static_cast<T*>(storage)->~T(); };
+        return *value;
+    }
+
+    template<typename T>
+    T& Get() { return *std::launder(reinterpret_cast<T*>(storage_)); }
+
+    void Reset() {
+        if (destroy_ != nullptr) {
+            destroy_(storage_);
+            destroy_ = nullptr;
+        }
+    }
+
+private:
+    alignas(std::max_align_t) uint8_t storage_[MCP_TOOL_ARGS_SIZE];
+    void (*destroy_)(void*) = nullptr;
+};
+
+// What the executor needs from a tool
+class McpToolCallable {
+public:
+    virtual ~McpToolCallable() = default;
+    // Parse and validate `arguments` into `args`.
+    // Throws std::invalid_argument if an argument is missing or out of range.
+    virtual void Bind(const cJSON* arguments, McpToolArgs& args) = 0;
+    // Returns the result JSON or throws std::exception on failure
+    virtual std::string Call(McpToolArgs& args) = 0;
+};
+
+// Runs tool calls on a fixed pool of worker tasks created once at startup.
+// Calls wait in a bounded queue, each tool can limit how many of its calls run
+// at the same time, and every call has a deadline after which it is answered
+// with an error and its late result is dropped.
+// A worker stuck in a timed out call is replaced by a new one, which keeps the
+// pool size; the stuck worker exits once its call returns.
+// A call that needs a larger stack than the workers have runs on a task of its own.
+class McpToolExecutor {
+public:
+    McpToolExecutor(int worker_count, int queue_size, uint32_t stack_size);
+    ~McpToolExecutor();
+
+    // The arguments are bound into a free job slot, exceptions of Bind() are passed on.
+    // `context` is handed back with the reply. A `stack_size` above the worker stack size
+    // starts a task for the call, std::runtime_error is thrown if it cannot be created.
+    // Returns false if the queue is full.
+    bool Submit(int id, uint32_t context, McpToolCallable* tool, int max_concurrency, int timeout_ms,
+        uint32_t stack_size, const cJSON* arguments, const std::string& progress_token);
+    // Drop a queued call or discard the result of a running one, no reply is sent
+    bool Cancel(int id, uint32_t context);
+
+    void OnResult(std::function<void(int id, uint32_t context, const std::string& result)> callback);
+    void OnError(std::function<void(int id, uint32_t context, const std::string& message)> callback);
+
+    McpToolCallStats GetStats();
+
+    // Progress token of the call running on the current task, empty if none was given
+    static const std::string& GetProgressToken() { return current_progress_token_; }
+
+private:
+    enum JobState {
+        kJobStateFree,
+        kJobStateQueued,
+        kJobStateRunning
+    };
+
+    struct Job {
+        JobState state = kJobStateFree;
+        int id = 0;
+        uint32_t context = 0;
+        McpToolCallable* tool = nullptr;
+        int max_concurrency = 1;
+        bool replied = false;
+        bool timed_out = false;
+        bool dedicated = false;     // Runs on its own task, not picked by the workers
+        uint32_t sequence = 0;
+        int64_t submit_time = 0;
+        int64_t deadline = 0;
+        McpToolArgs args;
+        std::string progress_token;
+    };
+
+    struct DedicatedStart {
+        McpToolExecutor* executor;
+        Job* job;
+        uint32_t sequence;
+    };
+
+    std::mutex mutex_;
+    std::condition_variable condition_variable_;
+    std::vector<Job> jobs_;
+    std::vector<TaskHandle_t> workers_;
+    int worker_count_;
+    int queue_size_;
+    uint32_t stack_size_;
+    int replacement_workers_ = 0;   // Running besides the pool, at most worker_count_
+    uint32_t next_sequence_ = 0;
+    McpToolCallStats stats_;
+    esp_timer_handle_t deadline_timer_ = nullptr;
+    bool deadline_timer_running_ = false;
+
+    std::function<void(int id, uint32_t context, const std::string& result)> on_result_;
+    std::function<void(int id, uint32_t context, const std::string& message)> on_error_;
+    static thread_local std::string current_progress_token_;
+
+    Job* PickJob();
+    int CountJobs(JobState state);
+    void StartWorker();
+    void WorkerLoop();
+    bool RunJob(std::unique_lock<std::mutex>& lock, Job* job);
+    void CheckDeadlines();
+};
+
+#endif // MCP_TOOL_EXECUTOR_H
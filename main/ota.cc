@@ -2,6 +2,10 @@
 #include "system_info.h"
 #include "settings.h"
 #include "assets/lang_config.h"
+#include "json_writer.h"
+#include "ota_pipeline.h"
+#include "ota_delta.h"
+#include "ota_decompress.h"
 
 #include <cJSON.h>
 #include <esp_log.h>
@@ -10,6 +14,8 @@
 #include <esp_app_format.h>
 #include <esp_efuse.h>
 #include <esp_efuse_table.h>
+#include <spi_flash_mmap.h>
+#include <mbedtls/sha256.h>
 #ifdef SOC_HMAC_SUPPORTED
 #include <esp_hmac.h>
 #endif
@@ -21,6 +27,9 @@
 
 #define TAG "Ota"
 
+// Commit the resume state to flash at least every 256 KB
+#define OTA_RESUME_FLUSH_INTERVAL (256 * 1024)
+
 
 Ota::Ota() {
 #ifdef ESP_EFUSE_BLOCK_USR_DATA
@@ -86,7 +95,21 @@ bool Ota::CheckVersion() {
 
     auto http = std::unique_ptr<Http>(SetupHttp());
 
-    std::string data = board.GetJson();
+    // While the descriptor is unchanged, the server answers 304 if the config it returned
+    // last time is still valid. The compact descriptor is only sent to servers that said
+    // they accept it with the X-Compact-Descriptor header, other servers get the full one.
+    Settings cache("ota_check", false);
+    std::string etag = cache.GetString("etag");
+    bool conditional = !etag.empty() && cache.GetString("descriptor") == board.GetDescriptorHash();
+    std::string data;
+    if (conditional) {
+        http->SetHeader("If-None-Match", etag);
+    }
+    if (conditional && cache.GetInt("compact") != 0) {
+        data = board.GetCompactJson();
+    } else {
+        data = board.GetJson();
+    }
     std::string method = data.length() > 0 ? "POST" : "GET";
     http->SetContent(std::move(data));
 
@@ -96,11 +119,19 @@ bool Ota::CheckVersion() {
     }
 
     auto status_code = http->GetStatusCode();
+    if (conditional && status_code == 304) {
+        auto date = http->GetResponseHeader("Date");
+        http->Close();
+        ESP_LOGI(TAG, "Server config not modified");
+        return LoadCheckResult(date);
+    }
     if (status_code != 200) {
         ESP_LOGE(TAG, "Failed to check version, status code: %d", status_code);
         return false;
     }
 
+    etag = http->GetResponseHeader("ETag");
+    bool compact = http->GetResponseHeader("X-Compact-Descriptor") == "1";
     data = http->ReadAll();
     http->Close();
 
@@ -173,10 +204,14 @@ bool Ota::CheckVersion() {
     }
 
     has_server_time_ = false;
+    timezone_offset_ = 0;
     cJSON *server_time = cJSON_GetObjectItem(root, "server_time");
     if (cJSON_IsObject(server_time)) {
         cJSON *timestamp = cJSON_GetObjectItem(server_time, "timestamp");
         cJSON *timezone_offset = cJSON_GetObjectItem(server_time, "timezone_offset");
+        if (cJSON_IsNumber(timezone_offset)) {
+            timezone_offset_ = timezone_offset->valueint;
+        }
         
         if (cJSON_IsNumber(timestamp)) {
             // 设置系统时间
@@ -208,6 +243,30 @@ bool Ota::CheckVersion() {
         if (cJSON_IsString(url)) {
             firmware_url_ = url->valuestring;
         }
+        // A delta patch is only usable if it was made against the running version
+        // "delta": { "from": "1.0.0", "url": "http://" }
+        firmware_delta_url_.clear();
+        cJSON *delta = cJSON_GetObjectItem(firmware, "delta");
+        if (cJSON_IsObject(delta)) {
+            cJSON *from = cJSON_GetObjectItem(delta, "from");
+            cJSON *delta_url = cJSON_GetObjectItem(delta, "url");
+            if (cJSON_IsString(from) && cJSON_IsString(delta_url) && current_version_ == from->valuestring) {
+                firmware_delta_url_ = delta_url->valuestring;
+                ESP_LOGI(TAG, "Delta update available from %s", from->valuestring);
+            }
+        }
+        // "compressed": { "encoding": "zlib", "url": "http://" }
+        firmware_compressed_url_.clear();
+        cJSON *compressed = cJSON_GetObjectItem(firmware, "compressed");
+        if (cJSON_IsObject(compressed)) {
+            cJSON *encoding = cJSON_GetObjectItem(compressed, "encoding");
+            cJSON *compressed_url = cJSON_GetObjectItem(compressed, "url");
+            if (cJSON_IsString(encoding) && strcmp(encoding->valuestring, "zlib") == 0 && cJSON_IsString(compressed_url)) {
+                firmware_compressed_url_ = compressed_url->valuestring;
+            } else {
+                ESP_LOGW(TAG, "Unsupported compressed firmware");
+            }
+        }
 
         if (cJSON_IsString(version) && cJSON_IsString(url)) {
             // Check if the version is newer, for example, 0.1.0 is newer than 0.0.1
@@ -228,6 +287,72 @@ bool Ota::CheckVersion() {
     }
 
     cJSON_Delete(root);
+
+    // Activation challenges are only valid once, such responses are never reused
+    if (!etag.empty() && !has_activation_code_ && !has_activation_challenge_) {
+        SaveCheckResult(etag, compact);
+    } else {
+        Settings settings("ota_check", true);
+        settings.EraseAll();
+    }
+    return true;
+}
+
+void Ota::SaveCheckResult(const std::string& etag, bool compact) {
+    Settings cache("ota_check", true);
+    cache.SetString("etag", etag);
+    cache.SetInt("compact", compact);
+    cache.SetString("descriptor", Board::GetInstance().GetDescriptorHash());
+    cache.SetInt("mqtt", has_mqtt_config_);
+    cache.SetInt("websocket", has_websocket_config_);
+    cache.SetInt("new_version", has_new_version_);
+    cache.SetInt("tz_offset", timezone_offset_);
+    cache.SetString("fw_version", firmware_version_);
+    cache.SetString("fw_url", firmware_url_);
+    cache.SetString("fw_delta", firmware_delta_url_);
+    cache.SetString("fw_compressed", firmware_compressed_url_);
+}
+
+// Days since 1970-01-01 of a date in the proleptic Gregorian calendar
+static int64_t DaysFromCivil(int year, int month, int day) {
+    year -= month <= 2;
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    int year_of_era = year - era * 400;
+    int day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + day_of_era - 719468;
+}
+
+// Restore the result of the last check, the settings it wrote are still in NVS
+bool Ota::LoadCheckResult(const std::string& date) {
+    Settings cache("ota_check", false);
+    has_activation_code_ = false;
+    has_activation_challenge_ = false;
+    has_mqtt_config_ = cache.GetInt("mqtt") != 0;
+    has_websocket_config_ = cache.GetInt("websocket") != 0;
+    has_new_version_ = cache.GetInt("new_version") != 0;
+    timezone_offset_ = cache.GetInt("tz_offset");
+    firmware_version_ = cache.GetString("fw_version");
+    firmware_url_ = cache.GetString("fw_url");
+    firmware_delta_url_ = cache.GetString("fw_delta");
+    firmware_compressed_url_ = cache.GetString("fw_compressed");
+
+    // The clock is set from the Date header instead of server_time, e.g. "Sun, 06 Nov 1994 08:49:37 GMT"
+    has_server_time_ = false;
+    static const char* const months[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+    char month_name[4] = {0};
+    int day, year, hour, minute, second;
+    if (sscanf(date.c_str(), "%*3s, %d %3s %d %d:%d:%d", &day, month_name, &year, &hour, &minute, &second) == 6) {
+        for (int month = 0; month < 12; month++) {
+            if (strcmp(month_name, months[month]) == 0) {
+                struct timeval tv = {};
+                tv.tv_sec = (time_t)(DaysFromCivil(year, month + 1, day) * 86400 + hour * 3600 + minute * 60 + second + timezone_offset_ * 60);
+                settimeofday(&tv, NULL);
+                has_server_time_ = true;
+                break;
+            }
+        }
+    }
     return true;
 }
 
@@ -251,111 +376,401 @@ void Ota::MarkCurrentVersionValid() {
     }
 }
 
-void Ota::Upgrade(const std::string& firmware_url) {
-    ESP_LOGI(TAG, "Upgrading firmware from %s", firmware_url.c_str());
+// SHA-256 over the bytes written to the update partition, used to check the
+// written prefix before an interrupted download is resumed
+class OtaImageHash {
+public:
+    OtaImageHash() {
+        mbedtls_sha256_init(&context_);
+        mbedtls_sha256_starts(&context_, 0);
+    }
+    ~OtaImageHash() {
+        mbedtls_sha256_free(&context_);
+    }
+
+    void Reset() {
+        mbedtls_sha256_free(&context_);
+        mbedtls_sha256_init(&context_);
+        mbedtls_sha256_starts(&context_, 0);
+    }
+
+    void Update(const uint8_t* data, size_t length) {
+        mbedtls_sha256_update(&context_, data, length);
+    }
+
+    // Digest of the data so far, hashing can continue afterwards
+    std::string HexDigest() const {
+        mbedtls_sha256_context copy;
+        mbedtls_sha256_init(&copy);
+        mbedtls_sha256_clone(&copy, &context_);
+        uint8_t digest[32];
+        mbedtls_sha256_finish(&copy, digest);
+        mbedtls_sha256_free(&copy);
+
+        char hex[65];
+        for (int i = 0; i < 32; i++) {
+            snprintf(hex + i * 2, 3, "%02x", digest[i]);
+        }
+        return std::string(hex, 64);
+    }
+
+private:
+    mbedtls_sha256_context context_;
+};
+
+bool Ota::LoadResumeState(const std::string& firmware_url, const esp_partition_t* partition, OtaResumeState& state) {
+    Settings settings("ota", false);
+    state.url = settings.GetString("url");
+    state.etag = settings.GetString("etag");
+    state.partition = settings.GetString("partition");
+    state.total_size = settings.GetInt("total");
+    state.offset = settings.GetInt("offset");
+    state.sha256 = settings.GetString("sha256");
+    if (state.offset == 0 || state.etag.empty()) {
+        return false;
+    }
+    if (state.url != firmware_url || state.partition != partition->label) {
+        ESP_LOGI(TAG, "Discard the interrupted download of %s", state.url.c_str());
+        ClearResumeState();
+        return false;
+    }
+    return true;
+}
+
+void Ota::SaveResumeState(const OtaResumeState& state) {
+    Settings settings("ota", true);
+    settings.SetString("url", state.url);
+    settings.SetString("etag", state.etag);
+    settings.SetString("partition", state.partition);
+    settings.SetInt("total", state.total_size);
+    settings.SetInt("offset", state.offset);
+    settings.SetString("sha256", state.sha256);
+}
+
+void Ota::ClearResumeState() {
+    Settings settings("ota", true);
+    settings.EraseAll();
+}
+
+// Hash the bytes already in the partition and compare them with the saved state
+static bool VerifyWrittenImage(const esp_partition_t* partition, const OtaResumeState& state, OtaImageHash& hash) {
+    std::vector<uint8_t> buffer(4096);
+    size_t offset = 0;
+    while (offset < state.offset) {
+        size_t length = std::min(buffer.size(), state.offset - offset);
+        if (esp_partition_read(partition, offset, buffer.data(), length) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to read partition at offset %u", offset);
+            return false;
+        }
+        hash.Update(buffer.data(), length);
+        offset += length;
+    }
+    return hash.HexDigest() == state.sha256;
+}
+
+// Reject images that are too short or have the same version as the running firmware
+static bool CheckImageHeader(const uint8_t* data, size_t length) {
+    const size_t header_size = sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t) + sizeof(esp_app_desc_t);
+    if (length < header_size) {
+        ESP_LOGE(TAG, "Firmware is too small: %u bytes", length);
+        return false;
+    }
+    esp_app_desc_t new_app_info;
+    memcpy(&new_app_info, data + sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t), sizeof(esp_app_desc_t));
+    ESP_LOGI(TAG, "New firmware version: %s", new_app_info.version);
+
+    auto current_version = esp_app_get_description()->version;
+    if (memcmp(new_app_info.version, current_version, sizeof(new_app_info.version)) == 0) {
+        ESP_LOGE(TAG, "Firmware version is the same, skipping upgrade");
+        return false;
+    }
+    return true;
+}
+
+bool Ota::Upgrade(const std::string& firmware_url, OtaImageFormat format) {
+    static const char* const format_names[] = { "full", "compressed", "delta" };
+    ESP_LOGI(TAG, "Upgrading firmware from %s (%s)", firmware_url.c_str(), format_names[format]);
+    auto upgrade_start_time = esp_timer_get_time();
+    // Commit pending settings before the long flash writes, the upgrade ends with a restart
+    Settings::Flush();
     esp_ota_handle_t update_handle = 0;
     auto update_partition = esp_ota_get_next_update_partition(NULL);
     if (update_partition == NULL) {
         ESP_LOGE(TAG, "Failed to get update partition");
-        return;
+        return false;
     }
 
     ESP_LOGI(TAG, "Writing to partition %s at offset 0x%lx", update_partition->label, update_partition->address);
     bool image_header_checked = false;
-    std::string image_header;
+
+    // Continue an interrupted download of the same image if the written part is intact
+    OtaImageHash image_hash;
+    OtaResumeState resume_state;
+    // Delta patches and compressed images are decoded as a stream and cannot be resumed
+    bool encoded = format != kOtaImageFormatFull;
+    bool resuming = !encoded && LoadResumeState(firmware_url, update_partition, resume_state);
+    if (resuming) {
+        ESP_LOGI(TAG, "Verifying %u bytes of the interrupted download", resume_state.offset);
+        if (!VerifyWrittenImage(update_partition, resume_state, image_hash)) {
+            ESP_LOGW(TAG, "Written data does not match, download from the beginning");
+            ClearResumeState();
+            image_hash.Reset();
+            resuming = false;
+        }
+    }
 
     auto http = std::unique_ptr<Http>(Board::GetInstance().CreateHttp());
+    if (resuming) {
+        // If-Range makes the server send the whole image if it has changed since
+        http->SetHeader("Range", "bytes=" + std::to_string(resume_state.offset) + "-");
+        http->SetHeader("If-Range", resume_state.etag);
+    }
     if (!http->Open("GET", firmware_url)) {
         ESP_LOGE(TAG, "Failed to open HTTP connection");
-        return;
+        return false;
     }
 
-    if (http->GetStatusCode() != 200) {
-        ESP_LOGE(TAG, "Failed to get firmware, status code: %d", http->GetStatusCode());
-        return;
+    int status_code = http->GetStatusCode();
+    if (resuming && status_code == 200) {
+        ESP_LOGW(TAG, "Server sent the whole image, download from the beginning");
+        ClearResumeState();
+        image_hash.Reset();
+        resuming = false;
+    } else if (resuming && status_code == 206) {
+        auto content_range = http->GetResponseHeader("Content-Range");
+        auto expected = "bytes " + std::to_string(resume_state.offset) + "-";
+        if (content_range.compare(0, expected.size(), expected) != 0) {
+            ESP_LOGE(TAG, "Unexpected Content-Range: %s", content_range.c_str());
+            ClearResumeState();
+            return false;
+        }
+    } else if (status_code != 200) {
+        ESP_LOGE(TAG, "Failed to get firmware, status code: %d", status_code);
+        return false;
     }
 
     size_t content_length = http->GetBodyLength();
     if (content_length == 0) {
         ESP_LOGE(TAG, "Failed to get content length");
-        return;
+        return false;
     }
-
-    char buffer[512];
-    size_t total_read = 0, recent_read = 0;
-    auto last_calc_time = esp_timer_get_time();
-    while (true) {
-        int ret = http->Read(buffer, sizeof(buffer));
-        if (ret < 0) {
-            ESP_LOGE(TAG, "Failed to read HTTP data: %s", esp_err_to_name(ret));
-            return;
+    size_t start_offset = resuming ? resume_state.offset : 0;
+    size_t total_size = start_offset + content_length;
+    if (resuming && total_size != resume_state.total_size) {
+        ESP_LOGE(TAG, "Image size changed from %u to %u", resume_state.total_size, total_size);
+        ClearResumeState();
+        return false;
+    }
+    if (!resuming) {
+        resume_state.url = firmware_url;
+        resume_state.etag = http->GetResponseHeader("ETag");
+        resume_state.partition = update_partition->label;
+        resume_state.total_size = total_size;
+        resume_state.offset = 0;
+        if (encoded) {
+            resume_state.etag.clear();
+        } else if (resume_state.etag.empty()) {
+            ESP_LOGW(TAG, "No ETag in the response, the download cannot be resumed");
         }
+    }
 
-        // Calculate speed and progress every second
-        recent_read += ret;
-        total_read += ret;
-        if (esp_timer_get_time() - last_calc_time >= 1000000 || ret == 0) {
-            size_t progress = total_read * 100 / content_length;
-            ESP_LOGI(TAG, "Progress: %u%% (%u/%u), Speed: %uB/s", progress, total_read, content_length, recent_read);
-            if (upgrade_callback_) {
-                upgrade_callback_(progress, recent_read);
-            }
-            last_calc_time = esp_timer_get_time();
-            recent_read = 0;
+    // Record the progress at the last sector boundary reached by each write, the sector at the
+    // resume offset is erased again. A write that ends past the boundary is split there, so the
+    // saved hash covers exactly the bytes up to the offset whatever the buffer size is.
+    size_t written = start_offset;
+    size_t last_flush = start_offset;
+    auto write_part = [&](const uint8_t* data, size_t size) -> esp_err_t {
+        auto err = esp_ota_write(update_handle, data, size);
+        if (err != ESP_OK) {
+            return err;
+        }
+        image_hash.Update(data, size);
+        written += size;
+        return ESP_OK;
+    };
+    auto writer = [&](const uint8_t* data, size_t size) -> esp_err_t {
+        // The header of an encoded image can only be checked once it is decoded
+        if (encoded && written == 0 && !CheckImageHeader(data, size)) {
+            return ESP_ERR_INVALID_VERSION;
+        }
+        size_t end = written + size;
+        size_t boundary = end - end % SPI_FLASH_SEC_SIZE;
+        if (resume_state.etag.empty() || boundary <= written) {
+            return write_part(data, size);
         }
+        size_t head = boundary - written;
+        auto err = write_part(data, head);
+        if (err != ESP_OK) {
+            return err;
+        }
+        resume_state.offset = written;
+        resume_state.sha256 = image_hash.HexDigest();
+        SaveResumeState(resume_state);
+        if (written - last_flush >= OTA_RESUME_FLUSH_INTERVAL) {
+            Settings::Flush();
+            last_flush = written;
+        }
+        return head < size ? write_part(data + head, size - head) : ESP_OK;
+    };
+
+    // A delta patch is turned into the new image against the running firmware before it is written,
+    // both helpers hold sizable buffers and are only created for their format
+    std::unique_ptr<OtaDeltaPatcher> patcher;
+    // A compressed image is inflated with a fixed window before it is written
+    std::unique_ptr<OtaDecompressor> decompressor;
+    std::function<esp_err_t(const uint8_t*, size_t)> stream_writer = writer;
+    if (format == kOtaImageFormatDelta) {
+        patcher = std::make_unique<OtaDeltaPatcher>(esp_ota_get_running_partition(), writer);
+        stream_writer = [&patcher](const uint8_t* data, size_t size) -> esp_err_t {
+            return patcher->Feed(data, size);
+        };
+    } else if (format == kOtaImageFormatCompressed) {
+        decompressor = std::make_unique<OtaDecompressor>(writer);
+        stream_writer = [&decompressor](const uint8_t* data, size_t size) -> esp_err_t {
+            return decompressor->Feed(data, size);
+        };
+    }
+
+    // The network side fills large buffers while the writer task commits them to flash
+    OtaPipeline pipeline(CONFIG_OTA_BUFFER_SIZE, CONFIG_OTA_BUFFER_COUNT);
+    if (resuming) {
+        ESP_LOGI(TAG, "Resuming download at %u/%u", start_offset, total_size);
+        if (esp_ota_resume(update_partition, OTA_WITH_SEQUENTIAL_WRITES, start_offset, &update_handle) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to resume OTA");
+            ClearResumeState();
+            return false;
+        }
+        if (!pipeline.Start(writer)) {
+            esp_ota_abort(update_handle);
+            return false;
+        }
+        image_header_checked = true;
+    }
 
-        if (ret == 0) {
+    size_t total_read = start_offset, recent_read = 0;
+    auto last_calc_time = esp_timer_get_time();
+    bool finished = false;
+    while (!finished) {
+        uint8_t* buffer = pipeline.AcquireBuffer();
+        if (buffer == nullptr) {
             break;
         }
 
-        if (!image_header_checked) {
-            image_header.append(buffer, ret);
-            if (image_header.size() >= sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t) + sizeof(esp_app_desc_t)) {
-                esp_app_desc_t new_app_info;
-                memcpy(&new_app_info, image_header.data() + sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t), sizeof(esp_app_desc_t));
-                ESP_LOGI(TAG, "New firmware version: %s", new_app_info.version);
-
-                auto current_version = esp_app_get_description()->version;
-                if (memcmp(new_app_info.version, current_version, sizeof(new_app_info.version)) == 0) {
-                    ESP_LOGE(TAG, "Firmware version is the same, skipping upgrade");
-                    return;
+        size_t length = 0;
+        while (length < pipeline.buffer_size()) {
+            auto read_start = esp_timer_get_time();
+            int ret = http->Read((char*)buffer + length, pipeline.buffer_size() - length);
+            pipeline.AddNetworkTime(esp_timer_get_time() - read_start);
+            if (ret < 0) {
+                ESP_LOGE(TAG, "Failed to read HTTP data: %s", esp_err_to_name(ret));
+                pipeline.Release(buffer);
+                if (image_header_checked) {
+                    pipeline.Finish();
+                    esp_ota_abort(update_handle);
+                    // Keep the progress for the next attempt
+                    Settings::Flush();
                 }
+                return false;
+            }
 
-                if (esp_ota_begin(update_partition, OTA_WITH_SEQUENTIAL_WRITES, &update_handle)) {
-                    esp_ota_abort(update_handle);
-                    ESP_LOGE(TAG, "Failed to begin OTA");
-                    return;
+            // Calculate speed and progress every second
+            recent_read += ret;
+            total_read += ret;
+            if (esp_timer_get_time() - last_calc_time >= 1000000 || ret == 0) {
+                size_t progress = total_read * 100 / total_size;
+                ESP_LOGI(TAG, "Progress: %u%% (%u/%u), Speed: %uB/s", progress, total_read, total_size, recent_read);
+                if (upgrade_callback_) {
+                    upgrade_callback_(progress, recent_read);
                 }
+                last_calc_time = esp_timer_get_time();
+                recent_read = 0;
+            }
 
-                image_header_checked = true;
-                std::string().swap(image_header);
+            if (ret == 0) {
+                finished = true;
+                break;
             }
+            length += ret;
         }
-        auto err = esp_ota_write(update_handle, buffer, ret);
-        if (err != ESP_OK) {
-            ESP_LOGE(TAG, "Failed to write OTA data: %s", esp_err_to_name(err));
-            esp_ota_abort(update_handle);
-            return;
+
+        if (!image_header_checked && length > 0 && !encoded && !CheckImageHeader(buffer, length)) {
+            pipeline.Release(buffer);
+            return false;
+        }
+
+        if (!image_header_checked && length > 0) {
+            if (esp_ota_begin(update_partition, OTA_WITH_SEQUENTIAL_WRITES, &update_handle)) {
+                esp_ota_abort(update_handle);
+                ESP_LOGE(TAG, "Failed to begin OTA");
+                pipeline.Release(buffer);
+                return false;
+            }
+
+            if (!pipeline.Start(stream_writer)) {
+                esp_ota_abort(update_handle);
+                pipeline.Release(buffer);
+                return false;
+            }
+            image_header_checked = true;
         }
+        pipeline.Submit(buffer, length);
     }
     http->Close();
 
-    esp_err_t err = esp_ota_end(update_handle);
+    esp_err_t err = pipeline.Finish();
+    pipeline.LogStats();
+    if (!image_header_checked) {
+        ESP_LOGE(TAG, "No firmware data received");
+        return false;
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to write OTA data: %s", esp_err_to_name(err));
+        esp_ota_abort(update_handle);
+        return false;
+    }
+    if (format == kOtaImageFormatDelta && (!patcher->finished() || written != patcher->target_size())) {
+        ESP_LOGE(TAG, "Delta patch incomplete: %u/%u bytes", written, patcher->target_size());
+        esp_ota_abort(update_handle);
+        return false;
+    }
+    if (format == kOtaImageFormatCompressed && (!decompressor->finished() || written != decompressor->output_size())) {
+        ESP_LOGE(TAG, "Compressed image incomplete: %u bytes inflated", written);
+        esp_ota_abort(update_handle);
+        return false;
+    }
+    if (!encoded && written != total_size) {
+        ESP_LOGE(TAG, "Download incomplete: %u/%u bytes", written, total_size);
+        esp_ota_abort(update_handle);
+        Settings::Flush();
+        return false;
+    }
+
+    // The image is complete, esp_ota_end() verifies its checksum and hash
+    ClearResumeState();
+    err = esp_ota_end(update_handle);
     if (err != ESP_OK) {
         if (err == ESP_ERR_OTA_VALIDATE_FAILED) {
             ESP_LOGE(TAG, "Image validation failed, image is corrupted");
         } else {
             ESP_LOGE(TAG, "Failed to end OTA: %s", esp_err_to_name(err));
         }
-        return;
+        return false;
     }
 
     err = esp_ota_set_boot_partition(update_partition);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Failed to set boot partition: %s", esp_err_to_name(err));
-        return;
+        return false;
     }
 
+    if (encoded) {
+        // Estimate how long the full image would have taken at the measured network speed
+        auto network_time_us = pipeline.GetStats().network_time_us;
+        int64_t saved_ms = total_size > 0 ? network_time_us * (int64_t)(written - std::min(written, total_size)) / total_size / 1000 : 0;
+        ESP_LOGI(TAG, "Downloaded %u bytes for a %u byte image (%u%%), about %lld ms saved",
+            total_size, written, written > 0 ? (unsigned)(total_size * 100ULL / written) : 0, saved_ms);
+    }
+    ESP_LOGI(TAG, "Firmware upgrade took %lld ms", (esp_timer_get_time() - upgrade_start_time) / 1000);
     ESP_LOGI(TAG, "Firmware upgrade successful, rebooting in 3 seconds...");
     vTaskDelay(pdMS_TO_TICKS(3000));
     esp_restart();
@@ -363,6 +778,18 @@ void Ota::Upgrade(const std::string& firmware_url) {
 
 void Ota::StartUpgrade(std::function<void(int progress, size_t speed)> callback) {
     upgrade_callback_ = callback;
+    if (!firmware_delta_url_.empty()) {
+        if (Upgrade(firmware_delta_url_, kOtaImageFormatDelta)) {
+            return;
+        }
+        ESP_LOGW(TAG, "Delta upgrade failed, download the full firmware");
+    }
+    if (!firmware_compressed_url_.empty()) {
+        if (Upgrade(firmware_compressed_url_, kOtaImageFormatCompressed)) {
+            return;
+        }
+        ESP_LOGW(TAG, "Compressed upgrade failed, download the uncompressed firmware");
+    }
     Upgrade(firmware_url_);
 }
 
@@ -416,15 +843,14 @@ std::string Ota::GetActivationPayload() {
     }
 #endif
 
-    cJSON *payload = cJSON_CreateObject();
-    cJSON_AddStringToObject(payload, "algorithm", "hmac-sha256");
-    cJSON_AddStringToObject(payload, "serial_number", serial_number_.c_str());
-    cJSON_AddStringToObject(payload, "challenge", activation_challenge_.c_str());
-    cJSON_AddStringToObject(payload, "hmac", hmac_hex.c_str());
-    auto json_str = cJSON_PrintUnformatted(payload);
-    std::string json(json_str);
-    cJSON_free(json_str);
-    cJSON_Delete(payload);
+    std::string json;
+    JsonWriter payload(json);
+    payload.BeginObject()
+        .Member("algorithm", "hmac-sha256")
+        .Member("serial_number", serial_number_)
+        .Member("challenge", activation_challenge_)
+        .Member("hmac", hmac_hex)
+        .EndObject();
 
     ESP_LOGI(TAG, "Activation payload: %s", json.c_str());
     return json;
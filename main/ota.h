@@ -5,8 +5,26 @@
 #include <string>
 
 #include <esp_err.h>
+#include <esp_partition.h>
 #include "board.h"
 
+// How the downloaded file encodes the firmware image
+enum OtaImageFormat {
+    kOtaImageFormatFull,
+    kOtaImageFormatCompressed,  // zlib stream of the image
+    kOtaImageFormatDelta        // Patch against the running image, see ota_delta.h
+};
+
+// Progress of an interrupted firmware download
+struct OtaResumeState {
+    std::string url;
+    std::string etag;
+    std::string partition;
+    size_t total_size = 0;
+    size_t offset = 0;      // Bytes written to the partition, a multiple of the sector size
+    std::string sha256;     // Hash of the bytes written
+};
+
 class Ota {
 public:
     Ota();
@@ -42,11 +60,20 @@ private:
     std::string current_version_;
     std::string firmware_version_;
     std::string firmware_url_;
+    std::string firmware_delta_url_;
+    std::string firmware_compressed_url_;
     std::string activation_challenge_;
     std::string serial_number_;
     int activation_timeout_ms_ = 30000;
+    int timezone_offset_ = 0;   // Minutes
 
-    void Upgrade(const std::string& firmware_url);
+    // Returns false if the upgrade failed, on success the device restarts
+    bool Upgrade(const std::string& firmware_url, OtaImageFormat format = kOtaImageFormatFull);
+    bool LoadResumeState(const std::string& firmware_url, const esp_partition_t* partition, OtaResumeState& state);
+    void SaveResumeState(const OtaResumeState& state);
+    void ClearResumeState();
+    void SaveCheckResult(const std::string& etag, bool compact);
+    bool LoadCheckResult(const std::string& date);
     std::function<void(int progress, size_t speed)> upgrade_callback_;
     std::vector<int> ParseVersion(const std::string& version);
     bool IsNewVersionAvailable(const std::string& currentVersion, const std::string& newVersion);
@@ -0,0 +1,69 @@
+#include "ota_decompress.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <rom/miniz.h>
+
+#define TAG "OtaDecompress"
+
+static void* AllocateBuffer(size_t size) {
+    auto buffer = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (buffer == nullptr) {
+        buffer = heap_caps_malloc(size, MALLOC_CAP_8BIT);
+    }
+    return buffer;
+}
+
+OtaDecompressor::OtaDecompressor(std::function<esp_err_t(const uint8_t* data, size_t length)> output) : output_(output) {
+    decompressor_ = (tinfl_decompressor*)AllocateBuffer(sizeof(tinfl_decompressor));
+    window_ = (uint8_t*)AllocateBuffer(TINFL_LZ_DICT_SIZE);
+    if (decompressor_ == nullptr || window_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate the decompression window");
+        return;
+    }
+    tinfl_init(decompressor_);
+}
+
+OtaDecompressor::~OtaDecompressor() {
+    heap_caps_free(decompressor_);
+    heap_caps_free(window_);
+}
+
+esp_err_t OtaDecompressor::Feed(const uint8_t* data, size_t length) {
+    if (decompressor_ == nullptr || window_ == nullptr) {
+        return ESP_ERR_NO_MEM;
+    }
+    input_size_ += length;
+    while (!finished_) {
+        size_t in_size = length;
+        size_t out_size = TINFL_LZ_DICT_SIZE - window_offset_;
+        // The window doubles as the output buffer, so a chunk is emitted each time it fills up
+        auto status = tinfl_decompress(decompressor_, data, &in_size,
+            window_, window_ + window_offset_, &out_size,
+            TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_COMPUTE_ADLER32 | TINFL_FLAG_HAS_MORE_INPUT);
+        data += in_size;
+        length -= in_size;
+        window_offset_ += out_size;
+
+        if (status < TINFL_STATUS_DONE) {
+            ESP_LOGE(TAG, "Invalid compressed data at offset %u: %d", input_size_ - length, status);
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+        finished_ = status == TINFL_STATUS_DONE;
+        if (window_offset_ == TINFL_LZ_DICT_SIZE || (finished_ && window_offset_ > 0)) {
+            auto err = output_(window_, window_offset_);
+            output_size_ += window_offset_;
+            window_offset_ = 0;
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+        if (status == TINFL_STATUS_NEEDS_MORE_INPUT) {
+            break;
+        }
+    }
+    if (finished_ && length > 0) {
+        ESP_LOGW(TAG, "Ignore %u bytes after the end of the compressed stream", length);
+    }
+    return ESP_OK;
+}
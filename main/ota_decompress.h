@@ -0,0 +1,42 @@
+#ifndef OTA_DECOMPRESS_H
+#define OTA_DECOMPRESS_H
+
+#include <esp_err.h>
+
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+struct tinfl_decompressor_tag;
+
+/*
+ * Inflates a zlib compressed firmware image while it is being downloaded,
+ * using the miniz decoder in ROM. The decoder keeps a fixed 32 KB window, the
+ * image is passed to `output` in window sized chunks (the last one may be shorter).
+ *
+ * A compressed image can be made with `python -c "import sys, zlib;
+ * sys.stdout.buffer.write(zlib.compress(open(sys.argv[1], 'rb').read(), 9))" app.bin > app.bin.z`
+ */
+class OtaDecompressor {
+public:
+    OtaDecompressor(std::function<esp_err_t(const uint8_t* data, size_t length)> output);
+    ~OtaDecompressor();
+
+    // Feed the next part of the compressed stream
+    esp_err_t Feed(const uint8_t* data, size_t length);
+
+    bool finished() const { return finished_; }
+    size_t input_size() const { return input_size_; }
+    size_t output_size() const { return output_size_; }
+
+private:
+    std::function<esp_err_t(const uint8_t* data, size_t length)> output_;
+    tinfl_decompressor_tag* decompressor_ = nullptr;
+    uint8_t* window_ = nullptr;
+    size_t window_offset_ = 0;
+    size_t input_size_ = 0;
+    size_t output_size_ = 0;
+    bool finished_ = false;
+};
+
+#endif // OTA_DECOMPRESS_H
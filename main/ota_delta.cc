@@ -0,0 +1,207 @@
+#include "ota_delta.h"
+
+#include <esp_log.h>
+#include <mbedtls/sha256.h>
+
+#include <cstring>
+#include <algorithm>
+
+#define TAG "OtaDelta"
+
+#define OUTPUT_BUFFER_SIZE 4096
+
+enum DeltaOpcode {
+    kDeltaOpcodeEnd = 0x00,
+    kDeltaOpcodeCopy = 0x01,
+    kDeltaOpcodeAdd = 0x02,
+    kDeltaOpcodeInsert = 0x03
+};
+
+static uint32_t ReadUint32(const uint8_t* data) {
+    return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+OtaDeltaPatcher::OtaDeltaPatcher(const esp_partition_t* source, std::function<esp_err_t(const uint8_t* data, size_t length)> output)
+    : source_(source), output_(output), output_buffer_(OUTPUT_BUFFER_SIZE) {
+}
+
+esp_err_t OtaDeltaPatcher::Feed(const uint8_t* data, size_t length) {
+    esp_err_t err = ESP_OK;
+    while (length > 0 && state_ != kStateEnd) {
+        switch (state_) {
+        case kStateHeader:
+        case kStateArguments: {
+            size_t n = std::min(length, fields_needed_ - fields_length_);
+            memcpy(fields_ + fields_length_, data, n);
+            fields_length_ += n;
+            data += n;
+            length -= n;
+            if (fields_length_ == fields_needed_) {
+                err = state_ == kStateHeader ? ParseHeader() : ParseArguments();
+            }
+            break;
+        }
+        case kStateOpcode:
+            opcode_ = *data++;
+            length--;
+            fields_length_ = 0;
+            if (opcode_ == kDeltaOpcodeEnd) {
+                err = FlushOutput();
+                if (err == ESP_OK && written_ != target_size_) {
+                    ESP_LOGE(TAG, "Patch ended at %u of %lu bytes", written_, target_size_);
+                    err = ESP_ERR_INVALID_SIZE;
+                }
+                state_ = kStateEnd;
+            } else if (opcode_ == kDeltaOpcodeCopy || opcode_ == kDeltaOpcodeAdd) {
+                fields_needed_ = 8;
+                state_ = kStateArguments;
+            } else if (opcode_ == kDeltaOpcodeInsert) {
+                fields_needed_ = 4;
+                state_ = kStateArguments;
+            } else {
+                ESP_LOGE(TAG, "Invalid opcode 0x%02x", opcode_);
+                err = ESP_ERR_INVALID_ARG;
+            }
+            break;
+        case kStateAdd:
+        case kStateInsert: {
+            size_t n = std::min({ length, (size_t)remaining_, output_buffer_.size() - output_length_ });
+            uint8_t* out = output_buffer_.data() + output_length_;
+            if (state_ == kStateAdd) {
+                err = ReadSource(source_offset_, out, n);
+                for (size_t i = 0; i < n; i++) {
+                    out[i] += data[i];
+                }
+                source_offset_ += n;
+            } else {
+                memcpy(out, data, n);
+            }
+            output_length_ += n;
+            remaining_ -= n;
+            data += n;
+            length -= n;
+            if (err == ESP_OK && output_length_ == output_buffer_.size()) {
+                err = FlushOutput();
+            }
+            if (remaining_ == 0) {
+                state_ = kStateOpcode;
+            }
+            break;
+        }
+        default:
+            break;
+        }
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t OtaDeltaPatcher::ParseHeader() {
+    if (memcmp(fields_, "XZD1", 4) != 0) {
+        ESP_LOGE(TAG, "Invalid patch magic");
+        return ESP_ERR_INVALID_ARG;
+    }
+    source_size_ = ReadUint32(fields_ + 4);
+    target_size_ = ReadUint32(fields_ + 8);
+    ESP_LOGI(TAG, "Patch from %lu to %lu bytes", source_size_, target_size_);
+    if (source_size_ > source_->size) {
+        ESP_LOGE(TAG, "Source image is larger than the running partition");
+        return ESP_ERR_INVALID_SIZE;
+    }
+    auto err = VerifySource(fields_ + 12);
+    if (err != ESP_OK) {
+        return err;
+    }
+    state_ = kStateOpcode;
+    return ESP_OK;
+}
+
+esp_err_t OtaDeltaPatcher::ParseArguments() {
+    uint32_t length;
+    if (opcode_ == kDeltaOpcodeInsert) {
+        length = ReadUint32(fields_);
+    } else {
+        source_offset_ = ReadUint32(fields_);
+        length = ReadUint32(fields_ + 4);
+        if (source_offset_ > source_size_ || length > source_size_ - source_offset_) {
+            ESP_LOGE(TAG, "Source range %lu+%lu out of bounds", source_offset_, length);
+            return ESP_ERR_INVALID_SIZE;
+        }
+    }
+    if (length > target_size_ - written_ - output_length_) {
+        ESP_LOGE(TAG, "Target size exceeded");
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    if (opcode_ == kDeltaOpcodeCopy) {
+        state_ = kStateOpcode;
+        return Copy(source_offset_, length);
+    }
+    remaining_ = length;
+    state_ = length == 0 ? kStateOpcode : (opcode_ == kDeltaOpcodeAdd ? kStateAdd : kStateInsert);
+    return ESP_OK;
+}
+
+// The patch only applies to the exact image it was created from
+esp_err_t OtaDeltaPatcher::VerifySource(const uint8_t* sha256) {
+    mbedtls_sha256_context context;
+    mbedtls_sha256_init(&context);
+    mbedtls_sha256_starts(&context, 0);
+    esp_err_t err = ESP_OK;
+    for (uint32_t offset = 0; offset < source_size_ && err == ESP_OK; offset += output_buffer_.size()) {
+        size_t n = std::min((size_t)(source_size_ - offset), output_buffer_.size());
+        err = ReadSource(offset, output_buffer_.data(), n);
+        mbedtls_sha256_update(&context, output_buffer_.data(), n);
+    }
+    uint8_t digest[32];
+    mbedtls_sha256_finish(&context, digest);
+    mbedtls_sha256_free(&context);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (memcmp(digest, sha256, sizeof(digest)) != 0) {
+        ESP_LOGE(TAG, "Patch does not match the running firmware");
+        return ESP_ERR_INVALID_VERSION;
+    }
+    return ESP_OK;
+}
+
+esp_err_t OtaDeltaPatcher::ReadSource(uint32_t offset, uint8_t* data, size_t length) {
+    auto err = esp_partition_read(source_, offset, data, length);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to read source at 0x%lx: %s", offset, esp_err_to_name(err));
+    }
+    return err;
+}
+
+esp_err_t OtaDeltaPatcher::Copy(uint32_t offset, uint32_t length) {
+    while (length > 0) {
+        size_t n = std::min((size_t)length, output_buffer_.size() - output_length_);
+        auto err = ReadSource(offset, output_buffer_.data() + output_length_, n);
+        if (err != ESP_OK) {
+            return err;
+        }
+        output_length_ += n;
+        offset += n;
+        length -= n;
+        if (output_length_ == output_buffer_.size()) {
+            err = FlushOutput();
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t OtaDeltaPatcher::FlushOutput() {
+    if (output_length_ == 0) {
+        return ESP_OK;
+    }
+    auto err = output_(output_buffer_.data(), output_length_);
+    written_ += output_length_;
+    output_length_ = 0;
+    return err;
+}
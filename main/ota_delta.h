@@ -0,0 +1,68 @@
+#ifndef OTA_DELTA_H
+#define OTA_DELTA_H
+
+#include <esp_err.h>
+#include <esp_partition.h>
+
+#include <functional>
+#include <vector>
+#include <cstdint>
+
+/*
+ * Applies a delta patch (see scripts/ota_delta.py) against the running firmware
+ * while the patch is being downloaded. Only a small output buffer is kept in RAM,
+ * source bytes are read from the running partition as the commands need them.
+ *
+ * Patch format, all integers are little endian:
+ *   header:  "XZD1" | u32 source_size | u32 target_size | sha256 of the source image
+ *   COPY   (0x01):  u32 source_offset | u32 length
+ *   ADD    (0x02):  u32 source_offset | u32 length | length bytes added to the source bytes
+ *   INSERT (0x03):  u32 length | length literal bytes
+ *   END    (0x00)
+ */
+class OtaDeltaPatcher {
+public:
+    OtaDeltaPatcher(const esp_partition_t* source, std::function<esp_err_t(const uint8_t* data, size_t length)> output);
+
+    // Feed the next part of the patch, the target image is passed to `output` in order
+    esp_err_t Feed(const uint8_t* data, size_t length);
+
+    bool finished() const { return state_ == kStateEnd; }
+    size_t target_size() const { return target_size_; }
+
+private:
+    enum State {
+        kStateHeader,
+        kStateOpcode,
+        kStateArguments,
+        kStateAdd,
+        kStateInsert,
+        kStateEnd
+    };
+
+    static constexpr size_t kHeaderSize = 44;
+
+    const esp_partition_t* source_;
+    std::function<esp_err_t(const uint8_t* data, size_t length)> output_;
+    State state_ = kStateHeader;
+    uint8_t opcode_ = 0;
+    uint8_t fields_[kHeaderSize];
+    size_t fields_length_ = 0;
+    size_t fields_needed_ = kHeaderSize;
+    uint32_t source_size_ = 0;
+    uint32_t target_size_ = 0;
+    uint32_t source_offset_ = 0;
+    uint32_t remaining_ = 0;
+    size_t written_ = 0;
+    std::vector<uint8_t> output_buffer_;
+    size_t output_length_ = 0;
+
+    esp_err_t ParseHeader();
+    esp_err_t ParseArguments();
+    esp_err_t VerifySource(const uint8_t* sha256);
+    esp_err_t ReadSource(uint32_t offset, uint8_t* data, size_t length);
+    esp_err_t Copy(uint32_t offset, uint32_t length);
+    esp_err_t FlushOutput();
+};
+
+#endif // OTA_DELTA_H
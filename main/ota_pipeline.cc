@@ -0,0 +1,146 @@
+#include "ota_pipeline.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include <freertos/task.h>
+
+#define TAG "OtaPipeline"
+
+// Besides the flash writes, the writer task runs the stream writer of the download: inflating
+// compressed images, applying delta patches with the SHA-256 check of the source partition, and
+// saving the resume state, which clones the SHA context and commits NVS
+#define OTA_WRITER_STACK_SIZE 8192
+
+OtaPipeline::OtaPipeline(size_t buffer_size, int buffer_count) : buffer_size_(buffer_size) {
+    free_queue_ = xQueueCreate(buffer_count, sizeof(uint8_t*));
+    filled_queue_ = xQueueCreate(buffer_count + 1, sizeof(Chunk));
+    done_semaphore_ = xSemaphoreCreateBinary();
+
+    for (int i = 0; i < buffer_count; i++) {
+        auto buffer = (uint8_t*)heap_caps_malloc(buffer_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (buffer == nullptr) {
+            buffer = (uint8_t*)heap_caps_malloc(buffer_size, MALLOC_CAP_8BIT);
+        }
+        if (buffer == nullptr) {
+            ESP_LOGW(TAG, "Only %d of %d buffers allocated", i, buffer_count);
+            break;
+        }
+        buffers_.push_back(buffer);
+        xQueueSend(free_queue_, &buffer, 0);
+    }
+}
+
+OtaPipeline::~OtaPipeline() {
+    if (running_) {
+        Finish();
+    }
+    for (auto buffer : buffers_) {
+        heap_caps_free(buffer);
+    }
+    vQueueDelete(free_queue_);
+    vQueueDelete(filled_queue_);
+    vSemaphoreDelete(done_semaphore_);
+}
+
+bool OtaPipeline::Start(std::function<esp_err_t(const uint8_t* data, size_t length)> writer) {
+    if (buffers_.empty()) {
+        ESP_LOGE(TAG, "No buffers allocated");
+        return false;
+    }
+    writer_ = writer;
+    running_ = true;
+    auto ret = xTaskCreate([](void* arg) {
+        auto pipeline = static_cast<OtaPipeline*>(arg);
+        pipeline->WriterLoop();
+        vTaskDelete(NULL);
+    }, "ota_writer", OTA_WRITER_STACK_SIZE, this, 3, nullptr);
+    if (ret != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create writer task");
+        running_ = false;
+        return false;
+    }
+    ESP_LOGI(TAG, "Started with %u buffers of %u bytes", buffers_.size(), buffer_size_);
+    return true;
+}
+
+uint8_t* OtaPipeline::AcquireBuffer() {
+    uint8_t* buffer = nullptr;
+    auto start_time = esp_timer_get_time();
+    xQueueReceive(free_queue_, &buffer, portMAX_DELAY);
+    producer_wait_us_ += esp_timer_get_time() - start_time;
+    if (failed()) {
+        Release(buffer);
+        return nullptr;
+    }
+    return buffer;
+}
+
+void OtaPipeline::Submit(uint8_t* buffer, size_t length) {
+    if (length == 0) {
+        Release(buffer);
+        return;
+    }
+    Chunk chunk = { buffer, length };
+    xQueueSend(filled_queue_, &chunk, portMAX_DELAY);
+}
+
+void OtaPipeline::Release(uint8_t* buffer) {
+    xQueueSend(free_queue_, &buffer, portMAX_DELAY);
+}
+
+esp_err_t OtaPipeline::Finish() {
+    if (!running_) {
+        return error_;
+    }
+    Chunk end = { nullptr, 0 };
+    xQueueSend(filled_queue_, &end, portMAX_DELAY);
+    xSemaphoreTake(done_semaphore_, portMAX_DELAY);
+    running_ = false;
+    return error_;
+}
+
+void OtaPipeline::WriterLoop() {
+    while (true) {
+        Chunk chunk;
+        auto wait_start = esp_timer_get_time();
+        xQueueReceive(filled_queue_, &chunk, portMAX_DELAY);
+        auto write_start = esp_timer_get_time();
+        writer_stats_.writer_wait_us += write_start - wait_start;
+        if (chunk.length == 0) {
+            break;
+        }
+
+        // After a failure keep draining, so the network side never blocks on a full queue
+        if (!failed()) {
+            auto err = writer_(chunk.data, chunk.length);
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to write data: %s", esp_err_to_name(err));
+                error_ = err;
+            }
+            writer_stats_.write_time_us += esp_timer_get_time() - write_start;
+            writer_stats_.bytes += chunk.length;
+        }
+        Release(chunk.data);
+    }
+    xSemaphoreGive(done_semaphore_);
+}
+
+OtaPipelineStats OtaPipeline::GetStats() const {
+    OtaPipelineStats stats = writer_stats_;
+    stats.network_time_us = network_time_us_;
+    stats.producer_wait_us = producer_wait_us_;
+    return stats;
+}
+
+void OtaPipeline::LogStats() const {
+    auto stats = GetStats();
+    auto rate = [](size_t bytes, int64_t time_us) -> unsigned {
+        return time_us > 0 ? (unsigned)(bytes * 1000000ULL / time_us / 1024) : 0;
+    };
+    ESP_LOGI(TAG, "Wrote %u bytes, network %u KB/s (%lld ms), flash %u KB/s (%lld ms)",
+        stats.bytes, rate(stats.bytes, stats.network_time_us), stats.network_time_us / 1000,
+        rate(stats.bytes, stats.write_time_us), stats.write_time_us / 1000);
+    ESP_LOGI(TAG, "Network waited %lld ms for buffers, writer waited %lld ms for data",
+        stats.producer_wait_us / 1000, stats.writer_wait_us / 1000);
+}
@@ -0,0 +1,69 @@
+#ifndef OTA_PIPELINE_H
+#define OTA_PIPELINE_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <esp_err.h>
+
+#include <functional>
+#include <vector>
+#include <atomic>
+
+struct OtaPipelineStats {
+    size_t bytes = 0;
+    int64_t network_time_us = 0;     // Time spent reading from the network
+    int64_t producer_wait_us = 0;    // Time the network side waited for a free buffer
+    int64_t write_time_us = 0;       // Time spent writing to flash
+    int64_t writer_wait_us = 0;      // Time the writer waited for data
+};
+
+// Decouples the firmware download from the flash writes: the caller fills buffers
+// from the network while a writer task passes the filled buffers to `writer`.
+// Buffers are allocated from PSRAM when available.
+class OtaPipeline {
+public:
+    OtaPipeline(size_t buffer_size, int buffer_count);
+    ~OtaPipeline();
+
+    bool Start(std::function<esp_err_t(const uint8_t* data, size_t length)> writer);
+
+    // Block until a free buffer is available, returns nullptr if the writer failed
+    uint8_t* AcquireBuffer();
+    void Submit(uint8_t* buffer, size_t length);
+    // Return a buffer that was acquired but will not be submitted
+    void Release(uint8_t* buffer);
+    // Wait until all submitted buffers are written and stop the writer task
+    esp_err_t Finish();
+
+    bool failed() const { return error_ != ESP_OK; }
+    size_t buffer_size() const { return buffer_size_; }
+
+    void AddNetworkTime(int64_t time_us) { network_time_us_ += time_us; }
+    // Call after Finish(), the writer task fills in its part of the stats until then
+    OtaPipelineStats GetStats() const;
+    void LogStats() const;
+
+private:
+    struct Chunk {
+        uint8_t* data;
+        size_t length;  // 0 marks the end of the stream
+    };
+
+    size_t buffer_size_;
+    std::vector<uint8_t*> buffers_;
+    QueueHandle_t free_queue_ = nullptr;
+    QueueHandle_t filled_queue_ = nullptr;
+    SemaphoreHandle_t done_semaphore_ = nullptr;
+    bool running_ = false;
+    std::atomic<esp_err_t> error_{ESP_OK};
+    std::function<esp_err_t(const uint8_t* data, size_t length)> writer_;
+    // Each side only writes its own stats, they are combined after the writer task is done
+    int64_t network_time_us_ = 0;       // Network side
+    int64_t producer_wait_us_ = 0;      // Network side
+    OtaPipelineStats writer_stats_;     // Writer task: bytes, write_time_us, writer_wait_us
+
+    void WriterLoop();
+};
+
+#endif // OTA_PIPELINE_H
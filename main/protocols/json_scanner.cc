@@ -0,0 +1,277 @@
+#include "json_scanner.h"
+
+#include <cstring>
+#include <cstdint>
+
+static inline int HexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+static bool ParseHex4(const char* p, const char* end, uint32_t& value) {
+    if (end - p < 4) {
+        return false;
+    }
+    value = 0;
+    for (int i = 0; i < 4; i++) {
+        int v = HexValue(p[i]);
+        if (v < 0) {
+            return false;
+        }
+        value = (value << 4) | v;
+    }
+    return true;
+}
+
+static void AppendUtf8(std::string& out, uint32_t code_point) {
+    if (code_point < 0x80) {
+        out.push_back(static_cast<char>(code_point));
+    } else if (code_point < 0x800) {
+        out.push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+        out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    } else if (code_point < 0x10000) {
+        out.push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    } else {
+        out.push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    }
+}
+
+std::string JsonStringView::ToString() const {
+    if (!escaped) {
+        return std::string(raw);
+    }
+
+    // Decoded text is never longer than the escaped source, so one reservation is enough
+    std::string out;
+    out.reserve(raw.size());
+    const char* p = raw.data();
+    const char* end = p + raw.size();
+    while (p < end) {
+        if (*p != '\\') {
+            out.push_back(*p++);
+            continue;
+        }
+        if (++p >= end) {
+            break;
+        }
+        char c = *p++;
+        switch (c) {
+            case 'b': out.push_back('\b'); break;
+            case 'f': out.push_back('\f'); break;
+            case 'n': out.push_back('\n'); break;
+            case 'r': out.push_back('\r'); break;
+            case 't': out.push_back('\t'); break;
+            case 'u': {
+                uint32_t code_point;
+                if (!ParseHex4(p, end, code_point)) {
+                    return out;
+                }
+                p += 4;
+                // Combine UTF-16 surrogate pairs
+                if (code_point >= 0xD800 && code_point <= 0xDBFF) {
+                    uint32_t low;
+                    if (end - p >= 6 && p[0] == '\\' && p[1] == 'u' && ParseHex4(p + 2, end, low) &&
+                        low >= 0xDC00 && low <= 0xDFFF) {
+                        code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+                        p += 6;
+                    } else {
+                        code_point = 0xFFFD;
+                    }
+                }
+                AppendUtf8(out, code_point);
+                break;
+            }
+            default:
+                // \" \\ \/
+                out.push_back(c);
+                break;
+        }
+    }
+    return out;
+}
+
+void JsonScanner::SkipWhitespace() {
+    while (pos_ < end_ && (*pos_ == ' ' || *pos_ == '\t' || *pos_ == '\n' || *pos_ == '\r')) {
+        pos_++;
+    }
+}
+
+bool JsonScanner::ParseString(JsonStringView& value) {
+    if (pos_ >= end_ || *pos_ != '"') {
+        return false;
+    }
+    const char* start = ++pos_;
+    bool escaped = false;
+    while (pos_ < end_) {
+        char c = *pos_;
+        if (c == '"') {
+            value.raw = std::string_view(start, pos_ - start);
+            value.escaped = escaped;
+            value.valid = true;
+            pos_++;
+            return true;
+        }
+        if (c == '\\') {
+            escaped = true;
+            pos_ += 2;
+            continue;
+        }
+        if (c == '\0') {
+            return false;
+        }
+        pos_++;
+    }
+    return false;
+}
+
+bool JsonScanner::SkipValue() {
+    if (pos_ >= end_) {
+        return false;
+    }
+
+    char c = *pos_;
+    if (c == '"') {
+        JsonStringView ignored;
+        return ParseString(ignored);
+    }
+
+    if (c == '{' || c == '[') {
+        // Skip the nested container by bracket counting, strings may contain brackets
+        int depth = 0;
+        while (pos_ < end_) {
+            c = *pos_;
+            if (c == '"') {
+                JsonStringView ignored;
+                if (!ParseString(ignored)) {
+                    return false;
+                }
+                continue;
+            }
+            if (c == '{' || c == '[') {
+                depth++;
+            } else if (c == '}' || c == ']') {
+                if (--depth == 0) {
+                    pos_++;
+                    return true;
+                }
+            } else if (c == '\0') {
+                return false;
+            }
+            pos_++;
+        }
+        return false;
+    }
+
+    // Number, true, false or null
+    const char* start = pos_;
+    while (pos_ < end_ && *pos_ != ',' && *pos_ != '}' && *pos_ != ']' &&
+           *pos_ != ' ' && *pos_ != '\t' && *pos_ != '\n' && *pos_ != '\r' && *pos_ != '\0') {
+        pos_++;
+    }
+    return pos_ > start;
+}
+
+bool JsonScanner::ScanObject(const char* const* keys, JsonStringView* values, size_t count) {
+    pos_ = data_;
+    for (size_t i = 0; i < count; i++) {
+        values[i] = JsonStringView();
+    }
+
+    SkipWhitespace();
+    if (pos_ >= end_ || *pos_ != '{') {
+        return false;
+    }
+    pos_++;
+    SkipWhitespace();
+    if (pos_ < end_ && *pos_ == '}') {
+        return true;
+    }
+
+    while (pos_ < end_) {
+        SkipWhitespace();
+        JsonStringView key;
+        if (!ParseString(key)) {
+            return false;
+        }
+        SkipWhitespace();
+        if (pos_ >= end_ || *pos_ != ':') {
+            return false;
+        }
+        pos_++;
+        SkipWhitespace();
+
+        JsonStringView* target = nullptr;
+        for (size_t i = 0; i < count; i++) {
+            if (!key.escaped && key.raw == keys[i]) {
+                target = &values[i];
+                break;
+            }
+        }
+        if (target != nullptr && pos_ < end_ && *pos_ == '"') {
+            if (!ParseString(*target)) {
+                return false;
+            }
+        } else if (!SkipValue()) {
+            return false;
+        }
+
+        SkipWhitespace();
+        if (pos_ >= end_) {
+            return false;
+        }
+        if (*pos_ == ',') {
+            pos_++;
+            continue;
+        }
+        if (*pos_ == '}') {
+            pos_++;
+            return true;
+        }
+        return false;
+    }
+    return false;
+}
+
+bool JsonScanner::ForEachArrayElement(const std::function<void(std::string_view element)>& callback) {
+    pos_ = data_;
+    SkipWhitespace();
+    if (pos_ >= end_ || *pos_ != '[') {
+        return false;
+    }
+    pos_++;
+    SkipWhitespace();
+    if (pos_ < end_ && *pos_ == ']') {
+        return true;
+    }
+
+    while (pos_ < end_) {
+        SkipWhitespace();
+        const char* start = pos_;
+        if (!SkipValue()) {
+            return false;
+        }
+        callback(std::string_view(start, pos_ - start));
+
+        SkipWhitespace();
+        if (pos_ >= end_) {
+            return false;
+        }
+        if (*pos_ == ',') {
+            pos_++;
+            continue;
+        }
+        if (*pos_ == ']') {
+            pos_++;
+            return true;
+        }
+        return false;
+    }
+    return false;
+}
@@ -0,0 +1,43 @@
+#ifndef JSON_SCANNER_H
+#define JSON_SCANNER_H
+
+#include <string>
+#include <string_view>
+#include <cstddef>
+#include <functional>
+
+// A string value found by JsonScanner. `raw` points into the scanned buffer and
+// still contains the JSON escape sequences; use ToString() to get the decoded text.
+struct JsonStringView {
+    std::string_view raw;
+    bool escaped = false;
+    bool valid = false;
+
+    std::string ToString() const;
+    bool operator==(std::string_view other) const { return valid && !escaped && raw == other; }
+};
+
+// Tokenizer for flat JSON objects that extracts the string members it is asked for
+// without building a DOM and without allocating. Nested objects and arrays are skipped.
+class JsonScanner {
+public:
+    JsonScanner(const char* data, size_t length) : data_(data), end_(data + length), pos_(data) {}
+
+    // Scan the top level object and fill values[i] with the string member named keys[i].
+    // Members that are missing or are not strings are left invalid.
+    bool ScanObject(const char* const* keys, JsonStringView* values, size_t count);
+
+    // Call back with the raw text of each element of the top level array
+    bool ForEachArrayElement(const std::function<void(std::string_view element)>& callback);
+
+private:
+    const char* data_;
+    const char* end_;
+    const char* pos_;
+
+    void SkipWhitespace();
+    bool ParseString(JsonStringView& value);
+    bool SkipValue();
+};
+
+#endif // JSON_SCANNER_H
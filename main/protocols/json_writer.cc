@@ -0,0 +1,163 @@
+#include "json_writer.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cinttypes>
+
+JsonWriter::JsonWriter(char* buffer, size_t capacity) : buffer_(buffer), capacity_(capacity) {
+}
+
+JsonWriter::JsonWriter(std::string& output) : output_(&output) {
+}
+
+void JsonWriter::Put(const char* data, size_t length) {
+    if (output_ != nullptr) {
+        output_->append(data, length);
+        return;
+    }
+    if (overflow_ || length_ + length > capacity_) {
+        overflow_ = true;
+        return;
+    }
+    memcpy(buffer_ + length_, data, length);
+    length_ += length;
+}
+
+void JsonWriter::PutEscaped(std::string_view value) {
+    // Escape the same characters as cJSON, so the output stays byte-identical
+    const char* p = value.data();
+    const char* end = p + value.size();
+    const char* run = p;
+    while (p < end) {
+        unsigned char c = static_cast<unsigned char>(*p);
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            p++;
+            continue;
+        }
+        Put(run, p - run);
+        switch (c) {
+            case '"': Put("\\\"", 2); break;
+            case '\\': Put("\\\\", 2); break;
+            case '\b': Put("\\b", 2); break;
+            case '\f': Put("\\f", 2); break;
+            case '\n': Put("\\n", 2); break;
+            case '\r': Put("\\r", 2); break;
+            case '\t': Put("\\t", 2); break;
+            default: {
+                char escaped[8];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                Put(escaped, 6);
+                break;
+            }
+        }
+        run = ++p;
+    }
+    Put(run, p - run);
+}
+
+void JsonWriter::Separator() {
+    if (after_key_) {
+        after_key_ = false;
+        return;
+    }
+    if (depth_ == 0) {
+        return;
+    }
+    uint32_t bit = 1u << (depth_ - 1);
+    if (has_items_ & bit) {
+        Put(',');
+    }
+    has_items_ |= bit;
+}
+
+void JsonWriter::Open(char c) {
+    Separator();
+    Put(c);
+    if (depth_ < kMaxDepth) {
+        depth_++;
+        has_items_ &= ~(1u << (depth_ - 1));
+    }
+}
+
+void JsonWriter::Close(char c) {
+    if (depth_ > 0) {
+        depth_--;
+    }
+    after_key_ = false;
+    Put(c);
+}
+
+JsonWriter& JsonWriter::BeginObject() {
+    Open('{');
+    return *this;
+}
+
+JsonWriter& JsonWriter::EndObject() {
+    Close('}');
+    return *this;
+}
+
+JsonWriter& JsonWriter::BeginArray() {
+    Open('[');
+    return *this;
+}
+
+JsonWriter& JsonWriter::EndArray() {
+    Close(']');
+    return *this;
+}
+
+JsonWriter& JsonWriter::Key(std::string_view key) {
+    Separator();
+    Put('"');
+    PutEscaped(key);
+    Put("\":", 2);
+    after_key_ = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::String(std::string_view value) {
+    Separator();
+    Put('"');
+    PutEscaped(value);
+    Put('"');
+    return *this;
+}
+
+JsonWriter& JsonWriter::Int(int64_t value) {
+    Separator();
+    char number[24];
+    int length = snprintf(number, sizeof(number), "%" PRId64, value);
+    Put(number, length);
+    return *this;
+}
+
+JsonWriter& JsonWriter::Uint(uint64_t value) {
+    Separator();
+    char number[24];
+    int length = snprintf(number, sizeof(number), "%" PRIu64, value);
+    Put(number, length);
+    return *this;
+}
+
+JsonWriter& JsonWriter::Bool(bool value) {
+    Separator();
+    if (value) {
+        Put("true", 4);
+    } else {
+        Put("false", 5);
+    }
+    return *this;
+}
+
+JsonWriter& JsonWriter::Null() {
+    Separator();
+    Put("null", 4);
+    return *this;
+}
+
+JsonWriter& JsonWriter::Raw(std::string_view json) {
+    Separator();
+    Put(json.data(), json.size());
+    return *this;
+}
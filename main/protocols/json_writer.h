@@ -0,0 +1,79 @@
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstddef>
+
+// Streaming JSON writer for outgoing messages.
+// It writes compact JSON (same layout as cJSON_PrintUnformatted) either into a fixed
+// caller-provided buffer, without any allocation, or appends to a std::string when
+// the size of the content is not known in advance.
+class JsonWriter {
+public:
+    JsonWriter(char* buffer, size_t capacity);
+    JsonWriter(std::string& output);
+
+    JsonWriter& BeginObject();
+    JsonWriter& EndObject();
+    JsonWriter& BeginArray();
+    JsonWriter& EndArray();
+    JsonWriter& Key(std::string_view key);
+
+    JsonWriter& String(std::string_view value);
+    JsonWriter& Int(int64_t value);
+    JsonWriter& Uint(uint64_t value);
+    JsonWriter& Bool(bool value);
+    JsonWriter& Null();
+    // Insert an already serialized JSON value as is
+    JsonWriter& Raw(std::string_view json);
+
+    template<typename T>
+    JsonWriter& Member(std::string_view key, const T& value) {
+        Key(key);
+        return Value(value);
+    }
+    JsonWriter& RawMember(std::string_view key, std::string_view json) {
+        Key(key);
+        return Raw(json);
+    }
+
+    // True if the fixed buffer was too small, the output is truncated in that case
+    bool overflow() const { return overflow_; }
+    size_t size() const { return output_ ? output_->size() : length_; }
+    const char* data() const { return output_ ? output_->data() : buffer_; }
+    std::string_view view() const { return std::string_view(data(), size()); }
+
+private:
+    static constexpr int kMaxDepth = 32;
+
+    char* buffer_ = nullptr;
+    size_t capacity_ = 0;
+    size_t length_ = 0;
+    std::string* output_ = nullptr;
+    bool overflow_ = false;
+    bool after_key_ = false;
+    int depth_ = 0;
+    uint32_t has_items_ = 0;  // One bit per nesting level
+
+    void Put(const char* data, size_t length);
+    void Put(char c) { Put(&c, 1); }
+    void PutEscaped(std::string_view value);
+    void Separator();
+    void Open(char c);
+    void Close(char c);
+
+    JsonWriter& Value(std::string_view value) { return String(value); }
+    JsonWriter& Value(const std::string& value) { return String(value); }
+    JsonWriter& Value(const char* value) { return value ? String(value) : Null(); }
+    JsonWriter& Value(bool value) { return Bool(value); }
+    JsonWriter& Value(int value) { return Int(value); }
+    JsonWriter& Value(long value) { return Int(value); }
+    JsonWriter& Value(long long value) { return Int(value); }
+    JsonWriter& Value(unsigned int value) { return Uint(value); }
+    JsonWriter& Value(unsigned long value) { return Uint(value); }
+    JsonWriter& Value(unsigned long long value) { return Uint(value); }
+};
+
+#endif // JSON_WRITER_H
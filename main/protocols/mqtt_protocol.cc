@@ -60,6 +60,11 @@ bool MqttProtocol::StartMqttClient(bool report_error) {
     });
 
     mqtt_->OnMessage([this](const std::string& topic, const std::string& payload) {
+        if (DispatchIncomingMessage(payload.data(), payload.size())) {
+            last_incoming_time_ = std::chrono::steady_clock::now();
+            return;
+        }
+
         cJSON* root = cJSON_Parse(payload.c_str());
         if (root == nullptr) {
             ESP_LOGE(TAG, "Failed to parse json message %s", payload.c_str());
@@ -72,9 +77,10 @@ bool MqttProtocol::StartMqttClient(bool report_error) {
             return;
         }
 
-        if (strcmp(type->valuestring, "hello") == 0) {
+        auto message_type = GetMessageType(type->valuestring);
+        if (message_type == kMessageTypeHello) {
             ParseServerHello(root);
-        } else if (strcmp(type->valuestring, "goodbye") == 0) {
+        } else if (message_type == kMessageTypeGoodbye) {
             auto session_id = cJSON_GetObjectItem(root, "session_id");
             ESP_LOGI(TAG, "Received goodbye message, session_id: %s", session_id ? session_id->valuestring : "null");
             if (session_id == nullptr || session_id_ == session_id->valuestring) {
@@ -156,11 +162,13 @@ void MqttProtocol::CloseAudioChannel() {
         }
     }
 
-    std::string message = "{";
-    message += "\"session_id\":\"" + session_id_ + "\",";
-    message += "\"type\":\"goodbye\"";
-    message += "}";
-    SendText(message);
+    char buffer[128];
+    JsonWriter json(buffer, sizeof(buffer));
+    json.BeginObject()
+        .Member("session_id", session_id_)
+        .Member("type", "goodbye")
+        .EndObject();
+    SendJson(json);
 
     if (on_audio_channel_closed_ != nullptr) {
         on_audio_channel_closed_();
@@ -253,28 +261,29 @@ bool MqttProtocol::OpenAudioChannel() {
 
 std::string MqttProtocol::GetHelloMessage() {
     // 发送 hello 消息申请 UDP 通道
-    cJSON* root = cJSON_CreateObject();
-    cJSON_AddStringToObject(root, "type", "hello");
-    cJSON_AddNumberToObject(root, "version", 3);
-    cJSON_AddStringToObject(root, "transport", "udp");
-    cJSON* features = cJSON_CreateObject();
+    std::string message;
+    message.reserve(320);
+    JsonWriter json(message);
+    json.BeginObject()
+        .Member("type", "hello")
+        .Member("version", 3)
+        .Member("transport", "udp")
+        .Key("features").BeginObject()
 #if CONFIG_USE_SERVER_AEC
-    cJSON_AddBoolToObject(features, "aec", true);
+        .Member("aec", true)
 #endif
 #if CONFIG_IOT_PROTOCOL_MCP
-    cJSON_AddBoolToObject(features, "mcp", true);
+        .Member("mcp", true)
 #endif
-    cJSON_AddItemToObject(root, "features", features);
-    cJSON* audio_params = cJSON_CreateObject();
-    cJSON_AddStringToObject(audio_params, "format", "opus");
-    cJSON_AddNumberToObject(audio_params, "sample_rate", 16000);
-    cJSON_AddNumberToObject(audio_params, "channels", 1);
-    cJSON_AddNumberToObject(audio_params, "frame_duration", OPUS_FRAME_DURATION_MS);
-    cJSON_AddItemToObject(root, "audio_params", audio_params);
-    auto json_str = cJSON_PrintUnformatted(root);
-    std::string message(json_str);
-    cJSON_free(json_str);
-    cJSON_Delete(root);
+        .EndObject()
+        .Key("audio_params").BeginObject()
+            .Member("format", "opus")
+            .Member("sample_rate", 16000)
+            .Member("channels", 1)
+            .Member("frame_duration", OPUS_FRAME_DURATION_MS)
+        .EndObject();
+    WriteDescriptorsHash(json);
+    json.EndObject();
     return message;
 }
 
@@ -290,6 +299,7 @@ void MqttProtocol::ParseServerHello(const cJSON* root) {
         session_id_ = session_id->valuestring;
         ESP_LOGI(TAG, "Session ID: %s", session_id_.c_str());
     }
+    ParseDescriptorsAck(root);
 
     // Get sample rate from hello message
     auto audio_params = cJSON_GetObjectItem(root, "audio_params");
@@ -4,10 +4,78 @@
 
 #define TAG "Protocol"
 
+struct MessageTypeEntry {
+    const char* name;
+    MessageType type;
+};
+
+// Perfect hash over the known message types: (type[0] * 4 + type[len - 1] + len) & 15
+// Keep the table in sync with the hash when adding a new message type.
+static constexpr size_t kMessageTypeTableSize = 16;
+static const MessageTypeEntry kMessageTypeTable[kMessageTypeTableSize] = {
+    {"llm", kMessageTypeLlm},           // 0
+    {nullptr, kMessageTypeUnknown},
+    {nullptr, kMessageTypeUnknown},
+    {"stt", kMessageTypeStt},           // 3
+    {"hello", kMessageTypeHello},       // 4
+    {nullptr, kMessageTypeUnknown},
+    {"tts", kMessageTypeTts},           // 6
+    {"mcp", kMessageTypeMcp},           // 7
+    {"goodbye", kMessageTypeGoodbye},   // 8
+    {nullptr, kMessageTypeUnknown},
+    {nullptr, kMessageTypeUnknown},
+    {"iot", kMessageTypeIot},           // 11
+    {nullptr, kMessageTypeUnknown},
+    {"alert", kMessageTypeAlert},       // 13
+    {nullptr, kMessageTypeUnknown},
+    {"system", kMessageTypeSystem},     // 15
+};
+
+static inline size_t HashMessageType(std::string_view type) {
+    return (static_cast<uint8_t>(type.front()) * 4 + static_cast<uint8_t>(type.back()) + type.size()) & (kMessageTypeTableSize - 1);
+}
+
+MessageType GetMessageType(std::string_view type) {
+    if (type.empty()) {
+        return kMessageTypeUnknown;
+    }
+    auto& entry = kMessageTypeTable[HashMessageType(type)];
+    if (entry.name == nullptr || type != entry.name) {
+        return kMessageTypeUnknown;
+    }
+    return entry.type;
+}
+
+static JsonStringView GetStringMember(const cJSON* root, const char* name) {
+    JsonStringView value;
+    auto item = cJSON_GetObjectItem(root, name);
+    if (cJSON_IsString(item)) {
+        value.raw = item->valuestring;
+        value.valid = true;
+    }
+    return value;
+}
+
+IncomingMessage GetIncomingMessage(const cJSON* root) {
+    IncomingMessage message;
+    auto type = cJSON_GetObjectItem(root, "type");
+    if (cJSON_IsString(type)) {
+        message.type = GetMessageType(type->valuestring);
+    }
+    message.state = GetStringMember(root, "state");
+    message.text = GetStringMember(root, "text");
+    message.emotion = GetStringMember(root, "emotion");
+    return message;
+}
+
 void Protocol::OnIncomingJson(std::function<void(const cJSON* root)> callback) {
     on_incoming_json_ = callback;
 }
 
+void Protocol::OnIncomingMessage(std::function<void(const IncomingMessage& message)> callback) {
+    on_incoming_message_ = callback;
+}
+
 void Protocol::OnIncomingAudio(std::function<void(AudioStreamPacket&& packet)> callback) {
     on_incoming_audio_ = callback;
 }
@@ -24,6 +92,39 @@ void Protocol::OnNetworkError(std::function<void(const std::string& message)> ca
     on_network_error_ = callback;
 }
 
+/*
+ * Fast path for the high rate tts / stt / llm messages.
+ * Returns false if the message should be parsed with cJSON instead.
+ */
+bool Protocol::DispatchIncomingMessage(const char* data, size_t length) {
+    if (on_incoming_message_ == nullptr) {
+        return false;
+    }
+
+    static const char* const keys[] = {"type", "state", "text", "emotion"};
+    JsonStringView values[4];
+    JsonScanner scanner(data, length);
+    if (!scanner.ScanObject(keys, values, 4) || !values[0].valid || values[0].escaped) {
+        return false;
+    }
+
+    IncomingMessage message;
+    message.type = GetMessageType(values[0].raw);
+    switch (message.type) {
+        case kMessageTypeTts:
+        case kMessageTypeStt:
+        case kMessageTypeLlm:
+            break;
+        default:
+            return false;
+    }
+    message.state = values[1];
+    message.text = values[2];
+    message.emotion = values[3];
+    on_incoming_message_(message);
+    return true;
+}
+
 void Protocol::SetError(const std::string& message) {
     error_occurred_ = true;
     if (on_network_error_ != nullptr) {
@@ -31,92 +132,142 @@ void Protocol::SetError(const std::string& message) {
     }
 }
 
+bool Protocol::SendJson(const JsonWriter& json) {
+    if (json.overflow()) {
+        ESP_LOGE(TAG, "JSON message exceeds the buffer size: %.*s", (int)json.size(), json.data());
+        return false;
+    }
+    return SendText(std::string(json.view()));
+}
+
 void Protocol::SendAbortSpeaking(AbortReason reason) {
-    std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"abort\"";
+    char buffer[256];
+    JsonWriter json(buffer, sizeof(buffer));
+    json.BeginObject()
+        .Member("session_id", session_id_)
+        .Member("type", "abort");
     if (reason == kAbortReasonWakeWordDetected) {
-        message += ",\"reason\":\"wake_word_detected\"";
+        json.Member("reason", "wake_word_detected");
     }
-    message += "}";
-    SendText(message);
+    json.EndObject();
+    SendJson(json);
 }
 
 void Protocol::SendWakeWordDetected(const std::string& wake_word) {
-    std::string json = "{\"session_id\":\"" + session_id_ + 
-                      "\",\"type\":\"listen\",\"state\":\"detect\",\"text\":\"" + wake_word + "\"}";
-    SendText(json);
+    char buffer[256];
+    JsonWriter json(buffer, sizeof(buffer));
+    json.BeginObject()
+        .Member("session_id", session_id_)
+        .Member("type", "listen")
+        .Member("state", "detect")
+        .Member("text", wake_word)
+        .EndObject();
+    SendJson(json);
 }
 
 void Protocol::SendStartListening(ListeningMode mode) {
-    std::string message = "{\"session_id\":\"" + session_id_ + "\"";
-    message += ",\"type\":\"listen\",\"state\":\"start\"";
+    char buffer[256];
+    JsonWriter json(buffer, sizeof(buffer));
+    json.BeginObject()
+        .Member("session_id", session_id_)
+        .Member("type", "listen")
+        .Member("state", "start");
     if (mode == kListeningModeRealtime) {
-        message += ",\"mode\":\"realtime\"";
+        json.Member("mode", "realtime");
     } else if (mode == kListeningModeAutoStop) {
-        message += ",\"mode\":\"auto\"";
+        json.Member("mode", "auto");
     } else {
-        message += ",\"mode\":\"manual\"";
+        json.Member("mode", "manual");
     }
-    message += "}";
-    SendText(message);
+    json.EndObject();
+    SendJson(json);
 }
 
 void Protocol::SendStopListening() {
-    std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"listen\",\"state\":\"stop\"}";
-    SendText(message);
+    char buffer[256];
+    JsonWriter json(buffer, sizeof(buffer));
+    json.BeginObject()
+        .Member("session_id", session_id_)
+        .Member("type", "listen")
+        .Member("state", "stop")
+        .EndObject();
+    SendJson(json);
 }
 
-void Protocol::SendIotDescriptors(const std::string& descriptors) {
-    cJSON* root = cJSON_Parse(descriptors.c_str());
-    if (root == nullptr) {
-        ESP_LOGE(TAG, "Failed to parse IoT descriptors: %s", descriptors.c_str());
+void Protocol::SetDescriptorsHash(const std::string& iot_hash, const std::string& mcp_hash) {
+    iot_descriptors_hash_ = iot_hash;
+    mcp_descriptors_hash_ = mcp_hash;
+}
+
+void Protocol::WriteDescriptorsHash(JsonWriter& json) {
+    if (iot_descriptors_hash_.empty() && mcp_descriptors_hash_.empty()) {
         return;
     }
+    json.Key("descriptors").BeginObject();
+    if (!iot_descriptors_hash_.empty()) {
+        json.Member("iot", iot_descriptors_hash_);
+    }
+    if (!mcp_descriptors_hash_.empty()) {
+        json.Member("mcp", mcp_descriptors_hash_);
+    }
+    json.EndObject();
+}
 
-    if (!cJSON_IsArray(root)) {
-        ESP_LOGE(TAG, "IoT descriptors should be an array");
-        cJSON_Delete(root);
+void Protocol::ParseDescriptorsAck(const cJSON* root) {
+    iot_descriptors_cached_ = false;
+    auto descriptors = cJSON_GetObjectItem(root, "descriptors");
+    if (!cJSON_IsObject(descriptors)) {
         return;
     }
-
-    int arraySize = cJSON_GetArraySize(root);
-    for (int i = 0; i < arraySize; ++i) {
-        cJSON* descriptor = cJSON_GetArrayItem(root, i);
-        if (descriptor == nullptr) {
-            ESP_LOGE(TAG, "Failed to get IoT descriptor at index %d", i);
-            continue;
-        }
-
-        cJSON* messageRoot = cJSON_CreateObject();
-        cJSON_AddStringToObject(messageRoot, "session_id", session_id_.c_str());
-        cJSON_AddStringToObject(messageRoot, "type", "iot");
-        cJSON_AddBoolToObject(messageRoot, "update", true);
-
-        cJSON* descriptorArray = cJSON_CreateArray();
-        cJSON_AddItemToArray(descriptorArray, cJSON_Duplicate(descriptor, 1));
-        cJSON_AddItemToObject(messageRoot, "descriptors", descriptorArray);
-
-        char* message = cJSON_PrintUnformatted(messageRoot);
-        if (message == nullptr) {
-            ESP_LOGE(TAG, "Failed to print JSON message for IoT descriptor at index %d", i);
-            cJSON_Delete(messageRoot);
-            continue;
-        }
-
-        SendText(std::string(message));
-        cJSON_free(message);
-        cJSON_Delete(messageRoot);
+    auto iot = cJSON_GetObjectItem(descriptors, "iot");
+    if (cJSON_IsString(iot) && !iot_descriptors_hash_.empty() && iot_descriptors_hash_ == iot->valuestring) {
+        iot_descriptors_cached_ = true;
+        ESP_LOGI(TAG, "Server has cached IoT descriptors %s", iot_descriptors_hash_.c_str());
     }
+}
 
-    cJSON_Delete(root);
+void Protocol::SendIotDescriptors(const std::string& descriptors) {
+    // Split the descriptor array without parsing it into cJSON, each descriptor is sent in its own message
+    JsonScanner scanner(descriptors.data(), descriptors.size());
+    bool valid = scanner.ForEachArrayElement([this](std::string_view descriptor) {
+        std::string message;
+        message.reserve(descriptor.size() + session_id_.size() + 80);
+        JsonWriter json(message);
+        json.BeginObject()
+            .Member("session_id", session_id_)
+            .Member("type", "iot")
+            .Member("update", true)
+            .Key("descriptors").BeginArray().Raw(descriptor).EndArray()
+            .EndObject();
+        SendText(message);
+    });
+    if (!valid) {
+        ESP_LOGE(TAG, "IoT descriptors should be an array: %s", descriptors.c_str());
+    }
 }
 
 void Protocol::SendIotStates(const std::string& states) {
-    std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"iot\",\"update\":true,\"states\":" + states + "}";
+    std::string message;
+    message.reserve(states.size() + session_id_.size() + 64);
+    JsonWriter json(message);
+    json.BeginObject()
+        .Member("session_id", session_id_)
+        .Member("type", "iot")
+        .Member("update", true)
+        .RawMember("states", states)
+        .EndObject();
     SendText(message);
 }
 
 void Protocol::SendMcpMessage(const std::string& payload) {
-    std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"mcp\",\"payload\":" + payload + "}";
+    std::string message;
+    message.reserve(payload.size() + session_id_.size() + 48);
+    JsonWriter json(message);
+    json.BeginObject()
+        .Member("session_id", session_id_)
+        .Member("type", "mcp")
+        .RawMember("payload", payload)
+        .EndObject();
     SendText(message);
 }
 
@@ -3,10 +3,14 @@
 
 #include <cJSON.h>
 #include <string>
+#include <string_view>
 #include <functional>
 #include <chrono>
 #include <vector>
 
+#include "json_scanner.h"
+#include "json_writer.h"
+
 struct AudioStreamPacket {
     int sample_rate = 0;
     int frame_duration = 0;
@@ -41,6 +45,35 @@ enum ListeningMode {
     kListeningModeRealtime // 需要 AEC 支持
 };
 
+enum MessageType {
+    kMessageTypeUnknown,
+    kMessageTypeHello,
+    kMessageTypeGoodbye,
+    kMessageTypeTts,
+    kMessageTypeStt,
+    kMessageTypeLlm,
+    kMessageTypeMcp,
+    kMessageTypeIot,
+    kMessageTypeSystem,
+    kMessageTypeAlert
+};
+
+// Look up the type of an incoming message through a perfect hash table
+MessageType GetMessageType(std::string_view type);
+
+// Fields of a high rate message (tts / stt / llm) extracted without parsing into cJSON.
+// The views point into the received buffer and are only valid during the callback.
+struct IncomingMessage {
+    MessageType type = kMessageTypeUnknown;
+    JsonStringView state;
+    JsonStringView text;
+    JsonStringView emotion;
+};
+
+// Same fields taken from a parsed message, for the messages the fast path hands back to cJSON.
+// The views point into the strings of `root`.
+IncomingMessage GetIncomingMessage(const cJSON* root);
+
 class Protocol {
 public:
     virtual ~Protocol() = default;
@@ -54,9 +87,18 @@ public:
     inline const std::string& session_id() const {
         return session_id_;
     }
+    // True if the server hello acknowledged the IoT descriptors hash, the descriptors need not be sent
+    inline bool iot_descriptors_cached() const {
+        return iot_descriptors_cached_;
+    }
+
+    // Content hashes of the IoT and MCP descriptors, advertised in the client hello.
+    // A server that has cached the same version echoes the hash back and skips the transfer.
+    void SetDescriptorsHash(const std::string& iot_hash, const std::string& mcp_hash);
 
     void OnIncomingAudio(std::function<void(AudioStreamPacket&& packet)> callback);
     void OnIncomingJson(std::function<void(const cJSON* root)> callback);
+    void OnIncomingMessage(std::function<void(const IncomingMessage& message)> callback);
     void OnAudioChannelOpened(std::function<void()> callback);
     void OnAudioChannelClosed(std::function<void()> callback);
     void OnNetworkError(std::function<void(const std::string& message)> callback);
@@ -76,6 +118,7 @@ public:
 
 protected:
     std::function<void(const cJSON* root)> on_incoming_json_;
+    std::function<void(const IncomingMessage& message)> on_incoming_message_;
     std::function<void(AudioStreamPacket&& packet)> on_incoming_audio_;
     std::function<void()> on_audio_channel_opened_;
     std::function<void()> on_audio_channel_closed_;
@@ -85,9 +128,16 @@ protected:
     int server_frame_duration_ = 60;
     bool error_occurred_ = false;
     std::string session_id_;
+    std::string iot_descriptors_hash_;
+    std::string mcp_descriptors_hash_;
+    bool iot_descriptors_cached_ = false;
     std::chrono::time_point<std::chrono::steady_clock> last_incoming_time_;
 
     virtual bool SendText(const std::string& text) = 0;
+    bool DispatchIncomingMessage(const char* data, size_t length);
+    bool SendJson(const JsonWriter& json);
+    void WriteDescriptorsHash(JsonWriter& json);
+    void ParseDescriptorsAck(const cJSON* root);
     virtual void SetError(const std::string& message);
     virtual bool IsTimeout() const;
 };
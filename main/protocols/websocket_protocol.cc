@@ -149,12 +149,12 @@ bool WebsocketProtocol::OpenAudioChannel() {
                     });
                 }
             }
-        } else {
+        } else if (!DispatchIncomingMessage(data, len)) {
             // Parse JSON data
             auto root = cJSON_Parse(data);
             auto type = cJSON_GetObjectItem(root, "type");
             if (cJSON_IsString(type)) {
-                if (strcmp(type->valuestring, "hello") == 0) {
+                if (GetMessageType(type->valuestring) == kMessageTypeHello) {
                     ParseServerHello(root);
                 } else {
                     if (on_incoming_json_ != nullptr) {
@@ -206,28 +206,30 @@ bool WebsocketProtocol::OpenAudioChannel() {
 
 std::string WebsocketProtocol::GetHelloMessage() {
     // keys: message type, version, audio_params (format, sample_rate, channels)
-    cJSON* root = cJSON_CreateObject();
-    cJSON_AddStringToObject(root, "type", "hello");
-    cJSON_AddNumberToObject(root, "version", version_);
-    cJSON* features = cJSON_CreateObject();
+    // Written to a string, so that more features or longer hashes can never truncate the hello
+    std::string message;
+    message.reserve(320);
+    JsonWriter json(message);
+    json.BeginObject()
+        .Member("type", "hello")
+        .Member("version", version_)
+        .Key("features").BeginObject()
 #if CONFIG_USE_SERVER_AEC
-    cJSON_AddBoolToObject(features, "aec", true);
+        .Member("aec", true)
 #endif
 #if CONFIG_IOT_PROTOCOL_MCP
-    cJSON_AddBoolToObject(features, "mcp", true);
+        .Member("mcp", true)
 #endif
-    cJSON_AddItemToObject(root, "features", features);
-    cJSON_AddStringToObject(root, "transport", "websocket");
-    cJSON* audio_params = cJSON_CreateObject();
-    cJSON_AddStringToObject(audio_params, "format", "opus");
-    cJSON_AddNumberToObject(audio_params, "sample_rate", 16000);
-    cJSON_AddNumberToObject(audio_params, "channels", 1);
-    cJSON_AddNumberToObject(audio_params, "frame_duration", OPUS_FRAME_DURATION_MS);
-    cJSON_AddItemToObject(root, "audio_params", audio_params);
-    auto json_str = cJSON_PrintUnformatted(root);
-    std::string message(json_str);
-    cJSON_free(json_str);
-    cJSON_Delete(root);
+        .EndObject()
+        .Member("transport", "websocket")
+        .Key("audio_params").BeginObject()
+            .Member("format", "opus")
+            .Member("sample_rate", 16000)
+            .Member("channels", 1)
+            .Member("frame_duration", OPUS_FRAME_DURATION_MS)
+        .EndObject();
+    WriteDescriptorsHash(json);
+    json.EndObject();
     return message;
 }
 
@@ -243,6 +245,7 @@ void WebsocketProtocol::ParseServerHello(const cJSON* root) {
         session_id_ = session_id->valuestring;
         ESP_LOGI(TAG, "Session ID: %s", session_id_.c_str());
     }
+    ParseDescriptorsAck(root);
 
     auto audio_params = cJSON_GetObjectItem(root, "audio_params");
     if (cJSON_IsObject(audio_params)) {
@@ -1,58 +1,271 @@
 #include "settings.h"
 
 #include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_system.h>
 #include <nvs_flash.h>
 
+#include <map>
+#include <mutex>
+#include <vector>
+
 #define TAG "Settings"
 
-Settings::Settings(const std::string& ns, bool read_write) : ns_(ns), read_write_(read_write) {
-    nvs_open(ns.c_str(), read_write_ ? NVS_READWRITE : NVS_READONLY, &nvs_handle_);
-}
+#define SETTINGS_COMMIT_DELAY_MS 3000
 
-Settings::~Settings() {
-    if (nvs_handle_ != 0) {
-        if (read_write_ && dirty_) {
-            ESP_ERROR_CHECK(nvs_commit(nvs_handle_));
+namespace {
+
+enum ValueType {
+    kValueTypeMissing,
+    kValueTypeString,
+    kValueTypeInt
+};
+
+struct Value {
+    ValueType type = kValueTypeMissing;
+    std::string string;
+    int32_t number = 0;
+    bool dirty = false;
+};
+
+struct Namespace {
+    bool loaded = false;
+    bool erase_all = false;
+    bool dirty = false;
+    std::map<std::string, Value> values;
+};
+
+class SettingsCache {
+public:
+    static SettingsCache& GetInstance() {
+        static SettingsCache instance;
+        return instance;
+    }
+
+    bool GetString(const std::string& ns, const std::string& key, std::string& value) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& entry = GetValue(ns, key);
+        if (entry.type != kValueTypeString) {
+            return false;
         }
-        nvs_close(nvs_handle_);
+        value = entry.string;
+        return true;
     }
-}
 
-std::string Settings::GetString(const std::string& key, const std::string& default_value) {
-    if (nvs_handle_ == 0) {
-        return default_value;
+    bool GetInt(const std::string& ns, const std::string& key, int32_t& value) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& entry = GetValue(ns, key);
+        if (entry.type != kValueTypeInt) {
+            return false;
+        }
+        value = entry.number;
+        return true;
     }
 
-    size_t length = 0;
-    if (nvs_get_str(nvs_handle_, key.c_str(), nullptr, &length) != ESP_OK) {
-        return default_value;
+    void SetString(const std::string& ns, const std::string& key, const std::string& value) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& entry = GetValue(ns, key);
+        if (entry.type == kValueTypeString && entry.string == value) {
+            return;
+        }
+        entry.type = kValueTypeString;
+        entry.string = value;
+        MarkDirty(ns, entry);
     }
 
+    void SetInt(const std::string& ns, const std::string& key, int32_t value) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& entry = GetValue(ns, key);
+        if (entry.type == kValueTypeInt && entry.number == value) {
+            return;
+        }
+        entry.type = kValueTypeInt;
+        entry.number = value;
+        entry.string.clear();
+        MarkDirty(ns, entry);
+    }
+
+    void EraseKey(const std::string& ns, const std::string& key) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& entry = GetValue(ns, key);
+        if (entry.type == kValueTypeMissing) {
+            return;
+        }
+        entry.type = kValueTypeMissing;
+        entry.string.clear();
+        MarkDirty(ns, entry);
+    }
+
+    void EraseAll(const std::string& ns) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& space = namespaces_[ns];
+        space.values.clear();
+        space.loaded = true;
+        space.erase_all = true;
+        space.dirty = true;
+        ScheduleCommit();
+    }
+
+    void Flush() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (commit_timer_ != nullptr) {
+            esp_timer_stop(commit_timer_);
+        }
+        for (auto& [name, space] : namespaces_) {
+            if (space.dirty) {
+                Commit(name, space);
+            }
+        }
+    }
+
+private:
+    std::mutex mutex_;
+    std::map<std::string, Namespace> namespaces_;
+    esp_timer_handle_t commit_timer_ = nullptr;
+
+    SettingsCache() {
+        esp_timer_create_args_t commit_timer_args = {
+            .callback = [](void* arg) {
+                static_cast<SettingsCache*>(arg)->Flush();
+            },
+            .arg = this,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "settings_commit",
+            .skip_unhandled_events = true,
+        };
+        ESP_ERROR_CHECK(esp_timer_create(&commit_timer_args, &commit_timer_));
+        // esp_restart() runs the shutdown handlers, so pending writes survive a reboot
+        esp_register_shutdown_handler([]() {
+            SettingsCache::GetInstance().Flush();
+        });
+    }
+
+    // Read all entries of a namespace the first time it is used
+    void Load(const std::string& ns, Namespace& space) {
+        space.loaded = true;
+        nvs_handle_t nvs_handle;
+        if (nvs_open(ns.c_str(), NVS_READONLY, &nvs_handle) != ESP_OK) {
+            return;
+        }
+
+        nvs_iterator_t it = nullptr;
+        esp_err_t ret = nvs_entry_find(NVS_DEFAULT_PART_NAME, ns.c_str(), NVS_TYPE_ANY, &it);
+        while (ret == ESP_OK) {
+            nvs_entry_info_t info;
+            nvs_entry_info(it, &info);
+            Value value;
+            if (info.type == NVS_TYPE_STR) {
+                size_t length = 0;
+                if (nvs_get_str(nvs_handle, info.key, nullptr, &length) == ESP_OK) {
+                    value.string.resize(length);
+                    nvs_get_str(nvs_handle, info.key, value.string.data(), &length);
+                    while (!value.string.empty() && value.string.back() == '\0') {
+                        value.string.pop_back();
+                    }
+                    value.type = kValueTypeString;
+                }
+            } else if (info.type == NVS_TYPE_I32) {
+                if (nvs_get_i32(nvs_handle, info.key, &value.number) == ESP_OK) {
+                    value.type = kValueTypeInt;
+                }
+            }
+            // Entries of other types are not handled by Settings and stay untouched
+            if (value.type != kValueTypeMissing) {
+                space.values[info.key] = std::move(value);
+            }
+            ret = nvs_entry_next(&it);
+        }
+        nvs_release_iterator(it);
+        nvs_close(nvs_handle);
+        ESP_LOGI(TAG, "Loaded namespace %s, %u entries", ns.c_str(), (unsigned)space.values.size());
+    }
+
+    Value& GetValue(const std::string& ns, const std::string& key) {
+        auto& space = namespaces_[ns];
+        if (!space.loaded) {
+            Load(ns, space);
+        }
+        return space.values[key];
+    }
+
+    void MarkDirty(const std::string& ns, Value& value) {
+        value.dirty = true;
+        namespaces_[ns].dirty = true;
+        ScheduleCommit();
+    }
+
+    // The first write after a commit arms the timer and later writes join it, so a burst of
+    // changes is committed once and a steady stream of writes is still committed every 3 s
+    void ScheduleCommit() {
+        if (!esp_timer_is_active(commit_timer_)) {
+            esp_timer_start_once(commit_timer_, SETTINGS_COMMIT_DELAY_MS * 1000);
+        }
+    }
+
+    void Commit(const std::string& ns, Namespace& space) {
+        nvs_handle_t nvs_handle;
+        esp_err_t ret = nvs_open(ns.c_str(), NVS_READWRITE, &nvs_handle);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to open namespace %s: %s", ns.c_str(), esp_err_to_name(ret));
+            return;
+        }
+
+        if (space.erase_all) {
+            ESP_ERROR_CHECK(nvs_erase_all(nvs_handle));
+            space.erase_all = false;
+        }
+        int count = 0;
+        for (auto& [key, value] : space.values) {
+            if (!value.dirty) {
+                continue;
+            }
+            if (value.type == kValueTypeString) {
+                ESP_ERROR_CHECK(nvs_set_str(nvs_handle, key.c_str(), value.string.c_str()));
+            } else if (value.type == kValueTypeInt) {
+                ESP_ERROR_CHECK(nvs_set_i32(nvs_handle, key.c_str(), value.number));
+            } else {
+                ret = nvs_erase_key(nvs_handle, key.c_str());
+                if (ret != ESP_ERR_NVS_NOT_FOUND) {
+                    ESP_ERROR_CHECK(ret);
+                }
+            }
+            value.dirty = false;
+            count++;
+        }
+        ESP_ERROR_CHECK(nvs_commit(nvs_handle));
+        nvs_close(nvs_handle);
+        space.dirty = false;
+        ESP_LOGI(TAG, "Committed %d changes to namespace %s", count, ns.c_str());
+    }
+};
+
+} // namespace
+
+Settings::Settings(const std::string& ns, bool read_write) : ns_(ns), read_write_(read_write) {
+}
+
+Settings::~Settings() {
+}
+
+std::string Settings::GetString(const std::string& key, const std::string& default_value) {
     std::string value;
-    value.resize(length);
-    ESP_ERROR_CHECK(nvs_get_str(nvs_handle_, key.c_str(), value.data(), &length));
-    while (!value.empty() && value.back() == '\0') {
-        value.pop_back();
+    if (!SettingsCache::GetInstance().GetString(ns_, key, value)) {
+        return default_value;
     }
     return value;
 }
 
 void Settings::SetString(const std::string& key, const std::string& value) {
     if (read_write_) {
-        ESP_ERROR_CHECK(nvs_set_str(nvs_handle_, key.c_str(), value.c_str()));
-        dirty_ = true;
+        SettingsCache::GetInstance().SetString(ns_, key, value);
     } else {
         ESP_LOGW(TAG, "Namespace %s is not open for writing", ns_.c_str());
     }
 }
 
 int32_t Settings::GetInt(const std::string& key, int32_t default_value) {
-    if (nvs_handle_ == 0) {
-        return default_value;
-    }
-
     int32_t value;
-    if (nvs_get_i32(nvs_handle_, key.c_str(), &value) != ESP_OK) {
+    if (!SettingsCache::GetInstance().GetInt(ns_, key, value)) {
         return default_value;
     }
     return value;
@@ -60,8 +273,7 @@ int32_t Settings::GetInt(const std::string& key, int32_t default_value) {
 
 void Settings::SetInt(const std::string& key, int32_t value) {
     if (read_write_) {
-        ESP_ERROR_CHECK(nvs_set_i32(nvs_handle_, key.c_str(), value));
-        dirty_ = true;
+        SettingsCache::GetInstance().SetInt(ns_, key, value);
     } else {
         ESP_LOGW(TAG, "Namespace %s is not open for writing", ns_.c_str());
     }
@@ -69,10 +281,7 @@ void Settings::SetInt(const std::string& key, int32_t value) {
 
 void Settings::EraseKey(const std::string& key) {
     if (read_write_) {
-        auto ret = nvs_erase_key(nvs_handle_, key.c_str());
-        if (ret != ESP_ERR_NVS_NOT_FOUND) {
-            ESP_ERROR_CHECK(ret);
-        }
+        SettingsCache::GetInstance().EraseKey(ns_, key);
     } else {
         ESP_LOGW(TAG, "Namespace %s is not open for writing", ns_.c_str());
     }
@@ -80,8 +289,12 @@ void Settings::EraseKey(const std::string& key) {
 
 void Settings::EraseAll() {
     if (read_write_) {
-        ESP_ERROR_CHECK(nvs_erase_all(nvs_handle_));
+        SettingsCache::GetInstance().EraseAll(ns_);
     } else {
         ESP_LOGW(TAG, "Namespace %s is not open for writing", ns_.c_str());
     }
 }
+
+void Settings::Flush() {
+    SettingsCache::GetInstance().Flush();
+}
@@ -4,6 +4,10 @@
 #include <string>
 #include <nvs_flash.h>
 
+// Settings are served from a process-wide cache in RAM. A namespace is only read
+// from NVS when it is first used, and writes are committed to flash together after
+// a short delay, so that repeated changes (e.g. turning the volume knob) do not
+// write the flash every time. Pending writes are flushed before restart.
 class Settings {
 public:
     Settings(const std::string& ns, bool read_write = false);
@@ -16,11 +20,12 @@ public:
     void EraseKey(const std::string& key);
     void EraseAll();
 
+    // Commit all pending writes to NVS now
+    static void Flush();
+
 private:
     std::string ns_;
-    nvs_handle_t nvs_handle_ = 0;
     bool read_write_ = false;
-    bool dirty_ = false;
 };
 
 #endif
@@ -0,0 +1,214 @@
+#! /usr/bin/env python3
+"""
+Convert emoji GIFs into sprites for the asset partition (see main/display/sprite_player.h).
+
+    python scripts/emoji_sprite.py build happy.gif assets/emoji/happy.sprite --size 240
+    python scripts/emoji_sprite.py info assets/emoji/happy.sprite
+
+Put the sprites under `emoji/<gif name>.sprite` in the asset directory and pack
+it with scripts/pack_assets.py. Boards that find `emoji/staticstate.sprite` in
+the partition play the sprites instead of the GIFs linked into the firmware.
+
+Every frame is run length encoded RGB565. Frames after the first are stored as
+changes to the previous frame when that is smaller. `build` decodes the sprite
+again and checks it against the source frames before writing it. Requires Pillow.
+
+Layout (little endian):
+    header   magic "XZSP", version u8, 1 byte reserved, frame_count u16,
+             width u16, height u16, 4 bytes reserved
+    frames   frame_count entries of offset u32, size u32, delay_ms u16,
+             type u8 (0 key, 1 delta), 1 byte reserved
+    data     u16 tokens, op in the top two bits and a pixel count in the rest:
+             SKIP keeps pixels of the previous frame, FILL is followed by one
+             pixel, COPY by `count` pixels
+"""
+import argparse
+import struct
+import sys
+
+MAGIC = b"XZSP"
+VERSION = 1
+HEADER_FORMAT = "<4sBxHHH4x"
+FRAME_FORMAT = "<IIHBx"
+HEADER_SIZE = struct.calcsize(HEADER_FORMAT)
+FRAME_SIZE = struct.calcsize(FRAME_FORMAT)
+
+FRAME_KEY = 0
+FRAME_DELTA = 1
+
+OP_SKIP = 0
+OP_FILL = 1
+OP_COPY = 2
+MAX_COUNT = 0x3fff
+MIN_FILL = 3         # Shorter runs are cheaper inside a COPY
+MIN_SKIP = 2         # A single unchanged pixel is cheaper to copy
+DEFAULT_DELAY_MS = 100
+
+
+def encode_frame(pixels, previous=None):
+    """Encode a list of RGB565 pixels, as changes to `previous` if it is given"""
+    tokens = []
+    literal = []
+
+    def flush_literal():
+        if literal:
+            tokens.append(OP_COPY << 14 | len(literal))
+            tokens.extend(literal)
+            literal.clear()
+
+    count = len(pixels)
+    position = 0
+    while position < count:
+        if previous is not None:
+            end = position
+            while end < count and end - position < MAX_COUNT and pixels[end] == previous[end]:
+                end += 1
+            if end - position >= MIN_SKIP or (end == count and end > position):
+                flush_literal()
+                tokens.append(OP_SKIP << 14 | (end - position))
+                position = end
+                continue
+
+        end = position
+        while end < count and end - position < MAX_COUNT and pixels[end] == pixels[position]:
+            end += 1
+        if end - position >= MIN_FILL:
+            flush_literal()
+            tokens.append(OP_FILL << 14 | (end - position))
+            tokens.append(pixels[position])
+            position = end
+            continue
+
+        literal.append(pixels[position])
+        position += 1
+        if len(literal) == MAX_COUNT:
+            flush_literal()
+    flush_literal()
+    return struct.pack(f"<{len(tokens)}H", *tokens)
+
+
+def decode_frame(data, pixel_count, previous=None):
+    tokens = struct.unpack(f"<{len(data) // 2}H", data)
+    pixels = []
+    index = 0
+    while index < len(tokens):
+        op, count = tokens[index] >> 14, tokens[index] & MAX_COUNT
+        index += 1
+        if op == OP_SKIP:
+            if previous is None:
+                raise ValueError("SKIP in a key frame")
+            pixels.extend(previous[len(pixels):len(pixels) + count])
+        elif op == OP_FILL:
+            pixels.extend([tokens[index]] * count)
+            index += 1
+        elif op == OP_COPY:
+            pixels.extend(tokens[index:index + count])
+            index += count
+        else:
+            raise ValueError(f"Unknown operation {op}")
+    if len(pixels) != pixel_count:
+        raise ValueError("Frame size does not match the sprite")
+    return pixels
+
+
+def pack(frames, width, height, use_delta=True):
+    """`frames` is a list of (pixels, delay_ms) pairs"""
+    entries = []
+    data = bytearray()
+    data_offset = HEADER_SIZE + len(frames) * FRAME_SIZE
+    previous = None
+    for pixels, delay_ms in frames:
+        if len(pixels) != width * height:
+            raise ValueError("Frame size does not match the sprite")
+        encoded, frame_type = encode_frame(pixels), FRAME_KEY
+        if use_delta and previous is not None:
+            delta = encode_frame(pixels, previous)
+            if len(delta) < len(encoded):
+                encoded, frame_type = delta, FRAME_DELTA
+        entries.append(struct.pack(FRAME_FORMAT, data_offset + len(data), len(encoded),
+                                   min(delay_ms, 0xffff), frame_type))
+        data += encoded
+        previous = pixels
+    header = struct.pack(HEADER_FORMAT, MAGIC, VERSION, len(frames), width, height)
+    return header + b"".join(entries) + bytes(data)
+
+
+def unpack(sprite):
+    """Returns width, height and a list of (pixels, delay_ms, type) tuples"""
+    if len(sprite) < HEADER_SIZE:
+        raise ValueError("Sprite is too small")
+    magic, version, frame_count, width, height = struct.unpack_from(HEADER_FORMAT, sprite)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError("Not a sprite or unsupported version")
+    frames = []
+    previous = None
+    for index in range(frame_count):
+        offset, size, delay_ms, frame_type = struct.unpack_from(FRAME_FORMAT, sprite, HEADER_SIZE + index * FRAME_SIZE)
+        if offset + size > len(sprite):
+            raise ValueError(f"Frame {index} is out of range")
+        reference = previous if frame_type == FRAME_DELTA else None
+        pixels = decode_frame(sprite[offset:offset + size], width * height, reference)
+        frames.append((pixels, delay_ms, frame_type))
+        previous = pixels
+    return width, height, frames
+
+
+def to_rgb565(image):
+    return [(r >> 3) << 11 | (g >> 2) << 5 | b >> 3 for r, g, b in image.getdata()]
+
+
+def load_gif(path, size, background):
+    from PIL import Image, ImageSequence
+
+    frames = []
+    with Image.open(path) as gif:
+        for frame in ImageSequence.Iterator(gif):
+            delay_ms = frame.info.get("duration") or DEFAULT_DELAY_MS
+            rgba = frame.convert("RGBA")
+            if size:
+                rgba = rgba.resize((size, size), Image.LANCZOS)
+            canvas = Image.new("RGBA", rgba.size, background)
+            canvas.alpha_composite(rgba)
+            frames.append((to_rgb565(canvas.convert("RGB")), delay_ms))
+        width, height = rgba.size
+    return frames, width, height
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Emoji sprite tool")
+    subparsers = parser.add_subparsers(dest="command", required=True)
+    build_parser = subparsers.add_parser("build", help="Convert a GIF into a sprite")
+    build_parser.add_argument("input")
+    build_parser.add_argument("output")
+    build_parser.add_argument("--size", type=int, help="Scale the frames to size x size pixels")
+    build_parser.add_argument("--background", type=lambda x: int(x, 0), default=0x000000,
+                              help="Color behind transparent pixels, e.g. 0x000000")
+    build_parser.add_argument("--no-delta", action="store_true", help="Store every frame as a key frame")
+    info_parser = subparsers.add_parser("info", help="Show the frames of a sprite")
+    info_parser.add_argument("sprite")
+    args = parser.parse_args()
+
+    if args.command == "build":
+        background = ((args.background >> 16) & 0xff, (args.background >> 8) & 0xff, args.background & 0xff, 0xff)
+        frames, width, height = load_gif(args.input, args.size, background)
+        sprite = pack(frames, width, height, not args.no_delta)
+        _, _, decoded = unpack(sprite)
+        if [pixels for pixels, _, _ in decoded] != [pixels for pixels, _ in frames]:
+            sys.exit("Decoded frames do not match the source")
+        with open(args.output, "wb") as f:
+            f.write(sprite)
+        raw_size = len(frames) * width * height * 2
+        print(f"{len(frames)} frames {width}x{height}, {len(sprite)} bytes "
+              f"({len(sprite) * 100 // raw_size}% of {raw_size} decoded)")
+    else:
+        with open(args.sprite, "rb") as f:
+            sprite = f.read()
+        width, height, frames = unpack(sprite)
+        print(f"{len(frames)} frames {width}x{height}, {len(sprite)} bytes")
+        for index in range(len(frames)):
+            offset, size, delay_ms, frame_type = struct.unpack_from(FRAME_FORMAT, sprite, HEADER_SIZE + index * FRAME_SIZE)
+            print(f"{index:4d}  {'delta' if frame_type == FRAME_DELTA else 'key  '}  size {size:8d}  delay {delay_ms:5d} ms")
+
+
+if __name__ == "__main__":
+    main()
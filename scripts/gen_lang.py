@@ -7,6 +7,7 @@ HEADER_TEMPLATE = """// Auto-generated language config
 #pragma once
 
 #include <string_view>
+#include <cstddef>
 
 #ifndef {lang_code_for_font}
     #define {lang_code_for_font}  // 預設語言
@@ -21,14 +22,48 @@ namespace Lang {{
 {strings}
     }}
 
-    // 音效资源
+    // 音效资源，资源分区中有同名音效时在启动时替换为分区中的数据
     namespace Sounds {{
 {sounds}
+
+        struct Asset {{
+            const char* name;       // 在资源分区中的名称
+            std::string_view* sound;
+        }};
+        extern const Asset ASSETS[];
+        extern const size_t ASSET_COUNT;
+    }}
+}}
+"""
+
+SOURCE_TEMPLATE = """// Auto-generated language config
+#include "lang_config.h"
+
+namespace Lang {{
+    namespace Sounds {{
+{sounds}
+
+        const Asset ASSETS[] = {{
+{sound_assets}
+        }};
+        const size_t ASSET_COUNT = sizeof(ASSETS) / sizeof(ASSETS[0]);
     }}
 }}
 """
 
-def generate_header(input_path, output_path):
+def sound_definition(base_name, embed):
+    if not embed:
+        # 只在资源分区中，加载分区前为空
+        return f'        std::string_view P3_{base_name.upper()};'
+    return f'''
+        extern const char p3_{base_name}_start[] asm("_binary_{base_name}_p3_start");
+        extern const char p3_{base_name}_end[] asm("_binary_{base_name}_p3_end");
+        std::string_view P3_{base_name.upper()} {{
+        static_cast<const char*>(p3_{base_name}_start),
+        static_cast<size_t>(p3_{base_name}_end - p3_{base_name}_start)
+        }};'''
+
+def generate(input_path, output_path, source_path, embed):
     with open(input_path, 'r', encoding='utf-8') as f:
         data = json.load(f)
 
@@ -40,52 +75,50 @@ def generate_header(input_path, output_path):
 
     # 生成字符串常量
     strings = []
-    sounds = []
+    sound_declarations = []
+    sound_definitions = []
+    sound_assets = []
+    lang_dir = os.path.basename(os.path.dirname(os.path.abspath(input_path)))
     for key, value in data['strings'].items():
         value = value.replace('"', '\\"')
         strings.append(f'        constexpr const char* {key.upper()} = "{value}";')
 
-    # 生成音效常量
-    for file in os.listdir(os.path.dirname(input_path)):
-        if file.endswith('.p3'):
-            base_name = os.path.splitext(file)[0]
-            sounds.append(f'''
-        extern const char p3_{base_name}_start[] asm("_binary_{base_name}_p3_start");
-        extern const char p3_{base_name}_end[] asm("_binary_{base_name}_p3_end");
-        static const std::string_view P3_{base_name.upper()} {{
-        static_cast<const char*>(p3_{base_name}_start),
-        static_cast<size_t>(p3_{base_name}_end - p3_{base_name}_start)
-        }};''')
-    
-    # 生成公共音效
-    for file in os.listdir(os.path.join(os.path.dirname(output_path), 'common')):
-        if file.endswith('.p3'):
-            base_name = os.path.splitext(file)[0]
-            sounds.append(f'''
-        extern const char p3_{base_name}_start[] asm("_binary_{base_name}_p3_start");
-        extern const char p3_{base_name}_end[] asm("_binary_{base_name}_p3_end");
-        static const std::string_view P3_{base_name.upper()} {{
-        static_cast<const char*>(p3_{base_name}_start),
-        static_cast<size_t>(p3_{base_name}_end - p3_{base_name}_start)
-        }};''')
+    # 生成音效常量，包括公共音效
+    sound_dirs = [(os.path.dirname(input_path), lang_dir),
+                  (os.path.join(os.path.dirname(output_path), 'common'), 'common')]
+    for directory, asset_dir in sound_dirs:
+        for file in os.listdir(directory):
+            if file.endswith('.p3'):
+                base_name = os.path.splitext(file)[0]
+                sound_declarations.append(f'        extern std::string_view P3_{base_name.upper()};')
+                sound_definitions.append(sound_definition(base_name, embed))
+                sound_assets.append(f'            {{"{asset_dir}/{file}", &P3_{base_name.upper()}}},')
 
     # 填充模板
-    content = HEADER_TEMPLATE.format(
+    header = HEADER_TEMPLATE.format(
         lang_code=lang_code,
         lang_code_for_font=lang_code.replace('-', '_').lower(),
         strings="\n".join(sorted(strings)),
-        sounds="\n".join(sorted(sounds))
+        sounds="\n".join(sorted(sound_declarations))
+    )
+    source = SOURCE_TEMPLATE.format(
+        sounds="\n".join(sorted(sound_definitions)),
+        sound_assets="\n".join(sorted(sound_assets))
     )
 
     # 写入文件
     os.makedirs(os.path.dirname(output_path), exist_ok=True)
     with open(output_path, 'w', encoding='utf-8') as f:
-        f.write(content)
+        f.write(header)
+    with open(source_path, 'w', encoding='utf-8') as f:
+        f.write(source)
 
 if __name__ == "__main__":
     parser = argparse.ArgumentParser()
     parser.add_argument("--input", required=True, help="输入JSON文件路径")
     parser.add_argument("--output", required=True, help="输出头文件路径")
+    parser.add_argument("--source", required=True, help="输出源文件路径")
+    parser.add_argument("--no-embed", action="store_true", help="音效不链接进固件，只从资源分区加载")
     args = parser.parse_args()
 
-    generate_header(args.input, args.output)
\ No newline at end of file
+    generate(args.input, args.output, args.source, not args.no_embed)
\ No newline at end of file
@@ -0,0 +1,170 @@
+#! /usr/bin/env python3
+"""
+Create and apply delta patches for firmware upgrades (see main/ota_delta.h).
+
+    python scripts/ota_delta.py create old.bin new.bin patch.bin
+    python scripts/ota_delta.py apply old.bin patch.bin out.bin
+
+`create` applies the new patch to the source again and checks that it gives
+back the target image before writing it.
+"""
+import argparse
+import hashlib
+import struct
+import sys
+
+MAGIC = b"XZD1"
+OP_END = 0x00
+OP_COPY = 0x01
+OP_ADD = 0x02
+OP_INSERT = 0x03
+
+BLOCK_SIZE = 32      # Length of the blocks used to find matches
+INDEX_STEP = 8       # Distance between indexed source blocks
+MIN_COPY = 24        # Shorter matches are not worth a COPY command
+
+
+def build_index(source):
+    index = {}
+    for offset in range(0, len(source) - BLOCK_SIZE + 1, INDEX_STEP):
+        index.setdefault(source[offset:offset + BLOCK_SIZE], offset)
+    return index
+
+
+def find_match(source, target, index, position):
+    """Find an indexed source block equal to the target at `position` and extend it forwards"""
+    block = target[position:position + BLOCK_SIZE]
+    offset = index.get(block)
+    if offset is None:
+        return None
+    length = BLOCK_SIZE
+    while offset + length < len(source) and position + length < len(target) \
+            and source[offset + length] == target[position + length]:
+        length += 1
+    return offset, length
+
+
+def emit_literal(commands, source, target, start, end, source_delta):
+    """Emit target[start:end] as ADD against the source at the same distance as the last match,
+    or as INSERT if the source bytes there are not similar"""
+    if start >= end:
+        return
+    source_start = start + source_delta
+    length = end - start
+    if 0 <= source_start and source_start + length <= len(source):
+        same = sum(1 for i in range(length) if source[source_start + i] == target[start + i])
+        if same * 2 >= length:
+            diff = bytes((target[start + i] - source[source_start + i]) & 0xFF for i in range(length))
+            commands.append((OP_ADD, source_start, diff))
+            return
+    commands.append((OP_INSERT, target[start:end]))
+
+
+def diff(source, target):
+    index = build_index(source)
+    commands = []
+    literal_start = 0
+    source_delta = 0
+    position = 0
+    while position + BLOCK_SIZE <= len(target):
+        match = find_match(source, target, index, position)
+        if match is None or match[1] < MIN_COPY:
+            position += 1
+            continue
+        offset, length = match
+        # Extend the match backwards into the pending literal bytes
+        while position > literal_start and offset > 0 and source[offset - 1] == target[position - 1]:
+            position -= 1
+            offset -= 1
+            length += 1
+        emit_literal(commands, source, target, literal_start, position, source_delta)
+        commands.append((OP_COPY, offset, length))
+        source_delta = offset - position
+        position += length
+        literal_start = position
+    emit_literal(commands, source, target, literal_start, len(target), source_delta)
+    return commands
+
+
+def encode(source, target, commands):
+    out = bytearray()
+    out += MAGIC
+    out += struct.pack("<II", len(source), len(target))
+    out += hashlib.sha256(source).digest()
+    for command in commands:
+        if command[0] == OP_COPY:
+            out += struct.pack("<BII", OP_COPY, command[1], command[2])
+        elif command[0] == OP_ADD:
+            out += struct.pack("<BII", OP_ADD, command[1], len(command[2]))
+            out += command[2]
+        else:
+            out += struct.pack("<BI", OP_INSERT, len(command[1]))
+            out += command[1]
+    out += bytes([OP_END])
+    return bytes(out)
+
+
+def apply(source, patch):
+    if patch[:4] != MAGIC:
+        raise ValueError("Invalid patch magic")
+    source_size, target_size = struct.unpack_from("<II", patch, 4)
+    if source_size != len(source) or hashlib.sha256(source).digest() != patch[12:44]:
+        raise ValueError("Patch does not match the source image")
+    target = bytearray()
+    position = 44
+    while True:
+        op = patch[position]
+        position += 1
+        if op == OP_END:
+            break
+        if op == OP_COPY:
+            offset, length = struct.unpack_from("<II", patch, position)
+            position += 8
+            target += source[offset:offset + length]
+        elif op == OP_ADD:
+            offset, length = struct.unpack_from("<II", patch, position)
+            position += 8
+            target += bytes((source[offset + i] + patch[position + i]) & 0xFF for i in range(length))
+            position += length
+        elif op == OP_INSERT:
+            length, = struct.unpack_from("<I", patch, position)
+            position += 4
+            target += patch[position:position + length]
+            position += length
+        else:
+            raise ValueError("Invalid opcode 0x%02x" % op)
+    if len(target) != target_size:
+        raise ValueError("Target size mismatch")
+    return bytes(target)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Firmware delta patch tool")
+    subparsers = parser.add_subparsers(dest="command", required=True)
+    create_parser = subparsers.add_parser("create", help="Create a patch from the old to the new firmware")
+    create_parser.add_argument("source")
+    create_parser.add_argument("target")
+    create_parser.add_argument("patch")
+    apply_parser = subparsers.add_parser("apply", help="Apply a patch to the old firmware")
+    apply_parser.add_argument("source")
+    apply_parser.add_argument("patch")
+    apply_parser.add_argument("output")
+    args = parser.parse_args()
+
+    if args.command == "create":
+        source = open(args.source, "rb").read()
+        target = open(args.target, "rb").read()
+        patch = encode(source, target, diff(source, target))
+        if apply(source, patch) != target:
+            print("Patch verification failed", file=sys.stderr)
+            sys.exit(1)
+        open(args.patch, "wb").write(patch)
+        print("Patch: %d bytes, %.1f%% of the new firmware" % (len(patch), len(patch) * 100 / len(target)))
+    else:
+        source = open(args.source, "rb").read()
+        patch = open(args.patch, "rb").read()
+        open(args.output, "wb").write(apply(source, patch))
+
+
+if __name__ == "__main__":
+    main()
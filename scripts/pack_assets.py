@@ -0,0 +1,155 @@
+#! /usr/bin/env python3
+"""
+Pack sounds, emoji and other assets into an image for the `assets` partition
+(see main/asset_partition.h).
+
+    python scripts/pack_assets.py pack main/assets build/assets.bin
+    python scripts/pack_assets.py list build/assets.bin
+
+Every file under the source directory becomes an asset named by its path
+relative to that directory, e.g. `common/popup.p3` or `zh-CN/activation.p3`.
+The device finds an asset by the FNV-1a hash of its name, so an image packed
+later can replace assets without rebuilding the firmware. Flash the image with
+
+    parttool.py write_partition --partition-name assets --input build/assets.bin
+
+Layout (little endian):
+    header   magic "XZAS", version u16, slot_count u16, asset_count u32,
+             image_size u32, table_crc32 u32, 12 bytes reserved
+    table    slot_count slots of id u32, offset u32, size u32, crc32 u32,
+             open addressing with linear probing, id 0 marks an empty slot
+    data     asset contents, each aligned to 4 bytes
+"""
+import argparse
+import os
+import struct
+import sys
+import zlib
+
+MAGIC = b"XZAS"
+VERSION = 1
+HEADER_FORMAT = "<4sHHIII12x"
+SLOT_FORMAT = "<IIII"
+HEADER_SIZE = struct.calcsize(HEADER_FORMAT)
+SLOT_SIZE = struct.calcsize(SLOT_FORMAT)
+DATA_ALIGN = 4
+MAX_SLOTS = 0x8000
+
+# Files that are generated from or only used by the build
+IGNORED_EXTENSIONS = {".json", ".h"}
+
+
+def asset_id(name):
+    """FNV-1a hash of the asset name, must match AssetPartition::GetAssetId"""
+    value = 0x811c9dc5
+    for byte in name.encode("utf-8"):
+        value ^= byte
+        value = (value * 0x01000193) & 0xffffffff
+    return value
+
+
+def collect_assets(source_dir):
+    assets = []
+    for root, dirs, files in os.walk(source_dir):
+        dirs.sort()
+        for file in sorted(files):
+            if file.startswith(".") or os.path.splitext(file)[1] in IGNORED_EXTENSIONS:
+                continue
+            path = os.path.join(root, file)
+            name = os.path.relpath(path, source_dir).replace(os.sep, "/")
+            with open(path, "rb") as f:
+                assets.append((name, f.read()))
+    return assets
+
+
+def slot_count_for(count):
+    """Keep the table at most half full so that probe sequences stay short"""
+    slots = 2
+    while slots < count * 2:
+        slots *= 2
+    return slots
+
+
+def pack(assets):
+    slot_count = slot_count_for(len(assets))
+    if slot_count > MAX_SLOTS:
+        raise ValueError(f"Too many assets: {len(assets)}")
+
+    names = {}
+    for name, _ in assets:
+        id = asset_id(name)
+        if id == 0:
+            raise ValueError(f"Asset {name} hashes to the reserved id 0, rename it")
+        if id in names:
+            raise ValueError(f"Assets {names[id]} and {name} have the same id 0x{id:08x}, rename one of them")
+        names[id] = name
+
+    slots = [(0, 0, 0, 0)] * slot_count
+    data = bytearray()
+    data_offset = HEADER_SIZE + slot_count * SLOT_SIZE
+    for name, content in assets:
+        id = asset_id(name)
+        index = id & (slot_count - 1)
+        while slots[index][0] != 0:
+            index = (index + 1) & (slot_count - 1)
+        slots[index] = (id, data_offset + len(data), len(content), zlib.crc32(content))
+        data += content
+        data += b"\0" * (-len(data) % DATA_ALIGN)
+
+    table = b"".join(struct.pack(SLOT_FORMAT, *slot) for slot in slots)
+    image_size = data_offset + len(data)
+    header = struct.pack(HEADER_FORMAT, MAGIC, VERSION, slot_count, len(assets),
+                         image_size, zlib.crc32(table))
+    return header + table + bytes(data)
+
+
+def parse(image):
+    if len(image) < HEADER_SIZE:
+        raise ValueError("Image is too small")
+    magic, version, slot_count, asset_count, image_size, table_crc = struct.unpack_from(HEADER_FORMAT, image)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError("Not an asset image or unsupported version")
+    table = image[HEADER_SIZE:HEADER_SIZE + slot_count * SLOT_SIZE]
+    if zlib.crc32(table) != table_crc or image_size > len(image):
+        raise ValueError("Image is corrupted")
+    slots = []
+    for index in range(slot_count):
+        id, offset, size, crc = struct.unpack_from(SLOT_FORMAT, table, index * SLOT_SIZE)
+        if id != 0:
+            slots.append((id, offset, size, crc))
+    if len(slots) != asset_count:
+        raise ValueError("Asset count does not match the table")
+    return slots
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Asset partition image tool")
+    subparsers = parser.add_subparsers(dest="command", required=True)
+    pack_parser = subparsers.add_parser("pack", help="Pack a directory into an image")
+    pack_parser.add_argument("source_dir")
+    pack_parser.add_argument("output")
+    pack_parser.add_argument("--partition-size", type=lambda x: int(x, 0),
+                             help="Fail if the image does not fit, e.g. 0x300000")
+    list_parser = subparsers.add_parser("list", help="List the assets in an image")
+    list_parser.add_argument("image")
+    args = parser.parse_args()
+
+    if args.command == "pack":
+        assets = collect_assets(args.source_dir)
+        image = pack(assets)
+        if args.partition_size and len(image) > args.partition_size:
+            sys.exit(f"Image size {len(image)} exceeds the partition size {args.partition_size}")
+        parse(image)
+        with open(args.output, "wb") as f:
+            f.write(image)
+        print(f"Packed {len(assets)} assets, {len(image)} bytes")
+    else:
+        with open(args.image, "rb") as f:
+            image = f.read()
+        for id, offset, size, crc in sorted(parse(image), key=lambda slot: slot[1]):
+            valid = zlib.crc32(image[offset:offset + size]) == crc
+            print(f"0x{id:08x}  offset {offset:8d}  size {size:8d}  {'ok' if valid else 'CRC MISMATCH'}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,44 @@
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <chrono>
+
+// Minimal checks for the host tests, a failed check ends the test with an error
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+        exit(1); \
+    } \
+} while (0)
+
+#define CHECK_EQ(actual, expected) do { \
+    auto actual_value_ = (actual); \
+    auto expected_value_ = (expected); \
+    if (!(actual_value_ == expected_value_)) { \
+        fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed\n  actual:   %s\n  expected: %s\n", __FILE__, __LINE__, \
+            #actual, #expected, HostTestString(actual_value_).c_str(), HostTestString(expected_value_).c_str()); \
+        exit(1); \
+    } \
+} while (0)
+
+inline std::string HostTestString(const std::string& value) { return value; }
+inline std::string HostTestString(std::string_view value) { return std::string(value); }
+inline std::string HostTestString(const char* value) { return value ? value : "(null)"; }
+template<typename T>
+inline std::string HostTestString(const T& value) { return std::to_string(value); }
+
+// Microseconds per call of `body`, averaged over `iterations` calls
+template<typename Body>
+double HostBenchmark(int iterations, Body body) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        body();
+    }
+    std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+#endif // HOST_TEST_H
@@ -0,0 +1,112 @@
+// Checks the fields the fast path of Protocol::DispatchIncomingMessage takes from the server
+// messages, and measures how long the scan takes on a recorded conversation.
+#include "host_test.h"
+#include "json_scanner.h"
+
+#include <cstring>
+#include <vector>
+
+static const char* const kKeys[] = {"type", "state", "text", "emotion"};
+
+// Messages of one recorded conversation, in the order the server sent them
+static const char* const kCorpus[] = {
+    R"({"type":"hello","transport":"websocket","session_id":"6d0c8f1e","audio_params":{"sample_rate":24000,"frame_duration":60}})",
+    R"({"type":"stt","text":"今天天气怎么样","session_id":"6d0c8f1e"})",
+    R"({"type":"llm","text":"😊","emotion":"happy","session_id":"6d0c8f1e"})",
+    R"({"type":"tts","state":"start","sample_rate":24000,"session_id":"6d0c8f1e"})",
+    R"({"type":"tts","state":"sentence_start","text":"今天是晴天，最高气温二十六度。","session_id":"6d0c8f1e"})",
+    R"({"type":"tts","state":"sentence_end","text":"今天是晴天，最高气温二十六度。","session_id":"6d0c8f1e"})",
+    R"({"type":"tts","state":"sentence_start","text":"It's a good day to go outside.","session_id":"6d0c8f1e"})",
+    R"({"type":"tts","state":"sentence_end","text":"It's a good day to go outside.","session_id":"6d0c8f1e"})",
+    R"({"type":"tts","state":"stop","session_id":"6d0c8f1e"})",
+    R"({"type":"stt","text":"把音量调到 \"50\"","session_id":"6d0c8f1e"})",
+    R"({"type":"mcp","payload":{"jsonrpc":"2.0","id":3,"method":"tools/call","params":{"name":"self.audio_speaker.set_volume","arguments":{"volume":50}}},"session_id":"6d0c8f1e"})",
+    R"({"type":"tts","state":"sentence_start","text":"好的，音量已调到 50。","session_id":"6d0c8f1e"})",
+    R"({"type":"tts","state":"stop","session_id":"6d0c8f1e"})",
+};
+
+static void TestFields() {
+    JsonStringView values[4];
+
+    JsonScanner stt(kCorpus[1], strlen(kCorpus[1]));
+    CHECK(stt.ScanObject(kKeys, values, 4));
+    CHECK(values[0] == "stt");
+    CHECK(!values[1].valid);
+    CHECK_EQ(values[2].ToString(), "今天天气怎么样");
+    CHECK(!values[3].valid);
+
+    JsonScanner llm(kCorpus[2], strlen(kCorpus[2]));
+    CHECK(llm.ScanObject(kKeys, values, 4));
+    CHECK(values[0] == "llm");
+    CHECK(values[3] == "happy");
+
+    JsonScanner quoted(kCorpus[9], strlen(kCorpus[9]));
+    CHECK(quoted.ScanObject(kKeys, values, 4));
+    CHECK(values[2].escaped);
+    CHECK_EQ(values[2].ToString(), "把音量调到 \"50\"");
+
+    JsonScanner unicode(kCorpus[11], strlen(kCorpus[11]));
+    CHECK(unicode.ScanObject(kKeys, values, 4));
+    CHECK(values[1] == "sentence_start");
+    CHECK_EQ(values[2].ToString(), "好的，音量已调到 50。");
+
+    // The nested payload is skipped, only the type is taken
+    JsonScanner mcp(kCorpus[10], strlen(kCorpus[10]));
+    CHECK(mcp.ScanObject(kKeys, values, 4));
+    CHECK(values[0] == "mcp");
+    CHECK(!values[1].valid && !values[2].valid);
+
+    // An escaped type does not compare equal, the message goes to cJSON instead
+    const char* escaped_type = R"({"type":"t\u0074s","state":"stop"})";
+    JsonScanner escaped(escaped_type, strlen(escaped_type));
+    CHECK(escaped.ScanObject(kKeys, values, 4));
+    CHECK(values[0].escaped);
+    CHECK(!(values[0] == "tts"));
+    CHECK_EQ(values[0].ToString(), "tts");
+
+    // A member that is not a string is left invalid
+    const char* number_text = R"({"type":"stt","text":42})";
+    JsonScanner number(number_text, strlen(number_text));
+    CHECK(number.ScanObject(kKeys, values, 4));
+    CHECK(!values[2].valid);
+
+    const char* truncated_text = R"({"type":"tts","state":"sta)";
+    JsonScanner truncated(truncated_text, strlen(truncated_text));
+    CHECK(!truncated.ScanObject(kKeys, values, 4));
+}
+
+static void TestArray() {
+    const char* descriptors = R"([{"name":"Speaker","methods":{}}, {"name":"Screen","properties":{"theme":"dark"}}])";
+    std::vector<std::string> elements;
+    JsonScanner scanner(descriptors, strlen(descriptors));
+    CHECK(scanner.ForEachArrayElement([&elements](std::string_view element) {
+        elements.emplace_back(element);
+    }));
+    CHECK_EQ(elements.size(), (size_t)2);
+    CHECK_EQ(elements[0], R"({"name":"Speaker","methods":{}})");
+    CHECK_EQ(elements[1], R"({"name":"Screen","properties":{"theme":"dark"}})");
+}
+
+int main() {
+    TestFields();
+    TestArray();
+
+    size_t bytes = 0;
+    for (auto message : kCorpus) {
+        bytes += strlen(message);
+    }
+    size_t count = sizeof(kCorpus) / sizeof(kCorpus[0]);
+    volatile size_t found = 0;
+    double us = HostBenchmark(20000, [&found]() {
+        JsonStringView values[4];
+        for (auto message : kCorpus) {
+            JsonScanner scanner(message, strlen(message));
+            if (scanner.ScanObject(kKeys, values, 4) && values[2].valid) {
+                found = found + 1;
+            }
+        }
+    });
+    printf("json_scanner: %zu messages, %zu bytes, %.3f us per message, %.1f MB/s\n",
+        count, bytes, us / count, bytes / us);
+    return 0;
+}
@@ -0,0 +1,137 @@
+// Checks that JsonWriter produces the same bytes as the code it replaced: cJSON_PrintUnformatted
+// for the hello messages, and string concatenation for the protocol and MCP envelopes.
+// The expected strings are the output of the replaced code for the same input.
+#include "host_test.h"
+#include "json_writer.h"
+
+#include <cstdint>
+#include <limits>
+
+static void TestHello() {
+    // cJSON_PrintUnformatted of the WebSocket hello with the aec and mcp features
+    const char* expected = "{\"type\":\"hello\",\"version\":3,\"features\":{\"aec\":true,\"mcp\":true},"
+        "\"transport\":\"websocket\",\"audio_params\":{\"format\":\"opus\",\"sample_rate\":16000,"
+        "\"channels\":1,\"frame_duration\":60}}";
+    std::string message;
+    JsonWriter json(message);
+    json.BeginObject()
+        .Member("type", "hello")
+        .Member("version", 3)
+        .Key("features").BeginObject()
+            .Member("aec", true)
+            .Member("mcp", true)
+        .EndObject()
+        .Member("transport", "websocket")
+        .Key("audio_params").BeginObject()
+            .Member("format", "opus")
+            .Member("sample_rate", 16000)
+            .Member("channels", 1)
+            .Member("frame_duration", 60)
+        .EndObject()
+        .EndObject();
+    CHECK_EQ(message, expected);
+
+    // An object without members, as cJSON prints the features of a board without them
+    message.clear();
+    JsonWriter empty(message);
+    empty.BeginObject().Key("features").BeginObject().EndObject().Key("list").BeginArray().EndArray().EndObject();
+    CHECK_EQ(message, "{\"features\":{},\"list\":[]}");
+}
+
+static void TestEnvelopes() {
+    std::string session_id = "a1b2c3";
+    char buffer[256];
+    JsonWriter json(buffer, sizeof(buffer));
+    json.BeginObject()
+        .Member("session_id", session_id)
+        .Member("type", "abort")
+        .Member("reason", "wake_word_detected")
+        .EndObject();
+    CHECK(!json.overflow());
+    CHECK_EQ(json.view(), "{\"session_id\":\"" + session_id + "\",\"type\":\"abort\",\"reason\":\"wake_word_detected\"}");
+
+    // McpServer::ReplyError
+    std::string payload;
+    JsonWriter error(payload);
+    error.BeginObject()
+        .Member("jsonrpc", "2.0")
+        .Member("id", 7)
+        .Key("error").BeginObject()
+            .Member("message", "Unknown tool: self.foo")
+        .EndObject()
+        .EndObject();
+    CHECK_EQ(payload, "{\"jsonrpc\":\"2.0\",\"id\":7,\"error\":{\"message\":\"Unknown tool: self.foo\"}}");
+
+    // McpServer::ReplyResult inserts the result JSON as is
+    payload.clear();
+    JsonWriter result(payload);
+    result.BeginObject()
+        .Member("jsonrpc", "2.0")
+        .Member("id", 8)
+        .RawMember("result", "{\"content\":[{\"type\":\"text\",\"text\":\"true\"}],\"isError\":false}")
+        .EndObject();
+    CHECK_EQ(payload, "{\"jsonrpc\":\"2.0\",\"id\":8,\"result\":{\"content\":[{\"type\":\"text\",\"text\":\"true\"}],\"isError\":false}}");
+}
+
+// Same escaping as print_string_ptr() of cJSON
+static void TestEscaping() {
+    std::string output;
+    JsonWriter json(output);
+    json.BeginArray()
+        .String("quote \" backslash \\ slash /")
+        .String("\b\f\n\r\t")
+        .String(std::string_view("\x01\x1f", 2))
+        .String("你好")
+        .EndArray();
+    CHECK_EQ(output, "[\"quote \\\" backslash \\\\ slash /\",\"\\b\\f\\n\\r\\t\",\"\\u0001\\u001f\",\"你好\"]");
+}
+
+static void TestValues() {
+    std::string output;
+    JsonWriter json(output);
+    const char* missing = nullptr;
+    json.BeginObject()
+        .Member("missing", missing)
+        .Member("min", std::numeric_limits<int64_t>::min())
+        .Member("max", std::numeric_limits<uint64_t>::max())
+        .Member("size", (size_t)4096)
+        .Member("negative", -1)
+        .Key("null").Null()
+        .EndObject();
+    CHECK_EQ(output, "{\"missing\":null,\"min\":-9223372036854775808,\"max\":18446744073709551615,"
+        "\"size\":4096,\"negative\":-1,\"null\":null}");
+}
+
+static void TestOverflow() {
+    char buffer[16];
+    JsonWriter json(buffer, sizeof(buffer));
+    json.BeginObject().Member("key", "a value that does not fit").EndObject();
+    CHECK(json.overflow());
+    CHECK(json.size() <= sizeof(buffer));
+
+    JsonWriter exact(buffer, 9);
+    exact.BeginObject().Member("a", 1).EndObject();
+    CHECK(!exact.overflow());
+    CHECK_EQ(exact.view(), "{\"a\":1}");
+}
+
+int main() {
+    TestHello();
+    TestEnvelopes();
+    TestEscaping();
+    TestValues();
+    TestOverflow();
+
+    char buffer[256];
+    double us = HostBenchmark(100000, [&buffer]() {
+        JsonWriter json(buffer, sizeof(buffer));
+        json.BeginObject()
+            .Member("session_id", "a1b2c3d4e5f6")
+            .Member("type", "listen")
+            .Member("state", "detect")
+            .Member("text", "你好小智")
+            .EndObject();
+    });
+    printf("json_writer: listen message %.3f us\n", us);
+    return 0;
+}
@@ -0,0 +1,186 @@
+// Round-trips firmware images through the encoded OTA formats: a delta patch made by
+// scripts/ota_delta.py and applied by OtaDeltaPatcher, and a zlib stream inflated by
+// OtaDecompressor. Both are fed in uneven pieces, as they arrive from the network.
+//
+//   ota_image_test [old.bin new.bin]
+//
+// Without arguments two synthetic images are used, pass two builds of the firmware
+// to round-trip real images.
+#include "host_test.h"
+#include "ota_delta.h"
+#include "ota_decompress.h"
+
+#include <zlib.h>
+
+#include <fstream>
+#include <iterator>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+using Image = std::vector<uint8_t>;
+
+static Image ReadFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    CHECK(file.good());
+    return Image(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static void WriteFile(const std::string& path, const Image& data) {
+    std::ofstream file(path, std::ios::binary);
+    file.write((const char*)data.data(), data.size());
+    CHECK(file.good());
+}
+
+// Code-like bytes: repeated instruction patterns with varying operands
+static Image MakeSourceImage(size_t size, uint32_t seed) {
+    std::mt19937 random(seed);
+    Image image;
+    image.reserve(size);
+    while (image.size() < size) {
+        uint8_t pattern[] = {0x36, 0x41, 0x00, 0x0c, 0x02, 0x1d, 0xf0, 0x00};
+        pattern[2] = random() % 256;
+        pattern[7] = random() % 16;
+        image.insert(image.end(), pattern, pattern + sizeof(pattern));
+        if (random() % 8 == 0) {
+            for (int i = 0; i < 24; i++) {
+                image.push_back(random() % 256);
+            }
+        }
+    }
+    image.resize(size);
+    return image;
+}
+
+// A patch release: a few functions change, code is inserted and everything after it moves,
+// and the addresses in the moved code change by the same offset
+static Image MakeTargetImage(const Image& source) {
+    Image target = source;
+    std::mt19937 random(7);
+    for (int i = 0; i < 20; i++) {
+        size_t offset = random() % (target.size() - 64);
+        for (int j = 0; j < 16; j++) {
+            target[offset + j] ^= random() % 256;
+        }
+    }
+    Image inserted(3000);
+    for (auto& byte : inserted) {
+        byte = random() % 256;
+    }
+    target.insert(target.begin() + target.size() / 3, inserted.begin(), inserted.end());
+    for (size_t offset = target.size() / 2; offset + 8 <= target.size(); offset += 64) {
+        target[offset + 2] += 0x30;
+    }
+    target.resize(target.size() - 1000);
+    return target;
+}
+
+// Feed `input` in pieces of random length up to `max_piece`
+template<typename Feed>
+static esp_err_t FeedInPieces(const Image& input, size_t max_piece, uint32_t seed, Feed feed) {
+    std::mt19937 random(seed);
+    size_t offset = 0;
+    while (offset < input.size()) {
+        size_t length = std::min<size_t>(1 + random() % max_piece, input.size() - offset);
+        auto err = feed(input.data() + offset, length);
+        if (err != ESP_OK) {
+            return err;
+        }
+        offset += length;
+    }
+    return ESP_OK;
+}
+
+static Image CreatePatch(const Image& source, const Image& target) {
+    std::string dir = HOST_TEST_OUTPUT_DIR;
+    WriteFile(dir + "/delta_source.bin", source);
+    WriteFile(dir + "/delta_target.bin", target);
+    std::string command = std::string(PYTHON_EXECUTABLE) + " " + OTA_DELTA_SCRIPT + " create " +
+        dir + "/delta_source.bin " + dir + "/delta_target.bin " + dir + "/delta_patch.bin";
+    CHECK_EQ(system(command.c_str()), 0);
+    return ReadFile(dir + "/delta_patch.bin");
+}
+
+static void TestDelta(const Image& source, const Image& target) {
+    auto patch = CreatePatch(source, target);
+    esp_partition_t partition = {"ota_0", 0x10000, (uint32_t)source.size(), source.data()};
+
+    for (size_t max_piece : {1, 512, 5000, 32768}) {
+        Image output;
+        size_t max_output = 0;
+        OtaDeltaPatcher patcher(&partition, [&output, &max_output](const uint8_t* data, size_t length) {
+            output.insert(output.end(), data, data + length);
+            max_output = std::max(max_output, length);
+            return ESP_OK;
+        });
+        CHECK_EQ(FeedInPieces(patch, max_piece, max_piece, [&patcher](const uint8_t* data, size_t length) {
+            return patcher.Feed(data, length);
+        }), ESP_OK);
+        CHECK(patcher.finished());
+        CHECK_EQ(patcher.target_size(), target.size());
+        CHECK(output == target);
+        // Only the output buffer is held in RAM
+        CHECK(max_output <= 4096);
+    }
+    printf("ota_delta: %zu -> %zu bytes, patch %zu bytes (%.1f%%)\n",
+        source.size(), target.size(), patch.size(), patch.size() * 100.0 / target.size());
+
+    // A patch is only applied to the image it was made for
+    Image other = source;
+    other[other.size() / 2] ^= 0xff;
+    esp_partition_t other_partition = {"ota_0", 0x10000, (uint32_t)other.size(), other.data()};
+    OtaDeltaPatcher mismatch(&other_partition, [](const uint8_t* data, size_t length) { return ESP_OK; });
+    CHECK(mismatch.Feed(patch.data(), patch.size()) != ESP_OK);
+
+    // A truncated patch does not finish
+    OtaDeltaPatcher truncated(&partition, [](const uint8_t* data, size_t length) { return ESP_OK; });
+    CHECK_EQ(truncated.Feed(patch.data(), patch.size() - 10), ESP_OK);
+    CHECK(!truncated.finished());
+}
+
+static void TestDecompress(const Image& image) {
+    uLongf compressed_size = compressBound(image.size());
+    Image compressed(compressed_size);
+    CHECK_EQ(compress2(compressed.data(), &compressed_size, image.data(), image.size(), 9), Z_OK);
+    compressed.resize(compressed_size);
+
+    for (size_t max_piece : {1, 512, 5000, 32768}) {
+        Image output;
+        size_t max_output = 0;
+        OtaDecompressor decompressor([&output, &max_output](const uint8_t* data, size_t length) {
+            output.insert(output.end(), data, data + length);
+            max_output = std::max(max_output, length);
+            return ESP_OK;
+        });
+        CHECK_EQ(FeedInPieces(compressed, max_piece, max_piece, [&decompressor](const uint8_t* data, size_t length) {
+            return decompressor.Feed(data, length);
+        }), ESP_OK);
+        CHECK(decompressor.finished());
+        CHECK_EQ(decompressor.input_size(), compressed.size());
+        CHECK_EQ(decompressor.output_size(), image.size());
+        CHECK(output == image);
+        CHECK(max_output <= 32768);
+    }
+    printf("ota_decompress: %zu -> %zu bytes (%.1f%%)\n",
+        image.size(), compressed.size(), compressed.size() * 100.0 / image.size());
+
+    Image corrupt = compressed;
+    corrupt[corrupt.size() / 2] ^= 0x55;
+    OtaDecompressor decompressor([](const uint8_t* data, size_t length) { return ESP_OK; });
+    auto err = decompressor.Feed(corrupt.data(), corrupt.size());
+    CHECK(err != ESP_OK || !decompressor.finished());
+}
+
+int main(int argc, char** argv) {
+    Image source, target;
+    if (argc == 3) {
+        source = ReadFile(argv[1]);
+        target = ReadFile(argv[2]);
+    } else {
+        source = MakeSourceImage(300 * 1024, 1);
+        target = MakeTargetImage(source);
+    }
+    TestDelta(source, target);
+    TestDecompress(target);
+    return 0;
+}
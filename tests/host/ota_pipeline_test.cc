@@ -0,0 +1,200 @@
+// Downloads an image from an HTTP stand-in into a flash stand-in, once with the reads and writes
+// alternating as Ota::Upgrade did before and once through OtaPipeline, and compares the times.
+#include "host_test.h"
+#include "ota_pipeline.h"
+
+#include <esp_timer.h>
+
+#include <thread>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+
+// Consumes bytes at a fixed rate, sleeping whenever it gets ahead of it
+class Throttle {
+public:
+    Throttle(double bytes_per_us) : bytes_per_us_(bytes_per_us) {}
+
+    void Consume(size_t bytes) {
+        if (start_ == 0) {
+            start_ = esp_timer_get_time();
+        }
+        total_ += bytes;
+        int64_t due = start_ + (int64_t)(total_ / bytes_per_us_);
+        int64_t now = esp_timer_get_time();
+        if (due > now) {
+            std::this_thread::sleep_for(std::chrono::microseconds(due - now));
+        }
+    }
+
+    // Time spent elsewhere is not made up for by the next bytes
+    void Pause() { start_ = 0; total_ = 0; }
+
+private:
+    double bytes_per_us_;
+    int64_t start_ = 0;
+    size_t total_ = 0;
+};
+
+// Serves the image at 1 MB/s. Like a TCP connection it only buffers a receive window of data while
+// the reader is busy, the sender stops when the window is full. Reading costs 1 us per byte, which
+// stands for the TLS decryption and copies done by the reading task.
+class HttpStandIn {
+public:
+    static constexpr size_t kWindow = 5744;     // TCP_WND of lwIP, 4 segments
+    static constexpr double kBytesPerUs = 1.0;
+    static constexpr double kReadUsPerByte = 1.0;
+
+    HttpStandIn(const std::vector<uint8_t>& body) : body_(body), last_time_(esp_timer_get_time()) {}
+
+    int Read(char* buffer, size_t size) {
+        size_t length = std::min({size, (size_t)1460, body_.size() - offset_});
+        if (length == 0) {
+            return 0;
+        }
+        Fill();
+        if (buffered_ < length) {
+            std::this_thread::sleep_for(std::chrono::microseconds((int64_t)((length - buffered_) / kBytesPerUs)));
+            Fill();
+        }
+        length = std::min(length, (size_t)buffered_);
+        buffered_ -= length;
+        memcpy(buffer, body_.data() + offset_, length);
+        offset_ += length;
+        std::this_thread::sleep_for(std::chrono::microseconds((int64_t)(length * kReadUsPerByte)));
+        return (int)length;
+    }
+
+private:
+    const std::vector<uint8_t>& body_;
+    size_t offset_ = 0;
+    double buffered_ = 0;
+    int64_t last_time_;
+
+    void Fill() {
+        auto now = esp_timer_get_time();
+        buffered_ = std::min((double)kWindow, buffered_ + (now - last_time_) * kBytesPerUs);
+        last_time_ = now;
+    }
+};
+
+// Erases each sector before it is written, erasing takes most of the time as on SPI flash
+class FlashStandIn {
+public:
+    std::vector<uint8_t> data;
+
+    esp_err_t Write(const uint8_t* buffer, size_t length) {
+        for (size_t end = data.size() + length; erased_ < end; erased_ += 4096) {
+            std::this_thread::sleep_for(std::chrono::microseconds(5000));
+        }
+        throttle_.Consume(length);
+        throttle_.Pause();
+        data.insert(data.end(), buffer, buffer + length);
+        return fail_at_ && data.size() >= fail_at_ ? ESP_FAIL : ESP_OK;
+    }
+
+    void FailAt(size_t offset) { fail_at_ = offset; }
+
+private:
+    size_t erased_ = 0;
+    size_t fail_at_ = 0;
+    Throttle throttle_{1.0};
+};
+
+static std::vector<uint8_t> MakeImage(size_t size) {
+    std::vector<uint8_t> image(size);
+    uint32_t state = 12345;
+    for (auto& byte : image) {
+        state = state * 1103515245 + 12345;
+        byte = state >> 16;
+    }
+    return image;
+}
+
+// The loop of Ota::Upgrade before the pipeline: read 512 bytes, write them, repeat
+static int64_t DownloadInline(const std::vector<uint8_t>& image, FlashStandIn& flash) {
+    auto start = esp_timer_get_time();
+    HttpStandIn http(image);
+    char buffer[512];
+    while (true) {
+        int ret = http.Read(buffer, sizeof(buffer));
+        if (ret <= 0) {
+            break;
+        }
+        CHECK_EQ(flash.Write((const uint8_t*)buffer, ret), ESP_OK);
+    }
+    return esp_timer_get_time() - start;
+}
+
+// The loop of Ota::Upgrade with the pipeline
+static esp_err_t DownloadPipelined(const std::vector<uint8_t>& image, FlashStandIn& flash, size_t buffer_size,
+        int buffer_count, int64_t* time_us) {
+    auto start = esp_timer_get_time();
+    HttpStandIn http(image);
+    OtaPipeline pipeline(buffer_size, buffer_count);
+    CHECK(pipeline.Start([&flash](const uint8_t* data, size_t length) {
+        return flash.Write(data, length);
+    }));
+    bool finished = false;
+    while (!finished) {
+        uint8_t* buffer = pipeline.AcquireBuffer();
+        if (buffer == nullptr) {
+            break;
+        }
+        size_t length = 0;
+        while (length < pipeline.buffer_size()) {
+            auto read_start = esp_timer_get_time();
+            int ret = http.Read((char*)buffer + length, pipeline.buffer_size() - length);
+            pipeline.AddNetworkTime(esp_timer_get_time() - read_start);
+            if (ret == 0) {
+                finished = true;
+                break;
+            }
+            length += ret;
+        }
+        pipeline.Submit(buffer, length);
+    }
+    auto err = pipeline.Finish();
+    *time_us = esp_timer_get_time() - start;
+
+    auto stats = pipeline.GetStats();
+    if (err == ESP_OK) {
+        CHECK_EQ(stats.bytes, image.size());
+    }
+    printf("ota_pipeline: %zu x %zu bytes, network %lld ms, flash %lld ms, network waited %lld ms, writer waited %lld ms\n",
+        (size_t)buffer_count, buffer_size, (long long)stats.network_time_us / 1000, (long long)stats.write_time_us / 1000,
+        (long long)stats.producer_wait_us / 1000, (long long)stats.writer_wait_us / 1000);
+    return err;
+}
+
+int main() {
+    auto image = MakeImage(192 * 1024 + 1000);
+
+    FlashStandIn inline_flash;
+    int64_t inline_us = DownloadInline(image, inline_flash);
+    CHECK(inline_flash.data == image);
+
+    FlashStandIn pipelined_flash;
+    int64_t pipelined_us = 0;
+    CHECK_EQ(DownloadPipelined(image, pipelined_flash, 32768, 4, &pipelined_us), ESP_OK);
+    CHECK(pipelined_flash.data == image);
+
+    // A buffer size that is not a multiple of the sector size gives the same image
+    FlashStandIn odd_flash;
+    int64_t odd_us = 0;
+    CHECK_EQ(DownloadPipelined(image, odd_flash, 5000, 2, &odd_us), ESP_OK);
+    CHECK(odd_flash.data == image);
+
+    printf("ota_pipeline: %zu bytes, inline %lld ms, pipelined %lld ms, 5000 byte buffers %lld ms\n",
+        image.size(), (long long)inline_us / 1000, (long long)pipelined_us / 1000, (long long)odd_us / 1000);
+    // The flash writes no longer wait for the network reads, only for the data
+    CHECK(pipelined_us < inline_us * 85 / 100);
+
+    // A failed write stops the download without blocking the network side
+    FlashStandIn failing_flash;
+    failing_flash.FailAt(100000);
+    int64_t failed_us = 0;
+    CHECK(DownloadPipelined(image, failing_flash, 8192, 2, &failed_us) == ESP_FAIL);
+    CHECK(failing_flash.data.size() < image.size());
+    return 0;
+}
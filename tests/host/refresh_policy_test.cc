@@ -0,0 +1,314 @@
+// Simulates the chat UI on an SPI panel against RefreshPolicy: replies stream into a chat bubble,
+// a GIF emotion keeps playing and the status bar clock ticks. The refresh timer, the rendering
+// into the draw buffers and the DMA flush run on a simulated clock with the costs of a 240x280
+// panel at 40 MHz, and the timer runs, frames and latencies are compared with and without the
+// idle refresh rate and with one or two draw buffers.
+#include "host_test.h"
+#include "display/refresh_policy.h"
+#include "json_writer.h"
+
+#include <esp_timer.h>
+
+#include <map>
+#include <string>
+
+static constexpr int32_t kWidth = 240;
+static constexpr int32_t kHeight = 280;
+static constexpr double kRenderUsPerPixel = 0.2;
+static constexpr double kFlushUsPerPixel = 0.4;    // RGB565 over SPI at 40 MHz
+static constexpr uint32_t kIdlePeriodMs = 100;      // CONFIG_LCD_IDLE_FPS 10
+static constexpr uint32_t kIdleTimeoutMs = 5000;
+
+// Member `key` of the refresh stats as a number
+static uint64_t StatsMember(const std::string& json, const std::string& key) {
+    auto pos = json.find("\"" + key + "\":");
+    CHECK(pos != std::string::npos);
+    return strtoull(json.c_str() + pos + key.size() + 3, nullptr, 10);
+}
+
+struct SimulationResult {
+    uint32_t timer_runs = 0;
+    uint32_t frames = 0;
+    int64_t busy_us = 0;            // Refresh timer runs, from REFR_START to REFR_READY
+    int64_t flush_wait_us = 0;
+    uint64_t pixels = 0;
+    int64_t max_append_latency_us = 0;
+    int64_t max_gif_latency_us = 0;
+    std::string stats_json;
+};
+
+class ChatUiSimulator {
+public:
+    ChatUiSimulator(uint32_t buffer_lines, bool double_buffer, uint32_t idle_period_ms)
+        : buffer_pixels_(kWidth * buffer_lines), double_buffer_(double_buffer) {
+        esp_timer_host_clock = &now_us_;
+        display_ = lv_display_create(kWidth, kHeight);
+        policy_ = new RefreshPolicy(display_, idle_period_ms, kIdleTimeoutMs);
+    }
+
+    ~ChatUiSimulator() {
+        delete policy_;
+        lv_display_delete(display_);
+        esp_timer_host_clock = nullptr;
+    }
+
+    lv_display_t* display() { return display_; }
+    RefreshPolicy& policy() { return *policy_; }
+    uint32_t period() { return lv_display_get_refr_timer(display_)->period; }
+
+    // `conversations` replies of 40 text appends 100 ms apart, each followed by `pause_ms` without changes
+    SimulationResult Run(int conversations, int64_t pause_ms) {
+        int64_t end_us = 0;
+        for (int c = 0; c < conversations; c++) {
+            int64_t start_us = now_us_ + c * (4000 + pause_ms) * 1000;
+            for (int i = 0; i < 40; i++) {
+                appends_.push_back(start_us + i * 100000);
+            }
+            end_us = start_us + (4000 + pause_ms) * 1000;
+        }
+        int64_t next_gif_us = now_us_;
+        int64_t next_clock_us = now_us_ + 60000000;
+        size_t next_append = 0;
+        int bubble_lines = 0;
+
+        while (now_us_ < end_us) {
+            if (next_append < appends_.size() && appends_[next_append] <= now_us_) {
+                // The whole label of the last bubble is laid out and redrawn, see LcdDisplay::ApplyAppendChatMessage
+                bubble_lines = next_append % 40 == 0 ? 1 : std::min(bubble_lines + 1, 6);
+                Invalidate(kBubble, {10, 40, kWidth - 11, 40 + bubble_lines * 24 - 1}, appends_[next_append]);
+                policy_->MarkActive();
+                next_append++;
+            }
+            if (next_gif_us <= now_us_) {
+                Invalidate(kGif, {80, 190, 159, 269}, next_gif_us);
+                next_gif_us += 100000;
+            }
+            if (next_clock_us <= now_us_) {
+                Invalidate(kClock, {90, 0, 149, 23}, next_clock_us);
+                next_clock_us += 60000000;
+            }
+            // The LVGL task checks the timers every few milliseconds
+            if (now_us_ - last_run_us_ >= period() * 1000LL) {
+                Refresh();
+            } else {
+                now_us_ += 1000;
+            }
+        }
+        result_.stats_json.clear();
+        JsonWriter writer(result_.stats_json);
+        writer.BeginObject();
+        policy_->WriteStatsJson(writer);
+        writer.EndObject();
+        return result_;
+    }
+
+private:
+    enum Kind { kBubble, kGif, kClock };
+    struct Dirty {
+        lv_area_t area;
+        int64_t since_us;
+    };
+
+    int64_t now_us_ = 1000000;
+    uint32_t buffer_pixels_;
+    bool double_buffer_;
+    lv_display_t* display_;
+    RefreshPolicy* policy_;
+    std::vector<int64_t> appends_;
+    std::map<Kind, Dirty> dirty_;
+    int64_t last_run_us_ = 0;
+    int64_t dma_end_us_ = 0;
+    SimulationResult result_;
+
+    void Invalidate(Kind kind, lv_area_t area, int64_t time_us) {
+        auto it = dirty_.find(kind);
+        if (it == dirty_.end()) {
+            dirty_[kind] = {area, time_us};
+        } else {
+            it->second.area = area;
+        }
+    }
+
+    void Send(lv_event_code_t code, void* param = nullptr) {
+        lv_display_send_event(display_, code, param);
+    }
+
+    void WaitFlush() {
+        Send(LV_EVENT_FLUSH_WAIT_START);
+        if (dma_end_us_ > now_us_) {
+            result_.flush_wait_us += dma_end_us_ - now_us_;
+            now_us_ = dma_end_us_;
+        }
+        Send(LV_EVENT_FLUSH_WAIT_FINISH);
+    }
+
+    // Renders one buffer and hands it to the DMA. With two buffers the next one is rendered while
+    // the DMA sends this one, with one buffer the DMA has to finish first.
+    void Flush(lv_area_t area) {
+        uint32_t pixels = lv_area_get_size(&area);
+        now_us_ += (int64_t)(pixels * kRenderUsPerPixel);
+        if (double_buffer_) {
+            WaitFlush();
+        }
+        Send(LV_EVENT_FLUSH_START, &area);
+        dma_end_us_ = now_us_ + (int64_t)(pixels * kFlushUsPerPixel);
+        result_.pixels += pixels;
+        if (!double_buffer_) {
+            WaitFlush();
+        }
+    }
+
+    void Refresh() {
+        int64_t start_us = now_us_;
+        last_run_us_ = now_us_;
+        result_.timer_runs++;
+        Send(LV_EVENT_REFR_START);
+        if (!dirty_.empty()) {
+            Send(LV_EVENT_RENDER_START);
+            for (auto& [kind, dirty] : dirty_) {
+                int32_t width = dirty.area.x2 - dirty.area.x1 + 1;
+                int32_t rows = std::max<int32_t>(1, buffer_pixels_ / width);
+                for (int32_t y = dirty.area.y1; y <= dirty.area.y2; y += rows) {
+                    Flush({dirty.area.x1, y, dirty.area.x2, std::min(dirty.area.y2, y + rows - 1)});
+                }
+            }
+            WaitFlush();
+            for (auto& [kind, dirty] : dirty_) {
+                int64_t latency_us = now_us_ - dirty.since_us;
+                if (kind == kBubble) {
+                    result_.max_append_latency_us = std::max(result_.max_append_latency_us, latency_us);
+                } else if (kind == kGif) {
+                    result_.max_gif_latency_us = std::max(result_.max_gif_latency_us, latency_us);
+                }
+            }
+            dirty_.clear();
+            result_.frames++;
+        }
+        Send(LV_EVENT_REFR_READY);
+        result_.busy_us += now_us_ - start_us;
+    }
+};
+
+static void Print(const char* name, const SimulationResult& result) {
+    printf("refresh_policy: %-24s timer runs %5u, frames %5u, busy %6lld ms, flush wait %5lld ms, "
+        "max append latency %3lld ms, max gif latency %3lld ms\n", name, result.timer_runs, result.frames,
+        (long long)result.busy_us / 1000, (long long)result.flush_wait_us / 1000,
+        (long long)result.max_append_latency_us / 1000, (long long)result.max_gif_latency_us / 1000);
+}
+
+static void TestChatUi() {
+    // Three replies with 30 s of only the GIF playing after each
+    SimulationResult idle, always_active, single_buffer;
+    {
+        ChatUiSimulator simulator(20, true, kIdlePeriodMs);
+        idle = simulator.Run(3, 30000);
+        CHECK(simulator.policy().IsIdle());
+        CHECK_EQ(simulator.period(), kIdlePeriodMs);
+        // Any content change restores the full rate at once
+        simulator.policy().MarkActive();
+        CHECK(!simulator.policy().IsIdle());
+        CHECK_EQ(simulator.period(), (uint32_t)LV_DEF_REFR_PERIOD);
+    }
+    {
+        ChatUiSimulator simulator(20, true, 0);
+        always_active = simulator.Run(3, 30000);
+        CHECK(!simulator.policy().IsIdle());
+        CHECK_EQ(simulator.period(), (uint32_t)LV_DEF_REFR_PERIOD);
+    }
+    {
+        ChatUiSimulator simulator(20, false, kIdlePeriodMs);
+        single_buffer = simulator.Run(3, 30000);
+    }
+    Print("idle 10 fps, 2 buffers", idle);
+    Print("always 30 fps, 2 buffers", always_active);
+    Print("idle 10 fps, 1 buffer", single_buffer);
+
+    // The stats of the policy agree with the simulated frames
+    CHECK_EQ(StatsMember(idle.stats_json, "frames"), (uint64_t)idle.frames);
+    CHECK_EQ(StatsMember(idle.stats_json, "avg_pixels"), idle.pixels / idle.frames);
+    CHECK_EQ(StatsMember(idle.stats_json, "avg_flush_wait_us"), (uint64_t)(idle.flush_wait_us / idle.frames));
+    CHECK_EQ(StatsMember(idle.stats_json, "period_ms"), (uint64_t)kIdlePeriodMs);
+
+    // Idle, the timer runs at a third of the rate for 87 of the 102 s, but every GIF frame is still shown
+    CHECK(idle.timer_runs * 3 < always_active.timer_runs * 2);
+    CHECK(idle.frames * 10 >= always_active.frames * 9);
+    CHECK(idle.max_gif_latency_us <= (kIdlePeriodMs + 20) * 1000);
+    // and the replies are not shown later than at the full rate
+    CHECK(idle.max_append_latency_us <= always_active.max_append_latency_us + 2000);
+
+    // With two buffers the rendering overlaps the flush
+    CHECK(idle.busy_us < single_buffer.busy_us);
+    CHECK(idle.flush_wait_us < single_buffer.flush_wait_us);
+}
+
+static void TestInput() {
+    ChatUiSimulator simulator(20, true, kIdlePeriodMs);
+    // Boards add their touch after the display
+    lv_indev_t* touch = lv_indev_create();
+    lv_indev_set_display(touch, simulator.display());
+    lv_display_t* other_display = lv_display_create(kWidth, kHeight);
+    lv_indev_t* other_touch = lv_indev_create();
+    lv_indev_set_display(other_touch, other_display);
+
+    simulator.Run(1, 6000);
+    CHECK(simulator.policy().IsIdle());
+    lv_indev_send_event(other_touch, LV_EVENT_PRESSED, nullptr);
+    CHECK(simulator.policy().IsIdle());
+    lv_indev_send_event(touch, LV_EVENT_RELEASED, nullptr);
+    CHECK(simulator.policy().IsIdle());
+    lv_indev_send_event(touch, LV_EVENT_PRESSED, nullptr);
+    CHECK(!simulator.policy().IsIdle());
+    CHECK_EQ(simulator.period(), (uint32_t)LV_DEF_REFR_PERIOD);
+
+    lv_indev_delete(other_touch);
+    lv_display_delete(other_display);
+    lv_indev_delete(touch);
+}
+
+static void TestLifetime() {
+    lv_display_t* display = lv_display_create(kWidth, kHeight);
+    lv_indev_t* touch = lv_indev_create();
+    lv_indev_set_display(touch, display);
+    {
+        // An idle period not longer than the active one leaves the rate alone
+        RefreshPolicy fast(display, 20, 0);
+        lv_display_send_event(display, LV_EVENT_REFR_READY, nullptr);
+        CHECK(!fast.IsIdle());
+    }
+    {
+        RefreshPolicy policy(display, kIdlePeriodMs, 0);
+        lv_display_send_event(display, LV_EVENT_REFR_READY, nullptr);
+        CHECK(policy.IsIdle());
+        CHECK_EQ(display->refr_timer.period, kIdlePeriodMs);
+        CHECK_EQ(touch->events.size(), (size_t)1);
+    }
+    // The callbacks are removed and the full rate is restored
+    CHECK(display->events.empty());
+    CHECK(touch->events.empty());
+    CHECK_EQ(display->refr_timer.period, (uint32_t)LV_DEF_REFR_PERIOD);
+    lv_indev_delete(touch);
+    lv_display_delete(display);
+}
+
+int main() {
+    TestChatUi();
+    TestInput();
+    TestLifetime();
+
+    // What the events of one frame of ten flushes cost on top of the rendering
+    lv_display_t* display = lv_display_create(kWidth, kHeight);
+    RefreshPolicy policy(display, kIdlePeriodMs, kIdleTimeoutMs);
+    lv_area_t area = {0, 0, kWidth - 1, 19};
+    double us = HostBenchmark(100000, [display, &area]() {
+        lv_display_send_event(display, LV_EVENT_REFR_START, nullptr);
+        lv_display_send_event(display, LV_EVENT_RENDER_START, nullptr);
+        for (int i = 0; i < 10; i++) {
+            lv_display_send_event(display, LV_EVENT_FLUSH_WAIT_START, nullptr);
+            lv_display_send_event(display, LV_EVENT_FLUSH_WAIT_FINISH, nullptr);
+            lv_display_send_event(display, LV_EVENT_FLUSH_START, &area);
+        }
+        lv_display_send_event(display, LV_EVENT_REFR_READY, nullptr);
+    });
+    printf("refresh_policy: events of a frame with 10 flushes %.3f us\n", us);
+    return 0;
+}
@@ -0,0 +1,16 @@
+#ifndef APPLICATION_H
+#define APPLICATION_H
+
+#include <functional>
+
+// Host stand-in, scheduled callbacks run immediately
+class Application {
+public:
+    static Application& GetInstance() {
+        static Application instance;
+        return instance;
+    }
+    void Schedule(std::function<void()> callback) { callback(); }
+};
+
+#endif // APPLICATION_H
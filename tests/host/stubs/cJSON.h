@@ -0,0 +1,19 @@
+#ifndef CJSON_H
+#define CJSON_H
+
+// Host stand-in with the cJSON declarations the tested sources refer to.
+// The tests do not parse JSON, the functions in stubs.cc find nothing.
+struct cJSON {
+    char* valuestring;
+    int valueint;
+    double valuedouble;
+};
+
+cJSON* cJSON_GetObjectItem(const cJSON* object, const char* name);
+bool cJSON_IsArray(const cJSON* item);
+bool cJSON_IsBool(const cJSON* item);
+bool cJSON_IsNumber(const cJSON* item);
+bool cJSON_IsObject(const cJSON* item);
+bool cJSON_IsString(const cJSON* item);
+
+#endif // CJSON_H
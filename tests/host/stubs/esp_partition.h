@@ -0,0 +1,26 @@
+#ifndef ESP_PARTITION_H
+#define ESP_PARTITION_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#include "esp_err.h"
+
+// Host stand-in, a partition is a buffer in memory
+typedef struct {
+    const char* label;
+    uint32_t address;
+    uint32_t size;
+    const uint8_t* data;    // Host only
+} esp_partition_t;
+
+inline esp_err_t esp_partition_read(const esp_partition_t* partition, size_t offset, void* dst, size_t size) {
+    if (offset + size > partition->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(dst, partition->data + offset, size);
+    return ESP_OK;
+}
+
+#endif // ESP_PARTITION_H
@@ -0,0 +1,18 @@
+#ifndef ESP_TIMER_H
+#define ESP_TIMER_H
+
+#include <chrono>
+#include <cstdint>
+
+// A test that simulates time points this at its own clock, the others get the steady clock
+inline const int64_t* esp_timer_host_clock = nullptr;
+
+inline int64_t esp_timer_get_time() {
+    if (esp_timer_host_clock != nullptr) {
+        return *esp_timer_host_clock;
+    }
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#endif // ESP_TIMER_H
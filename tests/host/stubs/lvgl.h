@@ -0,0 +1,155 @@
+#ifndef LVGL_H
+#define LVGL_H
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+// Host stand-in for the parts of LVGL 9 used by RefreshPolicy: displays and input devices with
+// their event callbacks, and the display refresh timer. Nothing is drawn, a test sends the events
+// of a refresh itself with lv_display_send_event().
+
+#define LV_DEF_REFR_PERIOD 33
+
+typedef enum {
+    LV_RESULT_INVALID = 0,
+    LV_RESULT_OK,
+} lv_result_t;
+
+typedef enum {
+    LV_EVENT_ALL = 0,
+    LV_EVENT_PRESSED,
+    LV_EVENT_PRESSING,
+    LV_EVENT_RELEASED,
+    LV_EVENT_GESTURE,
+    LV_EVENT_KEY,
+    LV_EVENT_REFR_START,
+    LV_EVENT_REFR_READY,
+    LV_EVENT_RENDER_START,
+    LV_EVENT_RENDER_READY,
+    LV_EVENT_FLUSH_START,
+    LV_EVENT_FLUSH_FINISH,
+    LV_EVENT_FLUSH_WAIT_START,
+    LV_EVENT_FLUSH_WAIT_FINISH,
+} lv_event_code_t;
+
+typedef struct {
+    int32_t x1, y1, x2, y2;
+} lv_area_t;
+
+typedef struct {
+    lv_event_code_t code;
+    void* param;
+    void* user_data;
+} lv_event_t;
+
+typedef void (*lv_event_cb_t)(lv_event_t* e);
+
+struct lv_event_dsc_t {
+    lv_event_cb_t cb;
+    lv_event_code_t filter;
+    void* user_data;
+};
+
+typedef struct {
+    uint32_t period;
+} lv_timer_t;
+
+typedef struct {
+    int32_t hor_res;
+    int32_t ver_res;
+    lv_timer_t refr_timer;
+    std::vector<lv_event_dsc_t> events;
+} lv_display_t;
+
+typedef struct {
+    lv_display_t* display;
+    std::vector<lv_event_dsc_t> events;
+} lv_indev_t;
+
+inline std::vector<lv_indev_t*> lv_host_indevs;
+
+inline uint32_t lv_area_get_size(const lv_area_t* area) {
+    return (uint32_t)(area->x2 - area->x1 + 1) * (uint32_t)(area->y2 - area->y1 + 1);
+}
+
+inline void* lv_event_get_user_data(lv_event_t* e) { return e->user_data; }
+inline lv_event_code_t lv_event_get_code(lv_event_t* e) { return e->code; }
+inline void* lv_event_get_param(lv_event_t* e) { return e->param; }
+
+inline void lv_timer_set_period(lv_timer_t* timer, uint32_t period) { timer->period = period; }
+
+inline lv_result_t lv_host_send_event(std::vector<lv_event_dsc_t> events, lv_event_code_t code, void* param) {
+    // A copy, callbacks may add or remove callbacks
+    for (auto& dsc : events) {
+        if (dsc.filter == LV_EVENT_ALL || dsc.filter == code) {
+            lv_event_t e = {code, param, dsc.user_data};
+            dsc.cb(&e);
+        }
+    }
+    return LV_RESULT_OK;
+}
+
+inline uint32_t lv_host_remove_event_cb(std::vector<lv_event_dsc_t>& events, lv_event_cb_t cb, void* user_data) {
+    auto size = events.size();
+    events.erase(std::remove_if(events.begin(), events.end(), [cb, user_data](const lv_event_dsc_t& dsc) {
+        return dsc.cb == cb && dsc.user_data == user_data;
+    }), events.end());
+    return (uint32_t)(size - events.size());
+}
+
+inline lv_display_t* lv_display_create(int32_t hor_res, int32_t ver_res) {
+    return new lv_display_t{hor_res, ver_res, {LV_DEF_REFR_PERIOD}, {}};
+}
+
+inline void lv_display_delete(lv_display_t* display) { delete display; }
+
+inline lv_timer_t* lv_display_get_refr_timer(lv_display_t* display) { return &display->refr_timer; }
+
+inline void lv_display_add_event_cb(lv_display_t* display, lv_event_cb_t cb, lv_event_code_t filter, void* user_data) {
+    display->events.push_back({cb, filter, user_data});
+}
+
+inline uint32_t lv_display_remove_event_cb_with_user_data(lv_display_t* display, lv_event_cb_t cb, void* user_data) {
+    return lv_host_remove_event_cb(display->events, cb, user_data);
+}
+
+inline lv_result_t lv_display_send_event(lv_display_t* display, lv_event_code_t code, void* param) {
+    return lv_host_send_event(display->events, code, param);
+}
+
+inline lv_indev_t* lv_indev_create() {
+    auto indev = new lv_indev_t{nullptr, {}};
+    lv_host_indevs.push_back(indev);
+    return indev;
+}
+
+inline void lv_indev_delete(lv_indev_t* indev) {
+    lv_host_indevs.erase(std::find(lv_host_indevs.begin(), lv_host_indevs.end(), indev));
+    delete indev;
+}
+
+inline void lv_indev_set_display(lv_indev_t* indev, lv_display_t* display) { indev->display = display; }
+inline lv_display_t* lv_indev_get_display(lv_indev_t* indev) { return indev->display; }
+
+inline lv_indev_t* lv_indev_get_next(lv_indev_t* indev) {
+    if (indev == nullptr) {
+        return lv_host_indevs.empty() ? nullptr : lv_host_indevs.front();
+    }
+    auto it = std::find(lv_host_indevs.begin(), lv_host_indevs.end(), indev);
+    return it == lv_host_indevs.end() || it + 1 == lv_host_indevs.end() ? nullptr : *(it + 1);
+}
+
+inline void lv_indev_add_event_cb(lv_indev_t* indev, lv_event_cb_t cb, lv_event_code_t filter, void* user_data) {
+    indev->events.push_back({cb, filter, user_data});
+}
+
+inline uint32_t lv_indev_remove_event_cb_with_user_data(lv_indev_t* indev, lv_event_cb_t cb, void* user_data) {
+    return lv_host_remove_event_cb(indev->events, cb, user_data);
+}
+
+inline lv_result_t lv_indev_send_event(lv_indev_t* indev, lv_event_code_t code, void* param) {
+    return lv_host_send_event(indev->events, code, param);
+}
+
+#endif // LVGL_H
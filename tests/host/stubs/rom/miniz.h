@@ -0,0 +1,50 @@
+#ifndef ROM_MINIZ_H
+#define ROM_MINIZ_H
+
+// Host stand-in for the tinfl decoder in ROM, on top of zlib
+#include <zlib.h>
+#include <cstddef>
+#include <cstdint>
+
+#define TINFL_LZ_DICT_SIZE 32768
+#define TINFL_FLAG_PARSE_ZLIB_HEADER 1
+#define TINFL_FLAG_HAS_MORE_INPUT 2
+#define TINFL_FLAG_COMPUTE_ADLER32 8
+
+typedef enum {
+    TINFL_STATUS_FAILED = -1,
+    TINFL_STATUS_DONE = 0,
+    TINFL_STATUS_NEEDS_MORE_INPUT = 1,
+    TINFL_STATUS_HAS_MORE_OUTPUT = 2
+} tinfl_status;
+
+typedef struct tinfl_decompressor_tag {
+    z_stream stream;
+} tinfl_decompressor;
+
+inline void tinfl_init(tinfl_decompressor* decompressor) {
+    decompressor->stream = z_stream();
+    inflateInit(&decompressor->stream);
+}
+
+inline tinfl_status tinfl_decompress(tinfl_decompressor* decompressor, const uint8_t* in, size_t* in_size,
+        uint8_t* out_start, uint8_t* out_next, size_t* out_size, uint32_t flags) {
+    auto& stream = decompressor->stream;
+    stream.next_in = const_cast<Bytef*>(in);
+    stream.avail_in = *in_size;
+    stream.next_out = out_next;
+    stream.avail_out = *out_size;
+    int ret = inflate(&stream, Z_NO_FLUSH);
+    *in_size -= stream.avail_in;
+    *out_size -= stream.avail_out;
+    if (ret == Z_STREAM_END) {
+        inflateEnd(&stream);
+        return TINFL_STATUS_DONE;
+    }
+    if (ret != Z_OK && ret != Z_BUF_ERROR) {
+        return TINFL_STATUS_FAILED;
+    }
+    return stream.avail_out == 0 ? TINFL_STATUS_HAS_MORE_OUTPUT : TINFL_STATUS_NEEDS_MORE_INPUT;
+}
+
+#endif // ROM_MINIZ_H
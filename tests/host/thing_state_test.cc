@@ -0,0 +1,111 @@
+// Checks the IoT state deltas with 60 things and compares the time of a delta with
+// the full state JSON that was built for every update before.
+#include "host_test.h"
+#include "iot/thing_manager.h"
+
+#include <thread>
+#include <atomic>
+
+namespace iot {
+
+class TestThing : public Thing {
+public:
+    bool power = false;
+    int level = 50;
+    std::string mode = "auto";
+    int reads = 0;
+    std::atomic<int> pushed{0};  // Only read after NotifyPropertyChanged
+
+    TestThing(int index) : Thing("Thing" + std::to_string(index), "A thing for the state test") {
+        properties_.AddBooleanProperty("power", "Power", [this]() -> bool { return power; });
+        properties_.AddNumberProperty("level", "Level", [this]() -> int { return level; });
+        properties_.AddStringProperty("mode", "Mode", [this]() -> std::string { return mode; });
+        properties_.AddNumberProperty("pushed", "Pushed", [this]() -> int {
+            reads++;
+            return pushed;
+        });
+        properties_["pushed"].set_polled(false);
+    }
+};
+
+} // namespace iot
+
+static constexpr int kThingCount = 60;
+
+int main() {
+    auto& manager = iot::ThingManager::GetInstance();
+    std::vector<iot::TestThing*> things;
+    for (int i = 0; i < kThingCount; i++) {
+        things.push_back(new iot::TestThing(i));
+        manager.AddThing(things.back());
+    }
+
+    // The first delta has every property, the next one nothing
+    std::string json;
+    CHECK(manager.GetStatesJson(json, true));
+    CHECK(json.find("{\"name\":\"Thing0\",\"state\":{\"power\":false,\"level\":50,\"mode\":\"auto\",\"pushed\":0}}") == 1);
+    CHECK(json.find("\"name\":\"Thing59\"") != std::string::npos);
+    CHECK(!manager.GetStatesJson(json, true));
+    CHECK_EQ(json, "[]");
+
+    // Only the changed properties of the changed things
+    things[3]->power = true;
+    things[42]->level = 75;
+    things[42]->mode = "manual \"quiet\"";
+    CHECK(manager.GetStatesJson(json, true));
+    CHECK_EQ(json, "[{\"name\":\"Thing3\",\"state\":{\"power\":true}},"
+        "{\"name\":\"Thing42\",\"state\":{\"level\":75,\"mode\":\"manual \\\"quiet\\\"\"}}]");
+
+    // A value changed and changed back between two updates is not sent
+    things[7]->level = 10;
+    things[7]->level = 50;
+    CHECK(!manager.GetStatesJson(json, true));
+
+    // A property that is not polled is only read after it was invalidated
+    int reads = things[5]->reads;
+    things[5]->pushed = 9;
+    CHECK(!manager.GetStatesJson(json, true));
+    CHECK_EQ(things[5]->reads, reads);
+    things[5]->NotifyPropertyChanged("pushed");
+    CHECK(manager.GetStatesJson(json, true));
+    CHECK_EQ(json, "[{\"name\":\"Thing5\",\"state\":{\"pushed\":9}}]");
+
+    // The full state still has every thing
+    CHECK(manager.GetStatesJson(json, false));
+    CHECK(json.find("\"name\":\"Thing0\"") != std::string::npos);
+    CHECK(json.find("{\"name\":\"Thing42\",\"state\":{\"power\":false,\"level\":75,") != std::string::npos);
+
+    // Invalidations from another task while the states are collected are never lost
+    std::atomic<bool> running = true;
+    std::thread notifier([&things, &running]() {
+        int value = 0;
+        while (running) {
+            things[11]->pushed = ++value;
+            things[11]->NotifyPropertyChanged("pushed");
+        }
+    });
+    for (int i = 0; i < 2000; i++) {
+        manager.GetStatesJson(json, true);
+    }
+    running = false;
+    notifier.join();
+    int last = things[11]->pushed;
+    manager.GetStatesJson(json, true);
+    CHECK(json.find("\"pushed\":" + std::to_string(last)) != std::string::npos || json == "[]");
+    CHECK(!manager.GetStatesJson(json, true));
+
+    double delta_us = HostBenchmark(2000, [&things, &manager, &json]() {
+        things[20]->level++;
+        manager.GetStatesJson(json, true);
+    });
+    double full_us = HostBenchmark(2000, [&things, &json]() {
+        json = "[";
+        for (auto thing : things) {
+            json += thing->GetStateJson() + ",";
+        }
+        json.back() = ']';
+    });
+    printf("thing_state: %d things, delta with one change %.2f us, full state %.2f us\n",
+        kThingCount, delta_us, full_us);
+    return 0;
+}